@@ -0,0 +1,77 @@
+/*******************************************************************************
+ JCommandQueue.cpp
+
+	Bounded queue with many producers and one consumer.  Producers claim
+	consecutive tickets with InterlockedExchangeAdd() and each ticket maps
+	to one slot.  Each slot carries a sequence number, so a producer knows
+	when its slot has been emptied and the consumer knows when it has been
+	filled.  No locks are required, and the only shared write that
+	producers contend for is the ticket counter.
+
+	Since a ticket cannot be returned, a producer that finds its slot
+	still in use must wait for the consumer.  The owner decides how to
+	wait, e.g., by waking the consumer.
+
+	Commands carry their text in the slot, so neither side allocates
+	memory or touches a reference count.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JCommandQueue.h"
+
+/*******************************************************************************
+ Constructor
+
+ *******************************************************************************/
+
+JCommandQueue::JCommandQueue()
+	:
+	m_pSlot(NULL),
+	m_nMask(0),
+	m_nTail(0),
+	m_nHead(0)
+{
+}
+
+/*******************************************************************************
+ Destructor
+
+ *******************************************************************************/
+
+JCommandQueue::~JCommandQueue()
+{
+	delete [] m_pSlot;
+}
+
+/*******************************************************************************
+ SetCapacity
+
+	capacity is rounded up to a power of 2.  This discards everything in
+	the queue, so it must be called before any other thread uses it.
+
+ *******************************************************************************/
+
+void
+JCommandQueue::SetCapacity
+	(
+	const int capacity
+	)
+{
+	int count = 1;
+	while (count < capacity)
+		{
+		count *= 2;
+		}
+
+	delete [] m_pSlot;
+	m_pSlot = new Slot [ count ];
+	m_nMask = count - 1;
+	m_nTail = 0;
+	m_nHead = 0;
+
+	for (int i=0; i<count; i++)
+		{
+		m_pSlot[i].nSequence = i;
+		}
+}
@@ -0,0 +1,169 @@
+/*******************************************************************************
+ JCommandQueue.h
+
+ *******************************************************************************/
+
+#pragma once
+
+class JCommandQueue
+{
+public:
+
+	enum
+	{
+		kMaxTextLength = 255	// per slot; longer text continues in the next slots
+	};
+
+	// The text is stored in the slot, so pushing a command never allocates.
+
+	struct Command
+	{
+		int		nType;
+		int		nValue1;
+		int		nValue2;
+		BOOL	bContinued;			// the text continues in the next slot
+		TCHAR	text[ kMaxTextLength+1 ];
+	};
+
+public:
+
+	JCommandQueue();
+
+	~JCommandQueue();
+
+	void	SetCapacity(const int capacity);
+
+	// any thread
+
+	LONG		Reserve(const LONG count = 1);
+	BOOL		IsFree(const LONG ticket) const;
+	Command&	GetSlot(const LONG ticket);
+	void		Publish(const LONG ticket);
+
+	// only one thread at a time
+
+	const Command*	GetFront() const;
+	void			PopFront();
+
+private:
+
+	struct Slot
+	{
+		volatile LONG	nSequence;	// ticket that may fill it, or ticket+1 once filled
+		Command			cmd;
+	};
+
+	Slot*			m_pSlot;
+	LONG			m_nMask;		// capacity is a power of 2
+	volatile LONG	m_nTail;		// next ticket
+	LONG			m_nHead;		// next ticket to pop
+
+private:
+
+	// not allowed
+
+	JCommandQueue(const JCommandQueue& source);
+	const JCommandQueue& operator=(const JCommandQueue& source);
+};
+
+
+/*******************************************************************************
+ Reserve
+
+	Returns the first of count consecutive tickets, so a command that
+	spans several slots is not interleaved with those of other producers.
+	Every ticket must be published, because the consumer cannot skip it.
+	If the queue is full, a slot will not be free until the consumer
+	catches up.
+
+ *******************************************************************************/
+
+inline LONG
+JCommandQueue::Reserve
+	(
+	const LONG count
+	)
+{
+	return InterlockedExchangeAdd(&m_nTail, count);
+}
+
+/*******************************************************************************
+ IsFree
+
+	Returns TRUE when the slot for the ticket may be filled.
+
+ *******************************************************************************/
+
+inline BOOL
+JCommandQueue::IsFree
+	(
+	const LONG ticket
+	)
+	const
+{
+	return (m_pSlot[ ticket & m_nMask ].nSequence == ticket);
+}
+
+/*******************************************************************************
+ GetSlot
+
+	Only valid after IsFree() returns TRUE.
+
+ *******************************************************************************/
+
+inline JCommandQueue::Command&
+JCommandQueue::GetSlot
+	(
+	const LONG ticket
+	)
+{
+	return m_pSlot[ ticket & m_nMask ].cmd;
+}
+
+/*******************************************************************************
+ Publish
+
+	Hands the filled slot to the consumer.
+
+ *******************************************************************************/
+
+inline void
+JCommandQueue::Publish
+	(
+	const LONG ticket
+	)
+{
+	InterlockedExchange(&(m_pSlot[ ticket & m_nMask ].nSequence), ticket + 1);
+}
+
+/*******************************************************************************
+ GetFront
+
+	Returns the next command, or NULL if it has not yet been published.
+	The command stays in its slot until PopFront() is called, so it is
+	never copied.
+
+ *******************************************************************************/
+
+inline const JCommandQueue::Command*
+JCommandQueue::GetFront()
+	const
+{
+	const Slot& s = m_pSlot[ m_nHead & m_nMask ];
+	return (s.nSequence == m_nHead + 1 ? &(s.cmd) : NULL);
+}
+
+/*******************************************************************************
+ PopFront
+
+	Only valid after GetFront() returns a command.  Gives the slot back to
+	the producers.
+
+ *******************************************************************************/
+
+inline void
+JCommandQueue::PopFront()
+{
+	InterlockedExchange(&(m_pSlot[ m_nHead & m_nMask ].nSequence), m_nHead + m_nMask + 1);
+	m_nHead++;
+}
@@ -0,0 +1,609 @@
+/*******************************************************************************
+ JFrameShare.cpp
+
+	Shares completed frames between processes, so one process can run the
+	simulation while any number of others (e.g., the screensaver and an
+	embedded panel) display it.  The frames live in a named file mapping:
+	a header followed by kSlotCount slots, each holding one 32 bit
+	top-down DIB.  Both sides create DIB sections directly on the mapping,
+	so the producer renders into shared memory with a single BitBlt.
+
+	Each slot is protected by a sequence lock.  The producer increments
+	the slot's sequence number before and after writing, so it is odd
+	while the slot is being written, and then publishes the slot index.
+	A consumer reads the sequence number of the latest slot, copies it,
+	and checks that the sequence number did not change.  If it did, the
+	producer lapped the consumer, so the consumer copies the new latest
+	slot.  The producer never waits for the consumers.
+
+	Blitting a slot straight to the screen would save a copy, but the
+	producer may overwrite the slot in the middle of the blit, and the
+	screen would show a torn frame.  So each consumer copies the slot
+	into a private back buffer, checks the sequence number, and only
+	then blits the copy.  If the producer keeps lapping it, the consumer
+	shows the last copy that was intact.
+
+	The producer cannot tell whether the consumers are visible, so each
+	consumer calls KeepAlive() while it is visible, and the producer only
+	suspends the animation when nobody has done so recently.
+
+	The mapping lives as long as anybody holds it, so when a producer
+	restarts, the consumers may still have the old mapping open.  The
+	header records the ID of the producer's process.  If that process is
+	gone and the new frames fit in the mapping, the new producer takes
+	it over: it invalidates every slot, writes the new geometry, and
+	increments the generation, which tells the consumers to map the
+	slots again.  If the new frames do not fit, the producer marks the
+	header as retired and fails.  The consumers then close the mapping,
+	so it disappears, and a later attempt creates a new one.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JFrameShare.h"
+
+const LONG kShareMagic       = 0x4A4D5846;	// "JMXF"
+const LONG kRetiredMagic     = 0x4A4D5852;	// "JMXR"
+const LONG kShareVersion     = 2;
+const int kMaxDrawAttempts   = 3;
+const LONG kWatchTimeout     = 2000;		// milliseconds
+
+/*******************************************************************************
+ Constructor
+
+ *******************************************************************************/
+
+JFrameShare::JFrameShare()
+	:
+	m_hMapping(NULL),
+	m_pHeader(NULL),
+	m_bProducer(FALSE),
+	m_nTornCount(0),
+	m_nGeneration(0),
+	m_SlotSize(0, 0),
+	m_BackSize(0, 0),
+	m_nBackValid(-1)
+{
+	for (int i=0; i<kSlotCount; i++)
+		{
+		m_Slot[i].hBitmapOld = NULL;
+		}
+
+	m_Back[0].hBitmapOld = NULL;
+	m_Back[1].hBitmapOld = NULL;
+}
+
+/*******************************************************************************
+ Destructor
+
+ *******************************************************************************/
+
+JFrameShare::~JFrameShare()
+{
+	Close();
+	FreeBack();
+}
+
+/*******************************************************************************
+ Create
+
+	Creates the mapping as the producer.  If consumers still hold the
+	mapping from a previous producer, takes it over.  Fails if another
+	producer is running under the same name, or if the frames do not fit
+	in the existing mapping.
+
+ *******************************************************************************/
+
+BOOL
+JFrameShare::Create
+	(
+	LPCTSTR		name,
+	const int	width,
+	const int	height
+	)
+{
+	Close();
+
+	const LONG offset = (sizeof(Header) + 15) & ~15;
+	const LONG bytes  = width * height * 4;
+	const DWORD size  = offset + kSlotCount * bytes;
+
+	m_hMapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, name);
+	const BOOL exists = (GetLastError() == ERROR_ALREADY_EXISTS);
+	if (m_hMapping == NULL)
+		{
+		return FALSE;
+		}
+
+	m_pHeader = (Header*) MapViewOfFile(m_hMapping, FILE_MAP_WRITE, 0, 0, sizeof(Header));
+	if (m_pHeader == NULL || (exists && !CanReuse(size)))
+		{
+		Close();
+		return FALSE;
+		}
+
+	// Consumers ignore the header until it is complete.  Every sequence
+	// number changes, so a consumer that is copying a slot discards the
+	// copy.
+
+	InterlockedExchange(&(m_pHeader->nMagic), 0);
+
+	for (int i=0; i<kSlotCount; i++)
+		{
+		InterlockedExchange(&(m_pHeader->nSequence[i]), (m_pHeader->nSequence[i] | 1) + 1);
+		}
+
+	if (!exists)
+		{
+		m_pHeader->nMappingBytes = size;
+		}
+
+	m_pHeader->nVersion    = kShareVersion;
+	m_pHeader->nWidth      = width;
+	m_pHeader->nHeight     = height;
+	m_pHeader->nSlotOffset = offset;
+	m_pHeader->nSlotBytes  = bytes;
+	m_pHeader->nLatest     = -1;
+	m_pHeader->nWatchTime  = GetTickCount() - kWatchTimeout;
+
+	InterlockedExchange(&(m_pHeader->nProducer), GetCurrentProcessId());
+	InterlockedIncrement(&(m_pHeader->nGeneration));
+	InterlockedExchange(&(m_pHeader->nMagic), kShareMagic);	// header is complete
+
+	m_bProducer = TRUE;
+	if (!MapSlots())
+		{
+		Close();
+		return FALSE;
+		}
+
+	return TRUE;
+}
+
+/*******************************************************************************
+ CanReuse (private)
+
+	Returns TRUE if the producer may take over a mapping that somebody
+	else created.  If the frames do not fit, the header is retired, so
+	the consumers let go of the mapping.
+
+ *******************************************************************************/
+
+BOOL
+JFrameShare::CanReuse
+	(
+	const DWORD size
+	)
+{
+	const LONG magic = m_pHeader->nMagic;
+	if ((magic != kShareMagic && magic != kRetiredMagic) ||
+		m_pHeader->nVersion != kShareVersion)
+		{
+		return FALSE;
+		}
+
+	const DWORD producer = m_pHeader->nProducer;
+	if (producer != 0)
+		{
+		HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, producer);
+		if (process == NULL && GetLastError() == ERROR_ACCESS_DENIED)
+			{
+			return FALSE;
+			}
+		else if (process != NULL)
+			{
+			const BOOL running = (WaitForSingleObject(process, 0) == WAIT_TIMEOUT);
+			CloseHandle(process);
+			if (running)
+				{
+				return FALSE;
+				}
+			}
+		}
+
+	if ((DWORD) m_pHeader->nMappingBytes < size)
+		{
+		InterlockedExchange(&(m_pHeader->nMagic), kRetiredMagic);
+		return FALSE;
+		}
+
+	return TRUE;
+}
+
+/*******************************************************************************
+ Open
+
+	Attaches to an existing mapping as a consumer.  Fails if the producer
+	has not finished creating it.
+
+ *******************************************************************************/
+
+BOOL
+JFrameShare::Open
+	(
+	LPCTSTR name
+	)
+{
+	Close();
+
+	m_hMapping = OpenFileMapping(FILE_MAP_WRITE, FALSE, name);
+	if (m_hMapping == NULL)
+		{
+		return FALSE;
+		}
+
+	m_pHeader = (Header*) MapViewOfFile(m_hMapping, FILE_MAP_WRITE, 0, 0, sizeof(Header));
+	if (m_pHeader == NULL || m_pHeader->nVersion != kShareVersion)
+		{
+		Close();
+		return FALSE;
+		}
+
+	m_bProducer = FALSE;
+	if (!CheckHeader())
+		{
+		Close();
+		return FALSE;
+		}
+
+	return TRUE;
+}
+
+/*******************************************************************************
+ CheckHeader
+
+	Consumers call this before using the slots.  Returns FALSE if a
+	producer is rewriting the header.  If the header has been retired,
+	also closes the mapping, so it can disappear.  If a new producer has
+	taken over the mapping, maps the slots again.
+
+ *******************************************************************************/
+
+BOOL
+JFrameShare::CheckHeader()
+{
+	if (m_pHeader == NULL)
+		{
+		return FALSE;
+		}
+	else if (m_bProducer)
+		{
+		return TRUE;
+		}
+
+	const LONG magic = m_pHeader->nMagic;
+	if (magic == kRetiredMagic)
+		{
+		Close();
+		return FALSE;
+		}
+	else if (magic != kShareMagic)
+		{
+		return FALSE;
+		}
+
+	const LONG generation = m_pHeader->nGeneration;
+	if (generation == m_nGeneration)
+		{
+		return TRUE;
+		}
+
+	Unmap();
+	if (!MapSlots() ||
+		m_pHeader->nMagic != kShareMagic || m_pHeader->nGeneration != generation)
+		{
+		Unmap();
+		return FALSE;
+		}
+
+	m_nGeneration = generation;
+	return TRUE;
+}
+
+/*******************************************************************************
+ MapSlots (private)
+
+	Creates a DIB section on each slot of the mapping.
+
+ *******************************************************************************/
+
+BOOL
+JFrameShare::MapSlots()
+{
+	const LONG width  = m_pHeader->nWidth;
+	const LONG height = m_pHeader->nHeight;
+	const LONG offset = m_pHeader->nSlotOffset;
+	if (width <= 0 || height <= 0 || offset < (LONG) sizeof(Header) ||
+		m_pHeader->nSlotBytes != width * height * 4 ||
+		(m_pHeader->nMappingBytes - offset) / kSlotCount < m_pHeader->nSlotBytes)
+		{
+		return FALSE;
+		}
+
+	BITMAPINFO info;
+	memset(&info, 0, sizeof(info));
+	info.bmiHeader.biSize        = sizeof(BITMAPINFOHEADER);
+	info.bmiHeader.biWidth       = width;
+	info.bmiHeader.biHeight      = -height;		// top-down
+	info.bmiHeader.biPlanes      = 1;
+	info.bmiHeader.biBitCount    = 32;
+	info.bmiHeader.biCompression = BI_RGB;
+
+	for (int i=0; i<kSlotCount; i++)
+		{
+		Slot& slot = m_Slot[i];
+
+		const DWORD slotOffset = offset + i * m_pHeader->nSlotBytes;
+
+		void* bits;
+		HBITMAP h = CreateDIBSection(NULL, &info, DIB_RGB_COLORS, &bits, m_hMapping, slotOffset);
+		if (h == NULL || !slot.bitmap.Attach(h) || !slot.dc.CreateCompatibleDC(NULL))
+			{
+			return FALSE;
+			}
+
+		slot.hBitmapOld = ::SelectObject(slot.dc.m_hDC, slot.bitmap.m_hObject);
+		}
+
+	m_SlotSize = CSize(width, height);
+	return TRUE;
+}
+
+/*******************************************************************************
+ Close
+
+ *******************************************************************************/
+
+void
+JFrameShare::Close()
+{
+	Unmap();
+
+	if (m_bProducer && m_pHeader != NULL)
+		{
+		InterlockedExchange(&(m_pHeader->nProducer), 0);
+		}
+
+	if (m_pHeader != NULL)
+		{
+		UnmapViewOfFile(m_pHeader);
+		m_pHeader = NULL;
+		}
+
+	if (m_hMapping != NULL)
+		{
+		CloseHandle(m_hMapping);
+		m_hMapping = NULL;
+		}
+
+	m_bProducer   = FALSE;
+	m_nGeneration = 0;
+}
+
+/*******************************************************************************
+ Unmap (private)
+
+ *******************************************************************************/
+
+void
+JFrameShare::Unmap()
+{
+	for (int i=0; i<kSlotCount; i++)
+		{
+		Slot& slot = m_Slot[i];
+		if (slot.hBitmapOld != NULL)
+			{
+			::SelectObject(slot.dc.m_hDC, slot.hBitmapOld);
+			slot.hBitmapOld = NULL;
+			}
+		if (slot.dc.m_hDC != NULL)
+			{
+			slot.dc.DeleteDC();
+			}
+		slot.bitmap.DeleteObject();
+		}
+
+	m_SlotSize = CSize(0, 0);
+}
+
+/*******************************************************************************
+ Publish
+
+	Copies a completed frame into the slot after the latest one.  The
+	frame must be at least as large as the mapping.
+
+ *******************************************************************************/
+
+void
+JFrameShare::Publish
+	(
+	CDC& src
+	)
+{
+	ASSERT( m_bProducer );
+
+	const LONG slot = (m_pHeader->nLatest + 1) % kSlotCount;
+
+	InterlockedIncrement(&(m_pHeader->nSequence[slot]));	// odd => busy
+
+	m_Slot[slot].dc.BitBlt(0, 0, m_pHeader->nWidth, m_pHeader->nHeight, &src, 0, 0, SRCCOPY);
+	GdiFlush();
+
+	InterlockedIncrement(&(m_pHeader->nSequence[slot]));
+	InterlockedExchange(&(m_pHeader->nLatest), slot);
+	InterlockedIncrement(&(m_pHeader->nSerial));
+}
+
+/*******************************************************************************
+ IsWatched
+
+	Returns TRUE if a consumer has called KeepAlive() recently.
+
+ *******************************************************************************/
+
+BOOL
+JFrameShare::IsWatched()
+	const
+{
+	return (m_pHeader != NULL &&
+			(LONG) GetTickCount() - m_pHeader->nWatchTime < kWatchTimeout);
+}
+
+/*******************************************************************************
+ KeepAlive
+
+	Consumers call this periodically while they are visible.
+
+ *******************************************************************************/
+
+void
+JFrameShare::KeepAlive()
+{
+	if (m_pHeader != NULL)
+		{
+		InterlockedExchange(&(m_pHeader->nWatchTime), GetTickCount());
+		}
+}
+
+/*******************************************************************************
+ Draw
+
+	Draws the given part of the latest frame.  Areas outside the frame
+	are black.  Returns FALSE if nothing intact could be copied, e.g.,
+	because nothing has been published yet, or the producer kept
+	overwriting the slot that was being copied.  The last intact frame
+	is drawn instead.
+
+ *******************************************************************************/
+
+BOOL
+JFrameShare::Draw
+	(
+	CDC&			dc,
+	const CRect&	source
+	)
+{
+	const CSize size = source.Size();
+	if (size != m_BackSize && !CreateBack(dc, size))
+		{
+		dc.FillSolidRect(0, 0, size.cx, size.cy, RGB(0,0,0));
+		return FALSE;
+		}
+
+	BOOL ok = FALSE;
+	if (CheckHeader())
+		{
+		CRect r;
+		r.IntersectRect(source, CRect(CPoint(0,0), m_SlotSize));
+
+		const int back = (m_nBackValid == 0 ? 1 : 0);
+		CDC& backDC    = m_Back[back].dc;
+
+		for (int i=0; i<kMaxDrawAttempts; i++)
+			{
+			const LONG slot = m_pHeader->nLatest;
+			if (slot < 0 || slot >= kSlotCount)
+				{
+				break;
+				}
+
+			const LONG seq = m_pHeader->nSequence[slot];
+			if (!(seq & 1))
+				{
+				if (r != source)
+					{
+					backDC.FillSolidRect(0, 0, size.cx, size.cy, RGB(0,0,0));
+					}
+				if (!r.IsRectEmpty())
+					{
+					backDC.BitBlt(r.left - source.left, r.top - source.top, r.Width(), r.Height(),
+								  &(m_Slot[slot].dc), r.left, r.top, SRCCOPY);
+					}
+				GdiFlush();
+
+				if (m_pHeader->nSequence[slot] == seq &&
+					m_pHeader->nMagic == kShareMagic &&
+					m_pHeader->nGeneration == m_nGeneration)
+					{
+					m_nBackValid = back;
+					ok           = TRUE;
+					break;
+					}
+				}
+
+			m_nTornCount++;
+			}
+		}
+
+	if (m_nBackValid >= 0)
+		{
+		dc.BitBlt(0, 0, size.cx, size.cy, &(m_Back[ m_nBackValid ].dc), 0, 0, SRCCOPY);
+		}
+	else
+		{
+		dc.FillSolidRect(0, 0, size.cx, size.cy, RGB(0,0,0));
+		}
+
+	return ok;
+}
+
+/*******************************************************************************
+ CreateBack (private)
+
+	Allocates the private copies of the frame.  They survive Close(), so
+	the last frame stays visible while the consumer reopens the mapping.
+
+ *******************************************************************************/
+
+BOOL
+JFrameShare::CreateBack
+	(
+	CDC&			dc,
+	const CSize&	size
+	)
+{
+	FreeBack();
+
+	for (int i=0; i<2; i++)
+		{
+		Slot& back = m_Back[i];
+		if (!back.dc.CreateCompatibleDC(&dc) ||
+			!back.bitmap.CreateCompatibleBitmap(&dc, size.cx, size.cy))
+			{
+			FreeBack();
+			return FALSE;
+			}
+
+		back.hBitmapOld = ::SelectObject(back.dc.m_hDC, back.bitmap.m_hObject);
+		}
+
+	m_BackSize = size;
+	return TRUE;
+}
+
+/*******************************************************************************
+ FreeBack (private)
+
+ *******************************************************************************/
+
+void
+JFrameShare::FreeBack()
+{
+	for (int i=0; i<2; i++)
+		{
+		Slot& back = m_Back[i];
+		if (back.hBitmapOld != NULL)
+			{
+			::SelectObject(back.dc.m_hDC, back.hBitmapOld);
+			back.hBitmapOld = NULL;
+			}
+		if (back.dc.m_hDC != NULL)
+			{
+			back.dc.DeleteDC();
+			}
+		back.bitmap.DeleteObject();
+		}
+
+	m_BackSize   = CSize(0, 0);
+	m_nBackValid = -1;
+}
\ No newline at end of file
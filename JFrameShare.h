@@ -0,0 +1,162 @@
+/*******************************************************************************
+ JFrameShare.h
+
+ *******************************************************************************/
+
+#pragma once
+
+class JFrameShare
+{
+public:
+
+	enum
+	{
+		kSlotCount = 4
+	};
+
+public:
+
+	JFrameShare();
+
+	~JFrameShare();
+
+	BOOL	Create(LPCTSTR name, const int width, const int height);
+	BOOL	Open(LPCTSTR name);
+	void	Close();
+
+	BOOL	IsOpen() const;
+	BOOL	IsProducer() const;
+	CSize	GetSize() const;
+	LONG	GetSerial() const;
+	int		GetTornCount() const;
+
+	// producer
+
+	void	Publish(CDC& src);
+	BOOL	IsWatched() const;
+
+	// consumer
+
+	BOOL	CheckHeader();
+	BOOL	Draw(CDC& dc, const CRect& source);
+	void	KeepAlive();
+
+private:
+
+	struct Header
+	{
+		volatile LONG	nMagic;		// set last; kRetiredMagic => consumers must let go
+		LONG			nVersion;
+		LONG			nMappingBytes;	// fixed by whoever created the mapping
+		volatile LONG	nProducer;		// process ID; 0 => none
+		volatile LONG	nGeneration;	// incremented each time a producer attaches
+		LONG			nWidth;
+		LONG			nHeight;
+		LONG			nSlotOffset;	// bytes from start of mapping to first slot
+		LONG			nSlotBytes;
+		volatile LONG	nLatest;		// last completed slot; -1 => none
+		volatile LONG	nSerial;		// frames published
+		volatile LONG	nWatchTime;		// GetTickCount() when a consumer was last visible
+		volatile LONG	nSequence[ kSlotCount ];	// odd while slot is being written
+	};
+
+	struct Slot
+	{
+		CDC			dc;
+		CBitmap		bitmap;				// DIB section in the shared mapping
+		HGDIOBJ		hBitmapOld;
+	};
+
+private:
+
+	HANDLE		m_hMapping;
+	Header*		m_pHeader;
+	BOOL		m_bProducer;
+	Slot		m_Slot[ kSlotCount ];
+	int			m_nTornCount;			// consumer reads that had to be retried
+
+	// consumer
+
+	LONG		m_nGeneration;			// generation that m_Slot was mapped for
+	CSize		m_SlotSize;
+	Slot		m_Back[2];				// private copies of the frame
+	CSize		m_BackSize;
+	int			m_nBackValid;			// index in m_Back of the last validated copy; -1 => none
+
+private:
+
+	BOOL	CanReuse(const DWORD size);
+	BOOL	MapSlots();
+	void	Unmap();
+	BOOL	CreateBack(CDC& dc, const CSize& size);
+	void	FreeBack();
+
+	// not allowed
+
+	JFrameShare(const JFrameShare& source);
+	const JFrameShare& operator=(const JFrameShare& source);
+};
+
+
+/*******************************************************************************
+ IsOpen
+
+ *******************************************************************************/
+
+inline BOOL
+JFrameShare::IsOpen()
+	const
+{
+	return (m_pHeader != NULL);
+}
+
+/*******************************************************************************
+ IsProducer
+
+ *******************************************************************************/
+
+inline BOOL
+JFrameShare::IsProducer()
+	const
+{
+	return m_bProducer;
+}
+
+/*******************************************************************************
+ GetSize
+
+ *******************************************************************************/
+
+inline CSize
+JFrameShare::GetSize()
+	const
+{
+	return (m_pHeader != NULL ? CSize(m_pHeader->nWidth, m_pHeader->nHeight) : CSize(0, 0));
+}
+
+/*******************************************************************************
+ GetSerial
+
+	Returns the number of frames that have been published.  Consumers
+	can poll this to decide when to repaint.
+
+ *******************************************************************************/
+
+inline LONG
+JFrameShare::GetSerial()
+	const
+{
+	return (m_pHeader != NULL ? m_pHeader->nSerial : 0);
+}
+
+/*******************************************************************************
+ GetTornCount
+
+ *******************************************************************************/
+
+inline int
+JFrameShare::GetTornCount()
+	const
+{
+	return m_nTornCount;
+}
@@ -0,0 +1,414 @@
+/*******************************************************************************
+ JGlowFilter.cpp
+
+	Adds a green glow around the bright parts of a 32 bit top-down DIB.
+	The glow is a box blur of the pixels whose green channel is at least
+	the threshold, added back onto the green channel with saturation.
+
+	Only the tiles near the sources that were added since the last call
+	to Apply() are processed.  Each tile is blurred separately, first
+	horizontally into a small buffer and then vertically into the image,
+	so the working set of each tile fits in the cache, and the cost is
+	proportional to the area around the sources, not the whole image.
+	The bright pixels of all the dirty tiles are extracted before any
+	glow is added, so the tiles do not feed on each other's glow.
+
+	Both passes use running sums, so the cost per pixel does not depend
+	on the radius.  The vertical pass and the final add use SSE2, eight
+	columns at a time, if the processor and the OS support it, and plain
+	integer code otherwise.  The two paths produce identical results.
+
+	The SSE2 path is compiled for x86 and x64 unless JGLOW_NO_SSE2 is
+	defined.  VC6 needs the Processor Pack for <emmintrin.h>, but it does
+	not need any compiler switch, since the path is selected at run time.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JGlowFilter.h"
+
+#if (defined _M_X64 || defined _M_IX86) && !defined JGLOW_NO_SSE2
+#define JGLOW_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifndef PF_XMMI64_INSTRUCTIONS_AVAILABLE
+#define PF_XMMI64_INSTRUCTIONS_AVAILABLE	10		// missing from the VC6 headers
+#endif
+
+/*******************************************************************************
+ Constructor
+
+ *******************************************************************************/
+
+JGlowFilter::JGlowFilter()
+	:
+	m_nWidth(0),
+	m_nHeight(0),
+	m_nRadius(1),
+	m_nStrength(0),
+	m_nThreshold(255),
+	m_nTileCols(0),
+	m_nTileRows(0),
+	m_pDirty(NULL),
+	m_pDirtyList(NULL),
+	m_nDirtyCount(0),
+	m_pSource(NULL),
+	m_pRowBlur(NULL),
+	m_bUseSSE2(IsSSE2Available())
+{
+}
+
+/*******************************************************************************
+ Destructor
+
+ *******************************************************************************/
+
+JGlowFilter::~JGlowFilter()
+{
+	delete [] m_pDirty;
+	delete [] m_pDirtyList;
+	delete [] m_pSource;
+	delete [] m_pRowBlur;
+}
+
+/*******************************************************************************
+ IsSSE2Available (static)
+
+	Returns TRUE if the SSE2 path was compiled and can run on this
+	machine.  IsProcessorFeaturePresent() checks the CPUID bit and that
+	the OS saves the SSE registers.
+
+ *******************************************************************************/
+
+BOOL
+JGlowFilter::IsSSE2Available()
+{
+#ifdef JGLOW_USE_SSE2
+	return IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+#else
+	return FALSE;
+#endif
+}
+
+/*******************************************************************************
+ SetSize
+
+	This discards all the sources.
+
+ *******************************************************************************/
+
+void
+JGlowFilter::SetSize
+	(
+	const int width,
+	const int height
+	)
+{
+	delete [] m_pDirty;
+	delete [] m_pDirtyList;
+	delete [] m_pSource;
+	delete [] m_pRowBlur;
+
+	m_nWidth    = width;
+	m_nHeight   = height;
+	m_nTileCols = (width  + kTileSize - 1) / kTileSize;
+	m_nTileRows = (height + kTileSize - 1) / kTileSize;
+
+	const int tileCount = m_nTileCols * m_nTileRows;
+	m_pDirty            = new BYTE [ tileCount ];
+	m_pDirtyList        = new int [ tileCount ];
+	m_nDirtyCount       = 0;
+	memset(m_pDirty, 0, tileCount);
+
+	m_pSource  = new BYTE [ width * height ];
+	m_pRowBlur = new WORD [ (kTileSize + 2*kMaxRadius) * kTileSize ];
+}
+
+/*******************************************************************************
+ SetParameters
+
+	radius is in pixels.  strength is the fraction of the blurred
+	brightness that is added, out of 256.  Pixels whose green channel is
+	below threshold do not glow.
+
+ *******************************************************************************/
+
+void
+JGlowFilter::SetParameters
+	(
+	const int radius,
+	const int strength,
+	const int threshold
+	)
+{
+	m_nRadius    = max(1, min(radius, (int) kMaxRadius));
+	m_nStrength  = max(0, min(strength, 256));
+	m_nThreshold = max(0, min(threshold, 255));
+}
+
+/*******************************************************************************
+ AddSource
+
+	Marks the tiles that the glow from the given rectangle can reach.
+
+ *******************************************************************************/
+
+void
+JGlowFilter::AddSource
+	(
+	const CRect& r
+	)
+{
+	const int left   = max(0, (r.left - m_nRadius) / kTileSize);
+	const int top    = max(0, (r.top  - m_nRadius) / kTileSize);
+	const int right  = min(m_nTileCols - 1, (r.right  - 1 + m_nRadius) / kTileSize);
+	const int bottom = min(m_nTileRows - 1, (r.bottom - 1 + m_nRadius) / kTileSize);
+
+	for (int y=top; y<=bottom; y++)
+		{
+		for (int x=left; x<=right; x++)
+			{
+			const int tile = y * m_nTileCols + x;
+			if (!m_pDirty[tile])
+				{
+				m_pDirty[tile]                  = 1;
+				m_pDirtyList[ m_nDirtyCount++ ] = tile;
+				}
+			}
+		}
+}
+
+/*******************************************************************************
+ Apply
+
+	bits must be the m_nWidth x m_nHeight image, with 4 bytes per pixel
+	and stride bytes per row.  Discards the sources and returns the number
+	of pixels that were processed.
+
+ *******************************************************************************/
+
+int
+JGlowFilter::Apply
+	(
+	BYTE*		bits,
+	const int	stride
+	)
+{
+	if (m_nStrength == 0)
+		{
+		for (int i=0; i<m_nDirtyCount; i++)
+			{
+			m_pDirty[ m_pDirtyList[i] ] = 0;
+			}
+		m_nDirtyCount = 0;
+		return 0;
+		}
+
+	for (int j=0; j<m_nDirtyCount; j++)
+		{
+		Extract(bits, stride, m_pDirtyList[j]);
+		}
+
+	int count = 0;
+	for (int k=0; k<m_nDirtyCount; k++)
+		{
+		const int tile = m_pDirtyList[k];
+		count         += BlurTile(bits, stride, tile);
+		m_pDirty[tile] = 0;
+		}
+
+	m_nDirtyCount = 0;
+	return count;
+}
+
+/*******************************************************************************
+ Extract (private)
+
+	Copies the bright part of the green channel of the tile and the
+	margin around it into m_pSource.
+
+ *******************************************************************************/
+
+void
+JGlowFilter::Extract
+	(
+	const BYTE*	bits,
+	const int	stride,
+	const int	tile
+	)
+{
+	const int tx = (tile % m_nTileCols) * kTileSize;
+	const int ty = (tile / m_nTileCols) * kTileSize;
+	const int x0 = max(0, tx - m_nRadius);
+	const int x1 = min(m_nWidth, tx + kTileSize + m_nRadius);
+	const int y0 = max(0, ty - m_nRadius);
+	const int y1 = min(m_nHeight, ty + kTileSize + m_nRadius);
+
+	const int threshold = m_nThreshold;
+	for (int y=y0; y<y1; y++)
+		{
+		const BYTE* p = bits + y * stride + x0 * 4 + 1;		// green
+		BYTE* s       = m_pSource + y * m_nWidth + x0;
+		for (int x=x0; x<x1; x++)
+			{
+			*s++ = (*p >= threshold ? *p : 0);
+			p   += 4;
+			}
+		}
+}
+
+/*******************************************************************************
+ BlurTile (private)
+
+	Horizontal pass:  each row of the tile and of the margins above and
+	below it is averaged into m_pRowBlur.  Rows outside the image are
+	zero.  Returns the number of pixels in the tile.
+
+ *******************************************************************************/
+
+int
+JGlowFilter::BlurTile
+	(
+	BYTE*		bits,
+	const int	stride,
+	const int	tile
+	)
+{
+	const int r      = m_nRadius;
+	const int x0     = (tile % m_nTileCols) * kTileSize;
+	const int y0     = (tile / m_nTileCols) * kTileSize;
+	const int width  = min(m_nWidth  - x0, (int) kTileSize);
+	const int height = min(m_nHeight - y0, (int) kTileSize);
+	const int scale  = 65536 / (2*r + 1);
+
+	const int rowCount = height + 2*r;
+	for (int i=0; i<rowCount; i++)
+		{
+		WORD* out   = m_pRowBlur + i * kTileSize;
+		const int y = y0 - r + i;
+		if (y < 0 || m_nHeight <= y)
+			{
+			memset(out, 0, width * sizeof(WORD));
+			continue;
+			}
+
+		const BYTE* s = m_pSource + y * m_nWidth;
+
+		int sum     = 0;
+		const int a = max(0, x0 - r);
+		const int b = min(m_nWidth, x0 + r + 1);
+		for (int x=a; x<b; x++)
+			{
+			sum += s[x];
+			}
+
+		for (int j=0; j<width; j++)
+			{
+			out[j] = (WORD) ((sum * scale) >> 16);
+
+			const int add = x0 + j + r + 1;
+			const int sub = x0 + j - r;
+			if (add < m_nWidth)
+				{
+				sum += s[add];
+				}
+			if (sub >= 0)
+				{
+				sum -= s[sub];
+				}
+			}
+		}
+
+	BlurColumns(bits, stride, x0, width, y0, height);
+	return width * height;
+}
+
+/*******************************************************************************
+ BlurColumns (private)
+
+	Vertical pass:  each column of m_pRowBlur is averaged, scaled by the
+	strength, and added to the green channel.  The sum of 2r+1 averages
+	fits in 16 bits, so SSE2 can process eight columns at once.
+
+ *******************************************************************************/
+
+void
+JGlowFilter::BlurColumns
+	(
+	BYTE*		bits,
+	const int	stride,
+	const int	x,
+	const int	width,
+	const int	y,
+	const int	height
+	)
+{
+	const int r      = m_nRadius;
+	const int window = 2*r;
+	const int scale  = m_nStrength * 256 / (window + 1);
+	const WORD* rb   = m_pRowBlur;
+
+	int c = 0;
+
+#ifdef JGLOW_USE_SSE2
+
+	const __m128i zero   = _mm_setzero_si128();
+	const __m128i factor = _mm_set1_epi16((short) scale);
+
+	for (; m_bUseSSE2 && c+8<=width; c+=8)
+		{
+		__m128i sum = zero;
+		for (int k=0; k<window; k++)
+			{
+			sum = _mm_add_epi16(sum, _mm_loadu_si128((const __m128i*) (rb + k * kTileSize + c)));
+			}
+
+		for (int j=0; j<height; j++)
+			{
+			sum = _mm_add_epi16(sum, _mm_loadu_si128((const __m128i*) (rb + (j + window) * kTileSize + c)));
+
+			const __m128i v  = _mm_mulhi_epu16(sum, factor);
+			const __m128i g0 = _mm_slli_epi32(_mm_unpacklo_epi16(v, zero), 8);	// green
+			const __m128i g1 = _mm_slli_epi32(_mm_unpackhi_epi16(v, zero), 8);
+
+			__m128i* dst = (__m128i*) (bits + (y + j) * stride + (x + c) * 4);
+			_mm_storeu_si128(dst,   _mm_adds_epu8(_mm_loadu_si128(dst),   g0));
+			_mm_storeu_si128(dst+1, _mm_adds_epu8(_mm_loadu_si128(dst+1), g1));
+
+			sum = _mm_sub_epi16(sum, _mm_loadu_si128((const __m128i*) (rb + j * kTileSize + c)));
+			}
+		}
+
+#endif
+
+	if (c >= width)
+		{
+		return;
+		}
+
+	int sum[ kTileSize ];
+	for (int i=c; i<width; i++)
+		{
+		sum[i] = 0;
+		for (int k=0; k<window; k++)
+			{
+			sum[i] += rb[ k * kTileSize + i ];
+			}
+		}
+
+	for (int j=0; j<height; j++)
+		{
+		const WORD* add = rb + (j + window) * kTileSize;
+		const WORD* sub = rb + j * kTileSize;
+		BYTE* g         = bits + (y + j) * stride + (x + c) * 4 + 1;		// green
+		for (int i=c; i<width; i++)
+			{
+			sum[i]     += add[i];
+			const int v = *g + ((sum[i] * scale) >> 16);
+			*g          = (BYTE) min(v, 255);
+			sum[i]     -= sub[i];
+			g          += 4;
+			}
+		}
+}
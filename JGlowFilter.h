@@ -0,0 +1,75 @@
+/*******************************************************************************
+ JGlowFilter.h
+
+ *******************************************************************************/
+
+#pragma once
+
+class JGlowFilter
+{
+public:
+
+	enum
+	{
+		kTileSize  = 64,		// pixels; multiple of 8
+		kMaxRadius = 16
+	};
+
+public:
+
+	JGlowFilter();
+
+	~JGlowFilter();
+
+	static BOOL	IsSSE2Available();
+
+	void	SetSize(const int width, const int height);
+	void	SetParameters(const int radius, const int strength, const int threshold);
+
+	void	AddSource(const CRect& r);
+	BOOL	IsEmpty() const;
+	int		Apply(BYTE* bits, const int stride);
+
+private:
+
+	int		m_nWidth;
+	int		m_nHeight;
+	int		m_nRadius;
+	int		m_nStrength;		// out of 256
+	int		m_nThreshold;		// out of 255
+
+	int		m_nTileCols;
+	int		m_nTileRows;
+	BYTE*	m_pDirty;			// 1 => tile is in m_pDirtyList
+	int*	m_pDirtyList;
+	int		m_nDirtyCount;
+
+	BYTE*	m_pSource;			// bright part of green channel, m_nWidth per row
+	WORD*	m_pRowBlur;			// horizontal pass of one tile, kTileSize per row
+	BOOL	m_bUseSSE2;
+
+private:
+
+	void	Extract(const BYTE* bits, const int stride, const int tile);
+	int		BlurTile(BYTE* bits, const int stride, const int tile);
+	void	BlurColumns(BYTE* bits, const int stride, const int x, const int width,
+						const int y, const int height);
+
+	// not allowed
+
+	JGlowFilter(const JGlowFilter& source);
+	const JGlowFilter& operator=(const JGlowFilter& source);
+};
+
+
+/*******************************************************************************
+ IsEmpty
+
+ *******************************************************************************/
+
+inline BOOL
+JGlowFilter::IsEmpty()
+	const
+{
+	return (m_nDirtyCount == 0);
+}
@@ -0,0 +1,406 @@
+/*******************************************************************************
+ JGlyphBatch.cpp
+
+	Collects single-cell glyphs and draws them with a handful of GDI calls:
+	one region fill to clear all the cells, plus one ExtTextOut() for each
+	run of glyphs that share a row and an intensity level.  The glyphs are
+	sorted with three stable counting sorts (column, row, level), so the
+	cost is linear in the number of glyphs, and no memory is allocated
+	once the buffers have grown to fit the typical frame.
+
+	Glyphs that are shifted off the grid by AddOffset() are drawn with
+	ETO_PDY, so a single ExtTextOut() per level can hop between rows.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JGlyphBatch.h"
+
+#ifndef ETO_PDY
+#define ETO_PDY	0x2000
+#endif
+
+enum
+{
+	kRowField,
+	kColField,
+	kLevelField
+};
+
+/*******************************************************************************
+ GetKey (static)
+
+ *******************************************************************************/
+
+inline static int
+GetKey
+	(
+	const short	row,
+	const short	col,
+	const BYTE	level,
+	const int	field
+	)
+{
+	return (field == kRowField ? row :
+			field == kColField ? col : level);
+}
+
+/*******************************************************************************
+ Constructor
+
+ *******************************************************************************/
+
+JGlyphBatch::JGlyphBatch()
+	:
+	m_nRows(0),
+	m_nCols(0),
+	m_nCellWidth(0),
+	m_nCellHeight(0),
+	m_pGlyphs(NULL),
+	m_pSorted(NULL),
+	m_nCount(0),
+	m_nCapacity(0),
+	m_pBucket(NULL),
+	m_nBucketCount(0),
+	m_pRunText(NULL),
+	m_pRunDx(NULL),
+	m_bOffsets(FALSE),
+	m_pRgnData(NULL),
+	m_nRunCapacity(0)
+{
+	memset(m_CharWidth, 0, sizeof(m_CharWidth));
+	memset(m_LevelColor, 0, sizeof(m_LevelColor));
+}
+
+/*******************************************************************************
+ Destructor
+
+ *******************************************************************************/
+
+JGlyphBatch::~JGlyphBatch()
+{
+	delete [] m_pGlyphs;
+	delete [] m_pSorted;
+	delete [] m_pBucket;
+	delete [] m_pRunText;
+	delete [] m_pRunDx;
+	delete [] m_pRgnData;
+}
+
+/*******************************************************************************
+ SetGrid
+
+	dc must have the font selected, because the glyph widths are measured
+	once here instead of once per glyph.
+
+ *******************************************************************************/
+
+void
+JGlyphBatch::SetGrid
+	(
+	CDC&		dc,
+	const int	rows,
+	const int	cols,
+	const int	cellWidth,
+	const int	cellHeight
+	)
+{
+	m_nRows       = rows;
+	m_nCols       = cols;
+	m_nCellWidth  = cellWidth;
+	m_nCellHeight = cellHeight;
+	m_nCount      = 0;
+	m_bOffsets    = FALSE;
+
+	dc.GetCharWidth(0, 255, m_CharWidth);
+
+	delete [] m_pBucket;
+	m_nBucketCount = max(max(rows, cols), (int) kMaxLevelCount) + 1;
+	m_pBucket      = new int [ m_nBucketCount ];
+
+	delete [] m_pRunText;
+	delete [] m_pRunDx;
+	m_nRunCapacity = cols;
+	m_pRunText     = new char [ m_nRunCapacity ];
+	m_pRunDx       = new INT [ 2 * m_nRunCapacity ];	// ETO_PDY needs pairs
+
+	if (m_nCapacity < 2 * cols)
+		{
+		Grow(2 * cols);
+		}
+}
+
+/*******************************************************************************
+ Grow (private)
+
+ *******************************************************************************/
+
+void
+JGlyphBatch::Grow
+	(
+	const int capacity
+	)
+{
+	Glyph* glyphs = new Glyph [ capacity ];
+	if (m_nCount > 0)
+		{
+		memcpy(glyphs, m_pGlyphs, m_nCount * sizeof(Glyph));
+		}
+
+	delete [] m_pGlyphs;
+	delete [] m_pSorted;
+	delete [] m_pRgnData;
+
+	m_pGlyphs   = glyphs;
+	m_pSorted   = new Glyph [ capacity ];
+	m_pRgnData  = new BYTE [ sizeof(RGNDATAHEADER) + capacity * sizeof(RECT) ];
+	m_nCapacity = capacity;
+}
+
+/*******************************************************************************
+ SortByKey (private)
+
+	Stable counting sort, so successive calls produce lexicographic order.
+
+ *******************************************************************************/
+
+void
+JGlyphBatch::SortByKey
+	(
+	const int field,
+	const int keyCount
+	)
+{
+	memset(m_pBucket, 0, (keyCount+1) * sizeof(int));
+
+	int i;
+	for (i=0; i<m_nCount; i++)
+		{
+		const Glyph& g = m_pGlyphs[i];
+		m_pBucket[ GetKey(g.row, g.col, g.level, field) + 1 ]++;
+		}
+
+	for (i=1; i<=keyCount; i++)
+		{
+		m_pBucket[i] += m_pBucket[i-1];
+		}
+
+	for (i=0; i<m_nCount; i++)
+		{
+		const Glyph& g = m_pGlyphs[i];
+		m_pSorted[ m_pBucket[ GetKey(g.row, g.col, g.level, field) ]++ ] = g;
+		}
+
+	Glyph* tmp = m_pGlyphs;
+	m_pGlyphs  = m_pSorted;
+	m_pSorted  = tmp;
+}
+
+/*******************************************************************************
+ Flush
+
+	Draws everything that was added and returns the number of GDI calls
+	that were required.
+
+ *******************************************************************************/
+
+int
+JGlyphBatch::Flush
+	(
+	CDC& dc
+	)
+{
+	if (m_nCount == 0)
+		{
+		return 0;
+		}
+
+	int callCount = 0;
+
+	// clear the cells with a single region, merging neighbors in each row
+
+	SortByKey(kColField, m_nCols);
+	SortByKey(kRowField, m_nRows);
+
+	RGNDATA* data  = (RGNDATA*) m_pRgnData;
+	RECT* rect     = (RECT*) data->Buffer;
+	int rectCount  = 0;
+
+	int i;
+	for (i=0; i<m_nCount; i++)
+		{
+		const Glyph& g   = m_pGlyphs[i];
+		const int left   = g.col * m_nCellWidth;
+		const int top    = g.row * m_nCellHeight + g.dy;
+
+		if (rectCount > 0 && rect[ rectCount-1 ].top == top &&
+			rect[ rectCount-1 ].right >= left)
+			{
+			rect[ rectCount-1 ].right = left + m_nCellWidth;
+			}
+		else
+			{
+			RECT& r  = rect[ rectCount++ ];
+			r.left   = left;
+			r.top    = top;
+			r.right  = left + m_nCellWidth;
+			r.bottom = top  + m_nCellHeight;
+			}
+		}
+
+	data->rdh.dwSize   = sizeof(RGNDATAHEADER);
+	data->rdh.iType    = RDH_RECTANGLES;
+	data->rdh.nCount   = rectCount;
+	data->rdh.nRgnSize = rectCount * sizeof(RECT);
+	data->rdh.rcBound.left   = 0;
+	data->rdh.rcBound.top    = 0;
+	data->rdh.rcBound.right  = m_nCols * m_nCellWidth;
+	data->rdh.rcBound.bottom = m_nRows * m_nCellHeight;
+
+	HRGN rgn = ExtCreateRegion(NULL, sizeof(RGNDATAHEADER) + rectCount * sizeof(RECT), data);
+	callCount++;
+	if (rgn != NULL)
+		{
+		FillRgn(dc.m_hDC, rgn, (HBRUSH) GetStockObject(BLACK_BRUSH));
+		DeleteObject(rgn);
+		callCount += 2;
+		}
+
+	if (m_bOffsets)
+		{
+		callCount += DrawOffsetRuns(dc);
+		m_bOffsets = FALSE;
+		m_nCount   = 0;
+		return callCount;
+		}
+
+	// draw one run per row for each level
+
+	SortByKey(kLevelField, kMaxLevelCount);
+
+	const int oldMode = dc.SetBkMode(TRANSPARENT);
+	callCount++;
+
+	int level = -1;
+
+	i = 0;
+	while (i < m_nCount)
+		{
+		const int runLevel = m_pGlyphs[i].level;
+		const int runRow   = m_pGlyphs[i].row;
+
+		int len = 0, x0 = 0, prevX = 0;
+		for ( ; i < m_nCount &&
+				m_pGlyphs[i].level == runLevel && m_pGlyphs[i].row == runRow; i++)
+			{
+			const unsigned char c = (unsigned char) m_pGlyphs[i].c;
+			if (c == ' ' || len >= m_nRunCapacity)
+				{
+				continue;
+				}
+
+			const int x = m_pGlyphs[i].col * m_nCellWidth + (m_nCellWidth - m_CharWidth[c])/2;
+			if (len == 0)
+				{
+				x0 = x;
+				}
+			else
+				{
+				m_pRunDx[ len-1 ] = x - prevX;
+				}
+
+			m_pRunText[ len++ ] = (char) c;
+			prevX = x;
+			}
+
+		if (len > 0)
+			{
+			if (runLevel != level)
+				{
+				dc.SetTextColor(m_LevelColor[ runLevel ]);
+				level = runLevel;
+				callCount++;
+				}
+
+			m_pRunDx[ len-1 ] = m_nCellWidth;
+			ExtTextOut(dc.m_hDC, x0, runRow * m_nCellHeight, 0, NULL,
+					   m_pRunText, len, m_pRunDx);
+			callCount++;
+			}
+		}
+
+	dc.SetBkMode(oldMode);
+	callCount++;
+
+	m_nCount = 0;
+	return callCount;
+}
+
+/*******************************************************************************
+ DrawOffsetRuns (private)
+
+	Draws one run per level, using ETO_PDY to move between rows.  The
+	vertical displacement is measured along the baseline direction of the
+	font, so it is positive upwards.
+
+ *******************************************************************************/
+
+int
+JGlyphBatch::DrawOffsetRuns
+	(
+	CDC& dc
+	)
+{
+	SortByKey(kLevelField, kMaxLevelCount);
+
+	int callCount = 2;
+	const int oldMode = dc.SetBkMode(TRANSPARENT);
+
+	int i = 0;
+	while (i < m_nCount)
+		{
+		const int runLevel = m_pGlyphs[i].level;
+
+		int len = 0, x0 = 0, y0 = 0, prevX = 0, prevY = 0;
+		for ( ; i < m_nCount && m_pGlyphs[i].level == runLevel; i++)
+			{
+			const Glyph& g        = m_pGlyphs[i];
+			const unsigned char c = (unsigned char) g.c;
+			if (c == ' ' || len >= m_nRunCapacity)
+				{
+				continue;
+				}
+
+			const int x = g.col * m_nCellWidth + (m_nCellWidth - m_CharWidth[c])/2;
+			const int y = g.row * m_nCellHeight + g.dy;
+			if (len == 0)
+				{
+				x0 = x;
+				y0 = y;
+				}
+			else
+				{
+				m_pRunDx[ 2*len-2 ] = x - prevX;
+				m_pRunDx[ 2*len-1 ] = prevY - y;
+				}
+
+			m_pRunText[ len++ ] = (char) c;
+			prevX = x;
+			prevY = y;
+			}
+
+		if (len > 0)
+			{
+			dc.SetTextColor(m_LevelColor[ runLevel ]);
+
+			m_pRunDx[ 2*len-2 ] = m_nCellWidth;
+			m_pRunDx[ 2*len-1 ] = 0;
+			ExtTextOut(dc.m_hDC, x0, y0, ETO_PDY, NULL,
+					   m_pRunText, len, m_pRunDx);
+			callCount += 2;
+			}
+		}
+
+	dc.SetBkMode(oldMode);
+	return callCount;
+}
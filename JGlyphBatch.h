@@ -0,0 +1,169 @@
+/*******************************************************************************
+ JGlyphBatch.h
+
+ *******************************************************************************/
+
+#pragma once
+
+class JGlyphBatch
+{
+public:
+
+	enum
+	{
+		kMaxLevelCount = 32
+	};
+
+public:
+
+	JGlyphBatch();
+
+	~JGlyphBatch();
+
+	void	SetGrid(CDC& dc, const int rows, const int cols,
+					const int cellWidth, const int cellHeight);
+	void	SetLevelColor(const int level, const COLORREF color);
+
+	void	Add(const int row, const int col, const char c, const int level);
+	void	AddOffset(const int row, const int col, const int dy,
+					  const char c, const int level);
+	BOOL	IsEmpty() const;
+	int		Flush(CDC& dc);
+
+private:
+
+	struct Glyph
+	{
+		short	row;
+		short	col;
+		short	dy;				// pixels below the top of the cell
+		BYTE	level;
+		char	c;
+	};
+
+private:
+
+	int			m_nRows;
+	int			m_nCols;
+	int			m_nCellWidth;
+	int			m_nCellHeight;
+	int			m_CharWidth[256];
+	COLORREF	m_LevelColor[ kMaxLevelCount ];
+
+	Glyph*		m_pGlyphs;			// glyphs added since last Flush()
+	Glyph*		m_pSorted;			// scratch space for sorting
+	int			m_nCount;
+	int			m_nCapacity;
+
+	int*		m_pBucket;			// counting sort histogram
+	int			m_nBucketCount;
+
+	char*		m_pRunText;			// characters in current ExtTextOut() call
+	INT*		m_pRunDx;			// spacing in current ExtTextOut() call
+	BOOL		m_bOffsets;			// TRUE if any glyph has dy != 0
+	BYTE*		m_pRgnData;			// RGNDATA for clearing the cells
+	int			m_nRunCapacity;
+
+private:
+
+	void	Grow(const int capacity);
+	void	SortByKey(const int field, const int keyCount);
+	int		DrawOffsetRuns(CDC& dc);
+
+	// not allowed
+
+	JGlyphBatch(const JGlyphBatch& source);
+	const JGlyphBatch& operator=(const JGlyphBatch& source);
+};
+
+
+/*******************************************************************************
+ Add
+
+	Queues a glyph to be drawn centered in the given cell, in the color
+	assigned to level.  The cell is cleared to black first.  Spaces only
+	clear the cell.
+
+ *******************************************************************************/
+
+inline void
+JGlyphBatch::Add
+	(
+	const int	row,
+	const int	col,
+	const char	c,
+	const int	level
+	)
+{
+	if (row < 0 || m_nRows <= row || col < 0 || m_nCols <= col)
+		{
+		return;
+		}
+
+	if (m_nCount >= m_nCapacity)
+		{
+		Grow(2 * m_nCapacity + 16);
+		}
+
+	Glyph& g = m_pGlyphs[ m_nCount++ ];
+	g.row    = (short) row;
+	g.col    = (short) col;
+	g.dy     = 0;
+	g.level  = (BYTE) level;
+	g.c      = c;
+}
+
+/*******************************************************************************
+ AddOffset
+
+	Like Add(), but the glyph and the cleared cell are shifted down by dy
+	pixels, for rain that moves smoothly between rows.
+
+ *******************************************************************************/
+
+inline void
+JGlyphBatch::AddOffset
+	(
+	const int	row,
+	const int	col,
+	const int	dy,
+	const char	c,
+	const int	level
+	)
+{
+	const int count = m_nCount;
+	Add(row, col, c, level);
+	if (m_nCount > count && dy != 0)
+		{
+		m_pGlyphs[ count ].dy = (short) dy;
+		m_bOffsets            = TRUE;
+		}
+}
+
+/*******************************************************************************
+ IsEmpty
+
+ *******************************************************************************/
+
+inline BOOL
+JGlyphBatch::IsEmpty()
+	const
+{
+	return (m_nCount == 0);
+}
+
+/*******************************************************************************
+ SetLevelColor
+
+ *******************************************************************************/
+
+inline void
+JGlyphBatch::SetLevelColor
+	(
+	const int		level,
+	const COLORREF	color
+	)
+{
+	ASSERT( 0 <= level && level < kMaxLevelCount );
+	m_LevelColor[ level ] = color;
+}
@@ -6,6 +6,11 @@
 	that looks like "\x01 T", where T is a positive integer specifying
 	how long to wait before starting on the next page.
 
+	A line that starts with "\x02" contains directives that change the
+	delay, alignment, color, phase count, or cursor of all following
+	lines, e.g., "\x02 align=left color=FFFFFF".  JMatrixScript.cpp
+	describes them.  The lines are compiled when they are added.
+
 	The default behavior is as close to the actual Matrix credits as I
 	could manager.  You can obtain a range of different effects with
 	the following settings:
@@ -14,7 +19,7 @@
 
 		Specifies how many seconds to wait before displaying the first
 		page, and how long to wait before restarting after all pages
-		have been displayed.
+		have been displayed.  Zero continues immediately.
 
 	SetCursor(const BOOL show, const BOOL solid)
 
@@ -36,6 +41,175 @@
 		*much* longer for the text to phase in when SetMaxPhaseCount()
 		is called with a very large value.
 
+	ClearText()
+
+		Discards all the lines, so a new script can be added.  The
+		current page is finished first.
+
+	Thread safety
+
+		AddTextLine(), ClearText(), SetIntervals(), SetCursor(),
+		SetMaxPhaseCount() and AllowEuropeanChars() may be called from
+		any thread.  They append a command to a lock-free queue that the
+		animation drains before each frame, in the order in which the
+		commands were pushed by each thread.  The other functions lock
+		the animation state directly, so they may overtake commands that
+		are still queued.
+
+	SetConfig(const Config& config)
+
+		Adjusts the obscure parameters:  column spacing, animation rates,
+		spinning characters, and colors.  Start with GetConfig() and
+		modify only what you need.  Column spacing only takes effect when
+		the control is created.  After that, SetConfig() keeps the values
+		of the settings that only take effect then, so GetConfig() always
+		shows the ones in use.
+
+	Config::bRenderThread
+
+		By default, the animation runs on a separate thread, so it does not
+		stall when the dialog is busy and vice versa.  The thread draws each
+		frame into one of three buffers, and OnPaint() presents the most
+		recently completed one.  This only takes effect when the control is
+		created.
+
+	Config::bSuspendWhenHidden
+
+		By default, the animation stops while the control (or all of its
+		viewports) is hidden, minimized, or completely covered.  When it
+		becomes visible again, the rain and the spinning characters jump
+		ahead to where they would have been, and the text continues where
+		it stopped.
+
+	Config::rainLayer
+
+		The rain is drawn in up to kMaxRainLayers layers, composited back to
+		front.  Each layer has its own font size, update interval, intensity
+		and density.  Each layer is also allotted a share of the frame
+		budget, and layers that exceed their share are updated less often.
+		The number of layers and the font sizes only take effect when the
+		control is created.
+
+	Config::bIndexedRain
+
+		Stores each rain layer as an 8 bit DIB whose color table is a ramp
+		of greens, instead of a bitmap compatible with the screen.  This
+		uses a quarter of the memory on 32 bit displays.  The layers are
+		expanded to RGB by the color table when they are composited into
+		the frame.  This only takes effect when the control is created.
+
+	Config::nRevealMode
+
+		Specifies how each line appears:  typed behind the cursor, one
+		character at a time in random order, outward from the center, or
+		decoded by the rain, where the drops in the front layer lock in
+		each character as they pass over it.  The "reveal" directive
+		overrides this for individual lines.
+
+	Config::nMinDropSpeed, nMaxDropSpeed
+
+		Each drop falls at its own speed, chosen between these percentages
+		of the normal speed, which is one row per nAnimateBkgdInterval.
+		The drops move smoothly, redrawn every nAnimateRainInterval.
+
+	PlaySignal(LPCTSTR wavFileName)
+	PushMetric(const int level)
+
+		Let an external signal drive the rain.  The loudness modulates the
+		number of active columns, the bass modulates how often new columns
+		start, and the treble modulates how often spinning characters
+		start.  A WAV file is analyzed on a separate thread while it plays
+		silently in a loop.  A metric between 0 and 1000 (e.g., the CPU
+		load) can be pushed from any thread, and it drives all three.
+		Config::nSignalDensity, nSignalActivation, and nSignalSpin specify
+		how much each one changes, in percent, between level 500 and the
+		extremes.  StopSignal() restores the normal behavior.
+
+	Config::nTickerRate
+
+		Switches the text from pages to a ticker that streams this many
+		lines per second up the screen.  Each line enters at the bottom
+		and phases in while the older lines scroll up.  Page breaks, line
+		delays, cursors, and reveal modes are ignored, and lines that are
+		wider than the control are truncated.  The lines are kept in a
+		ring of slots that is allocated when the grid is computed, so
+		hundreds of lines per second do not allocate any memory.
+		Stats::nTickerLines counts the lines that have been read, so the
+		throughput can be measured.  Set it to zero to return to pages.
+
+	Config::bGlow
+
+		Adds a glow around the bright heads of the front rain layer by
+		blurring the area around them in the frame, on the CPU.  The frames
+		must be DIB sections for this, so the control must be created with
+		bGlow set, but it can be turned off and on afterwards.  The glow is
+		skipped when the quality governor has reduced the quality.
+		Stats::nGlowCost reports the cost per megapixel, so you can decide
+		whether the hardware can afford it.
+
+	AddViewport(JMatrixViewport* viewport)
+
+		To span several monitors, create the control with the virtual
+		size of the whole wall and let each JMatrixViewport display its
+		slice.  The viewports register themselves.  There is only one
+		simulation, so the rain continues seamlessly from one monitor to
+		the next.
+
+	ShareFrames(LPCTSTR name)
+
+		Publishes each frame in a named shared memory mapping, so other
+		processes can display the same simulation with
+		JMatrixViewport::CreateShared() instead of running their own.
+		The control must already exist.  Only one control can share
+		frames under each name.  If the previous producer exited while
+		consumers were still open, the new one takes over their mapping,
+		as long as the frames are not larger than before.  While frames
+		are shared, the animation is only suspended when neither this
+		control nor any of the consumers is visible.  JFrameShare.cpp
+		describes the protocol.
+
+	SaveSnapshot(CByteArray* data)
+	RestoreSnapshot(const BYTE* data, const int length)
+
+		Save the complete state of the animation (the rain, the spinning
+		characters, the current page, the active line, the timers, and
+		the random number generator) in a small versioned binary blob,
+		and restore it later, e.g., to resume exactly where a previous
+		session stopped or to reproduce a problem.  After a restore, the
+		frames are the same as if the animation had never been
+		interrupted.  The blob can only be restored into a control with
+		the same size, fonts, and rain layers, and a script that is at
+		least as long.  Restoring does not allocate any GDI resources.
+		Stats::nSnapshotTime reports how long the last one took.
+
+	Text plane
+
+		The text is drawn into its own bitmap, and only the characters
+		that change are redrawn.  Each frame copies the lines from this
+		bitmap.  The cells that are hidden by the lines are recorded, so
+		the rain and the spinning characters do not waste time drawing
+		glyphs that nobody will see.  Stats::nSkippedCells reports the
+		savings.
+
+	SetTextFont(const LOGFONT& font)
+	SetRainFont(const LOGFONT& font)
+
+		Change the fonts used for the text and the rain.  The height of
+		the rain font is ignored, because each layer has its own.  Each
+		font defines a grid of cells as wide as its widest glyph, so
+		proportional fonts stay aligned.  If the control already exists,
+		the grid, the rain, the spinning characters, and the layout of
+		the current page are recomputed immediately.
+
+	SetFrameBudget(const int msec)
+
+		Specifies how long each update+redraw may take before the quality
+		governor starts reducing the rain rate, the number of spinning
+		characters, the number of active columns, and the text update
+		rate.  Quality is restored when the load goes away.  Specify zero
+		to disable the governor.  GetStats() reports the measurements and
+		the current quality level.
+
 	Written by John Lindal.
 	http://jafl.my.speedingbits.com/
 
@@ -49,19 +223,36 @@
 
 #include "StdAfx.h"
 #include "JMatrixCtrl.h"
+#include "JMatrixViewport.h"
 #include <float.h>
 
 // The following parameters can be tweaked to produce different effects.
-// They are not included in the API because they are too obscure for the
-// casual user.
+// They are the defaults for JMatrixCtrl::Config.
 
 const int kColSpacing          = 2;		// pixels between columns
 const int kAnimateTextInterval = 10;	// milliseconds
 const int kMoveCursorInterval  = 30;	// milliseconds
-const int kAnimateBkgdInterval = 80;	// milliseconds
+const int kAnimateBkgdInterval = 80;	// milliseconds per row at normal speed
+const int kAnimateRainInterval = 16;	// milliseconds between rain frames
+const int kMinDropSpeed        = 60;	// percent of normal speed
+const int kMaxDropSpeed        = 140;	// percent of normal speed
 const float kSpinCharFraction  = 0.2f;	// fraction of columns with spinning character
 const int kMinSpinCount        = 300;	// centiseconds
 const int kMaxSpinCount        = 800;	// centiseconds
+const int kSpinRate            = 10;	// characters started per 10 seconds
+
+const int kGlowRadius          = 4;		// pixels
+const int kGlowStrength        = 60;	// percent
+const int kGlowThreshold       = 200;	// out of 255
+
+const int kSignalDensity       = 50;	// percent
+const int kSignalActivation    = 100;	// percent
+const int kSignalSpin          = 100;	// percent
+
+const int kTickerRate          = 0;		// lines per second; 0 => pages
+
+const int kFontHeight          = 14;	// pixels
+const char* const kFontName    = "Courier";
 
 const COLORREF kTextColor      = RGB(128, 255, 128);
 const int kBrightGreen         = 255;	// out of 255
@@ -75,22 +266,254 @@ const int kMinGreen            = 60;	// out of 255
 const int kMaxGreen            = 100;	// out of 255
 */
 
-const unsigned char kMinBackChar = 32;
-const unsigned char kMaxBackChar = '\xFF';
+// Additional rain layers are smaller, slower, dimmer and sparser, so they
+// appear to be farther away.
+
+static const JMatrixCtrl::RainLayerConfig kRainLayer[ JMatrixCtrl::kMaxRainLayers ] =
+{
+	{ 14, 100, 100, 100, 40 },
+	{ 11, 150,  60,  70, 25 },
+	{  9, 200,  35,  50, 20 },
+	{  7, 300,  20,  40, 15 }
+};
+
+const int kDefaultRainLayerCount = 1;
+const int kMaxLayerSlowdown      = 4;
+
+const int kMaxRainStep = 250;		// milliseconds; longer gaps are not caught up
+
+// Each frame only redraws the tiles that changed since it was last drawn.
+
+const int kDirtyTileShift = 4;		// 16 pixels
+
+// The characters of the active line that changed are redrawn in runs.
+// Runs separated by at most this many characters are merged.
+
+const int kMaxTextRunGap = 3;
+
+// Producers that find the command queue full wait this long before
+// checking again, in case another waiter took the event.
+
+const int kCommandQueueSize = 1024;
+const int kCommandWait      = 1;		// milliseconds
+
+// The quality governor steps through these levels.  Each entry scales the
+// corresponding parameter above, in percent.
+
+struct QualityLevel
+{
+	int	bkgdInterval;
+	int	spinFraction;
+	int	columnFraction;
+	int	textInterval;
+};
+
+static const QualityLevel kQualityLevel[] =
+{
+	{ 100, 100, 100, 100 },
+	{ 125,  75,  90, 150 },
+	{ 150,  50,  80, 200 },
+	{ 200,  25,  65, 300 },
+	{ 250,   0,  50, 400 }
+};
+
+const int kQualityLevelCount   = sizeof(kQualityLevel) / sizeof(QualityLevel);
+const int kDefaultFrameBudget  = 10000;	// microseconds
+const int kGovernorPeriod      = 1000;	// milliseconds between decisions
+const int kRestoreThreshold    = 50;	// percent of budget that counts as headroom
+const int kRestoreDelay        = 3;		// periods of headroom before restoring
 
-const char kPageBreak          = '\x01';
 const char kBlockCursorChar    = '\x01';
 
+// Each text preset resolves the cursor and character set options at compile
+// time, so UpdateTextT() does not test them for every character.
+
+template <int cursor, int randomCursor, int european>
+struct TextPreset
+{
+	enum
+	{
+		kCursor       = cursor,
+		kRandomCursor = randomCursor,
+		kMaxChar      = (european ? 255 : 127)
+	};
+};
+
+// Each glyph kind resolves the layout of DrawActiveString() at compile time.
+
+struct SingleGlyph
+{
+	enum { kSingle = 1, kBlock = 0 };
+};
+
+struct BlockGlyph
+{
+	enum { kSingle = 1, kBlock = 1 };
+};
+
+const UINT kTickTimerID        = 1;		// WM_TIMER used when there is no render thread
+const int kSyncTickInterval    = 10;	// milliseconds
+const int kMaxRenderSleep      = 100;	// milliseconds
+const UINT kVisibilityTimerID  = 2;		// WM_TIMER used to check if the control is visible
+const int kVisibilityInterval  = 500;	// milliseconds
+const int kMaxFastForward      = 600000;	// milliseconds; longer suspensions are truncated
+const int kMaxPauseInterval    = 86400;		// seconds; longer pauses are truncated
+
+// Spinning characters change every 1 to kMaxSpinPeriod spin ticks.
+
+const int kMaxSpinPeriod = 3;
+
+// m_nReadyFrame holds the index of the most recently completed frame,
+// plus kFreshFrame if it has not yet been presented.
+
+const LONG kFreshFrame         = 0x100;
+const LONG kFrameIndexMask     = 0xFF;
+
+// states of the page being laid out by the layout thread
+
 enum
 {
-	kInitTextID,
-	kUpdateTextID,
-	kUpdateCursorID,
-	kUpdateBackgroundID,
-	kUpdateSpinID		// only runs when kUpdateTextID does not run to minimize redraws
+	kPageEmpty,
+	kPageBusy,
+	kPageReady
 };
 
-#define getrandom(min,max) ((rand()%(int)(((max)+1)-(min)))+(min))
+// only usable in member functions, because the generator state is part of
+// the snapshot
+
+#define getrandom(min,max) (GetRandomIndex(((max)+1)-(min)) + (min))
+
+/*******************************************************************************
+ InitFontInfo (static)
+
+ *******************************************************************************/
+
+static void
+InitFontInfo
+	(
+	LOGFONT*	info,
+	const BYTE	charSet
+	)
+{
+	memset(info, 0, sizeof(LOGFONT));
+	info->lfHeight         = kFontHeight;
+	info->lfWeight         = FW_BOLD;
+	info->lfCharSet        = charSet;
+	info->lfOutPrecision   = OUT_DEFAULT_PRECIS;
+	info->lfClipPrecision  = CLIP_DEFAULT_PRECIS;
+	info->lfQuality        = DEFAULT_QUALITY;
+	info->lfPitchAndFamily = DEFAULT_PITCH|FF_SWISS;
+	strcpy(info->lfFaceName, kFontName);
+}
+
+/*******************************************************************************
+ GetMaxAdvance (static)
+
+	Returns the width of the widest glyph that will be drawn.  Using this
+	instead of tmAveCharWidth keeps proportional fonts on the grid.
+
+ *******************************************************************************/
+
+static int
+GetMaxAdvance
+	(
+	CDC&		dc,
+	const int	first,
+	const int	last
+	)
+{
+	int width[256];
+	dc.GetCharWidth(first, last, width);
+
+	int advance = 1;
+	for (int i=0; i<=last-first; i++)
+		{
+		advance = max(advance, width[i]);
+		}
+	return advance;
+}
+
+/*******************************************************************************
+ GetMicroseconds (static)
+
+ *******************************************************************************/
+
+static LONGLONG
+GetMicroseconds()
+{
+	static LONGLONG freq = 0;
+	if (freq == 0)
+		{
+		LARGE_INTEGER f;
+		QueryPerformanceFrequency(&f);
+		freq = f.QuadPart;
+		}
+
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return (t.QuadPart / freq) * 1000000 + ((t.QuadPart % freq) * 1000000) / freq;
+}
+
+/*******************************************************************************
+ CompareIndex (static)
+
+	For qsort().
+
+ *******************************************************************************/
+
+static int
+CompareIndex
+	(
+	const void* a,
+	const void* b
+	)
+{
+	return *((const int*) a) - *((const int*) b);
+}
+
+/*******************************************************************************
+ Config constructor
+
+	Initializes all the parameters to their default values.
+
+ *******************************************************************************/
+
+JMatrixCtrl::Config::Config()
+	:
+	nColSpacing(kColSpacing),
+	nAnimateTextInterval(kAnimateTextInterval),
+	nMoveCursorInterval(kMoveCursorInterval),
+	nAnimateBkgdInterval(kAnimateBkgdInterval),
+	nAnimateRainInterval(kAnimateRainInterval),
+	nMinDropSpeed(kMinDropSpeed),
+	nMaxDropSpeed(kMaxDropSpeed),
+	fSpinCharFraction(kSpinCharFraction),
+	nMinSpinCount(kMinSpinCount),
+	nMaxSpinCount(kMaxSpinCount),
+	nSpinRate(kSpinRate),
+	textColor(kTextColor),
+	nBrightGreen(kBrightGreen),
+	nMinGreen(kMinGreen),
+	nMaxGreen(kMaxGreen),
+	bRenderThread(TRUE),
+	bSuspendWhenHidden(TRUE),
+	nRainLayerCount(kDefaultRainLayerCount),
+	bIndexedRain(FALSE),
+	nRevealMode(JMatrixScript::kTypeReveal),
+	bGlow(FALSE),
+	nGlowRadius(kGlowRadius),
+	nGlowStrength(kGlowStrength),
+	nGlowThreshold(kGlowThreshold),
+	nSignalDensity(kSignalDensity),
+	nSignalActivation(kSignalActivation),
+	nSignalSpin(kSignalSpin),
+	nTickerRate(kTickerRate)
+{
+	for (int i=0; i<kMaxRainLayers; i++)
+		{
+		rainLayer[i] = kRainLayer[i];
+		}
+}
 
 /*******************************************************************************
  Constructor
@@ -99,26 +522,131 @@ enum
  
 JMatrixCtrl::JMatrixCtrl()
 	:
-	m_MaxChar('\xFF'),
+	m_bEuropeanChars(TRUE),
 	m_IntroInterval(5),
 	m_RestartInterval(5),
 	m_nMaxPhaseCount(20),
 	m_bShowCursor(TRUE),
 	m_CursorPt(-1, -1),
 	m_CursorChar(kBlockCursorChar),
-	m_nPageStartLine(0),
+	m_nNextPageOffset(0),
+	m_nLayoutSerial(0),
+	m_pPage(m_PageLayout),
+	m_pNextPage(m_PageLayout + 1),
+	m_nNextPageState(kPageEmpty),
+	m_LayoutEvent(FALSE, FALSE),
+	m_pLayoutThread(NULL),
+	m_bStopLayout(FALSE),
 	m_nActiveLine(-1),
-	m_pFontOld(NULL),
-	m_pBitmapOld(NULL),
-	m_pMatrixColumns(NULL),
-	m_nActiveColumns(0),
-	m_pSpinChars(NULL),
-	m_nActiveSpins(0),
+	m_nLineCursor(JMatrixScript::kDefaultValue),
+	m_nLinePhaseCount(JMatrixScript::kDefaultValue),
+	m_nCharAdvance(1),
+	m_nLineReveal(JMatrixScript::kTypeReveal),
+	m_nRevealCount(0),
+	m_nHiddenCount(0),
+	m_nRevealRow(-1),
+	m_pFrameDC(NULL),
+	m_nDrawFrame(0),
+	m_nReadyFrame(1),
+	m_nPresentFrame(2),
+	m_bPainted(FALSE),
+	m_nDirtyCols(0),
+	m_nDirtyRows(0),
+	m_pChangedTiles(NULL),
+	m_pOverlayTiles(NULL),
+	m_pRgnData(NULL),
+	m_nRainLayerCount(0),
 	m_nTotalSpins(0),
-	m_pBackFontOld(NULL),
-	m_pBackBitmapOld(NULL)
+	m_nActiveSpins(0),
+	m_pSpinEnd(NULL),
+	m_pSpinChar(NULL),
+	m_nSpinTick(1),
+	m_nSpinCredit(0),
+	m_hSpinBitmapOld(NULL),
+	m_hSpinFontOld(NULL),
+	m_nFrameSkips(0),
+	m_hTextBitmapOld(NULL),
+	m_hTextFontOld(NULL),
+	m_pTextMask(NULL),
+	m_nMaskedLength(0),
+	m_bTextPlaneClear(FALSE),
+	m_nTextDirtyCount(0),
+	m_nTextPreset(kBlockCursor),
+	m_nBkgdInterval(kAnimateBkgdInterval),
+	m_nTextInterval(kAnimateTextInterval),
+	m_nRainInterval(kAnimateRainInterval),
+	m_RainTime(0),
+	m_nSpinLimit(0),
+	m_nTextTimerID(-1),
+	m_GovernorTime(0),
+	m_nHeadroomCount(0),
+	m_bTicker(FALSE),
+	m_pTickerLine(NULL),
+	m_pTickerChars(NULL),
+	m_pTickerPhase(NULL),
+	m_nTickerRows(0),
+	m_nTickerWidth(0),
+	m_nTickerHead(0),
+	m_nTickerCount(0),
+	m_nTickerCredit(0),
+	m_nDensityScale(100),
+	m_nActivationScale(100),
+	m_nSpinScale(100),
+	m_nFrameDrawCalls(0),
+	m_WakeEvent(FALSE, FALSE),
+	m_CommandEvent(FALSE, FALSE),
+	m_nCommandStalls(0),
+	m_pRenderThread(NULL),
+	m_bSuspended(FALSE),
+	m_SuspendTime(0),
+	m_bStopRender(FALSE),
+	m_ManualTime(-1)
 {
-	srand((unsigned int) time(NULL));
+	m_nRandomState = (DWORD) time(NULL) | 1;		// xorshift never leaves 0
+
+	memset(m_Timer, 0, sizeof(m_Timer));
+
+	for (int i=0; i<kFrameCount; i++)
+		{
+		m_Frame[i].hBitmapOld = NULL;
+		m_Frame[i].hFontOld   = NULL;
+		m_Frame[i].pBits      = NULL;
+		m_Frame[i].pDirty     = NULL;
+		}
+
+	// a snapshot can be saved before the first page is built
+
+	for (int k=0; k<2; k++)
+		{
+		m_PageLayout[k].nEndOffset     = 0;
+		m_PageLayout[k].nPauseInterval = 0;
+		m_PageLayout[k].nSerial        = -1;
+		}
+
+	for (int j=0; j<kMaxRainLayers; j++)
+		{
+		m_RainLayer[j].hBitmapOld = NULL;
+		m_RainLayer[j].hFontOld   = NULL;
+		m_RainLayer[j].pColumns   = NULL;
+		m_RainLayer[j].pPosition  = NULL;
+		m_RainLayer[j].pVelocity  = NULL;
+		m_RainLayer[j].pTime      = NULL;
+		m_RainLayer[j].pActive    = NULL;
+		m_RainLayer[j].pActiveIndex = NULL;
+		m_RainLayer[j].nClock     = 0;
+		m_RainLayer[j].nCols      = 0;
+		m_RainLayer[j].pMask      = NULL;
+		m_RainLayer[j].pCells     = NULL;
+		m_RainLayer[j].nActivationCredit = 0;
+		}
+
+	m_Commands.SetCapacity(kCommandQueueSize);
+
+	InitFontInfo(&m_TextFontInfo, ANSI_CHARSET);
+	InitFontInfo(&m_RainFontInfo, GREEK_CHARSET);
+
+	memset(&m_Stats, 0, sizeof(m_Stats));
+	m_Stats.nFrameBudget = kDefaultFrameBudget;
 }
 
 /*******************************************************************************
@@ -128,26 +656,73 @@ JMatrixCtrl::JMatrixCtrl()
 
 JMatrixCtrl::~JMatrixCtrl()
 {
-	if (m_pBitmapOld != NULL)
+	StopRenderThread();
+	StopLayoutThread();
+
+	for (int i=0; i<kFrameCount; i++)
+		{
+		Frame& f = m_Frame[i];
+		if (f.hBitmapOld != NULL)
+			{
+			::SelectObject(f.dc.m_hDC, f.hBitmapOld);
+			}
+		if (f.hFontOld != NULL)
+			{
+			::SelectObject(f.dc.m_hDC, f.hFontOld);
+			}
+		delete [] f.pDirty;
+		}
+
+	delete [] m_pChangedTiles;
+	delete [] m_pOverlayTiles;
+	delete [] m_pRgnData;
+
+	for (int j=0; j<kMaxRainLayers; j++)
+		{
+		RainLayer& layer = m_RainLayer[j];
+		if (layer.hBitmapOld != NULL)
+			{
+			::SelectObject(layer.dc.m_hDC, layer.hBitmapOld);
+			}
+		if (layer.hFontOld != NULL)
+			{
+			::SelectObject(layer.dc.m_hDC, layer.hFontOld);
+			}
+
+		delete [] layer.pColumns;
+		delete [] layer.pPosition;
+		delete [] layer.pVelocity;
+		delete [] layer.pTime;
+		delete [] layer.pActive;
+		delete [] layer.pActiveIndex;
+		delete [] layer.pMask;
+		delete [] layer.pCells;
+		}
+	if (m_hSpinBitmapOld != NULL)
 		{
-		m_DC.SelectObject(m_pBitmapOld);  
+		::SelectObject(m_SpinDC.m_hDC, m_hSpinBitmapOld);
 		}
-	if (m_pFontOld != NULL)
+	if (m_hSpinFontOld != NULL)
 		{
-		m_DC.SelectObject(m_pFontOld);  
+		::SelectObject(m_SpinDC.m_hDC, m_hSpinFontOld);
 		}
 
-	if (m_pBackBitmapOld != NULL)
+	if (m_hTextBitmapOld != NULL)
 		{
-		m_BackDC.SelectObject(m_pBackBitmapOld);  
+		::SelectObject(m_TextDC.m_hDC, m_hTextBitmapOld);
 		}
-	if (m_pBackFontOld != NULL)
+	if (m_hTextFontOld != NULL)
 		{
-		m_BackDC.SelectObject(m_pBackFontOld);  
+		::SelectObject(m_TextDC.m_hDC, m_hTextFontOld);
 		}
 
-	delete [] m_pMatrixColumns;
-	delete [] m_pSpinChars;
+	delete [] m_pSpinEnd;
+	delete [] m_pSpinChar;
+	delete [] m_pTextMask;
+
+	delete [] m_pTickerLine;
+	delete [] m_pTickerChars;
+	delete [] m_pTickerPhase;
 }
 
 /*******************************************************************************
@@ -166,493 +741,3890 @@ JMatrixCtrl::Create
 {
 	static CString className = AfxRegisterWndClass(CS_HREDRAW | CS_VREDRAW);
 
+	DrainCommands();		// apply the settings before the timers are started
+
 	const BOOL result = CreateEx(WS_EX_CLIENTEDGE, className, NULL, dwStyle, rect,
 								 pParentWnd, nID);
 
 	CRect r;
 	GetClientRect(r);
-	const int h = r.Height();
-	const int w = r.Width();
+	const int h = m_nHeight = r.Height();
+	const int w = m_nWidth  = r.Width();
 
-	m_Font.CreateFont(14, 0, 0, 0, FW_BOLD,
-					  FALSE, FALSE, 0, ANSI_CHARSET,
-					  OUT_DEFAULT_PRECIS, 
-					  CLIP_DEFAULT_PRECIS,
-					  DEFAULT_QUALITY, 
-					  DEFAULT_PITCH|FF_SWISS, "Courier");
+	// create the frame buffers that get copied to window
 
-	m_BGFont.CreateFont(14, 0, 0, 0, FW_BOLD,
-						FALSE, FALSE, 0, GREEK_CHARSET,
-						OUT_DEFAULT_PRECIS, 
-						CLIP_DEFAULT_PRECIS,
-						DEFAULT_QUALITY, 
-						DEFAULT_PITCH|FF_SWISS, "Courier");
+	CClientDC dc(this);
+	const int pixelBytes = (dc.GetDeviceCaps(BITSPIXEL) * dc.GetDeviceCaps(PLANES) + 7) / 8;
+	m_Stats.nBufferBytes = 0;
 
-	// create main DC that gets copied to window
+	for (int i=0; i<kFrameCount; i++)
+		{
+		Frame& f = m_Frame[i];
+		f.dc.CreateCompatibleDC(&dc);
+		if (!m_Config.bGlow || !CreateRGBBitmap(dc, &f.bitmap, &f.pBits))
+			{
+			f.bitmap.CreateCompatibleBitmap(&dc, w, h);
+			}
+		f.hBitmapOld    = ::SelectObject(f.dc.m_hDC, f.bitmap.m_hObject);
+		f.completedTime = 0;
 
-	CClientDC dc(this);
-	m_DC.CreateCompatibleDC(&dc);
-	m_Bitmap.CreateCompatibleBitmap(&dc, w, h);
-	m_pBitmapOld = m_DC.SelectObject(&m_Bitmap);
-	m_pFontOld   = m_DC.SelectObject(&m_Font);
+		BITMAP frameInfo;
+		f.bitmap.GetBitmap(&frameInfo);
+		m_Stats.nBufferBytes += frameInfo.bmWidthBytes * frameInfo.bmHeight * frameInfo.bmPlanes;
+		}
 
-	TEXTMETRIC tm;
-	m_DC.GetTextMetrics(&tm);
-	m_nTextWidth = tm.tmAveCharWidth + kColSpacing;
-	m_nTextHeight= tm.tmHeight;
-	m_nCols      = w/m_nTextWidth  + 1;
-	m_nRows      = h/m_nTextHeight + 1;
+	if (m_Frame[0].pBits != NULL)
+		{
+		m_Glow.SetSize(w, h);
+		m_Stats.nBufferBytes += w * h;
+		}
+
+	m_pFrameDC = &(m_Frame[ m_nDrawFrame ].dc);
+
+	// Recompute() marks every tile of every frame
+
+	m_nDirtyCols        = (w >> kDirtyTileShift) + 1;
+	m_nDirtyRows        = (h >> kDirtyTileShift) + 1;
+	const int tileCount = m_nDirtyCols * m_nDirtyRows;
+
+	for (int k=0; k<kFrameCount; k++)
+		{
+		m_Frame[k].pDirty = new BYTE [ tileCount ];
+		}
+	m_pChangedTiles = new BYTE [ tileCount ];
+	m_pOverlayTiles = new BYTE [ tileCount ];
+	m_pRgnData      = new BYTE [ sizeof(RGNDATAHEADER) + tileCount * sizeof(RECT) ];
+	memset(m_pChangedTiles, 0, tileCount);
+	memset(m_pOverlayTiles, 0, tileCount);
 
-	// create background DC that stores rain animation
+	// create background DCs that store rain animation
 
-	m_BackDC.CreateCompatibleDC(&dc);
-	m_BackBitmap.CreateCompatibleBitmap(&dc, w, h);
-	m_pBackBitmapOld = m_BackDC.SelectObject(&m_BackBitmap);
-	m_pBackFontOld   = m_BackDC.SelectObject(&m_BGFont);
+	m_nRainLayerCount = max(1, min(m_Config.nRainLayerCount, (int) kMaxRainLayers));
+	for (int j=0; j<m_nRainLayerCount; j++)
+		{
+		CreateRainLayer(dc, j);
 
-	m_BackDC.FillSolidRect(0,0, w,h, RGB(0,0,0));
+		BITMAP layerInfo;
+		m_RainLayer[j].bitmap.GetBitmap(&layerInfo);
+		m_Stats.nBufferBytes += layerInfo.bmWidthBytes * layerInfo.bmHeight * layerInfo.bmPlanes;
+		}
 
-	m_pMatrixColumns = new MatrixColumn[ m_nCols ];
+	// create the DC that stores the spinning characters
 
-	for (int i=0; i<m_nCols; i++)
+	m_SpinDC.CreateCompatibleDC(&dc);
+	if (!m_Config.bIndexedRain || !CreateIndexedBitmap(dc, &m_SpinBitmap))
 		{
-		m_pMatrixColumns[i].bActive = FALSE;
+		m_SpinBitmap.CreateCompatibleBitmap(&dc, w, h);
 		}
+	m_hSpinBitmapOld = ::SelectObject(m_SpinDC.m_hDC, m_SpinBitmap.m_hObject);
+
+	BITMAP info;
+	m_SpinBitmap.GetBitmap(&info);
+	m_Stats.nBufferBytes += info.bmWidthBytes * info.bmHeight * info.bmPlanes;
+
+	// create the DC that stores the text
+
+	m_TextDC.CreateCompatibleDC(&dc);
+	m_TextBitmap.CreateCompatibleBitmap(&dc, w, h);
+	m_hTextBitmapOld      = ::SelectObject(m_TextDC.m_hDC, m_TextBitmap.m_hObject);
+	m_Stats.nBufferBytes += w * h * pixelBytes;
+
+	Recompute();
+	UpdateBatchColors();
+	UpdateGlowParameters();
+
+	m_nBkgdInterval = m_nRainInterval = 0;		// force all timers to be scheduled
+	ApplyQualityLevel(0);
+	m_GovernorTime = m_RainTime = GetTime();
 
-	m_nTotalSpins = (int) (m_nCols * kSpinCharFraction);
-	m_pSpinChars  = new SpinChar[ m_nTotalSpins ];
+	StartPause(m_IntroInterval);
+	StartLayoutThread();
 
-	for (i=0; i<m_nTotalSpins; i++)
+	if (m_ManualTime >= 0)
 		{
-		m_pSpinChars[i].bActive = FALSE;
+		// Step() drives the animation
+		}
+	else if (m_Config.bRenderThread)
+		{
+		StartRenderThread();
+		}
+	else
+		{
+		SetTimer(kTickTimerID, kSyncTickInterval, NULL);
 		}
 
-	SetTimer(kInitTextID, m_IntroInterval * 1000, NULL);
-	SetTimer(kUpdateBackgroundID, kAnimateBkgdInterval, NULL);
+	SetTimer(kVisibilityTimerID, kVisibilityInterval, NULL);
 
 	Invalidate(FALSE);
 	return result;
 }
 
 /*******************************************************************************
- SetCursor
+ AddTextLine
 
-	If the cursor is not solid, it is a randomly changing character.
+	Lines of any length are accepted.  Those longer than
+	JCommandQueue::kMaxTextLength take several slots in the queue.
 
  *******************************************************************************/
 
 void
-JMatrixCtrl::SetCursor
+JMatrixCtrl::AddTextLine
 	(
-	const BOOL show,
-	const BOOL solid
+	LPCTSTR lpszLine
 	)
 {
-	m_bShowCursor = show;
-	m_CursorChar  = (solid ? kBlockCursorChar : 'a');
+	PushCommand(kAddTextLineCmd, 0, 0, lpszLine);
 }
 
 /*******************************************************************************
- Message map
+ ClearText
 
  *******************************************************************************/
 
-BEGIN_MESSAGE_MAP(JMatrixCtrl, CWnd)
-	//{{AFX_MSG_MAP(JMatrixCtrl)
-	ON_WM_PAINT()
-	ON_WM_TIMER()
-	//}}AFX_MSG_MAP
-END_MESSAGE_MAP()
+void
+JMatrixCtrl::ClearText()
+{
+	PushCommand(kClearTextCmd, 0, 0);
+}
 
 /*******************************************************************************
- OnPaint
+ SetIntervals
+
+	The wait time before the first page and the wait time between
+	repetitions.
 
  *******************************************************************************/
 
 void
-JMatrixCtrl::OnPaint()
+JMatrixCtrl::SetIntervals
+	(
+	const int intro,
+	const int restart
+	)
 {
-	if (m_pBitmapOld != NULL)
-		{
-		CRect r;
-		GetClientRect(&r);
-
-		CPaintDC dc(this);
-		dc.BitBlt(0, 0, r.Width(), r.Height(), &m_DC, 0, 0, SRCCOPY);
-		}
+	PushCommand(kSetIntervalsCmd, intro, restart);
 }
 
 /*******************************************************************************
- OnTimer
+ SetTextFont
 
  *******************************************************************************/
 
 void
-JMatrixCtrl::OnTimer
+JMatrixCtrl::SetTextFont
 	(
-	UINT nEventID
+	const LOGFONT& font
 	)
 {
-	if (nEventID == kInitTextID)
-		{
-		InitText();
-		InitCursor();
-		}
-	else if (nEventID == kUpdateTextID)
-		{
-		UpdateSpin();
-		UpdateText();
-		Draw();
-		}
-	else if (nEventID == kUpdateCursorID)
-		{
-		UpdateCursor();
-		Draw();
-		}
-	else if (nEventID == kUpdateBackgroundID)
-		{
-		UpdateBackground();
-		Draw();
-		}
-	else if (nEventID == kUpdateSpinID)		// runs when kUpdateTextID is not active
+	CSingleLock lock(&m_StateLock, TRUE);
+
+	m_TextFontInfo = font;
+	if (m_nRainLayerCount > 0)
 		{
-		UpdateSpin();
-		Draw();
-		}
+		Recompute();
 
-	CWnd::OnTimer(nEventID);
+		m_nBkgdInterval = m_nRainInterval = 0;		// force all timers to be rescheduled
+		ApplyQualityLevel(m_Stats.nQualityLevel);
+		}
 }
 
 /*******************************************************************************
- Draw (private)
+ SetRainFont
+
+	The height is ignored, because each layer has its own.
 
  *******************************************************************************/
 
 void
-JMatrixCtrl::Draw()
+JMatrixCtrl::SetRainFont
+	(
+	const LOGFONT& font
+	)
 {
-	CRect r;
-	GetClientRect(&r);
+	CSingleLock lock(&m_StateLock, TRUE);
 
-	m_DC.BitBlt(0, 0, r.Width(), r.Height(), &m_BackDC, 0, 0, SRCCOPY);
-	DrawSpin();
-	DrawText();
-	DrawCursor();
-	Invalidate(FALSE);
+	m_RainFontInfo = font;
+	if (m_nRainLayerCount > 0)
+		{
+		Recompute();
+
+		m_nBkgdInterval = m_nRainInterval = 0;		// force all timers to be rescheduled
+		ApplyQualityLevel(m_Stats.nQualityLevel);
+		}
 }
 
 /*******************************************************************************
- InitText (private)
+ Recompute (private)
+
+	Everything that depends on the fonts is derived here:  the cell size,
+	the grid dimensions, the rain layers, the spinning characters, and
+	the alignment of the current page.  Arrays and bitmaps are only
+	reallocated if their size changes.  The caller must hold m_StateLock
+	or own the only thread.
+
+	The render thread uses the same DCs, so objects are selected with
+	::SelectObject() and the previous handles are stored.  The CGdiObject
+	that CDC::SelectObject() returns is a temporary that belongs to the
+	calling thread's handle map.
 
  *******************************************************************************/
 
 void
-JMatrixCtrl::InitText()
+JMatrixCtrl::Recompute()
 {
-	if (m_LineList.GetSize() == 0)
+	const LONGLONG start = GetTime();
+
+	// the frames and the spin DC share the text font
+
+	for (int i=0; i<kFrameCount; i++)
 		{
-		return;
+		Frame& f = m_Frame[i];
+		if (f.hFontOld != NULL)
+			{
+			::SelectObject(f.dc.m_hDC, f.hFontOld);
+			}
+		}
+	if (m_hSpinFontOld != NULL)
+		{
+		::SelectObject(m_SpinDC.m_hDC, m_hSpinFontOld);
+		}
+	if (m_hTextFontOld != NULL)
+		{
+		::SelectObject(m_TextDC.m_hDC, m_hTextFontOld);
 		}
 
-	m_nPageStartLine = m_nPageEndLine + 2;		// skip page break
-	if (m_nPageStartLine >= m_LineList.GetSize())
+	m_Font.DeleteObject();
+	m_Font.CreateFontIndirect(&m_TextFontInfo);
+
+	for (int j=0; j<kFrameCount; j++)
 		{
-		m_nPageStartLine = 0;
+		Frame& f   = m_Frame[j];
+		f.hFontOld = ::SelectObject(f.dc.m_hDC, m_Font.m_hObject);
 		}
-	m_nActiveLine = m_nPageEndLine = m_nPageStartLine;
+	m_hSpinFontOld = ::SelectObject(m_SpinDC.m_hDC, m_Font.m_hObject);
+	m_hTextFontOld = ::SelectObject(m_TextDC.m_hDC, m_Font.m_hObject);
 
-	while (1)
+	TEXTMETRIC tm;
+	m_SpinDC.GetTextMetrics(&tm);
+
+	m_nCharAdvance = GetMaxAdvance(m_SpinDC, 0, 255);
+	m_nTextWidth   = m_nCharAdvance + m_Config.nColSpacing;
+	m_nTextHeight  = tm.tmHeight;
+	m_nCols        = m_nWidth/m_nTextWidth  + 1;
+	m_nRows        = m_nHeight/m_nTextHeight + 1;
+	m_TextDx.RemoveAll();
+
+	for (int k=0; k<m_nRainLayerCount; k++)
 		{
-		const CString& line = m_LineList.ElementAt(m_nPageEndLine);
-		if (!line.IsEmpty() && line[0] == kPageBreak)
-			{
-			CString s = line;
-			s.Delete(0, 1);
-			s.TrimLeft();
-			m_nPauseInterval = atoi(s);
-			m_nPageEndLine--;
-			break;
-			}
-		else if (m_nPageEndLine == m_LineList.GetSize()-1)
-			{
-			m_nPauseInterval = m_RestartInterval;
-			break;
-			}
+		SetRainLayerFont(k);
+		}
+
+	// the spinning characters start over
+
+	m_SpinDC.FillSolidRect(0,0, m_nWidth,m_nHeight, RGB(0,0,0));
+	m_SpinBatch.SetGrid(m_SpinDC, m_nRows, m_nCols, m_nTextWidth, m_nTextHeight);
+
+	if (m_pSpinEnd != NULL && m_SpinWheel.GetItemCount() == m_nRows * m_nCols)
+		{
+		memset(m_pSpinEnd, 0, m_nRows * m_nCols * sizeof(int));
+		memset(m_pSpinChar, 0, m_nRows * m_nCols);
+		m_SpinWheel.Reset(m_nSpinTick);
+		}
+	else
+		{
+		delete [] m_pSpinEnd;
+		m_pSpinEnd = NULL;
 
-		m_nPageEndLine++;
+		delete [] m_pTextMask;
+		m_pTextMask = new BYTE [ m_nRows * m_nCols ];
 		}
+	m_nActiveSpins = 0;
+	AllocateSpinChars();
 
-	const int lineCount = m_nPageEndLine - m_nPageStartLine + 1;
-	const int topLine   = (m_nRows-1 - lineCount)/2;
+	// the ticker keeps its lines, but they move
 
-	CRect r;
-	GetClientRect(&r);
+	AllocateTicker();
 
-	m_LineStartList.RemoveAll();
-	for (int i=0; i<lineCount; i++)
+	// the current page keeps its lines, but they move; the next page was
+	// laid out with the old metrics
+
+	AlignPageLayout(m_pPage);		// even if the first line has not started
+	if (m_nActiveLine >= 0)
 		{
-		const CString& line = m_LineList.ElementAt(m_nPageStartLine + i);
-		const CSize size    = m_DC.GetTextExtent(line, line.GetLength());
+		m_CursorPt.x = min(m_CursorPt.x, m_nCols);		// a wider font has fewer columns
+		m_CursorPt.y = m_pPage->lineStart.ElementAt(m_nActiveLine).y;
 
-		CPoint pt;
-		pt.x = ((r.Width() - size.cx)/2)/m_nTextWidth;
-		pt.y = topLine + i;
-		m_LineStartList.Add(pt);
+		if (m_nLineReveal == JMatrixScript::kRainReveal)
+			{
+			BuildRevealOrder(m_PhaseList.GetSize());
+			}
 		}
 
-	m_ActiveLine.Empty();
-	m_PhaseList.RemoveAll();
-	KillTimer(kInitTextID);
-	KillTimer(kUpdateSpinID);
-	SetTimer(kUpdateTextID, kAnimateTextInterval, NULL);
+	RedrawTextPlane();
+	MarkAllChanged();
+
+	m_nLayoutSerial++;
+	m_LayoutEvent.SetEvent();
+
+	m_Stats.nRecomputeTime = (int) (GetTime() - start);
 }
 
 /*******************************************************************************
- UpdateText (private)
+ CreateRainLayer (private)
 
  *******************************************************************************/
 
 void
-JMatrixCtrl::UpdateText()
+JMatrixCtrl::CreateRainLayer
+	(
+	CDC&		dc,
+	const int	index
+	)
 {
-	if (m_bShowCursor && m_CursorChar != kBlockCursorChar)
+	RainLayer& layer = m_RainLayer[ index ];
+
+	layer.dc.CreateCompatibleDC(&dc);
+	if (!m_Config.bIndexedRain || !CreateIndexedBitmap(dc, &(layer.bitmap)))
+		{
+		layer.bitmap.CreateCompatibleBitmap(&dc, m_nWidth, m_nHeight);
+		}
+	layer.hBitmapOld = ::SelectObject(layer.dc.m_hDC, layer.bitmap.m_hObject);
+
+	layer.nActiveColumns = 0;
+	layer.nColumnLimit   = 0;
+	layer.nSlowdown      = 1;
+}
+
+/*******************************************************************************
+ SetRainLayerFont (private)
+
+	Creates the font from m_RainFontInfo and rebuilds the grid.  The
+	bitmap is reused, because its size does not depend on the font.  All
+	the drops are discarded.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::SetRainLayerFont
+	(
+	const int index
+	)
+{
+	RainLayer& layer = m_RainLayer[ index ];
+
+	if (layer.hFontOld != NULL)
+		{
+		::SelectObject(layer.dc.m_hDC, layer.hFontOld);
+		}
+	layer.font.DeleteObject();
+
+	LOGFONT info  = m_RainFontInfo;
+	info.lfHeight = m_Config.rainLayer[ index ].nFontHeight;
+	layer.font.CreateFontIndirect(&info);
+	layer.hFontOld = ::SelectObject(layer.dc.m_hDC, layer.font.m_hObject);
+
+	TEXTMETRIC tm;
+	layer.dc.GetTextMetrics(&tm);
+
+	const int oldCells = layer.nRows * layer.nCols;
+	const int oldCols  = layer.nCols;
+	layer.nTextWidth  = GetMaxAdvance(layer.dc, kMinBackChar, kMaxBackChar) + m_Config.nColSpacing;
+	layer.nTextHeight = tm.tmHeight;
+	layer.nCols       = m_nWidth/layer.nTextWidth  + 1;
+	layer.nRows       = m_nHeight/layer.nTextHeight + 1;
+
+	layer.dc.FillSolidRect(0,0, m_nWidth,m_nHeight, RGB(0,0,0));
+	layer.batch.SetGrid(layer.dc, layer.nRows, layer.nCols, layer.nTextWidth, layer.nTextHeight);
+	layer.headBatch.SetGrid(layer.dc, layer.nRows, layer.nCols, layer.nTextWidth, layer.nTextHeight);
+
+	if (layer.nCols != oldCols)
+		{
+		delete [] layer.pColumns;
+		delete [] layer.pPosition;
+		delete [] layer.pTime;
+		delete [] layer.pVelocity;
+		delete [] layer.pActive;
+		delete [] layer.pActiveIndex;
+
+		layer.pColumns     = new MatrixColumn[ layer.nCols ];
+		layer.pPosition    = new int[ layer.nCols ];
+		layer.pTime        = new int[ layer.nCols ];
+		layer.pVelocity    = new int[ layer.nCols ];
+		layer.pActive      = new int[ layer.nCols ];
+		layer.pActiveIndex = new int[ layer.nCols ];
+
+		layer.wheel.SetSize(layer.nCols, kRainWheelSize);
+		}
+	layer.wheel.Reset(layer.nClock);
+
+	if (layer.nRows * layer.nCols != oldCells || layer.pMask == NULL)
+		{
+		delete [] layer.pMask;
+		layer.pMask = new BYTE[ layer.nRows * layer.nCols ];
+
+		delete [] layer.pCells;
+		layer.pCells = new WORD[ layer.nRows * layer.nCols ];
+		}
+	memset(layer.pMask, 0, layer.nRows * layer.nCols);	// RedrawTextPlane() fills it
+	memset(layer.pCells, 0, layer.nRows * layer.nCols * sizeof(WORD));
+
+	for (int i=0; i<layer.nCols; i++)
+		{
+		layer.pColumns[i].bActive  = FALSE;
+		layer.pColumns[i].nCounter = 0;
+		layer.pPosition[i]         = 0;
+		layer.pTime[i]             = layer.nClock;
+		layer.pVelocity[i]         = 0;
+		}
+
+	layer.nActiveColumns = 0;
+}
+
+/*******************************************************************************
+ CreateIndexedBitmap (private)
+
+	Creates an 8 bit DIB section whose color table maps each index to the
+	same level of green.  The rain only uses pure greens, so GDI always
+	finds an exact match when drawing into it.
+
+ *******************************************************************************/
+
+BOOL
+JMatrixCtrl::CreateIndexedBitmap
+	(
+	CDC&		dc,
+	CBitmap*	bitmap
+	)
+{
+	struct
+		{
+		BITMAPINFOHEADER	header;
+		RGBQUAD				colors[256];
+		}
+		info;
+
+	memset(&info, 0, sizeof(info));
+	info.header.biSize        = sizeof(BITMAPINFOHEADER);
+	info.header.biWidth       = m_nWidth;
+	info.header.biHeight      = -m_nHeight;		// top-down
+	info.header.biPlanes      = 1;
+	info.header.biBitCount    = 8;
+	info.header.biCompression = BI_RGB;
+	info.header.biClrUsed     = 256;
+
+	for (int i=0; i<256; i++)
+		{
+		info.colors[i].rgbGreen = (BYTE) i;
+		}
+
+	void* bits;
+	HBITMAP h = CreateDIBSection(dc.m_hDC, (BITMAPINFO*) &info, DIB_RGB_COLORS, &bits, NULL, 0);
+	return (h != NULL && bitmap->Attach(h));
+}
+
+/*******************************************************************************
+ CreateRGBBitmap (private)
+
+	Creates a 32 bit top-down DIB section, so the CPU can post-process the
+	frame.  Each row is m_nWidth * 4 bytes.
+
+ *******************************************************************************/
+
+BOOL
+JMatrixCtrl::CreateRGBBitmap
+	(
+	CDC&		dc,
+	CBitmap*	bitmap,
+	BYTE**		bits
+	)
+{
+	BITMAPINFO info;
+	memset(&info, 0, sizeof(info));
+	info.bmiHeader.biSize        = sizeof(BITMAPINFOHEADER);
+	info.bmiHeader.biWidth       = m_nWidth;
+	info.bmiHeader.biHeight      = -m_nHeight;		// top-down
+	info.bmiHeader.biPlanes      = 1;
+	info.bmiHeader.biBitCount    = 32;
+	info.bmiHeader.biCompression = BI_RGB;
+
+	void* p;
+	HBITMAP h = CreateDIBSection(dc.m_hDC, &info, DIB_RGB_COLORS, &p, NULL, 0);
+	if (h == NULL || !bitmap->Attach(h))
+		{
+		return FALSE;
+		}
+
+	*bits = (BYTE*) p;
+	return TRUE;
+}
+
+/*******************************************************************************
+ ScheduleRainLayer (private)
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::ScheduleRainLayer
+	(
+	const int index
+	)
+{
+	const int interval = max(1, m_nBkgdInterval * m_Config.rainLayer[ index ].nIntervalScale / 100 *
+								m_RainLayer[ index ].nSlowdown);
+
+	StartTimer(kUpdateBackgroundID + index, interval);
+	m_Stats.nLayerInterval[ index ] = interval;
+}
+
+/*******************************************************************************
+ SetCursor
+
+	If the cursor is not solid, it is a randomly changing character.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::SetCursor
+	(
+	const BOOL show,
+	const BOOL solid
+	)
+{
+	PushCommand(kSetCursorCmd, show, solid);
+}
+
+/*******************************************************************************
+ SetMaxPhaseCount
+
+	The larger the max phase count, the longer it may take for the text
+	to settle down.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::SetMaxPhaseCount
+	(
+	const int maxCount
+	)
+{
+	PushCommand(kSetMaxPhaseCountCmd, maxCount, 0);
+}
+
+/*******************************************************************************
+ AllowEuropeanChars
+
+	The disadvantage of allowing European characters is that it takes longer
+	for the text to phase in.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::AllowEuropeanChars
+	(
+	const BOOL allow
+	)
+{
+	PushCommand(kAllowEuropeanCharsCmd, allow, 0);
+}
+
+/*******************************************************************************
+ PushCommand (private)
+
+	Never blocks unless the queue is full, and never allocates memory.
+	Text longer than JCommandQueue::kMaxTextLength is split across
+	consecutive slots, and ApplyCommand() joins the pieces again.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::PushCommand
+	(
+	const int	type,
+	const int	value1,
+	const int	value2,
+	LPCTSTR		text
+	)
+{
+	const int perSlot = JCommandQueue::kMaxTextLength;
+	const int length  = (text != NULL ? lstrlen(text) : 0);
+	const int count   = max(1, (length + perSlot - 1) / perSlot);
+	const LONG first  = m_Commands.Reserve(count);
+
+	for (int i=0; i<count; i++)
+		{
+		const LONG ticket = first + i;
+		if (!m_Commands.IsFree(ticket))
+			{
+			InterlockedIncrement(&m_nCommandStalls);
+			WaitForCommandSlot(ticket);
+			}
+
+		const int chunk = min(length - i * perSlot, perSlot);
+
+		JCommandQueue::Command& cmd = m_Commands.GetSlot(ticket);
+		cmd.nType                   = type;
+		cmd.nValue1                 = value1;
+		cmd.nValue2                 = value2;
+		cmd.bContinued              = (i < count-1);
+		if (chunk > 0)
+			{
+			memcpy(cmd.text, text + i * perSlot, chunk * sizeof(TCHAR));
+			}
+		cmd.text[ chunk ] = '\0';
+
+		m_Commands.Publish(ticket);
+		}
+}
+
+/*******************************************************************************
+ WaitForCommandSlot (private)
+
+	The queue is full, so the slot for the ticket is still in use.  The
+	thread that runs Tick() is woken, and the caller waits until it has
+	made room, without touching m_StateLock.  If no other thread drains
+	the queue, i.e., before Create() or on the UI thread when there is no
+	render thread, the caller drains it itself, so nothing is lost and
+	nothing is reordered.
+
+	Even after a drain, another producer may still be filling an earlier
+	slot, so the loop must check again.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::WaitForCommandSlot
+	(
+	const LONG ticket
+	)
+{
+	while (!m_Commands.IsFree(ticket))
+		{
+		const HWND window = m_hWnd;
+		if (m_pRenderThread != NULL)
+			{
+			m_WakeEvent.SetEvent();
+			}
+		else if (window == NULL ||
+				 GetWindowThreadProcessId(window, NULL) == GetCurrentThreadId())
+			{
+			CSingleLock lock(&m_StateLock, TRUE);
+			DrainCommands();
+			continue;
+			}
+		else
+			{
+			::PostMessage(window, WM_TIMER, kTickTimerID, 0);
+			}
+
+		WaitForSingleObject(m_CommandEvent, kCommandWait);
+		}
+}
+
+/*******************************************************************************
+ DrainCommands (private)
+
+	The caller must hold m_StateLock or own the only thread.  Producers
+	waiting for room are released afterwards.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::DrainCommands()
+{
+	const JCommandQueue::Command* cmd;
+	int count = 0;
+	while ((cmd = m_Commands.GetFront()) != NULL)
+		{
+		ApplyCommand(*cmd);
+		m_Commands.PopFront();
+		count++;
+		}
+
+	if (count > 0)
+		{
+		m_Stats.nCommandCount += count;
+		m_CommandEvent.SetEvent();
+		}
+	m_Stats.nCommandStalls = m_nCommandStalls;
+}
+
+/*******************************************************************************
+ ApplyCommand (private)
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::ApplyCommand
+	(
+	const JCommandQueue::Command& cmd
+	)
+{
+	if (cmd.bContinued)
+		{
+		m_PendingText += cmd.text;		// the rest is in the next slots
+		return;
+		}
+
+	if (cmd.nType == kAddTextLineCmd)
+		{
+		const LONGLONG start = GetTime();
+		if (m_PendingText.IsEmpty())
+			{
+			m_Script.AddLine(cmd.text);
+			}
+		else
+			{
+			m_PendingText += cmd.text;
+			m_Script.AddLine(m_PendingText);
+			m_PendingText.Empty();
+			}
+		m_Stats.nScriptCompileTime += (int) (GetTime() - start);
+
+		m_nNextPageOffset = m_Script.GetLength();	// force InitText() to start at beginning
+		m_nLayoutSerial++;
+
+		m_LayoutEvent.SetEvent();
+		}
+	else if (cmd.nType == kClearTextCmd)
+		{
+		m_Script.RemoveAll();
+		m_nNextPageOffset = 0;
+		m_nLayoutSerial++;
+		}
+	else if (cmd.nType == kSetIntervalsCmd)
+		{
+		m_IntroInterval   = cmd.nValue1;
+		m_RestartInterval = cmd.nValue2;
+		}
+	else if (cmd.nType == kSetCursorCmd)
+		{
+		m_bShowCursor = cmd.nValue1;
+		m_CursorChar  = (cmd.nValue2 ? kBlockCursorChar : 'a');
+		UpdateTextPreset();
+		}
+	else if (cmd.nType == kSetMaxPhaseCountCmd)
+		{
+		m_nMaxPhaseCount = cmd.nValue1;
+		}
+	else if (cmd.nType == kAllowEuropeanCharsCmd)
+		{
+		m_bEuropeanChars = cmd.nValue1;
+		UpdateTextPreset();
+		}
+}
+
+/*******************************************************************************
+ UpdateTextPreset (private)
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::UpdateTextPreset()
+{
+	if (m_nLineCursor == JMatrixScript::kNoCursor ||
+		m_nLineReveal != JMatrixScript::kTypeReveal)
+		{
+		m_nTextPreset = kNoCursor;
+		}
+	else if (m_nLineCursor == JMatrixScript::kBlockCursor)
+		{
+		m_nTextPreset = kBlockCursor;
+		}
+	else if (m_nLineCursor == JMatrixScript::kRandomCursor)
+		{
+		m_nTextPreset = kRandomCursor;
+		}
+	else
+		{
+		m_nTextPreset = (!m_bShowCursor                    ? kNoCursor    :
+						 m_CursorChar == kBlockCursorChar ? kBlockCursor :
+						 kRandomCursor);
+		}
+}
+
+/*******************************************************************************
+ SetConfig
+
+	The column spacing, the render thread, the number of rain layers,
+	their font sizes, and the indexed rain buffers only take effect when
+	the control is created.  After that, their values are kept.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::SetConfig
+	(
+	const Config& config
+	)
+{
+	CSingleLock lock(&m_StateLock, TRUE);
+
+	const BOOL spinsChanged = (config.fSpinCharFraction != m_Config.fSpinCharFraction);
+
+	const Config old = m_Config;
+
+	m_Config = config;
+	if (m_nRainLayerCount == 0)
+		{
+		return;
+		}
+
+	m_Config.nColSpacing     = old.nColSpacing;
+	m_Config.bRenderThread   = old.bRenderThread;
+	m_Config.nRainLayerCount = old.nRainLayerCount;
+	m_Config.bIndexedRain    = old.bIndexedRain;
+	for (int i=0; i<kMaxRainLayers; i++)
+		{
+		m_Config.rainLayer[i].nFontHeight = old.rainLayer[i].nFontHeight;
+		}
+
+	UpdateBatchColors();
+	MarkAllChanged();
+	UpdateGlowParameters();
+
+	if (spinsChanged)
+		{
+		AllocateSpinChars();
+		}
+
+	// force all timers to pick up the new intervals
+
+	m_nBkgdInterval = m_nTextInterval = m_nRainInterval = 0;
+	ApplyQualityLevel(m_Stats.nQualityLevel);
+
+	if (m_nTextPreset != kNoCursor && m_nActiveLine >= 0 && !CursorFinished())
+		{
+		StartTimer(kUpdateCursorID, m_Config.nMoveCursorInterval);
+		}
+
+	// InitText() picks up the new mode, so if the text is running, stop
+	// it as if the page had ended
+
+	if ((m_Config.nTickerRate > 0) != m_bTicker && m_Timer[ kInitTextID ].nInterval == 0)
+		{
+		StopTimer(kUpdateCursorID);
+		StopTimer(kNextLineID);
+		m_nActiveLine  = -1;
+		m_nRevealRow   = -1;
+		m_nTickerCount = 0;
+		ClearTextPlane();
+		m_nLayoutSerial++;			// the ticker moved m_nNextPageOffset
+
+		StopTimer(kUpdateTextID);
+		StartTimer(kUpdateSpinID, m_nTextInterval);
+		m_nTextTimerID = kUpdateSpinID;
+		StartTimer(kInitTextID, m_nTextInterval);
+		}
+}
+
+/*******************************************************************************
+ UpdateGlowParameters (private)
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::UpdateGlowParameters()
+{
+	m_Glow.SetParameters(m_Config.nGlowRadius, m_Config.nGlowStrength * 256 / 100,
+						 m_Config.nGlowThreshold);
+}
+
+/*******************************************************************************
+ UpdateBatchColors (private)
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::UpdateBatchColors()
+{
+	for (int i=0; i<m_nRainLayerCount; i++)
+		{
+		JGlyphBatch& batch  = m_RainLayer[i].batch;
+		const int intensity = m_Config.rainLayer[i].nIntensity;
+
+		for (int j=0; j<kFadeLevelCount; j++)
+			{
+			const int green = m_Config.nMinGreen +
+				(j * (m_Config.nMaxGreen - m_Config.nMinGreen)) / (kFadeLevelCount-1);
+			batch.SetLevelColor(j, RGB(0, green * intensity / 100, 0));
+			}
+
+		batch.SetLevelColor(kBrightLevel, RGB(0, m_Config.nBrightGreen * intensity / 100, 0));
+		}
+
+	m_SpinBatch.SetLevelColor(kBrightLevel, RGB(0, m_Config.nBrightGreen, 0));
+}
+
+/*******************************************************************************
+ AllocateSpinChars (private)
+
+	Any cell in the grid can spin.  The per-cell state is only allocated
+	once, so changing fSpinCharFraction only changes the limit.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::AllocateSpinChars()
+{
+	const int cellCount = m_nRows * m_nCols;
+	if (m_pSpinEnd == NULL)
+		{
+		m_pSpinEnd = new int[ cellCount ];
+		memset(m_pSpinEnd, 0, cellCount * sizeof(int));
+
+		delete [] m_pSpinChar;
+		m_pSpinChar = new BYTE[ cellCount ];
+		memset(m_pSpinChar, 0, cellCount);
+
+		m_SpinWheel.SetSize(cellCount, kSpinWheelSize);
+		m_SpinWheel.Reset(m_nSpinTick);
+		}
+
+	m_nTotalSpins = min((int) (m_nCols * m_Config.fSpinCharFraction), cellCount);
+	m_nSpinLimit  = m_nTotalSpins * kQualityLevel[ m_Stats.nQualityLevel ].spinFraction / 100;
+}
+
+/*******************************************************************************
+ SetFrameBudget
+
+	Zero disables the quality governor and restores full quality.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::SetFrameBudget
+	(
+	const int msec
+	)
+{
+	CSingleLock lock(&m_StateLock, TRUE);
+
+	m_Stats.nFrameBudget = msec * 1000;
+	m_nHeadroomCount     = 0;
+
+	if (msec <= 0 && m_Stats.nQualityLevel > 0 && m_nRainLayerCount > 0)
+		{
+		ApplyQualityLevel(0);
+		}
+}
+
+/*******************************************************************************
+ Message map
+
+ *******************************************************************************/
+
+BEGIN_MESSAGE_MAP(JMatrixCtrl, CWnd)
+	//{{AFX_MSG_MAP(JMatrixCtrl)
+	ON_WM_PAINT()
+	ON_WM_TIMER()
+	ON_WM_DESTROY()
+	//}}AFX_MSG_MAP
+END_MESSAGE_MAP()
+
+/*******************************************************************************
+ OnPaint
+
+	Presents the most recently completed frame.  This never waits for the
+	render thread.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::OnPaint()
+{
+	CPaintDC dc(this);
+	m_bPainted = TRUE;
+
+	CDC* frame = AcquirePresentFrame();
+	if (frame != NULL)
+		{
+		dc.BitBlt(0, 0, m_nWidth, m_nHeight, frame, 0, 0, SRCCOPY);
+		}
+}
+
+/*******************************************************************************
+ AcquirePresentFrame (private)
+
+	Takes the most recently completed frame, if it has not already been
+	taken.  Only the UI thread calls this, so the control and all the
+	viewports can share the frame without locking.
+
+ *******************************************************************************/
+
+CDC*
+JMatrixCtrl::AcquirePresentFrame()
+{
+	if (m_Frame[0].hBitmapOld == NULL)
+		{
+		return NULL;
+		}
+
+	if (m_nReadyFrame & kFreshFrame)
+		{
+		m_nPresentFrame = InterlockedExchange(&m_nReadyFrame, m_nPresentFrame) & kFrameIndexMask;
+
+		const int latency = (int) (GetTime() - m_Frame[ m_nPresentFrame ].completedTime);
+		m_Stats.nPresentedFrames++;
+		m_Stats.nPresentLatency += (latency - m_Stats.nPresentLatency) / 8;
+		}
+
+	return &(m_Frame[ m_nPresentFrame ].dc);
+}
+
+/*******************************************************************************
+ AddViewport
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::AddViewport
+	(
+	JMatrixViewport* viewport
+	)
+{
+	CSingleLock lock(&m_StateLock, TRUE);
+	m_ViewportList.Add(viewport);
+}
+
+/*******************************************************************************
+ RemoveViewport
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::RemoveViewport
+	(
+	JMatrixViewport* viewport
+	)
+{
+	CSingleLock lock(&m_StateLock, TRUE);
+
+	const int count = m_ViewportList.GetSize();
+	for (int i=0; i<count; i++)
+		{
+		if (m_ViewportList[i] == viewport)
+			{
+			m_ViewportList.RemoveAt(i);
+			break;
+			}
+		}
+}
+
+/*******************************************************************************
+ DrawViewport
+
+	Copies the given part of the virtual grid.  Areas outside the grid
+	are black.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::DrawViewport
+	(
+	CDC&			dc,
+	const CRect&	source
+	)
+{
+	CDC* frame = AcquirePresentFrame();
+	if (frame == NULL)
+		{
+		dc.FillSolidRect(0, 0, source.Width(), source.Height(), RGB(0,0,0));
+		return;
+		}
+
+	CRect r;
+	r.IntersectRect(source, CRect(0, 0, m_nWidth, m_nHeight));
+	if (r != source)
+		{
+		dc.FillSolidRect(0, 0, source.Width(), source.Height(), RGB(0,0,0));
+		}
+
+	if (!r.IsRectEmpty())
+		{
+		dc.BitBlt(r.left - source.left, r.top - source.top, r.Width(), r.Height(),
+				  frame, r.left, r.top, SRCCOPY);
+		}
+}
+
+/*******************************************************************************
+ PlaySignal
+
+	Returns FALSE if the file is not a PCM WAV file.  Call this and
+	StopSignal() from the thread that created the control.
+
+ *******************************************************************************/
+
+BOOL
+JMatrixCtrl::PlaySignal
+	(
+	LPCTSTR wavFileName
+	)
+{
+	return m_Signal.PlayFile(wavFileName);
+}
+
+/*******************************************************************************
+ PushMetric
+
+	level is between 0 and 1000.  This can be called from any thread,
+	and it never blocks.  It is ignored while a file is playing.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::PushMetric
+	(
+	const int level
+	)
+{
+	m_Signal.PushMetric(level);
+}
+
+/*******************************************************************************
+ StopSignal
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::StopSignal()
+{
+	m_Signal.Stop();
+}
+
+/*******************************************************************************
+ RedrawRainLayer (private)
+
+	Rebuilds the layer's bitmap from its grid of cells.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::RedrawRainLayer
+	(
+	RainLayer& layer
+	)
+{
+	layer.dc.FillSolidRect(0,0, m_nWidth,m_nHeight, RGB(0,0,0));
+	MarkAllChanged();
+
+	for (int row=0; row<layer.nRows; row++)
+		{
+		const WORD* cell = layer.pCells + row * layer.nCols;
+		for (int col=0; col<layer.nCols; col++)
+			{
+			if (cell[col] != 0)
+				{
+				layer.batch.Add(row, col, (char) (cell[col] & 0xFF), cell[col] >> 8);
+				}
+			}
+		}
+
+	m_nFrameDrawCalls += layer.batch.Flush(layer.dc);
+}
+
+/*******************************************************************************
+ RedrawSpin (private)
+
+	Rebuilds m_SpinDC from m_pSpinChar.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::RedrawSpin()
+{
+	m_SpinDC.FillSolidRect(0,0, m_nWidth,m_nHeight, RGB(0,0,0));
+	MarkAllChanged();
+
+	for (int row=0; row<m_nRows; row++)
+		{
+		const BYTE* ch = m_pSpinChar + row * m_nCols;
+		for (int col=0; col<m_nCols; col++)
+			{
+			if (ch[col] != 0)
+				{
+				m_SpinBatch.Add(row, col, (char) ch[col], kBrightLevel);
+				}
+			}
+		}
+
+	m_nFrameDrawCalls += m_SpinBatch.Flush(m_SpinDC);
+}
+
+/*******************************************************************************
+ ShareFrames
+
+	Returns FALSE if the control does not exist yet, or if another process
+	is already sharing frames under the given name.
+
+ *******************************************************************************/
+
+BOOL
+JMatrixCtrl::ShareFrames
+	(
+	LPCTSTR name
+	)
+{
+	CSingleLock lock(&m_StateLock, TRUE);
+
+	if (m_nRainLayerCount == 0)
+		{
+		return FALSE;
+		}
+
+	return m_FrameShare.Create(name, m_nWidth, m_nHeight);
+}
+
+/*******************************************************************************
+ StopSharingFrames
+
+	Consumers keep displaying the last frame that was published.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::StopSharingFrames()
+{
+	CSingleLock lock(&m_StateLock, TRUE);
+	m_FrameShare.Close();
+}
+
+/*******************************************************************************
+ UseManualClock
+
+	Call this before Create().  The control then neither starts the
+	render thread nor sets the tick timer, so nothing moves until Step()
+	is called, and two controls with the same seed, size, and settings
+	draw the same frames.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::UseManualClock
+	(
+	const DWORD seed
+	)
+{
+	ASSERT( m_nRainLayerCount == 0 );
+
+	m_nRandomState = seed | 1;		// xorshift never leaves 0
+	m_ManualTime   = 1000000;		// 0 would look like no suspension
+}
+
+/*******************************************************************************
+ Step
+
+	Advances the manual clock by msec, one millisecond at a time, and
+	runs each tick, so every timer fires exactly when it is due.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::Step
+	(
+	const int msec
+	)
+{
+	ASSERT( m_ManualTime >= 0 );
+
+	CSingleLock lock(&m_StateLock, TRUE);
+	for (int i=0; i<msec; i++)
+		{
+		m_ManualTime += 1000;
+		Tick();
+		}
+}
+
+/*******************************************************************************
+ OnTimer
+
+	Only used when there is no render thread.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::OnTimer
+	(
+	UINT nEventID
+	)
+{
+	if (nEventID == kTickTimerID)
+		{
+		CSingleLock lock(&m_StateLock, TRUE);
+		Tick();
+		}
+	else if (nEventID == kVisibilityTimerID)
+		{
+		UpdateVisibility();
+		}
+
+	CWnd::OnTimer(nEventID);
+}
+
+/*******************************************************************************
+ OnDestroy
+
+	The render thread must stop before the window disappears.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::OnDestroy()
+{
+	StopRenderThread();
+	StopLayoutThread();
+	KillTimer(kTickTimerID);
+	KillTimer(kVisibilityTimerID);
+	m_FrameShare.Close();
+	m_Signal.Stop();
+	CWnd::OnDestroy();
+}
+
+/*******************************************************************************
+ StartTimer (private)
+
+	Replaces SetTimer(), so the same code can run on the render thread.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::StartTimer
+	(
+	const int id,
+	const int msec
+	)
+{
+	m_Timer[id].nInterval = msec;
+	m_Timer[id].due       = GetTime() + msec * (LONGLONG) 1000;
+	m_WakeEvent.SetEvent();
+}
+
+/*******************************************************************************
+ StopTimer (private)
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::StopTimer
+	(
+	const int id
+	)
+{
+	m_Timer[id].nInterval = 0;
+}
+
+/*******************************************************************************
+ StartPause (private)
+
+	Starts kInitTextID.  A zero interval would stop the timer, and with
+	it the text, so a pause of zero seconds continues on the next tick
+	instead.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::StartPause
+	(
+	const int seconds
+	)
+{
+	StartTimer(kInitTextID, max(1, min(seconds, kMaxPauseInterval) * 1000));
+}
+
+/*******************************************************************************
+ Tick (private)
+
+	Runs every timer that is due and then draws a single frame.  The caller
+	must hold m_StateLock.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::Tick()
+{
+	DrainCommands();
+
+	const LONGLONG start = GetTime();
+
+	if (m_bSuspended)
+		{
+		if (m_SuspendTime == 0)
+			{
+			m_SuspendTime = start;
+			m_Stats.nSuspendCount++;
+			}
+		return;
+		}
+	else if (m_SuspendTime != 0)
+		{
+		const LONGLONG usec = start - m_SuspendTime;
+		m_Stats.nSuspendedTime += (int) (usec / 1000);
+		m_SuspendTime = 0;
+		FastForward(usec);
+		}
+
+	UpdateSignal();
+
+	// the text changes on almost every tick, so it waits for the next rain
+	// frame instead of redrawing the tiles around the heads each time
+
+	const BOOL rainFrames = (m_Timer[ kAnimateRainID ].nInterval > 0);
+
+	BOOL changed = FALSE, textChanged = FALSE;
+	for (int id=0; id<kTimerCount; id++)
+		{
+		Timer& t = m_Timer[id];
+		if (t.nInterval <= 0 || t.due > start)
+			{
+			continue;
+			}
+
+		// like WM_TIMER, skip the ticks that were missed
+
+		const LONGLONG late = start - t.due;
+		t.due += t.nInterval * (LONGLONG) 1000;
+		if (t.due <= start)
+			{
+			t.due = start + t.nInterval * (LONGLONG) 1000;
+			}
+
+		if (id == kInitTextID)
+			{
+			InitText();
+			}
+		else if (id == kNextLineID)
+			{
+			ActivateLine();
+			textChanged = TRUE;
+			}
+		else if (id == kUpdateTextID)
+			{
+			UpdateSpin();
+			UpdateText();
+			textChanged = TRUE;
+			}
+		else if (id == kUpdateCursorID)
+			{
+			UpdateCursor();
+			textChanged = TRUE;
+			}
+		else if (id == kUpdateSpinID)		// runs when kUpdateTextID is not active
+			{
+			UpdateSpin();
+			textChanged = TRUE;
+			}
+		else if (id == kAnimateRainID)
+			{
+			// lateness is the best indicator that other processes need the CPU
+
+			m_Stats.nTimerLatency += ((int) late - m_Stats.nTimerLatency) / 8;
+
+			// advance by whole milliseconds and carry the remainder
+
+			const int msec = (int) min((start - m_RainTime) / 1000, (LONGLONG) kMaxRainStep);
+			m_RainTime     = max(m_RainTime + msec * (LONGLONG) 1000, start - 1000);
+
+			m_Stats.nRainEvents = 0;
+			for (int i=0; i<m_nRainLayerCount; i++)
+				{
+				const LONGLONG layerStart = GetTime();
+				AdvanceRain(m_RainLayer[i], msec);
+
+				int& cost = m_Stats.nLayerCost[i];
+				cost     += ((int) (GetTime() - layerStart) - cost) / 8;
+				}
+
+			changed = TRUE;
+			}
+		else if (id >= kUpdateBackgroundID)
+			{
+			ActivateColumns(m_RainLayer[ id - kUpdateBackgroundID ]);
+			}
+		}
+
+	if (changed || (textChanged && !rainFrames))
+		{
+		Draw();
+		UpdateGovernor(start, GetTime());
+		}
+}
+
+/*******************************************************************************
+ GetTime (private)
+
+	Returns the time in microseconds.  This is the manual clock if
+	UseManualClock() was called.
+
+ *******************************************************************************/
+
+LONGLONG
+JMatrixCtrl::GetTime()
+	const
+{
+	return (m_ManualTime >= 0 ? m_ManualTime : GetMicroseconds());
+}
+
+/*******************************************************************************
+ UpdateVisibility (private)
+
+	Called on the UI thread.  When the control has viewports, the control
+	itself is usually hidden, so only the viewports matter.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::UpdateVisibility()
+{
+	BOOL visible = !m_Config.bSuspendWhenHidden;
+	if (!visible)
+		{
+		CSingleLock lock(&m_StateLock, TRUE);
+
+		const int count = m_ViewportList.GetSize();
+		if (count == 0)
+			{
+			visible = IsOnScreen(this, m_bPainted);
+			}
+
+		for (int i=0; i<count; i++)		// clear every flag
+			{
+			JMatrixViewport* viewport = m_ViewportList[i];
+			visible = IsOnScreen(viewport, viewport->WasPainted()) || visible;
+			}
+
+		if (!visible && m_FrameShare.IsOpen())
+			{
+			visible = m_FrameShare.IsWatched();
+			}
+		}
+
+	m_bPainted = FALSE;
+
+	const BOOL wasSuspended = InterlockedExchange(&m_bSuspended, !visible);
+	if (wasSuspended && visible)
+		{
+		if (m_pRenderThread != NULL)
+			{
+			m_WakeEvent.SetEvent();
+			}
+		else
+			{
+			SetTimer(kTickTimerID, kSyncTickInterval, NULL);
+			}
+		}
+	else if (!wasSuspended && !visible && m_pRenderThread == NULL)
+		{
+		KillTimer(kTickTimerID);
+		CSingleLock lock(&m_StateLock, TRUE);
+		Tick();			// record the start of the suspension
+		}
+}
+
+/*******************************************************************************
+ IsOnScreen (private)
+
+	WM_PAINT only arrives if part of the window can be seen, and every
+	frame invalidates the window, so a recent paint settles it.
+	Otherwise, the window is invalidated:  the update region is clipped to
+	the part that can be seen, so if it stays empty, the window is
+	covered.  Neither check needs a DC.
+
+ *******************************************************************************/
+
+BOOL
+JMatrixCtrl::IsOnScreen
+	(
+	CWnd*		window,
+	const BOOL	painted
+	)
+	const
+{
+	if (!window->IsWindowVisible() || window->GetTopLevelParent()->IsIconic())
+		{
+		return FALSE;
+		}
+	else if (painted)
+		{
+		return TRUE;
+		}
+
+	window->InvalidateRect(NULL, FALSE);
+	return window->GetUpdateRect(NULL, FALSE);
+}
+
+/*******************************************************************************
+ FastForward (private)
+
+	Catches up after a suspension in closed form instead of replaying the
+	missed ticks.  Each drop moves by velocity * time, spinning
+	characters that expired are stopped, and the columns that would have
+	started are started at random points along their paths.  The timers
+	are shifted, so the text continues where it stopped.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::FastForward
+	(
+	const LONGLONG usec
+	)
+{
+	for (int id=0; id<kTimerCount; id++)
+		{
+		m_Timer[id].due += usec;
+		}
+
+	m_RainTime     += usec;
+	m_GovernorTime += usec;
+
+	const int msec = (int) min(usec / 1000, (LONGLONG) kMaxFastForward);
+
+	for (int i=0; i<m_nRainLayerCount; i++)
+		{
+		RainLayer& layer = m_RainLayer[i];
+		AdvanceRain(layer, msec);
+
+		const int interval = max(1, m_Stats.nLayerInterval[i]);
+		int startCount     = min(msec / interval, layer.nColumnLimit - layer.nActiveColumns);
+		while (startCount-- > 0)
+			{
+			const int col = UpdateBackground(layer);
+			if (col >= 0)
+				{
+				FastForwardColumn(layer, col, getrandom(0, msec));
+				}
+			}
+
+		m_nFrameDrawCalls += layer.batch.Flush(layer.dc);
+		}
+
+	// each cell is visited at most once, however long the suspension
+
+	m_nSpinTick = (int) ((DWORD) m_nSpinTick + msec / max(1, m_nTextInterval));
+	UpdateSpin();
+}
+
+/*******************************************************************************
+ FastForwardColumn (private)
+
+	Moves the head of a column that was just started, as if it had been
+	falling for msec.  The trail is drawn when the head's next row entry
+	comes due.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::FastForwardColumn
+	(
+	RainLayer&	layer,
+	const int	col,
+	const int	msec
+	)
+{
+	const LONGLONG pos = layer.pPosition[col] + (LONGLONG) layer.pVelocity[col] * msec;
+	layer.pPosition[col] = (int) min(pos, ((LONGLONG) layer.pColumns[col].nCounterMax) << kRowShift);
+}
+
+/*******************************************************************************
+ GetTimeToNextTick (private)
+
+	Returns the number of milliseconds until the next timer is due.
+
+ *******************************************************************************/
+
+int
+JMatrixCtrl::GetTimeToNextTick()
+	const
+{
+	const LONGLONG now = GetTime();
+
+	LONGLONG wait = kMaxRenderSleep * 1000;
+	if (m_bSuspended)
+		{
+		return kMaxRenderSleep;		// UpdateVisibility() wakes us
+		}
+
+	for (int id=0; id<kTimerCount; id++)
+		{
+		const Timer& t = m_Timer[id];
+		if (t.nInterval > 0 && t.due - now < wait)
+			{
+			wait = t.due - now;
+			}
+		}
+
+	return (wait > 0 ? (int) ((wait + 999) / 1000) : 0);
+}
+
+/*******************************************************************************
+ StartRenderThread (private)
+
+	Falls back to WM_TIMER if the thread cannot be created.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::StartRenderThread()
+{
+	m_bStopRender   = FALSE;
+	m_pRenderThread = AfxBeginThread(RenderThreadMain, this, THREAD_PRIORITY_NORMAL,
+									 0, CREATE_SUSPENDED);
+	if (m_pRenderThread != NULL)
+		{
+		m_pRenderThread->m_bAutoDelete = FALSE;
+		m_pRenderThread->ResumeThread();
+		}
+	else
+		{
+		SetTimer(kTickTimerID, kSyncTickInterval, NULL);
+		}
+}
+
+/*******************************************************************************
+ StopRenderThread (private)
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::StopRenderThread()
+{
+	if (m_pRenderThread != NULL)
+		{
+		InterlockedExchange(&m_bStopRender, TRUE);
+		m_WakeEvent.SetEvent();
+		WaitForSingleObject(m_pRenderThread->m_hThread, INFINITE);
+
+		delete m_pRenderThread;
+		m_pRenderThread = NULL;
+		}
+}
+
+/*******************************************************************************
+ RenderThreadMain (static private)
+
+ *******************************************************************************/
+
+UINT
+JMatrixCtrl::RenderThreadMain
+	(
+	LPVOID param
+	)
+{
+	JMatrixCtrl* self = (JMatrixCtrl*) param;
+
+	while (!self->m_bStopRender)
+		{
+		int wait;
+			{
+			CSingleLock lock(&(self->m_StateLock), TRUE);
+			self->Tick();
+			wait = self->GetTimeToNextTick();
+			}
+
+		if (wait > 0)
+			{
+			WaitForSingleObject(self->m_WakeEvent, wait);
+			}
+		}
+
+	return 0;
+}
+
+/*******************************************************************************
+ StartLayoutThread (private)
+
+	The layout thread prepares the next page while the current page is
+	displayed, so starting a page only requires swapping two pointers.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::StartLayoutThread()
+{
+	m_bStopLayout   = FALSE;
+	m_pLayoutThread = AfxBeginThread(LayoutThreadMain, this, THREAD_PRIORITY_BELOW_NORMAL,
+									 0, CREATE_SUSPENDED);
+	if (m_pLayoutThread != NULL)
+		{
+		m_pLayoutThread->m_bAutoDelete = FALSE;
+		m_pLayoutThread->ResumeThread();
+		m_LayoutEvent.SetEvent();
+		}
+}
+
+/*******************************************************************************
+ StopLayoutThread (private)
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::StopLayoutThread()
+{
+	if (m_pLayoutThread != NULL)
+		{
+		InterlockedExchange(&m_bStopLayout, TRUE);
+		m_LayoutEvent.SetEvent();
+		WaitForSingleObject(m_pLayoutThread->m_hThread, INFINITE);
+
+		delete m_pLayoutThread;
+		m_pLayoutThread = NULL;
+		}
+}
+
+/*******************************************************************************
+ LayoutThreadMain (static private)
+
+	Rebuilds m_pNextPage whenever m_LayoutEvent is signalled, unless
+	InitText() is busy swapping it.
+
+ *******************************************************************************/
+
+UINT
+JMatrixCtrl::LayoutThreadMain
+	(
+	LPVOID param
+	)
+{
+	JMatrixCtrl* self = (JMatrixCtrl*) param;
+
+	while (1)
+		{
+		WaitForSingleObject(self->m_LayoutEvent, INFINITE);
+		if (self->m_bStopLayout)
+			{
+			break;
+			}
+
+		// if it was already busy, InitText() owns it and will release it
+
+		if (InterlockedExchange(&(self->m_nNextPageState), kPageBusy) != kPageBusy)
+			{
+			self->BuildPageLayout(self->m_pNextPage);
+			InterlockedExchange(&(self->m_nNextPageState), kPageReady);
+			}
+		}
+
+	return 0;
+}
+
+/*******************************************************************************
+ BuildPageLayout (private)
+
+	Runs the script from m_nNextPageOffset to the next page break and
+	aligns the lines.  The lock is only held while the rest of the script
+	is copied and while the text of the lines on the page is fetched, so
+	the scan does not stall the animation.  Every change to the script
+	increments m_nLayoutSerial, so if it changed in between, the text is
+	not fetched and InitText() discards the page.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::BuildPageLayout
+	(
+	PageLayout* page
+	)
+{
+	page->lines.RemoveAll();
+	page->lineStart.RemoveAll();
+	page->lineStyle.RemoveAll();
+	page->lineText.RemoveAll();
+
+	int startOffset;
+	JMatrixScript::Style style;
+	{
+	CSingleLock lock(&m_StateLock, TRUE);
+
+	page->nSerial        = m_nLayoutSerial;
+	page->nPauseInterval = m_RestartInterval;
+
+	startOffset = m_nNextPageOffset;
+	style       = m_NextPageStyle;
+	if (startOffset >= m_Script.GetLength())
+		{
+		startOffset = 0;
+		style       = JMatrixScript::Style();
+		}
+
+	m_Script.CopyCode(startOffset, &(page->code));
+	}
+
+	const BYTE* code = page->code.GetData();
+	const int length = page->code.GetSize();
+
+	int offset = 0, opcode, value;
+	while (offset < length)
+		{
+		offset = JMatrixScript::ReadCode(code, offset, &opcode, &value);
+		if (opcode == JMatrixScript::kPageBreakOp)
+			{
+			page->nPauseInterval = value;
+			break;
+			}
+		else if (opcode == JMatrixScript::kLineOp)
+			{
+			page->lineText.Add(value);
+			page->lineStyle.Add(style);
+			}
+		else
+			{
+			style.Apply(opcode, value);
+			}
+		}
+
+	page->nEndOffset = startOffset + offset;
+	page->endStyle   = style;
+
+	{
+	CSingleLock lock(&m_StateLock, TRUE);
+
+	if (page->nSerial == m_nLayoutSerial)
+		{
+		const int lineCount = page->lineText.GetSize();
+		page->lines.SetSize(lineCount);
+		for (int i=0; i<lineCount; i++)
+			{
+			page->lines.SetAt(i, m_Script.GetText(page->lineText.ElementAt(i)));
+			}
+		}
+	}
+
+	AlignPageLayout(page);
+}
+
+/*******************************************************************************
+ AlignPageLayout (private)
+
+	Computes the position of each line on the grid.  Every character
+	occupies m_nCharAdvance pixels, so no DC is required.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::AlignPageLayout
+	(
+	PageLayout* page
+	)
+{
+	const int lineCount = page->lines.GetSize();
+	const int topLine   = (m_nRows-1 - lineCount)/2;
+	page->lineStart.SetSize(lineCount);
+	for (int i=0; i<lineCount; i++)
+		{
+		CPoint& pt = page->lineStart.ElementAt(i);
+		pt.x       = GetLineColumn(page->lines.ElementAt(i).GetLength(),
+								   page->lineStyle.ElementAt(i).nAlign);
+		pt.y       = topLine + i;
+		}
+}
+
+/*******************************************************************************
+ GetLineColumn (private)
+
+	Returns the grid column of the first character of a line with the
+	given length and alignment.
+
+ *******************************************************************************/
+
+int
+JMatrixCtrl::GetLineColumn
+	(
+	const int length,
+	const int align
+	)
+	const
+{
+	const int width = length * m_nCharAdvance;
+	return (align == JMatrixScript::kAlignLeft  ? 1 :
+			align == JMatrixScript::kAlignRight ? max(0, (m_nWidth - width)/m_nTextWidth - 1) :
+			((m_nWidth - width)/2)/m_nTextWidth);
+}
+
+/*******************************************************************************
+ Draw (private)
+
+	Renders into the private frame buffer and then publishes it for
+	OnPaint().  If the previous frame was never presented, it is dropped.
+
+	Only the tiles that changed since this frame buffer was last drawn
+	are redrawn.  Everything is still drawn with full-frame calls, but GDI
+	clips them to those tiles, so the cost follows the area that moved.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::Draw()
+{
+	// the heads and the cursor are only drawn into the frame, so their
+	// tiles must be known before anything is composited
+
+	if (!m_bTicker)
+		{
+		UpdateTextPlane();
+		}
+
+	for (int k=0; k<m_nRainLayerCount; k++)
+		{
+		PrepareRainHeads(m_RainLayer[k]);
+		}
+
+	if (!m_bTicker && (m_nTextPreset == kBlockCursor || m_nTextPreset == kRandomCursor))
+		{
+		MarkOverlay(CRect(    m_CursorPt.x * m_nTextWidth,     m_CursorPt.y * m_nTextHeight,
+						  (m_CursorPt.x+1) * m_nTextWidth, (m_CursorPt.y+1) * m_nTextHeight));
+		}
+
+	m_Stats.nRedrawPercent = ClipToChangedTiles();
+
+	// composite the rain layers back to front; the rain is black and
+	// green, so OR is a reasonable approximation of max
+
+	const int last = m_nRainLayerCount-1;
+	for (int i=last; i>=0; i--)
+		{
+		RainLayer& layer = m_RainLayer[i];
+		m_pFrameDC->BitBlt(0, 0, m_nWidth, m_nHeight, &(layer.dc), 0, 0,
+						   i == last ? SRCCOPY : SRCPAINT);
+		DrawRainHeads(layer);
+		}
+
+	DrawGlow();
+	DrawSpin();
+	DrawText();
+	DrawCursor();
+	::SelectClipRgn(m_pFrameDC->m_hDC, NULL);
+	GdiFlush();
+
+	if (m_FrameShare.IsOpen())
+		{
+		m_FrameShare.Publish(*m_pFrameDC);
+		m_Stats.nSharedFrames++;
+		}
+
+	m_Stats.nDrawCalls    = m_nFrameDrawCalls + m_nRainLayerCount + 1;
+	m_Stats.nSkippedCells = m_nFrameSkips;
+	m_nFrameDrawCalls     = 0;
+	m_nFrameSkips         = 0;
+
+	m_Frame[ m_nDrawFrame ].completedTime = GetTime();
+
+	const LONG prev = InterlockedExchange(&m_nReadyFrame, m_nDrawFrame | kFreshFrame);
+	if (prev & kFreshFrame)
+		{
+		m_Stats.nDroppedFrames++;
+		}
+
+	m_nDrawFrame = prev & kFrameIndexMask;
+	m_pFrameDC   = &(m_Frame[ m_nDrawFrame ].dc);
+
+	::InvalidateRect(m_hWnd, NULL, FALSE);
+
+	const int count = m_ViewportList.GetSize();
+	for (int j=0; j<count; j++)
+		{
+		::InvalidateRect(m_ViewportList[j]->m_hWnd, NULL, FALSE);
+		}
+}
+
+/*******************************************************************************
+ UpdateGovernor (private)
+
+	Accumulates the cost of the frame that started at frameStart.  Once per
+	kGovernorPeriod, reduces the quality by one level if the frames do not
+	fit in the budget or the rain timer is falling behind, and restores one
+	level after kRestoreDelay periods with plenty of headroom.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::UpdateGovernor
+	(
+	const LONGLONG frameStart,
+	const LONGLONG now
+	)
+{
+	m_Stats.nFrames++;
+	m_Stats.nFrameTime += ((int) (now - frameStart) - m_Stats.nFrameTime) / 8;
+
+	if (m_Stats.nFrameBudget <= 0 || now - m_GovernorTime < kGovernorPeriod * 1000)
+		{
+		return;
+		}
+	m_GovernorTime = now;
+
+	BudgetRainLayers();
+
+	// nTimerLatency measures kAnimateRainID, so it must be compared
+	// with that timer's interval
+
+	const BOOL overBudget = (m_Stats.nFrameTime > m_Stats.nFrameBudget ||
+							 m_Stats.nTimerLatency > m_nRainInterval * 500);
+	const BOOL headroom   = (m_Stats.nFrameTime * 100 < m_Stats.nFrameBudget * kRestoreThreshold &&
+							 m_Stats.nTimerLatency < m_nRainInterval * 250);
+
+	if (overBudget && m_Stats.nQualityLevel < kQualityLevelCount-1)
+		{
+		ApplyQualityLevel(m_Stats.nQualityLevel + 1);
+		m_Stats.nDegradeCount++;
+		m_nHeadroomCount = 0;
+		}
+	else if (headroom && m_Stats.nQualityLevel > 0)
+		{
+		m_nHeadroomCount++;
+		if (m_nHeadroomCount >= kRestoreDelay)
+			{
+			ApplyQualityLevel(m_Stats.nQualityLevel - 1);
+			m_Stats.nRestoreCount++;
+			m_nHeadroomCount = 0;
+			}
+		}
+	else
+		{
+		m_nHeadroomCount = 0;
+		}
+}
+
+/*******************************************************************************
+ ApplyQualityLevel (private)
+
+	Columns and spins that are already active are allowed to finish, so
+	lowering the limits never causes a visible jump.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::ApplyQualityLevel
+	(
+	const int level
+	)
+{
+	const QualityLevel& q = kQualityLevel[level];
+
+	const int bkgdInterval = m_Config.nAnimateBkgdInterval * q.bkgdInterval / 100;
+	const int textInterval = m_Config.nAnimateTextInterval * q.textInterval / 100;
+	const int rainInterval = m_Config.nAnimateRainInterval * q.bkgdInterval / 100;
+
+	m_Stats.nQualityLevel = level;
+	m_Stats.nColumnLimit  = 0;
+	m_nSpinLimit          = m_nTotalSpins * q.spinFraction / 100;
+
+	for (int i=0; i<m_nRainLayerCount; i++)
+		{
+		RainLayer& layer    = m_RainLayer[i];
+		layer.nColumnLimit  = layer.nCols * m_Config.rainLayer[i].nDensity / 100 *
+							  q.columnFraction / 100;
+		m_Stats.nColumnLimit += layer.nColumnLimit;
+		}
+
+	if (bkgdInterval != m_nBkgdInterval)
+		{
+		m_nBkgdInterval = bkgdInterval;
+		for (int j=0; j<m_nRainLayerCount; j++)
+			{
+			ScheduleRainLayer(j);
+			}
+		}
+
+	if (rainInterval != m_nRainInterval)
+		{
+		m_nRainInterval = rainInterval;
+		StartTimer(kAnimateRainID, m_nRainInterval);
+		}
+
+	if (textInterval != m_nTextInterval)
+		{
+		m_nTextInterval = textInterval;
+		if (m_nTextTimerID >= 0)
+			{
+			StartTimer(m_nTextTimerID, m_nTextInterval);
+			}
+		}
+
+	m_Stats.nBkgdInterval = m_nBkgdInterval;
+	m_Stats.nTextInterval = m_nTextInterval;
+	m_Stats.nSpinLimit    = m_nSpinLimit;
+}
+
+/*******************************************************************************
+ UpdateSignal (private)
+
+	Reads the latest levels of the external signal.  This never waits for
+	the analysis thread.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::UpdateSignal()
+{
+	int level, bass, treble;
+	m_Signal.GetLevels(&level, &bass, &treble);
+
+	m_Stats.nSignalLevel  = level;
+	m_Stats.nSignalBass   = bass;
+	m_Stats.nSignalTreble = treble;
+
+	m_nDensityScale    = GetSignalScale(level,  m_Config.nSignalDensity);
+	m_nActivationScale = GetSignalScale(bass,   m_Config.nSignalActivation);
+	m_nSpinScale       = GetSignalScale(treble, m_Config.nSignalSpin);
+}
+
+/*******************************************************************************
+ GetSignalScale (static private)
+
+	Returns a percentage that is 100 at the neutral level and changes by
+	depth percent at the extremes.
+
+ *******************************************************************************/
+
+int
+JMatrixCtrl::GetSignalScale
+	(
+	const int level,
+	const int depth
+	)
+{
+	const int neutral = JSignalAnalyzer::kNeutralLevel;
+	return max(0, 100 + depth * (level - neutral) / neutral);
+}
+
+/*******************************************************************************
+ BudgetRainLayers (private)
+
+	Each layer may use its share of the frame budget.  A layer that exceeds
+	its share is updated less often, and it speeds up again once its cost
+	drops well below its share.  This runs once per kGovernorPeriod.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::BudgetRainLayers()
+{
+	for (int i=0; i<m_nRainLayerCount; i++)
+		{
+		RainLayer& layer = m_RainLayer[i];
+		const int cost   = m_Stats.nLayerCost[i];
+		const int share  = m_Stats.nFrameBudget * m_Config.rainLayer[i].nCostShare / 100;
+
+		if (cost > share && layer.nSlowdown < kMaxLayerSlowdown)
+			{
+			layer.nSlowdown++;
+			ScheduleRainLayer(i);
+			}
+		else if (2 * cost < share && layer.nSlowdown > 1)
+			{
+			layer.nSlowdown--;
+			ScheduleRainLayer(i);
+			}
+		}
+}
+
+/*******************************************************************************
+ InitText (private)
+
+	Swaps in the page that was prepared by the layout thread.  If it is
+	not ready, or the lines changed after it was built, the page is laid
+	out here instead.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::InitText()
+{
+	if (m_Script.IsEmpty())
+		{
+		return;
+		}
+
+	m_bTicker = (m_Config.nTickerRate > 0);
+	if (m_bTicker)
+		{
+		InitTicker();
+		return;
+		}
+
+	// if it was already busy, the layout thread owns it and will release it
+
+	BOOL swapped     = FALSE;
+	const LONG state = InterlockedExchange(&m_nNextPageState, kPageBusy);
+	if (state == kPageReady && m_pNextPage->nSerial == m_nLayoutSerial)
+		{
+		PageLayout* page = m_pPage;
+		m_pPage          = m_pNextPage;
+		m_pNextPage      = page;
+		swapped          = TRUE;
+		}
+	if (state != kPageBusy)
+		{
+		InterlockedExchange(&m_nNextPageState, kPageEmpty);
+		}
+
+	if (!swapped)
+		{
+		BuildPageLayout(m_pPage);
+		m_Stats.nLayoutMisses++;
+		}
+
+	StopTimer(kUpdateCursorID);		// the pause can end before it reaches the edge
+	m_nActiveLine     = -1;
+	m_nRevealRow      = -1;
+	ClearTextPlane();
+	m_nNextPageOffset = m_pPage->nEndOffset;
+	m_NextPageStyle   = m_pPage->endStyle;
+	m_nLayoutSerial++;
+
+	if (m_pPage->lines.GetSize() == 0)		// consecutive page breaks
+		{
+		m_LayoutEvent.SetEvent();
+		StartPause(m_pPage->nPauseInterval);
+		return;
+		}
+
+	StopTimer(kInitTextID);
+	AdvanceLine();
+}
+
+/*******************************************************************************
+ AdvanceLine (private)
+
+	Starts the next line, after its delay, if any.  Until then, the spin
+	timer keeps running in place of the text timer.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::AdvanceLine()
+{
+	ASSERT( m_nActiveLine+1 < m_pPage->lines.GetSize() );
+
+	const int delay = m_pPage->lineStyle.ElementAt(m_nActiveLine+1).nDelay;
+	if (delay > 0)
+		{
+		StopTimer(kUpdateTextID);
+		StartTimer(kUpdateSpinID, m_nTextInterval);
+		m_nTextTimerID = kUpdateSpinID;
+		StartTimer(kNextLineID, delay);
+		}
+	else
+		{
+		ActivateLine();
+		}
+}
+
+/*******************************************************************************
+ ActivateLine (private)
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::ActivateLine()
+{
+	StopTimer(kNextLineID);
+
+	UpdateTextPlane();		// the previous line may not have been drawn yet
+	m_nMaskedLength = 0;
+
+	m_nActiveLine++;
+	const JMatrixScript::Style& style = m_pPage->lineStyle.ElementAt(m_nActiveLine);
+
+	m_nLineCursor     = style.nCursor;
+	m_nLinePhaseCount = style.nPhaseCount;
+	m_nLineReveal     = (style.nReveal != JMatrixScript::kDefaultValue ?
+						 style.nReveal : m_Config.nRevealMode);
+	if (m_nLineReveal == JMatrixScript::kRainReveal && m_nRainLayerCount == 0)
+		{
+		m_nLineReveal = JMatrixScript::kRandomReveal;
+		}
+	UpdateTextPreset();
+
+	const int length = m_pPage->lines.ElementAt(m_nActiveLine).GetLength();
+
+	m_ActiveLine.Empty();
+	ResetTextDirty(length);
+	m_PhaseList.SetSize(length);
+	for (int i=0; i<length; i++)
+		{
+		m_PhaseList[i] = -1;
+		}
+	m_PhasingList.RemoveAll();
+	m_nRevealCount = 0;
+	m_nHiddenCount = length;
+	BuildRevealOrder(length);
+
+	if (m_nTextTimerID != kUpdateTextID)
+		{
+		StopTimer(kUpdateSpinID);
+		StartTimer(kUpdateTextID, m_nTextInterval);
+		m_nTextTimerID = kUpdateTextID;
+		}
+
+	InitCursor();
+}
+
+/*******************************************************************************
+ UpdateText (private)
+
+	The options are dispatched once per tick to the matching specialization
+	of UpdateTextT().
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::UpdateText()
+{
+	if (m_bTicker)
+		{
+		UpdateTicker();
+		return;
+		}
+
+	BOOL done;
+	if (m_nTextPreset == kNoCursor && m_bEuropeanChars)
+		{
+		done = UpdateTextT(TextPreset<0,0,1>());
+		}
+	else if (m_nTextPreset == kNoCursor)
+		{
+		done = UpdateTextT(TextPreset<0,0,0>());
+		}
+	else if (m_nTextPreset == kBlockCursor && m_bEuropeanChars)
+		{
+		done = UpdateTextT(TextPreset<1,0,1>());
+		}
+	else if (m_nTextPreset == kBlockCursor)
+		{
+		done = UpdateTextT(TextPreset<1,0,0>());
+		}
+	else if (m_bEuropeanChars)
+		{
+		done = UpdateTextT(TextPreset<1,1,1>());
+		}
+	else
+		{
+		done = UpdateTextT(TextPreset<1,1,0>());
+		}
+
+	if (done && m_nActiveLine >= m_pPage->lines.GetSize()-1)
+		{
+		m_LayoutEvent.SetEvent();		// prepare the next page during the pause
+
+		StopTimer(kUpdateTextID);
+		StartPause(m_pPage->nPauseInterval);
+		StartTimer(kUpdateSpinID, m_nTextInterval);
+		m_nTextTimerID = kUpdateSpinID;
+		}
+	else if (done)
+		{
+		AdvanceLine();
+		}
+}
+
+/*******************************************************************************
+ UpdateTextT (private)
+
+	Phases in the revealed part of the active line.  Returns TRUE when
+	the line is finished.  Only the characters that are still changing
+	are touched, so the cost does not depend on the length of the line.
+
+ *******************************************************************************/
+
+template <class P>
+BOOL
+JMatrixCtrl::UpdateTextT
+	(
+	const P& preset
+	)
+{
+	if (P::kRandomCursor)
+		{
+		m_CursorChar = (char) getrandom(32, P::kMaxChar);
+		}
+
+	const int index      = m_nActiveLine;
+	const CString& line  = m_pPage->lines.ElementAt(index);
+	const int phaseCount = (m_nLinePhaseCount >= 0 ? m_nLinePhaseCount : m_nMaxPhaseCount);
+	const int lineLength = line.GetLength();
+
+	// iterate backwards, so swapping in the last element is safe
+
+	for (int j=m_PhasingList.GetSize()-1; j>=0; j--)
+		{
+		const int i       = m_PhasingList[j];
+		int& phase        = m_PhaseList.ElementAt(i);
+		const BYTE target = (BYTE) line[i];
+		MarkTextDirty(i);
+		if (phase < phaseCount && m_ActiveLine[i] != line[i] &&
+			32 <= target && target <= P::kMaxChar)		// otherwise, it can never match
+			{
+			m_ActiveLine.SetAt(i, (char) getrandom(32, P::kMaxChar));
+			phase++;
+			}
+		else
+			{
+			m_ActiveLine.SetAt(i, line[i]);
+
+			const int last = m_PhasingList.GetSize()-1;
+			m_PhasingList.SetAt(j, m_PhasingList[last]);
+			m_PhasingList.RemoveAt(last);
+			}
+		m_Stats.nTextUpdates++;
+		}
+
+	// the other reveal modes are driven by UpdateCursor()
+
+	if (m_nLineReveal == JMatrixScript::kTypeReveal)
+		{
+		int end = lineLength;
+		if (P::kCursor)
+			{
+			const CPoint& pt = m_pPage->lineStart.ElementAt(index);
+			end              = max(0, min(end, m_CursorPt.x - pt.x));
+			}
+
+		while (m_nRevealCount < end)
+			{
+			RevealChar(m_nRevealCount);
+			m_nRevealCount++;
+			}
+		}
+
+	BOOL done = (m_nHiddenCount == 0 && m_PhasingList.GetSize() == 0);
+	if (P::kCursor && lineLength > 0 && !CursorFinished())
+		{
+		done = FALSE;
+		}
+
+	return done;
+}
+
+/*******************************************************************************
+ BuildRevealOrder (private)
+
+	Computes the order in which the characters of the active line appear.
+	For kRainReveal, each character is also linked to the column of the
+	front rain layer that covers it.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::BuildRevealOrder
+	(
+	const int length
+	)
+{
+	m_RevealOrder.SetSize(length);
+	m_nRevealRow = -1;
+
+	if (m_nLineReveal == JMatrixScript::kCenterReveal)
+		{
+		int left = (length-1)/2, right = left+1, k = 0;
+		while (k < length)
+			{
+			if (left >= 0)
+				{
+				m_RevealOrder[k++] = left--;
+				}
+			if (right < length)
+				{
+				m_RevealOrder[k++] = right++;
+				}
+			}
+		}
+	else
+		{
+		for (int i=0; i<length; i++)
+			{
+			m_RevealOrder[i] = i;
+			}
+
+		if (m_nLineReveal != JMatrixScript::kTypeReveal)
+			{
+			for (int j=length-1; j>0; j--)
+				{
+				const int k      = GetRandomIndex(j+1);
+				const int tmp    = m_RevealOrder[j];
+				m_RevealOrder[j] = m_RevealOrder[k];
+				m_RevealOrder[k] = tmp;
+				}
+			}
+		}
+
+	if (m_nLineReveal == JMatrixScript::kRainReveal)
+		{
+		const RainLayer& layer = m_RainLayer[0];
+		const CPoint& pt       = m_pPage->lineStart.ElementAt(m_nActiveLine);
+
+		m_nRevealRow = max(0, min((pt.y * m_nTextHeight + m_nTextHeight/2) / layer.nTextHeight,
+								  layer.nRows-1));		// a page may be taller than the grid
+
+		m_RevealColumn.SetSize(layer.nCols);
+		for (int col=0; col<layer.nCols; col++)
+			{
+			m_RevealColumn[col] = -1;
+			}
+
+		m_RevealNext.SetSize(length);
+		for (int i=length-1; i>=0; i--)
+			{
+			const int col       = GetRevealColumn(i);
+			m_RevealNext[i]     = m_RevealColumn[col];
+			m_RevealColumn[col] = i;
+			}
+		}
+}
+
+/*******************************************************************************
+ RevealChar (private)
+
+	Shows a random character at the given index of the active line and
+	starts phasing it in.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::RevealChar
+	(
+	const int index
+	)
+{
+	m_PhaseList[ index ] = 0;
+	m_PhasingList.Add(index);
+	m_nHiddenCount--;
+
+	// hidden characters before it are blank
+
+	if (m_ActiveLine.GetLength() <= index)
+		{
+		m_ActiveLine += CString(' ', index+1 - m_ActiveLine.GetLength());
+		}
+	m_ActiveLine.SetAt(index, (char) getrandom(32, m_bEuropeanChars ? 255 : 127));
+	MarkTextDirty(index);
+	m_Stats.nTextUpdates++;
+}
+
+/*******************************************************************************
+ GetRevealColumn (private)
+
+	Returns the column of the front rain layer that covers the center of
+	the given character of the active line.
+
+ *******************************************************************************/
+
+int
+JMatrixCtrl::GetRevealColumn
+	(
+	const int index
+	)
+	const
+{
+	const RainLayer& layer = m_RainLayer[0];
+	const CPoint& pt       = m_pPage->lineStart.ElementAt(m_nActiveLine);
+
+	const int x = (pt.x + index) * m_nTextWidth + m_nTextWidth/2;
+	return max(0, min(x / layer.nTextWidth, layer.nCols-1));
+}
+
+/*******************************************************************************
+ StartRevealDrop (private)
+
+	Starts a drop above the next hidden character, unless its column is
+	already active.  Hidden characters are visited in m_RevealOrder,
+	wrapping around, because a drop that was already below the text when
+	it was requested will not reveal anything.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::StartRevealDrop()
+{
+	const int count = m_RevealOrder.GetSize();
+	for (int k=0; k<count; k++)
+		{
+		const int i    = m_RevealOrder[ m_nRevealCount ];
+		m_nRevealCount = (m_nRevealCount + 1) % count;
+		if (m_PhaseList[i] >= 0)
+			{
+			continue;
+			}
+
+		RainLayer& layer = m_RainLayer[0];
+		const int col    = GetRevealColumn(i);
+		if (!layer.pColumns[col].bActive)
+			{
+			StartColumn(layer, col, m_nRevealRow);
+			if (m_nRevealRow == 0)		// EnterRow() will never see it
+				{
+				RevealRainColumn(col);
+				}
+			}
+		break;
+		}
+}
+
+/*******************************************************************************
+ RevealRainColumn (private)
+
+	Called when a drop in the front rain layer enters m_nRevealRow.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::RevealRainColumn
+	(
+	const int col
+	)
+{
+	int i               = m_RevealColumn[col];
+	m_RevealColumn[col] = -1;
+	while (i >= 0)
+		{
+		if (m_PhaseList[i] < 0)		// the font may have changed
+			{
+			RevealChar(i);
+			}
+		i = m_RevealNext[i];
+		}
+
+	if (m_nHiddenCount == 0)
+		{
+		m_nRevealRow = -1;
+		}
+}
+
+/*******************************************************************************
+ DrawText (private)
+
+	Copies each line from the text plane.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::DrawText()
+{
+	if (m_bTicker)
+		{
+		DrawTicker();
+		return;
+		}
+	else if (m_nActiveLine < 0)
+		{
+		return;
+		}
+
+	for (int i=0; i<=m_nActiveLine; i++)
+		{
+		const int length = (i < m_nActiveLine ? m_pPage->lines.ElementAt(i).GetLength() :
+							m_ActiveLine.GetLength());
+		if (length > 0)
+			{
+			const CPoint& pt = m_pPage->lineStart.ElementAt(i);
+			const int x      = pt.x * m_nTextWidth;
+			const int y      = pt.y * m_nTextHeight;
+			m_pFrameDC->BitBlt(x, y, length * m_nCharAdvance, m_nTextHeight,
+							   &m_TextDC, x, y, SRCCOPY);
+			m_nFrameDrawCalls++;
+			}
+		}
+}
+
+/*******************************************************************************
+ UpdateTextPlane (private)
+
+	Redraws the characters of the active line that changed since the last
+	time and hides the cells that it now covers.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::UpdateTextPlane()
+{
+	if (m_nActiveLine < 0 || m_nTextDirtyCount == 0)
+		{
+		return;
+		}
+
+	// Sorting only touches the characters that changed.  Neighbors are
+	// drawn together, and so are characters separated by a small gap,
+	// because redrawing a few characters is cheaper than another call.
+
+	int* list = m_TextDirtyList.GetData();
+	qsort(list, m_nTextDirtyCount, sizeof(int), CompareIndex);
+
+	const CPoint& pt     = m_pPage->lineStart.ElementAt(m_nActiveLine);
+	const COLORREF color = GetLineColor(m_nActiveLine);
+
+	int i = 0;
+	while (i < m_nTextDirtyCount)
+		{
+		const int start = list[i];
+		int end         = start;
+		while (i < m_nTextDirtyCount && list[i] - end <= kMaxTextRunGap)
+			{
+			m_TextDirtyFlag[ list[i] ] = 0;
+			end = list[i] + 1;
+			i++;
+			}
+
+		DrawTextRun(pt, start, ((LPCTSTR) m_ActiveLine) + start, end - start, color);
+		}
+	m_nTextDirtyCount = 0;
+
+	const int count = m_ActiveLine.GetLength() * m_nCharAdvance / m_nTextWidth;
+	if (count > m_nMaskedLength)
+		{
+		MaskTextCells(pt.y, pt.x + m_nMaskedLength, pt.x + count);
+		m_nMaskedLength = count;
+		}
+}
+
+/*******************************************************************************
+ RedrawTextPlane (private)
+
+	Draws every line on the current page, or every line of the ticker,
+	from scratch, e.g., after the font changes.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::RedrawTextPlane()
+{
+	m_bTextPlaneClear = FALSE;		// the bitmap or the masks may be new
+	ClearTextPlane();
+
+	for (int i=0; i<=m_nActiveLine; i++)
+		{
+		const CString& line = (i < m_nActiveLine ? m_pPage->lines.ElementAt(i) : m_ActiveLine);
+		const int length    = line.GetLength();
+		const CPoint& pt    = m_pPage->lineStart.ElementAt(i);
+		const int count     = length * m_nCharAdvance / m_nTextWidth;
+
+		DrawTextRun(pt, 0, line, length, GetLineColor(i));
+		MaskTextCells(pt.y, pt.x, pt.x + count);
+
+		m_nMaskedLength = count;
+		}
+
+	for (int j=0; j<m_nTickerCount; j++)
+		{
+		DrawTickerLine(m_pTickerLine[ (m_nTickerHead - j + m_nTickerRows) % m_nTickerRows ],
+					   m_nTickerRows-1 - j);
+		}
+}
+
+/*******************************************************************************
+ ClearTextPlane (private)
+
+	Erases all the text and all the masks.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::ClearTextPlane()
+{
+	// consecutive page breaks without a pause call this every millisecond
+
+	if (!m_bTextPlaneClear)
+		{
+		m_TextDC.FillSolidRect(0,0, m_nWidth,m_nHeight, RGB(0,0,0));
+		MarkAllChanged();
+
+		memset(m_pTextMask, 0, m_nRows * m_nCols);
+		for (int i=0; i<m_nRainLayerCount; i++)
+			{
+			const RainLayer& layer = m_RainLayer[i];
+			memset(layer.pMask, 0, layer.nRows * layer.nCols);
+			}
+
+		m_bTextPlaneClear = TRUE;
+		}
+
+	m_nMaskedLength       = 0;
+	m_Stats.nMaskedCells  = 0;
+
+	for (int j=0; j<m_nTextDirtyCount; j++)
+		{
+		m_TextDirtyFlag[ m_TextDirtyList[j] ] = 0;
+		}
+	m_nTextDirtyCount = 0;
+}
+
+/*******************************************************************************
+ ResetTextDirty (private)
+
+	Makes room to mark every character of an active line of the given
+	length.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::ResetTextDirty
+	(
+	const int length
+	)
+{
+	m_TextDirtyList.SetSize(length);
+	m_TextDirtyFlag.SetSize(length);
+	if (length > 0)
+		{
+		memset(m_TextDirtyFlag.GetData(), 0, length);
+		}
+	m_nTextDirtyCount = 0;
+}
+
+/*******************************************************************************
+ DrawTextRun (private)
+
+	Draws len characters of the line that starts at pt, starting with the
+	character at offset.  Every character advances by the same amount, so
+	proportional fonts do not drift away from the grid.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::DrawTextRun
+	(
+	const CPoint&	pt,
+	const int		offset,
+	const char*		str,
+	const int		len,
+	const COLORREF	color
+	)
+{
+	if (len <= 0)
+		{
+		return;
+		}
+
+	for (int i=m_TextDx.GetSize(); i<len; i++)
+		{
+		m_TextDx.Add(m_nCharAdvance);
+		}
+
+	const int x = pt.x * m_nTextWidth + offset * m_nCharAdvance;
+	const int y = pt.y * m_nTextHeight;
+
+	m_TextDC.FillSolidRect(x, y, len * m_nCharAdvance, m_nTextHeight, RGB(0,0,0));
+	MarkChanged(CRect(x, y, x + len * m_nCharAdvance, y + m_nTextHeight));
+	m_TextDC.SetTextColor(color);
+	m_TextDC.ExtTextOut(x, y, 0, NULL, str, len, m_TextDx.GetData());
+	m_nFrameDrawCalls += 3;
+	m_bTextPlaneClear  = FALSE;
+}
+
+/*******************************************************************************
+ MaskTextCells (private)
+
+	Marks the cells [first, last) in the given row as hidden by text, and
+	then marks every cell in the rain layers that is now completely hidden.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::MaskTextCells
+	(
+	const int row,
+	const int first,
+	const int last
+	)
+{
+	const int start = max(first, 0);		// a line may be wider than the grid
+	const int end   = min(last, m_nCols);
+	if (row < 0 || row >= m_nRows || start >= end)
+		{
+		return;
+		}
+
+	memset(m_pTextMask + row * m_nCols + start, 1, end - start);
+	m_Stats.nMaskedCells += end - start;
+	m_bTextPlaneClear     = FALSE;
+
+	const CRect r(start * m_nTextWidth, row * m_nTextHeight,
+				  end * m_nTextWidth, (row+1) * m_nTextHeight);
+
+	for (int i=0; i<m_nRainLayerCount; i++)
+		{
+		RainLayer& layer = m_RainLayer[i];
+
+		const int w  = layer.nTextWidth;
+		const int h  = layer.nTextHeight;
+		const int r1 = min((r.bottom-1) / h, layer.nRows-1);
+		const int c1 = min((r.right-1) / w, layer.nCols-1);
+		for (int y=r.top / h; y<=r1; y++)
+			{
+			for (int x=r.left / w; x<=c1; x++)
+				{
+				const CRect cell(x*w, y*h, (x+1)*w, (y+1)*h);
+				layer.pMask[ y * layer.nCols + x ] = (BYTE) IsHiddenByText(cell);
+				}
+			}
+		}
+}
+
+/*******************************************************************************
+ IsHiddenByText (private)
+
+	Returns TRUE if every text cell that overlaps r is hidden by text.
+
+ *******************************************************************************/
+
+BOOL
+JMatrixCtrl::IsHiddenByText
+	(
+	const CRect& r
+	)
+	const
+{
+	const int r1 = (r.bottom-1) / m_nTextHeight;
+	const int c1 = (r.right-1) / m_nTextWidth;
+	if (r1 >= m_nRows || c1 >= m_nCols)
+		{
+		return FALSE;
+		}
+
+	for (int y=r.top / m_nTextHeight; y<=r1; y++)
+		{
+		const BYTE* mask = m_pTextMask + y * m_nCols;
+		for (int x=r.left / m_nTextWidth; x<=c1; x++)
+			{
+			if (!mask[x])
+				{
+				return FALSE;
+				}
+			}
+		}
+
+	return TRUE;
+}
+
+/*******************************************************************************
+ AllocateTicker (private)
+
+	Each slot in the ring holds one line, truncated to the width of the
+	control.  All the slots are allocated at once, so starting a line
+	never allocates memory.  The lines on screen survive a change of
+	font:  the ring is only reallocated if its size changes, and then the
+	newest lines that fit are copied, truncated to the new width.  Every
+	line is realigned, because the grid moved.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::AllocateTicker()
+{
+	const int rows  = max(1, m_nRows-1);		// the last row is not completely visible
+	const int width = max(1, m_nWidth / m_nCharAdvance);
+
+	if (rows != m_nTickerRows || width != m_nTickerWidth)
+		{
+		TickerLine* oldLine = m_pTickerLine;
+		char* oldChars      = m_pTickerChars;
+		int* oldPhase       = m_pTickerPhase;
+		const int oldRows   = m_nTickerRows;
+		const int oldHead   = m_nTickerHead;
+		const int count     = min(m_nTickerCount, rows);
+
+		m_nTickerRows  = rows;
+		m_nTickerWidth = width;
+		m_pTickerLine  = new TickerLine [ m_nTickerRows ];
+		m_pTickerChars = new char [ 2 * m_nTickerRows * m_nTickerWidth ];
+		m_pTickerPhase = new int [ m_nTickerRows * m_nTickerWidth ];
+
+		for (int i=0; i<m_nTickerRows; i++)
+			{
+			TickerLine& line = m_pTickerLine[i];
+			line.pText       = m_pTickerChars + 2 * i * m_nTickerWidth;
+			line.pShown      = line.pText + m_nTickerWidth;
+			line.pPhase      = m_pTickerPhase + i * m_nTickerWidth;
+			line.nLength     = 0;
+			line.nPhasing    = 0;
+			line.bDirty      = FALSE;
+			}
+
+		// newest line first
+
+		m_nTickerHead  = (count > 0 ? count-1 : 0);
+		m_nTickerCount = count;
+		for (int t=0; t<count; t++)
+			{
+			const TickerLine& src = oldLine[ (oldHead - t + oldRows) % oldRows ];
+			TickerLine& line      = m_pTickerLine[ m_nTickerHead - t ];
+
+			line.nLength     = min(src.nLength, m_nTickerWidth);
+			line.nAlign      = src.nAlign;
+			line.nPhaseCount = src.nPhaseCount;
+			line.color       = src.color;
+			memcpy(line.pText,  src.pText,  line.nLength);
+			memcpy(line.pShown, src.pShown, line.nLength);
+			memcpy(line.pPhase, src.pPhase, line.nLength * sizeof(int));
+
+			for (int c=0; c<line.nLength; c++)
+				{
+				if (line.pShown[c] != line.pText[c])
+					{
+					line.nPhasing++;
+					}
+				}
+			}
+
+		delete [] oldLine;
+		delete [] oldChars;
+		delete [] oldPhase;
+		}
+
+	for (int j=0; j<m_nTickerCount; j++)
+		{
+		TickerLine& line = m_pTickerLine[ (m_nTickerHead - j + m_nTickerRows) % m_nTickerRows ];
+		line.nCol        = GetLineColumn(line.nLength, line.nAlign);
+		}
+}
+
+/*******************************************************************************
+ InitTicker (private)
+
+	The lines scroll too quickly for the text masks to pay off, so the
+	rain is drawn under the ticker.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::InitTicker()
+{
+	StopTimer(kInitTextID);
+	StopTimer(kUpdateCursorID);
+	StopTimer(kNextLineID);
+
+	m_nActiveLine = -1;
+	m_nRevealRow  = -1;
+	ClearTextPlane();
+
+	m_nTickerCount  = 0;
+	m_nTickerCredit = 1000;		// start the first line immediately
+
+	if (m_nTextTimerID != kUpdateTextID)
+		{
+		StopTimer(kUpdateSpinID);
+		StartTimer(kUpdateTextID, m_nTextInterval);
+		m_nTextTimerID = kUpdateTextID;
+		}
+}
+
+/*******************************************************************************
+ UpdateTicker (private)
+
+	Starts the lines that are due at nTickerRate, scrolls the older ones
+	up, and phases in every line that is still changing.  The rate is
+	credited per tick, so it is maintained when the quality governor
+	slows the text timer.  Lines that would scroll off the top before
+	they are ever drawn are read but not started.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::UpdateTicker()
+{
+	m_nTickerCredit += m_Config.nTickerRate * m_nTextInterval;
+
+	const int count  = m_nTickerCredit / 1000;
+	m_nTickerCredit -= count * 1000;
+
+	int added = 0;
+	for (int i=0; i<count; i++)
+		{
+		const int index = ReadTickerLine();
+		if (index < 0)
+			{
+			break;
+			}
+
+		m_Stats.nTickerLines++;
+		if (i >= count - m_nTickerRows)
+			{
+			m_nTickerHead = (m_nTickerHead + 1) % m_nTickerRows;
+			StartTickerLine(m_pTickerLine[ m_nTickerHead ], m_Script.GetText(index),
+							m_NextPageStyle);
+			added++;
+			}
+		}
+
+	if (added > 0)
+		{
+		ScrollTicker(added);
+		m_nTickerCount = min(m_nTickerCount + added, m_nTickerRows);
+		}
+
+	ASSERT( 0 <= m_nTickerHead && m_nTickerHead < m_nTickerRows );
+
+	for (int j=0; j<m_nTickerCount; j++)
+		{
+		TickerLine& line = m_pTickerLine[ (m_nTickerHead - j + m_nTickerRows) % m_nTickerRows ];
+		if (line.nPhasing > 0)
+			{
+			PhaseTickerLine(line);
+			}
+		if (line.bDirty)
+			{
+			DrawTickerLine(line, m_nTickerRows-1 - j);
+			}
+		}
+}
+
+/*******************************************************************************
+ ReadTickerLine (private)
+
+	Returns the text index of the next line in the script and applies the
+	directives before it to m_NextPageStyle.  Page breaks are ignored.
+	Starts over at the end of the script.  Returns -1 if the script does
+	not contain any lines.
+
+ *******************************************************************************/
+
+int
+JMatrixCtrl::ReadTickerLine()
+{
+	const int length = m_Script.GetLength();
+
+	BOOL wrapped = FALSE;
+	int opcode, value;
+	while (1)
+		{
+		if (m_nNextPageOffset >= length)
+			{
+			if (wrapped)
+				{
+				return -1;
+				}
+
+			m_nNextPageOffset = 0;
+			m_NextPageStyle   = JMatrixScript::Style();
+			wrapped           = TRUE;
+			continue;		// the script may be empty
+			}
+
+		m_nNextPageOffset = m_Script.Read(m_nNextPageOffset, &opcode, &value);
+		if (opcode == JMatrixScript::kLineOp)
+			{
+			return value;
+			}
+		else if (opcode != JMatrixScript::kPageBreakOp)
+			{
+			m_NextPageStyle.Apply(opcode, value);
+			}
+		}
+}
+
+/*******************************************************************************
+ StartTickerLine (private)
+
+	Copies the text into the slot and scrambles it.  The delay, cursor,
+	and reveal mode of the style are ignored.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::StartTickerLine
+	(
+	TickerLine&					line,
+	const CString&				text,
+	const JMatrixScript::Style&	style
+	)
+{
+	const int length = min(text.GetLength(), m_nTickerWidth);
+	memcpy(line.pText, (LPCTSTR) text, length);
+
+	line.nLength     = length;
+	line.nAlign      = style.nAlign;
+	line.nCol        = GetLineColumn(length, line.nAlign);
+	line.nPhaseCount = (style.nPhaseCount >= 0 ? style.nPhaseCount : m_nMaxPhaseCount);
+	line.color       = (style.color == (COLORREF) JMatrixScript::kDefaultValue ?
+						m_Config.textColor : style.color);
+	line.nPhasing    = 0;
+	line.bDirty      = TRUE;
+
+	const int maxChar = (m_bEuropeanChars ? 255 : 127);
+	for (int i=0; i<length; i++)
+		{
+		line.pPhase[i] = 0;
+		line.pShown[i] = (line.nPhaseCount > 0 ? (char) getrandom(32, maxChar) : line.pText[i]);
+		if (line.pShown[i] != line.pText[i])
+			{
+			line.nPhasing++;
+			}
+		}
+}
+
+/*******************************************************************************
+ PhaseTickerLine (private)
+
+	Same rules as UpdateTextT():  a character stops changing when it hits
+	the correct value or exceeds the phase count, or immediately if the
+	correct value is outside the range of random characters.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::PhaseTickerLine
+	(
+	TickerLine& line
+	)
+{
+	const int maxChar = (m_bEuropeanChars ? 255 : 127);
+	for (int i=0; i<line.nLength; i++)
+		{
+		if (line.pShown[i] == line.pText[i])
+			{
+			continue;
+			}
+
+		const BYTE target = (BYTE) line.pText[i];
+		if (line.pPhase[i] < line.nPhaseCount && 32 <= target && target <= maxChar)
+			{
+			line.pShown[i] = (char) getrandom(32, maxChar);
+			line.pPhase[i]++;
+			}
+		else
+			{
+			line.pShown[i] = line.pText[i];
+			}
+
+		if (line.pShown[i] == line.pText[i])
+			{
+			line.nPhasing--;
+			}
+		m_Stats.nTextUpdates++;
+		}
+
+	line.bDirty = TRUE;
+}
+
+/*******************************************************************************
+ ScrollTicker (private)
+
+	Moves the text plane up by count rows and clears the rows at the
+	bottom for the new lines.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::ScrollTicker
+	(
+	const int count
+	)
+{
+	const int h  = m_nTickerRows * m_nTextHeight;
+	const int dy = min(count, m_nTickerRows) * m_nTextHeight;
+	if (dy < h)
+		{
+		m_TextDC.BitBlt(0, 0, m_nWidth, h - dy, &m_TextDC, 0, dy, SRCCOPY);
+		m_nFrameDrawCalls++;
+		}
+
+	m_TextDC.FillSolidRect(0, h - dy, m_nWidth, dy, RGB(0,0,0));
+	m_nFrameDrawCalls++;
+
+	MarkChanged(CRect(0, 0, m_nWidth, h));
+}
+
+/*******************************************************************************
+ DrawTickerLine (private)
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::DrawTickerLine
+	(
+	TickerLine&	line,
+	const int	row
+	)
+{
+	DrawTextRun(CPoint(line.nCol, row), 0, line.pShown, line.nLength, line.color);
+	line.bDirty = FALSE;
+}
+
+/*******************************************************************************
+ DrawTicker (private)
+
+	Copies each line from the text plane.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::DrawTicker()
+{
+	for (int i=0; i<m_nTickerCount; i++)
+		{
+		const TickerLine& line = m_pTickerLine[ (m_nTickerHead - i + m_nTickerRows) % m_nTickerRows ];
+		if (line.nLength > 0)
+			{
+			const int x = line.nCol * m_nTextWidth;
+			const int y = (m_nTickerRows-1 - i) * m_nTextHeight;
+			m_pFrameDC->BitBlt(x, y, line.nLength * m_nCharAdvance, m_nTextHeight,
+							   &m_TextDC, x, y, SRCCOPY);
+			m_nFrameDrawCalls++;
+			}
+		}
+}
+
+/*******************************************************************************
+ InitCursor
+
+	The cursor timer also paces the reveal modes that do not have a
+	cursor.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::InitCursor()
+{
+	if (m_nActiveLine >= 0 &&
+		(m_nTextPreset != kNoCursor || m_nLineReveal != JMatrixScript::kTypeReveal))
 		{
-		m_CursorChar = (char) getrandom(32, m_MaxChar);
+		const CPoint& pt = m_pPage->lineStart.ElementAt(m_nActiveLine);
+		m_CursorPt.x       = 0;
+		m_CursorPt.y       = pt.y;
+		StartTimer(kUpdateCursorID, m_Config.nMoveCursorInterval);
 		}
+}
+
+/*******************************************************************************
+ UpdateCursor
 
-	BOOL done = TRUE;
+	kCenterReveal reveals two characters per tick, so it keeps pace with
+	the cursor.
 
-	const CString& line  = m_LineList.ElementAt(m_nActiveLine);
-	const int lineLength = line.GetLength();
-	for (int i=0; i<lineLength; i++)
+ *******************************************************************************/
+
+void
+JMatrixCtrl::UpdateCursor()
+{
+	if (m_nLineReveal == JMatrixScript::kTypeReveal)
 		{
-		if (m_bShowCursor)
+		m_CursorPt.x = min(m_CursorPt.x + 1, m_nCols);		// the font may have changed
+		if (CursorFinished())
 			{
-			const CPoint& pt = m_LineStartList.ElementAt(m_nActiveLine - m_nPageStartLine);
-			if (i >= m_CursorPt.x - pt.x)
-				{
-				done = FALSE;
-				break;
-				}
+			StopTimer(kUpdateCursorID);
 			}
-
-		if (m_ActiveLine.GetLength() <= i)
+		}
+	else if (m_nLineReveal == JMatrixScript::kRainReveal)
+		{
+		if (m_nHiddenCount > 0)
 			{
-			m_ActiveLine += (char) getrandom(32, m_MaxChar);
-			m_PhaseList.Add(0);
-			done = FALSE;
+			StartRevealDrop();
 			}
-		else if (m_PhaseList[i] >= m_nMaxPhaseCount)
+		if (m_nHiddenCount == 0)
 			{
-			m_ActiveLine.SetAt(i, line[i]);
+			StopTimer(kUpdateCursorID);
+			}
+		}
+	else
+		{
+		const int count = m_RevealOrder.GetSize();
+		const int step  = (m_nLineReveal == JMatrixScript::kCenterReveal ? 2 : 1);
+		for (int i=0; i<step && m_nRevealCount < count; i++)
+			{
+			RevealChar(m_RevealOrder[ m_nRevealCount ]);
+			m_nRevealCount++;
 			}
-		else if (m_ActiveLine[i] != line[i])
+
+		if (m_nRevealCount >= count)
 			{
-			m_ActiveLine.SetAt(i, (char) getrandom(32, m_MaxChar));
-			(m_PhaseList.ElementAt(i))++;
-			done = FALSE;
+			StopTimer(kUpdateCursorID);
 			}
 		}
+}
 
-	if (m_bShowCursor && lineLength > 0 && !CursorFinished())
+/*******************************************************************************
+ DrawCursor (private)
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::DrawCursor()
+{
+	if (m_bTicker)
 		{
-		done = FALSE;
+		return;
 		}
-
-	if (done && m_nActiveLine == m_nPageEndLine)
+	else if (m_nTextPreset == kBlockCursor)
 		{
-		KillTimer(kUpdateTextID);
-		SetTimer(kInitTextID, m_nPauseInterval * 1000, NULL);
-		SetTimer(kUpdateSpinID, kAnimateTextInterval, NULL);
+		DrawActiveString(*m_pFrameDC, m_CursorPt.y, m_CursorPt.x, &(m_CursorChar), 1,
+						 m_Config.textColor, BlockGlyph());
 		}
-	else if (done)
+	else if (m_nTextPreset == kRandomCursor)
 		{
-		m_nActiveLine++;
-		m_ActiveLine.Empty();
-		m_PhaseList.RemoveAll();
-		InitCursor();
+		DrawActiveString(*m_pFrameDC, m_CursorPt.y, m_CursorPt.x, &(m_CursorChar), 1,
+						 m_Config.textColor, SingleGlyph());
 		}
 }
 
 /*******************************************************************************
- DrawText (private)
+ InitBackgroundCharacters (private)
 
  *******************************************************************************/
 
 void
-JMatrixCtrl::DrawText()
+JMatrixCtrl::InitBackgroundCharacters
+	(
+	RainLayer&	layer,
+	const int	col
+	)
 {
-	for (int i=m_nPageStartLine; i<m_nActiveLine; i++)
+	const int bottomOffset = 3;
+
+	MatrixColumn& c = layer.pColumns[col];
+
+	c.nCounter = 0;
+	if (getrandom(1,2) == 1)
 		{
-		const CPoint& pt    = m_LineStartList.ElementAt(i - m_nPageStartLine);
-		const CString& line = m_LineList.ElementAt(i);
-		DrawActiveString(m_DC, pt.y, pt.x, line, line.GetLength(), kTextColor);
+		c.nCounter = getrandom(0, layer.nRows-bottomOffset);
 		}
 
-	if (m_nActiveLine >= 0)
+	c.nCounterMax = layer.nRows;
+	if (getrandom(1,2) == 1)
 		{
-		const CPoint& pt = m_LineStartList.ElementAt(m_nActiveLine - m_nPageStartLine);
-		DrawActiveString(m_DC, pt.y , pt.x, m_ActiveLine, m_ActiveLine.GetLength(), kTextColor);
+		c.nCounterMax = c.nCounter + getrandom(bottomOffset, layer.nRows-c.nCounter);
+		if (c.nCounterMax > layer.nRows)	// don't trust getrandom()
+			{
+			c.nCounterMax = layer.nRows;
+			}
 		}
+
+	const BOOL blank = (getrandom(1,5) == 1);
+	c.prev           = (blank ? ' ' : getrandom(kMinBackChar, kMaxBackChar));
 }
 
 /*******************************************************************************
- InitCursor
+ UpdateBackground (private)
+
+	Activates another column and returns its index, or -1 if none was
+	activated.  The columns are advanced by AdvanceRain().
 
  *******************************************************************************/
 
-void
-JMatrixCtrl::InitCursor()
+int
+JMatrixCtrl::UpdateBackground
+	(
+	RainLayer& layer
+	)
 {
-	if (m_bShowCursor && m_nActiveLine >= 0)
+	MatrixColumn* columns = layer.pColumns;
+	if (layer.nActiveColumns >= layer.nColumnLimit * m_nDensityScale / 100)
 		{
-		const CPoint& pt = m_LineStartList.ElementAt(m_nActiveLine - m_nPageStartLine);
-		m_CursorPt.x       = 0;
-		m_CursorPt.y       = pt.y;
-		SetTimer(kUpdateCursorID, kMoveCursorInterval, NULL);
+		return -1;
+		}
+
+	int nStartColumn, nSafetyCounter = 0;
+	do
+		{
+		nStartColumn = GetRandomIndex(layer.nCols);
+		nSafetyCounter++;
+		if (nSafetyCounter > layer.nCols)
+			break;
+		}
+		while (columns[nStartColumn].bActive);
+
+	if (!columns[nStartColumn].bActive)
+		{
+		StartColumn(layer, nStartColumn, -1);
+		return nStartColumn;
 		}
+
+	return -1;
 }
 
 /*******************************************************************************
- UpdateCursor
+ ActivateColumns (private)
+
+	Normally activates one column per tick.  The external signal changes
+	the rate by accumulating fractions of a column.
 
  *******************************************************************************/
 
 void
-JMatrixCtrl::UpdateCursor()
+JMatrixCtrl::ActivateColumns
+	(
+	RainLayer& layer
+	)
 {
-	m_CursorPt.x++;
-	if (CursorFinished())
+	layer.nActivationCredit += m_nActivationScale;
+	while (layer.nActivationCredit >= 100)
 		{
-		KillTimer(kUpdateCursorID);
+		layer.nActivationCredit -= 100;
+		UpdateBackground(layer);
 		}
 }
 
 /*******************************************************************************
- DrawCursor (private)
+ StartColumn (private)
+
+	Activates the given column.  If passRow is not negative, the drop
+	starts above it and does not stop before it.
 
  *******************************************************************************/
 
 void
-JMatrixCtrl::DrawCursor()
+JMatrixCtrl::StartColumn
+	(
+	RainLayer&	layer,
+	const int	col,
+	const int	passRow
+	)
 {
-	if (m_bShowCursor)
+	MatrixColumn& c = layer.pColumns[col];
+	ASSERT( !c.bActive && layer.nActiveColumns < layer.nCols );
+
+	c.bActive = TRUE;
+	InitBackgroundCharacters(layer, col);
+
+	layer.pActiveIndex[col]                 = layer.nActiveColumns;
+	layer.pActive[ layer.nActiveColumns++ ] = col;
+
+	if (passRow >= 0)
 		{
-		DrawActiveString(m_DC, m_CursorPt.y, m_CursorPt.x, &(m_CursorChar), 1, kTextColor);
+		c.nCounter    = min(c.nCounter, max(passRow-1, 0));
+		c.nCounterMax = layer.nRows;
 		}
+
+	// the normal speed is one row per configured layer interval; the
+	// governor only changes how often columns start, not how fast they fall
+
+	const int index    = &layer - m_RainLayer;
+	const int interval = m_Config.nAnimateBkgdInterval * m_Config.rainLayer[index].nIntervalScale / 100;
+	const int speed    = getrandom(m_Config.nMinDropSpeed, m_Config.nMaxDropSpeed);
+
+	layer.pPosition[col] = c.nCounter << kRowShift;
+	layer.pTime[col]     = layer.nClock;
+	layer.pVelocity[col] = max(1, (kRowOne / 100) * speed / max(1, interval));
+	ScheduleRainColumn(layer, col);
+
+	DrawFadedBackgroundChar(layer, col);
+	m_nFrameDrawCalls += layer.batch.Flush(layer.dc);
 }
 
 /*******************************************************************************
- InitBackgroundCharacters (private)
+ AdvanceRain (private)
+
+	Advances the layer's clock and processes the heads that entered a new
+	row, so the cost is proportional to the number of heads that changed
+	rows, not the number of columns.  The trail is only drawn into the
+	layer when a head enters a new row.
 
  *******************************************************************************/
 
 void
-JMatrixCtrl::InitBackgroundCharacters
+JMatrixCtrl::AdvanceRain
 	(
-	const int col
+	RainLayer&	layer,
+	const int	msec
 	)
 {
-	const int bottomOffset = 3;
+	layer.nClock = (int) ((DWORD) layer.nClock + msec);		// clock wraps
 
-	m_pMatrixColumns[col].nCounter = 0;
-	if (getrandom(1,2) == 1)
+	int col, count = 0;
+	while ((col = layer.wheel.PopDue(layer.nClock)) >= 0)
 		{
-		m_pMatrixColumns[col].nCounter = getrandom(0, m_nRows-bottomOffset);
-		}
+		const int pos = GetRainPosition(layer, col);
+		EnterRow(layer, col, pos >> kRowShift);
 
-	m_pMatrixColumns[col].nCounterMax = m_nRows;
-	if (getrandom(1,2) == 1)
-		{
-		m_pMatrixColumns[col].nCounterMax =
-			m_pMatrixColumns[col].nCounter +
-			getrandom(bottomOffset, m_nRows-m_pMatrixColumns[col].nCounter);
-		if (m_pMatrixColumns[col].nCounterMax > m_nRows)	// don't trust getrandom()
+		if (layer.pColumns[col].bActive)
 			{
-			m_pMatrixColumns[col].nCounterMax = m_nRows;
+			layer.pPosition[col] = pos;
+			layer.pTime[col]     = layer.nClock;
+			ScheduleRainColumn(layer, col);
 			}
+		count++;
 		}
 
-	const BOOL blank           = (getrandom(1,5) == 1);
-	m_pMatrixColumns[col].prev = (blank ? ' ' : getrandom(kMinBackChar, kMaxBackChar));
+	m_Stats.nRainEvents += count;
+	m_nFrameDrawCalls   += layer.batch.Flush(layer.dc);
+}
+
+/*******************************************************************************
+ GetRainPosition (private)
+
+	Returns the fixed-point position of the head at the layer's current
+	time.  The head never moves past nCounterMax.
+
+ *******************************************************************************/
+
+int
+JMatrixCtrl::GetRainPosition
+	(
+	const RainLayer&	layer,
+	const int			col
+	)
+	const
+{
+	const LONGLONG pos = layer.pPosition[col] +
+		(LONGLONG) layer.pVelocity[col] * (int) ((DWORD) layer.nClock - (DWORD) layer.pTime[col]);
+	return (int) min(pos, ((LONGLONG) layer.pColumns[col].nCounterMax) << kRowShift);
 }
 
 /*******************************************************************************
- UpdateBackground
+ ScheduleRainColumn (private)
+
+	Schedules the active column for the time when its head will enter the
+	next row.  pPosition must be current.
 
  *******************************************************************************/
 
 void
-JMatrixCtrl::UpdateBackground()
+JMatrixCtrl::ScheduleRainColumn
+	(
+	RainLayer&	layer,
+	const int	col
+	)
 {
-	// activate another column
+	const int remaining = ((layer.pColumns[col].nCounter + 1) << kRowShift) - layer.pPosition[col];
+	const int velocity  = layer.pVelocity[col];
+	const int msec      = max(1, (remaining + velocity - 1) / velocity);
+
+	layer.wheel.Schedule(col, (int) ((DWORD) layer.nClock + msec));
+}
+
+/*******************************************************************************
+ EnterRow (private)
+
+	Draws the trail for each row that the head passed, and retires the
+	column when it reaches the end.
+
+ *******************************************************************************/
 
-	if (m_nActiveColumns < m_nCols)
+void
+JMatrixCtrl::EnterRow
+	(
+	RainLayer&	layer,
+	const int	col,
+	const int	row
+	)
+{
+	MatrixColumn& c = layer.pColumns[col];
+	while (c.nCounter < row)
 		{
-		int nStartColumn, nSafetyCounter = 0;
-		do
+		c.nCounter++;
+		if (c.nCounter >= c.nCounterMax)
 			{
-			nStartColumn = rand() % m_nCols;
-			nSafetyCounter++;
-			if (nSafetyCounter > m_nCols)
-				break;
+			c.bActive            = FALSE;
+			layer.pVelocity[col] = 0;
+			layer.pPosition[col] = c.nCounter << kRowShift;
+
+			// swap the last active column into its place
+
+			const int i              = layer.pActiveIndex[col];
+			const int last           = layer.pActive[ --layer.nActiveColumns ];
+			layer.pActive[i]         = last;
+			layer.pActiveIndex[last] = i;
+			return;
 			}
-			while (m_pMatrixColumns[nStartColumn].bActive);
 
-		if (!m_pMatrixColumns[nStartColumn].bActive)
+		if (c.prev != ' ')
 			{
-			m_pMatrixColumns[nStartColumn].bActive = TRUE;
-			InitBackgroundCharacters(nStartColumn);
-			DrawActiveBackgroundChar(nStartColumn);
+			c.prev = getrandom(kMinBackChar, kMaxBackChar);
+			}
 
-			m_pMatrixColumns[nStartColumn].nCounter++;
-			m_nActiveColumns++;
+		DrawFadedBackgroundChar(layer, col);
+
+		if (c.nCounter == m_nRevealRow && &layer == m_RainLayer)
+			{
+			RevealRainColumn(col);
 			}
 		}
+}
+
+/*******************************************************************************
+ PrepareRainHeads (private)
+
+	The heads are drawn into the frame, at their exact positions, so they
+	move smoothly between rows.  Each head is an overlay, because the
+	next frame will draw it somewhere else.
+
+ *******************************************************************************/
 
-	// increment each active column
+void
+JMatrixCtrl::PrepareRainHeads
+	(
+	RainLayer& layer
+	)
+{
+	const int count             = layer.nActiveColumns;
+	const int* active           = layer.pActive;
+	const MatrixColumn* columns = layer.pColumns;
+	const BYTE* mask            = layer.pMask;
+	const BOOL glow             = (&layer == m_RainLayer && IsGlowActive());
 
-	for (int i=0; i<m_nCols; i++)
+	for (int j=0; j<count; j++)
 		{
-		if (m_pMatrixColumns[i].bActive &&
-			m_pMatrixColumns[i].nCounter >= m_pMatrixColumns[i].nCounterMax)
+		const int i           = active[j];
+		const MatrixColumn& c = columns[i];
+		if (mask[ c.nCounter * layer.nCols + i ])
 			{
-			DrawFadedBackgroundChar(i);
-
-			m_pMatrixColumns[i].bActive = FALSE;
-			m_nActiveColumns--;
+			m_nFrameSkips++;
+			continue;
 			}
-		else if (m_pMatrixColumns[i].bActive)
-			{
-			DrawFadedBackgroundChar(i);
-			DrawActiveBackgroundChar(i);
 
-			m_pMatrixColumns[i].nCounter++;
+		// the head may be slightly ahead of its row until AdvanceRain() catches up
+
+		const int offset = min(GetRainPosition(layer, i) - (c.nCounter << kRowShift), kRowMask);
+		const int dy     = (max(offset, 0) * layer.nTextHeight) >> kRowShift;
+		layer.headBatch.AddOffset(c.nCounter, i, dy, c.prev, kBrightLevel);
+
+		const int x = i * layer.nTextWidth;
+		const int y = c.nCounter * layer.nTextHeight + dy;
+		const CRect r(x, y, x + layer.nTextWidth, y + layer.nTextHeight);
+		MarkOverlay(r);
+
+		if (glow)
+			{
+			m_Glow.AddSource(r);
 			}
 		}
 }
 
 /*******************************************************************************
- DrawActiveBackgroundChar (private)
+ DrawRainHeads (private)
 
-	Must be called after DrawFadedBackgroundChar() since it replaces prev.
+	Draws the heads that PrepareRainHeads() collected.
 
  *******************************************************************************/
 
 void
-JMatrixCtrl::DrawActiveBackgroundChar
+JMatrixCtrl::DrawRainHeads
 	(
-	const int col
+	RainLayer& layer
 	)
 {
-	if (m_pMatrixColumns[col].prev != ' ')
+	if (!layer.headBatch.IsEmpty())
+		{
+		HGDIOBJ hOldFont   = ::SelectObject(m_pFrameDC->m_hDC, layer.font.m_hObject);
+		m_nFrameDrawCalls += layer.headBatch.Flush(*m_pFrameDC) + 2;
+		::SelectObject(m_pFrameDC->m_hDC, hOldFont);
+		}
+}
+
+/*******************************************************************************
+ DrawGlow (private)
+
+	Blurs the area around the heads that DrawRainHeads() added to m_Glow.
+	GDI must finish drawing the heads before the CPU can read them.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::DrawGlow()
+{
+	m_Stats.nGlowPixels = 0;
+	if (m_Glow.IsEmpty())
 		{
-		m_pMatrixColumns[col].prev = getrandom(kMinBackChar, kMaxBackChar);
+		return;
 		}
 
-	const int row = m_pMatrixColumns[col].nCounter;
-	DrawActiveString(m_BackDC, row, col, &(m_pMatrixColumns[col].prev), 1,
-					 RGB(0, kBrightGreen, 0));
+	GdiFlush();
+
+	const LONGLONG start = GetTime();
+	const int count      = m_Glow.Apply(m_Frame[ m_nDrawFrame ].pBits, m_nWidth * 4);
+	if (count > 0)
+		{
+		const int cost = (int) ((GetTime() - start) * 1000000 / count);
+		m_Stats.nGlowPixels = count;
+		m_Stats.nGlowCost  += (cost - m_Stats.nGlowCost) / 8;
+		}
 }
 
 /*******************************************************************************
@@ -663,67 +4635,109 @@ JMatrixCtrl::DrawActiveBackgroundChar
 void
 JMatrixCtrl::DrawFadedBackgroundChar
 	(
-	const int col
+	RainLayer&	layer,
+	const int	col
 	)
 {
-	const int row    = m_pMatrixColumns[col].nCounter - 1;
-	const CSize size = m_BackDC.GetTextExtent(&(m_pMatrixColumns[col].prev), 1);
+	const MatrixColumn& c = layer.pColumns[col];
+	ASSERT( 0 <= c.nCounter && c.nCounter < layer.nRows );
 
-	m_BackDC.SetTextColor(RGB(0, getrandom(kMinGreen, kMaxGreen), 0));
-	m_BackDC.TextOut(col * m_nTextWidth + (m_nTextWidth - size.cx)/2,
-					 row * m_nTextHeight,
-					 &(m_pMatrixColumns[col].prev), 1);
+	if (layer.pMask[ c.nCounter * layer.nCols + col ])
+		{
+		m_nFrameSkips++;
+		}
+	else
+		{
+		const int level = getrandom(0, kFadeLevelCount-1);
+		layer.batch.Add(c.nCounter, col, c.prev, level);
+		MarkChanged(CRect(    col * layer.nTextWidth,     c.nCounter * layer.nTextHeight,
+						  (col+1) * layer.nTextWidth, (c.nCounter+1) * layer.nTextHeight));
+		layer.pCells[ c.nCounter * layer.nCols + col ] = (WORD) ((BYTE) c.prev | (level << 8));
+		}
 }
 
 /*******************************************************************************
  UpdateSpin
 
+	Starts spinning characters at random cells at nSpinRate, and then
+	changes the cells that are due.  The cost is proportional to the
+	number of changes, not the size of the grid.  Only the cells that
+	change are redrawn, into m_SpinDC.
+
  *******************************************************************************/
 
 void
 JMatrixCtrl::UpdateSpin()
 {
-	// activate another spinning character
+	m_nSpinTick = (int) ((DWORD) m_nSpinTick + 1);		// tick wraps
 
-	if (m_nActiveSpins < m_nTotalSpins && getrandom(0,100) == 0)
+	// activate more spinning characters
+
+	m_nSpinCredit += m_Config.nSpinRate * m_nTextInterval * m_nSpinScale / 100;
+	int startCount = m_nSpinCredit / 10000;
+	m_nSpinCredit %= 10000;
+
+	const int cellCount = m_nRows * m_nCols;
+	while (startCount-- > 0 && m_nActiveSpins < m_nSpinLimit)
 		{
-		int nIndex, nSafetyCounter = 0;
-		do
+		const int cell = GetRandomIndex(cellCount);
+		if (m_pTextMask[cell])
 			{
-			nIndex = rand() % m_nTotalSpins;
-			nSafetyCounter++;
-			if (nSafetyCounter > m_nTotalSpins)
-				break;
+			m_nFrameSkips++;
 			}
-			while (m_pSpinChars[nIndex].bActive);
-
-		if (!m_pSpinChars[nIndex].bActive)
+		else if (m_pSpinEnd[cell] == 0)
 			{
-			m_pSpinChars[nIndex].bActive  = TRUE;
-			m_pSpinChars[nIndex].nCounter = getrandom(kMinSpinCount, kMaxSpinCount);
-			m_pSpinChars[nIndex].pt.x     = getrandom(0, m_nCols);
-			m_pSpinChars[nIndex].pt.y     = getrandom(0, m_nRows);
-
+			const int count  = max(1, getrandom(m_Config.nMinSpinCount, m_Config.nMaxSpinCount));
+			m_pSpinEnd[cell] = (int) ((DWORD) m_nSpinTick + count);
+			if (m_pSpinEnd[cell] == 0)
+				{
+				m_pSpinEnd[cell] = 1;		// 0 => idle; one more tick is harmless
+				}
+			m_SpinWheel.Schedule(cell, m_nSpinTick);
 			m_nActiveSpins++;
 			}
 		}
 
-	// increment each spinning character
+	ASSERT( 0 <= m_nActiveSpins && m_nActiveSpins <= cellCount );
 
-	for (int i=0; i<m_nTotalSpins; i++)
+	// change each cell that is due
+
+	int cell;
+	while ((cell = m_SpinWheel.PopDue(m_nSpinTick)) >= 0)
 		{
-		if (m_pSpinChars[i].bActive &&
-			m_pSpinChars[i].nCounter <= 0)
+		const int row = cell / m_nCols;
+		const int col = cell - row * m_nCols;
+
+		const int remaining = (int) ((DWORD) m_pSpinEnd[cell] - (DWORD) m_nSpinTick);
+		if (remaining <= 0)
 			{
-			m_pSpinChars[i].bActive = FALSE;
+			m_pSpinEnd[cell]  = 0;
+			m_pSpinChar[cell] = 0;
 			m_nActiveSpins--;
+			m_SpinBatch.Add(row, col, ' ', kBrightLevel);
+			MarkChanged(CRect(col * m_nTextWidth, row * m_nTextHeight,
+							  (col+1) * m_nTextWidth, (row+1) * m_nTextHeight));
 			}
-		else if (m_pSpinChars[i].bActive)
+		else
 			{
-			m_pSpinChars[i].c = getrandom(kMinBackChar, kMaxBackChar);
-			m_pSpinChars[i].nCounter--;
+			if (m_pTextMask[cell])
+				{
+				m_nFrameSkips++;
+				}
+			else
+				{
+				const char ch     = (char) getrandom(kMinBackChar, kMaxBackChar);
+				m_pSpinChar[cell] = (BYTE) ch;
+				m_SpinBatch.Add(row, col, ch, kBrightLevel);
+				MarkChanged(CRect(col * m_nTextWidth, row * m_nTextHeight,
+								  (col+1) * m_nTextWidth, (row+1) * m_nTextHeight));
+				}
+			m_SpinWheel.Schedule(cell, (int) ((DWORD) m_nSpinTick +
+											  min(getrandom(1, kMaxSpinPeriod), remaining)));
 			}
 		}
+
+	m_nFrameDrawCalls += m_SpinBatch.Flush(m_SpinDC);
 }
 
 /*******************************************************************************
@@ -734,21 +4748,170 @@ JMatrixCtrl::UpdateSpin()
 void
 JMatrixCtrl::DrawSpin()
 {
-	for (int i=0; i<m_nTotalSpins; i++)
+	m_pFrameDC->BitBlt(0, 0, m_nWidth, m_nHeight, &m_SpinDC, 0, 0, SRCPAINT);
+	m_nFrameDrawCalls++;
+}
+
+/*******************************************************************************
+ MarkTiles (private)
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::MarkTiles
+	(
+	BYTE*			tiles,
+	const CRect&	r
+	)
+{
+	const int x0 = max(r.left, 0) >> kDirtyTileShift;
+	const int y0 = max(r.top,  0) >> kDirtyTileShift;
+	const int x1 = min((r.right-1)  >> kDirtyTileShift, m_nDirtyCols-1);
+	const int y1 = min((r.bottom-1) >> kDirtyTileShift, m_nDirtyRows-1);
+
+	if (tiles != NULL && x0 <= x1)
+		{
+		for (int y=y0; y<=y1; y++)
+			{
+			memset(tiles + y * m_nDirtyCols + x0, 1, x1 - x0 + 1);
+			}
+		}
+}
+
+/*******************************************************************************
+ MarkAllChanged (private)
+
+	Every frame must be redrawn from scratch, e.g., after a plane was
+	cleared.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::MarkAllChanged()
+{
+	for (int i=0; i<kFrameCount; i++)
+		{
+		if (m_Frame[i].pDirty != NULL)
+			{
+			memset(m_Frame[i].pDirty, 1, m_nDirtyCols * m_nDirtyRows);
+			}
+		}
+}
+
+/*******************************************************************************
+ ClipToChangedTiles (private)
+
+	Adds the tiles that changed since the last Draw() to every frame, and
+	then clips the frame being drawn to the tiles that it is missing.
+	Afterwards, this frame only has to erase its overlays the next time it
+	is drawn.  Returns the percentage of the frame that will be redrawn.
+
+ *******************************************************************************/
+
+int
+JMatrixCtrl::ClipToChangedTiles()
+{
+	const int count = m_nDirtyCols * m_nDirtyRows;
+
+	for (int i=0; i<kFrameCount; i++)
+		{
+		BYTE* frameTiles = m_Frame[i].pDirty;
+		for (int j=0; j<count; j++)
+			{
+			frameTiles[j] |= m_pChangedTiles[j] | m_pOverlayTiles[j];
+			}
+		}
+
+	// the glow is added to the whole neighborhood of each head, so it
+	// would accumulate in the tiles that are not redrawn
+
+	BYTE* tiles     = m_Frame[ m_nDrawFrame ].pDirty;
+	const BOOL glow = IsGlowActive();
+	if (glow)
+		{
+		memset(tiles, 1, count);
+		}
+
+	// one rectangle per run of tiles in each row
+
+	RGNDATA* data = (RGNDATA*) m_pRgnData;
+	RECT* rect    = (RECT*) data->Buffer;
+	int rectCount = 0;
+	int tileCount = 0;
+
+	for (int y=0; y<m_nDirtyRows; y++)
+		{
+		const BYTE* row = tiles + y * m_nDirtyCols;
+
+		int x = 0;
+		while (x < m_nDirtyCols)
+			{
+			if (!row[x])
+				{
+				x++;
+				continue;
+				}
+
+			RECT& r = rect[ rectCount++ ];
+			r.left  = x << kDirtyTileShift;
+			r.top   = y << kDirtyTileShift;
+			while (x < m_nDirtyCols && row[x])
+				{
+				x++;
+				tileCount++;
+				}
+			r.right  = x << kDirtyTileShift;
+			r.bottom = (y+1) << kDirtyTileShift;
+			}
+		}
+
+	// a frame with glow has it everywhere, so it must be redrawn completely
+
+	if (glow)
+		{
+		memset(tiles, 1, count);
+		}
+	else
 		{
-		if (m_pSpinChars[i].bActive)
+		memcpy(tiles, m_pOverlayTiles, count);
+		}
+	memset(m_pChangedTiles, 0, count);
+	memset(m_pOverlayTiles, 0, count);
+
+	if (tileCount < count)
+		{
+		data->rdh.dwSize   = sizeof(RGNDATAHEADER);
+		data->rdh.iType    = RDH_RECTANGLES;
+		data->rdh.nCount   = rectCount;
+		data->rdh.nRgnSize = rectCount * sizeof(RECT);
+		data->rdh.rcBound.left   = 0;
+		data->rdh.rcBound.top    = 0;
+		data->rdh.rcBound.right  = m_nDirtyCols << kDirtyTileShift;
+		data->rdh.rcBound.bottom = m_nDirtyRows << kDirtyTileShift;
+
+		// if this fails, the whole frame is redrawn, which is always correct
+
+		HRGN rgn = ExtCreateRegion(NULL, sizeof(RGNDATAHEADER) + rectCount * sizeof(RECT), data);
+		if (rgn != NULL)
 			{
-			DrawActiveString(m_DC, m_pSpinChars[i].pt.y, m_pSpinChars[i].pt.x,
-							 &(m_pSpinChars[i].c), 1, RGB(0, kBrightGreen, 0));
+			::SelectClipRgn(m_pFrameDC->m_hDC, rgn);
+			DeleteObject(rgn);
+			m_nFrameDrawCalls += 3;
 			}
 		}
+
+	return tileCount * 100 / count;
 }
 
 /*******************************************************************************
  DrawActiveString (private)
 
+	K specifies whether str is a single glyph centered in its cell or a
+	solid block.  Lines of text are drawn by DrawTextRun().
+
  *******************************************************************************/
 
+template <class K>
 void
 JMatrixCtrl::DrawActiveString
 	(
@@ -757,32 +4920,30 @@ JMatrixCtrl::DrawActiveString
 	const int		col,
 	const char*		str,
 	const int		len,
-	const COLORREF	color
+	const COLORREF	color,
+	const K&		kind
 	)
 {
-	if (len > 0)
+	if (len <= 0)
 		{
-		const CSize size = dc.GetTextExtent(str, len);
-
-		CRect r(      col*m_nTextWidth,     row*m_nTextHeight,
-				(col+len)*m_nTextWidth, (row+1)*m_nTextHeight);
-		if (len > 1)
-			{
-			r.right = r.left + size.cx;
-			}
+		return;
+		}
 
-		if (len == 1 && str[0] == kBlockCursorChar)
-			{
-			dc.FillSolidRect(r, color);
-			}
-		else
-			{
-			dc.FillSolidRect(r, RGB(0,0,0));
+	CRect r(      col*m_nTextWidth,     row*m_nTextHeight,
+			(col+len)*m_nTextWidth, (row+1)*m_nTextHeight);
 
-			dc.SetTextColor(color);
-			dc.TextOut(col * m_nTextWidth + (len > 1 ? 0 : (m_nTextWidth - size.cx)/2),
-					   row * m_nTextHeight,
-					   str, len);
-			}
+	if (K::kBlock)
+		{
+		dc.FillSolidRect(r, color);
+		m_nFrameDrawCalls++;
+		return;
 		}
+
+	const CSize size = dc.GetTextExtent(str, len);
+
+	dc.FillSolidRect(r, RGB(0,0,0));
+	dc.SetTextColor(color);
+	dc.TextOut(col * m_nTextWidth + (m_nTextWidth - size.cx)/2, row * m_nTextHeight,
+			   str, len);
+	m_nFrameDrawCalls += 4;
 }
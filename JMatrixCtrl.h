@@ -6,9 +6,119 @@
 #pragma once
 
 #include <afxtempl.h>
+#include <afxmt.h>
+#include "JCommandQueue.h"
+#include "JFrameShare.h"
+#include "JGlowFilter.h"
+#include "JGlyphBatch.h"
+#include "JMatrixScript.h"
+#include "JSignalAnalyzer.h"
+#include "JTimingWheel.h"
+
+class JMatrixViewport;
 
 class JMatrixCtrl : public CWnd
 {
+public:
+
+	enum
+	{
+		kMaxRainLayers = 4
+	};
+
+	struct RainLayerConfig
+	{
+		int			nFontHeight;			// pixels
+		int			nIntervalScale;			// percent of nAnimateBkgdInterval; larger is slower
+		int			nIntensity;				// percent of the rain colors
+		int			nDensity;				// percent of columns that may be active
+		int			nCostShare;				// percent of the frame budget
+	};
+
+	struct Config
+	{
+		int			nColSpacing;			// pixels between columns
+		int			nAnimateTextInterval;	// milliseconds
+		int			nMoveCursorInterval;	// milliseconds
+		int			nAnimateBkgdInterval;	// milliseconds per row at normal speed
+		int			nAnimateRainInterval;	// milliseconds between rain frames
+		int			nMinDropSpeed;			// percent of normal speed
+		int			nMaxDropSpeed;			// percent of normal speed
+		float		fSpinCharFraction;		// max spinning characters, as fraction of columns
+		int			nMinSpinCount;			// centiseconds
+		int			nMaxSpinCount;			// centiseconds
+		int			nSpinRate;				// characters started per 10 seconds
+
+		COLORREF	textColor;
+		int			nBrightGreen;			// out of 255
+		int			nMinGreen;				// out of 255
+		int			nMaxGreen;				// out of 255
+
+		BOOL		bRenderThread;			// animate on a separate thread
+		BOOL		bSuspendWhenHidden;		// stop animating while not visible
+
+		int				nRainLayerCount;	// layer 0 is in front
+		RainLayerConfig	rainLayer[ kMaxRainLayers ];
+		BOOL			bIndexedRain;		// 8 bit rain buffers
+
+		int			nRevealMode;			// JMatrixScript::Reveal
+
+		BOOL		bGlow;					// glow around the bright heads
+		int			nGlowRadius;			// pixels
+		int			nGlowStrength;			// percent
+		int			nGlowThreshold;			// out of 255
+
+		int			nSignalDensity;			// percent modulation of the column limit
+		int			nSignalActivation;		// percent modulation of the column start rate
+		int			nSignalSpin;			// percent modulation of nSpinRate
+
+		int			nTickerRate;			// lines per second; 0 => pages
+
+		Config();
+	};
+
+	struct Stats
+	{
+		int		nFrames;				// frames drawn
+		int		nFrameTime;				// microseconds; smoothed update+draw time
+		int		nTimerLatency;			// microseconds; smoothed lateness of rain timer
+		int		nFrameBudget;			// microseconds; 0 => governor disabled
+		int		nQualityLevel;			// 0 => full quality
+		int		nDegradeCount;			// number of times quality was reduced
+		int		nRestoreCount;			// number of times quality was increased
+		int		nBkgdInterval;			// milliseconds; current rain update interval
+		int		nTextInterval;			// milliseconds; current text update interval
+		int		nColumnLimit;			// max simultaneously active columns
+		int		nSpinLimit;				// max simultaneously active spinning characters
+		int		nDrawCalls;				// GDI calls required for the last frame
+		int		nPresentedFrames;		// frames copied to the window
+		int		nDroppedFrames;			// frames replaced before being presented
+		int		nPresentLatency;		// microseconds; smoothed time from completion to present
+		int		nLayerInterval[ kMaxRainLayers ];	// milliseconds; current update interval
+		int		nLayerCost[ kMaxRainLayers ];		// microseconds; smoothed update time
+		int		nLayoutMisses;			// pages laid out synchronously
+		int		nScriptCompileTime;		// microseconds; total spent in AddTextLine()
+		int		nBufferBytes;			// offscreen bitmap memory
+		int		nSuspendCount;			// number of times animation was suspended
+		int		nSuspendedTime;			// milliseconds; total time suspended
+		int		nTextUpdates;			// characters touched while phasing in text
+		int		nRecomputeTime;			// microseconds; last rebuild after changing a font
+		int		nCommandCount;			// commands applied from the queue
+		int		nCommandStalls;			// times a caller found the queue full
+		int		nMaskedCells;			// text cells hidden behind the current page
+		int		nSkippedCells;			// glyphs under the text that were not drawn in the last frame
+		int		nRainEvents;			// heads that entered a row or stopped in the last rain update
+		int		nSharedFrames;			// frames published to other processes
+		int		nGlowPixels;			// pixels blurred in the last frame
+		int		nGlowCost;				// microseconds per megapixel; smoothed
+		int		nSignalLevel;			// 0 to 1000; JSignalAnalyzer::kNeutralLevel if no signal
+		int		nSignalBass;
+		int		nSignalTreble;
+		int		nSnapshotTime;			// microseconds; last SaveSnapshot() or RestoreSnapshot()
+		int		nTickerLines;			// lines read in ticker mode, including those never shown
+		int		nRedrawPercent;			// area of the last frame that was redrawn
+	};
+
 public:
 
 	JMatrixCtrl();
@@ -16,11 +126,41 @@ public:
 	virtual	~JMatrixCtrl();
 
 	void	AddTextLine(LPCTSTR lpszLine);
+	void	ClearText();
 
 	void	SetIntervals(const int intro, const int restart);
 	void	SetCursor(const BOOL show, const BOOL solid);
 	void	SetMaxPhaseCount(const int maxCount);
 	void	AllowEuropeanChars(const BOOL allow);
+	void	SetFrameBudget(const int msec);
+
+	void	SetTextFont(const LOGFONT& font);
+	void	SetRainFont(const LOGFONT& font);
+
+	void	SaveSnapshot(CByteArray* data);
+	BOOL	RestoreSnapshot(const BYTE* data, const int length);
+
+	BOOL	PlaySignal(LPCTSTR wavFileName);
+	void	PushMetric(const int level);
+	void	StopSignal();
+
+	const Config&	GetConfig() const;
+	void			SetConfig(const Config& config);
+
+	const Stats&	GetStats() const;
+
+	void	AddViewport(JMatrixViewport* viewport);
+	void	RemoveViewport(JMatrixViewport* viewport);
+	void	DrawViewport(CDC& dc, const CRect& source);
+
+	BOOL	ShareFrames(LPCTSTR name);
+	void	StopSharingFrames();
+
+	// for tests:  time only passes in Step(), and the random numbers
+	// repeat for a given seed
+
+	void	UseManualClock(const DWORD seed);
+	void	Step(const int msec);
 
 	//{{AFX_VIRTUAL(JMatrixCtrl)
 	public:
@@ -32,11 +172,88 @@ protected:
 	//{{AFX_MSG(JMatrixCtrl)
 	afx_msg void OnPaint();
 	afx_msg void OnTimer(UINT nIDEvent);
+	afx_msg void OnDestroy();
 	//}}AFX_MSG
 	DECLARE_MESSAGE_MAP()
 
 private:
 
+	enum
+	{
+		kInitTextID,
+		kUpdateTextID,
+		kUpdateCursorID,
+		kUpdateSpinID,		// only runs when kUpdateTextID does not run to minimize redraws
+		kNextLineID,		// per-line delay
+		kAnimateRainID,
+		kUpdateBackgroundID,	// one per rain layer
+
+		kTimerCount = kUpdateBackgroundID + kMaxRainLayers
+	};
+
+	enum
+	{
+		kFrameCount = 3		// drawing, ready, presenting
+	};
+
+	// Drop positions are fixed-point rows.
+
+	enum
+	{
+		kRowShift        = 16,
+		kRowOne          = 1 << kRowShift,
+		kRowMask         = kRowOne - 1,
+		kMaxDropVelocity = kRowOne << 8,	// 256 rows per millisecond; only corrupt snapshots are faster
+		kRainWheelSize   = 256,				// milliseconds; slower heads go into the coarse slots
+		kSpinWheelSize   = 64				// ticks; larger than kMaxSpinPeriod, so each tick scans one slot
+	};
+
+	// Faded rain characters are quantized to kFadeLevelCount shades, so
+	// they can be drawn in batches.  The bright level follows the faded
+	// levels.
+
+	enum
+	{
+		kMinBackChar    = 32,
+		kMaxBackChar    = 255,
+		kFadeLevelCount = 8,
+		kBrightLevel    = kFadeLevelCount
+	};
+
+	enum
+	{
+		kNoCursor,			// m_nTextPreset
+		kBlockCursor,
+		kRandomCursor
+	};
+
+	enum
+	{
+		kAddTextLineCmd,
+		kClearTextCmd,
+		kSetIntervalsCmd,
+		kSetCursorCmd,
+		kSetMaxPhaseCountCmd,
+		kAllowEuropeanCharsCmd
+	};
+
+	struct Timer
+	{
+		int			nInterval;			// milliseconds; 0 => inactive
+		LONGLONG	due;				// microseconds
+	};
+
+	struct Frame
+	{
+		CDC			dc;
+		CBitmap		bitmap;
+		HGDIOBJ		hBitmapOld;
+		HGDIOBJ		hFontOld;
+		BYTE*		pBits;				// NULL unless the frame is a DIB section
+		BYTE*		pDirty;				// tiles to redraw the next time; 1 => redraw
+		LONGLONG	completedTime;		// microseconds
+	};
+
 	struct MatrixColumn
 	{
 		BOOL	bActive;				// column is active
@@ -45,162 +262,579 @@ private:
 		char	prev;					// previous character in column
 	};
 
-	struct SpinChar
+	struct RainLayer
 	{
-		BOOL	bActive;				// character is active
-		int		nCounter;				// number of iterations left
-		CPoint	pt;						// location
-		char	c;						// current character
+		CFont			font;
+		CDC				dc;
+		CBitmap			bitmap;
+		HGDIOBJ			hBitmapOld;
+		HGDIOBJ			hFontOld;
+		JGlyphBatch		batch;				// trail, drawn into dc
+		JGlyphBatch		headBatch;			// heads, drawn into each frame
+
+		int				nTextWidth;
+		int				nTextHeight;
+		int				nRows;
+		int				nCols;
+
+		MatrixColumn*	pColumns;
+		int*			pPosition;			// head at pTime; fixed-point rows
+		int*			pTime;				// nClock when pPosition was computed
+		int*			pVelocity;			// fixed-point rows per millisecond; 0 if inactive
+		int*			pActive;			// indices of the active columns
+		int*			pActiveIndex;		// index of each active column in pActive
+		int				nActiveColumns;
+		JTimingWheel	wheel;				// when each active head enters the next row
+		int				nClock;				// milliseconds of rain
+		int				nColumnLimit;		// max active columns at current quality
+		int				nActivationCredit;	// hundredths of a column start
+		int				nSlowdown;			// interval multiplier imposed by cost budget
+		BYTE*			pMask;				// 1 => cell is hidden by text
+		WORD*			pCells;				// char | (fade level << 8) in dc; 0 => empty
 	};
 
 	typedef CArray<CPoint, CPoint&>	CPointList;
+	typedef CArray<int, int>		CIndexList;
+
+	typedef CArray<JMatrixScript::Style, JMatrixScript::Style&>	CStyleList;
+	typedef CArray<JMatrixViewport*, JMatrixViewport*>			CViewportList;
+
+	struct PageLayout
+	{
+		int						nEndOffset;		// script offset of the next page
+		JMatrixScript::Style	endStyle;		// style at the start of the next page
+		int						nPauseInterval;	// seconds; how long to wait before going to next page
+		LONG					nSerial;		// m_nLayoutSerial when it was built
+		CStringArray			lines;
+		CPointList				lineStart;		// character grid coordinates
+		CStyleList				lineStyle;
+		CByteArray				code;			// copy of the script that is laid out
+		CIndexList				lineText;		// text index of each line
+	};
 	typedef CArray<int, int>		CPhaseList;
 
+	struct TickerLine
+	{
+		char*		pText;				// target characters; not terminated
+		char*		pShown;				// characters in the text plane
+		int*		pPhase;				// phase count of each character
+		int			nLength;
+		int			nAlign;				// JMatrixScript::Align
+		int			nCol;				// grid column of the first character
+		int			nPhaseCount;		// max phase count
+		int			nPhasing;			// characters that are still changing
+		BOOL		bDirty;				// must be redrawn in the text plane
+		COLORREF	color;
+	};
+
+	typedef CArray<MatrixColumn, MatrixColumn&>	CColumnList;
+
+	// ReadSnapshot() decodes into these, so nothing changes until the
+	// whole snapshot has been validated
+
+	struct SnapshotLayer
+	{
+		int				nClock;
+		int				nActivationCredit;
+		CPhaseList		active;				// indices of the active columns, in order
+		CColumnList		columns;			// parallel to active
+		CPhaseList		position;			// parallel to active
+		CPhaseList		time;				// parallel to active
+		CPhaseList		velocity;			// parallel to active
+		JTimingWheel	wheel;
+		CWordArray		cells;
+	};
+
+	struct Snapshot
+	{
+		DWORD			nRandomState;
+		Timer			timer[ kTimerCount ];
+		int				nTextTimerID;
+		LONGLONG		rainTime;
+
+		SnapshotLayer	layer[ kMaxRainLayers ];
+
+		int				nSpinTick;
+		int				nSpinCredit;
+		CPhaseList		spinCell;			// active cells, in increasing order
+		CPhaseList		spinEnd;			// parallel to spinCell
+		JTimingWheel	spinWheel;
+		CByteArray		spinChar;
+
+		int						nNextPageOffset;
+		JMatrixScript::Style	nextPageStyle;
+		PageLayout				page;
+
+		int				nActiveLine;
+		int				nLineCursor;
+		int				nLinePhaseCount;
+		int				nLineReveal;
+		CString			activeLine;
+		CPhaseList		phaseList;
+		CPhaseList		phasingList;
+		CPhaseList		revealOrder;
+		int				nRevealCount;
+		int				nHiddenCount;
+		int				nRevealRow;
+		CPhaseList		revealColumn;
+		CPhaseList		revealNext;
+		CPoint			cursorPt;
+		char			cursorChar;
+		int				nTextPreset;
+
+		BOOL			bTicker;
+		int				nTickerCredit;
+		CArray<TickerLine, TickerLine&>	tickerLine;		// newest first; pointers are not used
+		CByteArray		tickerText;			// pText of each line, m_nTickerWidth apart
+		CByteArray		tickerShown;		// pShown of each line, m_nTickerWidth apart
+		CPhaseList		tickerPhase;		// pPhase of each line, m_nTickerWidth apart
+	};
+
 private:
 
+	int				m_nWidth;
+	int				m_nHeight;
 	int				m_nTextHeight;
 	int				m_nTextWidth;
 	int				m_nRows;
 	int				m_nCols;
 
-	char			m_MaxChar;			// out of 255
+	Config			m_Config;
+	BOOL			m_bEuropeanChars;	// allow characters above 127
 	int				m_IntroInterval;	// seconds
 	int				m_RestartInterval;	// seconds
 	int				m_nMaxPhaseCount;	// cycles
+	DWORD			m_nRandomState;		// NextRandom()
 
 	BOOL			m_bShowCursor;		// FALSE => phase in entire line immediately
 	CPoint			m_CursorPt;
 	char			m_CursorChar;		// 1 => solid block
-
-	CStringArray	m_LineList;			// all lines to display
-	int				m_nPageStartLine;	// first line on current page
-	int				m_nPageEndLine;		// last line on current page
-	CPointList		m_LineStartList;	// character grid coordinates
-	int				m_nActiveLine;		// index of line being phased in
+	int				m_nTextPreset;		// cursor style, cached for UpdateText()
+
+	JMatrixScript	m_Script;			// all lines to display
+	int				m_nNextPageOffset;	// script offset of the next page
+	JMatrixScript::Style	m_NextPageStyle;
+	LONG			m_nLayoutSerial;	// incremented when the next page changes
+	int				m_nActiveLine;		// index on current page of line being phased in
+	int				m_nLineCursor;		// cursor style of the active line
+	int				m_nLinePhaseCount;	// max phase count of the active line
+	int				m_nLineReveal;		// reveal mode of the active line
 	CString			m_ActiveLine;		// partially phased in line
-	CPhaseList		m_PhaseList;		// phase count for each character in active line
-	int				m_nPauseInterval;	// seconds; how long to wait before going to next page
-
-	CDC				m_DC;
-	CFont*			m_pFontOld;
-	CBitmap*		m_pBitmapOld;
-	CBitmap			m_Bitmap;
-
-	MatrixColumn*	m_pMatrixColumns;	// all the columns that are displayed
-	int				m_nActiveColumns;	// number of active columns
+	CPhaseList		m_PhaseList;		// phase count for each character in active line; -1 => hidden
+	CPhaseList		m_PhasingList;		// indices of characters that are still changing
+	CPhaseList		m_RevealOrder;		// indices of characters in the order they appear
+	int				m_nRevealCount;		// position in m_RevealOrder
+	int				m_nHiddenCount;		// characters not yet revealed
+	int				m_nRevealRow;		// row of front rain layer that reveals text; -1 => none
+	CPhaseList		m_RevealColumn;		// first hidden character under each front rain column
+	CPhaseList		m_RevealNext;		// next hidden character under the same column
+	int				m_nCharAdvance;		// widest glyph in text font
+	CArray<INT, INT>	m_TextDx;		// m_nCharAdvance for each character, for ExtTextOut()
+
+	PageLayout		m_PageLayout[2];
+	PageLayout*		m_pPage;			// current page
+	PageLayout*		m_pNextPage;		// owned by whoever sets m_nNextPageState to kPageBusy
+	volatile LONG	m_nNextPageState;
+	CEvent			m_LayoutEvent;
+	CWinThread*		m_pLayoutThread;
+	volatile LONG	m_bStopLayout;
+
+	Frame			m_Frame[ kFrameCount ];
+	CDC*			m_pFrameDC;			// frame being drawn
+	int				m_nDrawFrame;		// owned by the render thread
+	volatile LONG	m_nReadyFrame;		// handed off via InterlockedExchange()
+	int				m_nPresentFrame;	// owned by the UI thread
+	BOOL			m_bPainted;			// OnPaint() ran since the last UpdateVisibility()
+	int				m_nDirtyCols;		// tiles of 1 << kDirtyTileShift pixels
+	int				m_nDirtyRows;
+	BYTE*			m_pChangedTiles;	// changed since the last Draw()
+	BYTE*			m_pOverlayTiles;	// covered by the heads and the cursor in this frame
+	BYTE*			m_pRgnData;			// clip region built from the tiles
+	CViewportList	m_ViewportList;
+	JFrameShare		m_FrameShare;		// other processes display the frames
+
+	RainLayer		m_RainLayer[ kMaxRainLayers ];
+	int				m_nRainLayerCount;	// 0 until Create() is called
 
 	int				m_nTotalSpins;
-	SpinChar*		m_pSpinChars;
 	int				m_nActiveSpins;
-
-	CDC				m_BackDC;
-	CFont*			m_pBackFontOld;
-	CBitmap*		m_pBackBitmapOld;
-	CBitmap			m_BackBitmap;
+	int*			m_pSpinEnd;			// tick at which each cell stops; 0 => inactive
+	BYTE*			m_pSpinChar;		// character in m_SpinDC; 0 => empty
+	JTimingWheel	m_SpinWheel;		// next change of each active cell
+	int				m_nSpinTick;
+	int				m_nSpinCredit;		// fraction of a start, out of 10000
+	CDC				m_SpinDC;			// spinning characters, composited onto the rain
+	CBitmap			m_SpinBitmap;
+	HGDIOBJ			m_hSpinBitmapOld;
+	HGDIOBJ			m_hSpinFontOld;
 
 	CFont			m_Font;
-	CFont			m_BGFont;
+	LOGFONT			m_TextFontInfo;
+	LOGFONT			m_RainFontInfo;		// height comes from Config::rainLayer
+
+	JGlyphBatch		m_SpinBatch;		// drawn into m_SpinDC
+	int				m_nFrameDrawCalls;	// GDI calls since last Draw()
+	int				m_nFrameSkips;		// glyphs not drawn under text since last Draw()
+	JGlowFilter		m_Glow;				// only used if the frames are DIB sections
+
+	CDC				m_TextDC;			// text plane, only redrawn where characters change
+	CBitmap			m_TextBitmap;
+	HGDIOBJ			m_hTextBitmapOld;
+	HGDIOBJ			m_hTextFontOld;
+	BYTE*			m_pTextMask;		// 1 => cell is hidden by text
+	int				m_nMaskedLength;	// cells of the active line in m_pTextMask
+	BOOL			m_bTextPlaneClear;	// nothing drawn since ClearTextPlane()
+	CPhaseList		m_TextDirtyList;	// characters of m_ActiveLine not yet in m_TextDC
+	int				m_nTextDirtyCount;	// used part of m_TextDirtyList
+	CByteArray		m_TextDirtyFlag;	// 1 => character is in m_TextDirtyList
+
+	// adaptive quality
+
+	int				m_nBkgdInterval;	// milliseconds; before per-layer scaling
+	int				m_nTextInterval;	// milliseconds
+	int				m_nRainInterval;	// milliseconds
+	LONGLONG		m_RainTime;			// microseconds; rain has been advanced to here
+	int				m_nSpinLimit;		// max active spins at current quality
+	int				m_nTextTimerID;		// kUpdateTextID, kUpdateSpinID, or -1
+	LONGLONG		m_GovernorTime;		// microseconds; start of evaluation window
+	int				m_nHeadroomCount;	// consecutive windows with spare time
+	Stats			m_Stats;
+
+	// ticker
+
+	BOOL			m_bTicker;			// text is in ticker mode
+	TickerLine*		m_pTickerLine;		// ring of m_nTickerRows slots
+	char*			m_pTickerChars;		// storage for pText and pShown of every slot
+	int*			m_pTickerPhase;		// storage for pPhase of every slot
+	int				m_nTickerRows;		// the newest line is in the last one
+	int				m_nTickerWidth;		// max characters per line
+	int				m_nTickerHead;		// slot of the newest line
+	int				m_nTickerCount;		// lines on screen
+	int				m_nTickerCredit;	// thousandths of a line
+
+	// external signal
+
+	JSignalAnalyzer	m_Signal;
+	int				m_nDensityScale;	// percent; 100 => no signal
+	int				m_nActivationScale;	// percent
+	int				m_nSpinScale;		// percent
+
+	// scheduling
+
+	Timer			m_Timer[ kTimerCount ];
+	CCriticalSection	m_StateLock;	// protects everything except the frames
+	JCommandQueue	m_Commands;			// drained by Tick() while holding m_StateLock
+	CString			m_PendingText;		// first slots of a command whose text continues
+	CEvent			m_WakeEvent;
+	CEvent			m_CommandEvent;		// set after the queue was drained
+	volatile LONG	m_nCommandStalls;	// copied to m_Stats by DrainCommands()
+	CWinThread*		m_pRenderThread;
+	volatile LONG	m_bSuspended;		// set by the UI thread
+	LONGLONG		m_SuspendTime;		// microseconds; 0 if not suspended
+	volatile LONG	m_bStopRender;
+	LONGLONG		m_ManualTime;		// microseconds; -1 => real clock
 
 private:
 
+	void	StartTimer(const int id, const int msec);
+	void	StopTimer(const int id);
+	void	StartPause(const int seconds);
+
+	void	PushCommand(const int type, const int value1, const int value2,
+						LPCTSTR text = NULL);
+	void	WaitForCommandSlot(const LONG ticket);
+	void	DrainCommands();
+	void	ApplyCommand(const JCommandQueue::Command& cmd);
+
+	void	Tick();
+	LONGLONG	GetTime() const;
+	void	UpdateVisibility();
+	BOOL	IsOnScreen(CWnd* window, const BOOL painted) const;
+	void	FastForward(const LONGLONG usec);
+	void	FastForwardColumn(RainLayer& layer, const int col, const int msec);
+	int		GetTimeToNextTick() const;
+
+	void	StartRenderThread();
+	void	StopRenderThread();
+
+	static UINT	RenderThreadMain(LPVOID param);
+
+	void		StartLayoutThread();
+	void		StopLayoutThread();
+	static UINT	LayoutThreadMain(LPVOID param);
+	void		BuildPageLayout(PageLayout* page);
+	void		AlignPageLayout(PageLayout* page);
+
 	void	Draw();
+	CDC*	AcquirePresentFrame();
+
+	void	UpdateGovernor(const LONGLONG frameStart, const LONGLONG now);
+	void	ApplyQualityLevel(const int level);
+	void	UpdateSignal();
+
+	void	WriteSnapshot(CArchive& ar);
+	BOOL	ReadSnapshotGeometry(CArchive& ar);
+	void	ReadSnapshot(CArchive& ar, Snapshot* snapshot);
+	void	ReadSnapshotLayer(CArchive& ar, const RainLayer& layer,
+							  SnapshotLayer* snapshot);
+	void	ReadSnapshotText(CArchive& ar, Snapshot* snapshot);
+	void	ValidateActiveLine(const Snapshot& snapshot) const;
+	void	ApplySnapshot(Snapshot& snapshot);
+	void	RedrawRainLayer(RainLayer& layer);
+	void	RedrawSpin();
+
+	static void	WriteStyle(CArchive& ar, const JMatrixScript::Style& style);
+	static void	ReadStyle(CArchive& ar, JMatrixScript::Style* style);
+	static void	WritePhaseList(CArchive& ar, const CPhaseList& list);
+	static void	ReadPhaseList(CArchive& ar, CPhaseList* list);
+
+	static int	GetSignalScale(const int level, const int depth);
+	void	BudgetRainLayers();
+
+	void	AllocateSpinChars();
+	void	UpdateBatchColors();
+	void	UpdateGlowParameters();
 
 	void	InitText();
+	void	UpdateTextPreset();
 	void	UpdateText();
+	void	AdvanceLine();
+	void	ActivateLine();
+	COLORREF	GetLineColor(const int index) const;
+	template <class P>
+	BOOL	UpdateTextT(const P& preset);
 	void	DrawText();
+	int		GetLineColumn(const int length, const int align) const;
+
+	void	AllocateTicker();
+	void	InitTicker();
+	void	UpdateTicker();
+	int		ReadTickerLine();
+	void	StartTickerLine(TickerLine& line, const CString& text,
+							const JMatrixScript::Style& style);
+	void	PhaseTickerLine(TickerLine& line);
+	void	ScrollTicker(const int count);
+	void	DrawTickerLine(TickerLine& line, const int row);
+	void	DrawTicker();
+
+	void	MarkTextDirty(const int index);
+	void	ResetTextDirty(const int length);
+	void	UpdateTextPlane();
+	void	RedrawTextPlane();
+	void	ClearTextPlane();
+	void	DrawTextRun(const CPoint& pt, const int offset, const char* str,
+						const int len, const COLORREF color);
+	void	MaskTextCells(const int row, const int first, const int last);
+	BOOL	IsHiddenByText(const CRect& r) const;
+
+	void	BuildRevealOrder(const int length);
+	void	RevealChar(const int index);
+	int		GetRevealColumn(const int index) const;
+	void	StartRevealDrop();
+	void	RevealRainColumn(const int col);
 
 	void	InitCursor();
 	void	UpdateCursor();
 	BOOL	CursorFinished();
+	BOOL	IsGlowActive() const;
+	DWORD	NextRandom();
+	int		GetRandomIndex(const int count);
 	void	DrawCursor();
 
-	void	UpdateBackground();
-	void	InitBackgroundCharacters(const int nColumn);
-	void	DrawActiveBackgroundChar(const int col);
-	void	DrawFadedBackgroundChar(const int col);
+	void	Recompute();
+
+	void	CreateRainLayer(CDC& dc, const int index);
+	void	SetRainLayerFont(const int index);
+	BOOL	CreateIndexedBitmap(CDC& dc, CBitmap* bitmap);
+	BOOL	CreateRGBBitmap(CDC& dc, CBitmap* bitmap, BYTE** bits);
+	void	ScheduleRainLayer(const int index);
+	int		UpdateBackground(RainLayer& layer);
+	void	ActivateColumns(RainLayer& layer);
+	void	StartColumn(RainLayer& layer, const int col, const int passRow);
+	void	InitBackgroundCharacters(RainLayer& layer, const int nColumn);
+	void	AdvanceRain(RainLayer& layer, const int msec);
+	void	EnterRow(RainLayer& layer, const int col, const int row);
+	int		GetRainPosition(const RainLayer& layer, const int col) const;
+	void	ScheduleRainColumn(RainLayer& layer, const int col);
+	void	PrepareRainHeads(RainLayer& layer);
+	void	DrawRainHeads(RainLayer& layer);
+	void	DrawGlow();
+	void	DrawFadedBackgroundChar(RainLayer& layer, const int col);
 
 	void	UpdateSpin();
 	void	DrawSpin();
 
+	void	MarkChanged(const CRect& r);
+	void	MarkOverlay(const CRect& r);
+	void	MarkTiles(BYTE* tiles, const CRect& r);
+	void	MarkAllChanged();
+	int		ClipToChangedTiles();
+
+	template <class K>
 	void	DrawActiveString(CDC& dc, const int row, const int col,
-							 const char* str, const int len, const COLORREF green);
+							 const char* str, const int len, const COLORREF color,
+							 const K& kind);
 };
 
 
 /*******************************************************************************
- AddTextLine
+ MarkTextDirty (private)
+
+	The character of m_ActiveLine at index must be redrawn in the text
+	plane.  The characters are collected individually, because with
+	random reveal, they are scattered across the whole line.
 
  *******************************************************************************/
 
 inline void
-JMatrixCtrl::AddTextLine
+JMatrixCtrl::MarkTextDirty
 	(
-	LPCTSTR lpszLine
+	const int index
 	)
 {
-	m_LineList.Add(lpszLine);
-	m_nPageEndLine = m_LineList.GetSize();	// force InitText() to start at beginning
+	if (!m_TextDirtyFlag[ index ])
+		{
+		m_TextDirtyFlag[ index ]            = 1;
+		m_TextDirtyList[ m_nTextDirtyCount ] = index;
+		m_nTextDirtyCount++;
+		}
 }
 
 /*******************************************************************************
- AllowEuropeanChars
-
-	The disadvantage of allowing European characters is that it takes longer
-	for the text to phase in.
+ GetLineColor (private)
 
  *******************************************************************************/
 
-inline void
-JMatrixCtrl::AllowEuropeanChars
+inline COLORREF
+JMatrixCtrl::GetLineColor
 	(
-	const BOOL allow
+	const int index
 	)
+	const
 {
-	m_MaxChar = (allow ? 255 : 127);
+	const COLORREF color = m_pPage->lineStyle.ElementAt(index).color;
+	return (color == (COLORREF) JMatrixScript::kDefaultValue ? m_Config.textColor : color);
 }
 
 /*******************************************************************************
- SetIntervals
+ GetConfig
 
-	The wait time before the first time and the wait time between repetitions.
+ *******************************************************************************/
+
+inline const JMatrixCtrl::Config&
+JMatrixCtrl::GetConfig()
+	const
+{
+	return m_Config;
+}
+
+/*******************************************************************************
+ GetStats
+
+	Performance counters and the decisions made by the quality governor.
+
+ *******************************************************************************/
+
+inline const JMatrixCtrl::Stats&
+JMatrixCtrl::GetStats()
+	const
+{
+	return m_Stats;
+}
+
+/*******************************************************************************
+ CursorFinished (private)
+
+ *******************************************************************************/
+
+inline BOOL
+JMatrixCtrl::CursorFinished()
+{
+	return (m_CursorPt.x >= m_nCols);
+}
+
+/*******************************************************************************
+ MarkChanged (private)
+
+	Something in r changed in one of the planes that are composited into
+	the frames.
 
  *******************************************************************************/
 
 inline void
-JMatrixCtrl::SetIntervals
+JMatrixCtrl::MarkChanged
 	(
-	const int intro,
-	const int restart
+	const CRect& r
 	)
 {
-	m_IntroInterval   = intro;
-	m_RestartInterval = restart;
+	MarkTiles(m_pChangedTiles, r);
 }
 
 /*******************************************************************************
- SetMaxPhaseCount
+ MarkOverlay (private)
 
-	The larger the max phase count, the longer it may take for the text
-	to settle down.
+	Something is drawn in r directly into the frame, so the frame must
+	erase it the next time it is drawn.
 
  *******************************************************************************/
 
 inline void
-JMatrixCtrl::SetMaxPhaseCount
+JMatrixCtrl::MarkOverlay
 	(
-	const int maxCount
+	const CRect& r
 	)
 {
-	m_nMaxPhaseCount = maxCount;
+	MarkTiles(m_pOverlayTiles, r);
 }
 
 /*******************************************************************************
- CursorFinished (private)
+ IsGlowActive (private)
 
  *******************************************************************************/
 
 inline BOOL
-JMatrixCtrl::CursorFinished()
+JMatrixCtrl::IsGlowActive()
+	const
 {
-	return (m_CursorPt.x >= m_nCols);
+	return (m_Config.bGlow && m_Frame[ m_nDrawFrame ].pBits != NULL &&
+			m_Stats.nQualityLevel == 0);
+}
+
+/*******************************************************************************
+ NextRandom (private)
+
+	xorshift32.  rand() is not used, because the state of the generator
+	must be saved in the snapshot, and it only returns 15 bits, which is
+	not enough for a large grid.
+
+ *******************************************************************************/
+
+inline DWORD
+JMatrixCtrl::NextRandom()
+{
+	DWORD x = m_nRandomState;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	m_nRandomState = x;
+	return x;
+}
+
+/*******************************************************************************
+ GetRandomIndex (private)
+
+	Returns a random number in [0, count), or 0 if count is not positive,
+	so getrandom() with an empty range (e.g., a tiny grid or a minimum
+	that exceeds the maximum) returns the minimum instead of dividing by
+	zero.
+
+ *******************************************************************************/
+
+inline int
+JMatrixCtrl::GetRandomIndex
+	(
+	const int count
+	)
+{
+	return (count > 1 ? (int) (NextRandom() % (DWORD) count) : 0);
 }
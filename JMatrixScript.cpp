@@ -0,0 +1,301 @@
+/*******************************************************************************
+ JMatrixScript.cpp
+
+	Compiles the lines passed to JMatrixCtrl::AddTextLine() into a compact
+	instruction stream, so the animation never has to parse text.  Each
+	instruction is an opcode byte followed by a 4 byte value.
+
+	Besides text and page breaks ("\x01 T"), a line may contain
+	directives:
+
+		"\x02 delay=500 align=left color=80FF80 phase=5 reveal=rain"
+
+	Each directive applies to all following lines until it is changed
+	again.  "default" restores the setting from JMatrixCtrl.
+
+		delay	milliseconds to wait before starting each line
+		align	left, center, right
+		color	RRGGBB in hex
+		phase	maximum phase count, as for SetMaxPhaseCount()
+		cursor	none, block, random
+		reveal	type, random, center, rain
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JMatrixScript.h"
+#include <ctype.h>
+
+const char kPageBreak = '\x01';
+const char kDirective = '\x02';
+
+const int kInstructionSize = 1 + sizeof(int);
+
+/*******************************************************************************
+ Style
+
+ *******************************************************************************/
+
+JMatrixScript::Style::Style()
+	:
+	nDelay(0),
+	nAlign(kAlignCenter),
+	color((COLORREF) kDefaultValue),
+	nPhaseCount(kDefaultValue),
+	nCursor(kDefaultValue),
+	nReveal(kDefaultValue)
+{
+}
+
+/*******************************************************************************
+ Style::Apply
+
+ *******************************************************************************/
+
+void
+JMatrixScript::Style::Apply
+	(
+	const int opcode,
+	const int value
+	)
+{
+	if (opcode == kDelayOp)
+		{
+		nDelay = value;
+		}
+	else if (opcode == kAlignOp)
+		{
+		nAlign = value;
+		}
+	else if (opcode == kColorOp)
+		{
+		color = (COLORREF) value;
+		}
+	else if (opcode == kPhaseCountOp)
+		{
+		nPhaseCount = value;
+		}
+	else if (opcode == kCursorOp)
+		{
+		nCursor = value;
+		}
+	else if (opcode == kRevealOp)
+		{
+		nReveal = value;
+		}
+}
+
+/*******************************************************************************
+ Constructor
+
+ *******************************************************************************/
+
+JMatrixScript::JMatrixScript()
+	:
+	m_pCode(NULL),
+	m_nLength(0),
+	m_nCapacity(0)
+{
+}
+
+/*******************************************************************************
+ Destructor
+
+ *******************************************************************************/
+
+JMatrixScript::~JMatrixScript()
+{
+	delete [] m_pCode;
+}
+
+/*******************************************************************************
+ AddLine
+
+ *******************************************************************************/
+
+void
+JMatrixScript::AddLine
+	(
+	LPCTSTR line
+	)
+{
+	if (line[0] == kPageBreak)
+		{
+		Emit(kPageBreakOp, max(0, atoi(line+1)));		// "\x01" alone => no pause
+		}
+	else if (line[0] == kDirective)
+		{
+		CompileDirective(line+1);
+		}
+	else
+		{
+		Emit(kLineOp, m_TextList.Add(line));
+		}
+}
+
+/*******************************************************************************
+ RemoveAll
+
+	The buffer is kept, since a new script usually follows.
+
+ *******************************************************************************/
+
+void
+JMatrixScript::RemoveAll()
+{
+	m_nLength = 0;
+	m_TextList.RemoveAll();
+}
+
+/*******************************************************************************
+ IsValidOffset
+
+	Returns TRUE if an offset that was saved earlier, e.g., in a snapshot,
+	is the start of an instruction.  Offsets at or beyond the end are
+	valid, because the readers start over when they reach the end.
+
+ *******************************************************************************/
+
+BOOL
+JMatrixScript::IsValidOffset
+	(
+	const int offset
+	)
+	const
+{
+	return (offset >= 0 && offset % kInstructionSize == 0);
+}
+
+/*******************************************************************************
+ CopyCode
+
+	Copies the instructions from offset to the end, so they can be read
+	with ReadCode() while the script is being changed.  The text indices
+	remain valid until RemoveAll() is called.
+
+ *******************************************************************************/
+
+void
+JMatrixScript::CopyCode
+	(
+	const int	offset,
+	CByteArray*	code
+	)
+	const
+{
+	const int length = max(0, m_nLength - offset);
+	code->SetSize(length);
+	if (length > 0)
+		{
+		memcpy(code->GetData(), m_pCode + offset, length);
+		}
+}
+
+/*******************************************************************************
+ CompileDirective (private)
+
+	Unknown keys and values are ignored.
+
+ *******************************************************************************/
+
+void
+JMatrixScript::CompileDirective
+	(
+	const CString& line
+	)
+{
+	const int length = line.GetLength();
+
+	int i = 0;
+	while (i < length)
+		{
+		while (i < length && isspace((unsigned char) line[i]))
+			{
+			i++;
+			}
+
+		const int start = i;
+		while (i < length && !isspace((unsigned char) line[i]))
+			{
+			i++;
+			}
+
+		const CString token = line.Mid(start, i - start);
+		const int eq        = token.Find('=');
+		if (eq <= 0)
+			{
+			continue;
+			}
+
+		const CString key   = token.Left(eq);
+		const CString value = token.Mid(eq+1);
+		const BOOL dflt     = (value.CompareNoCase("default") == 0);
+
+		if (key.CompareNoCase("delay") == 0)
+			{
+			Emit(kDelayOp, dflt ? 0 : max(0, atoi(value)));
+			}
+		else if (key.CompareNoCase("align") == 0)
+			{
+			Emit(kAlignOp, value.CompareNoCase("left")  == 0 ? kAlignLeft  :
+						   value.CompareNoCase("right") == 0 ? kAlignRight :
+						   kAlignCenter);
+			}
+		else if (key.CompareNoCase("color") == 0)
+			{
+			const long rgb = strtol(value, NULL, 16);
+			Emit(kColorOp, dflt ? kDefaultValue :
+						   (int) RGB((rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF));
+			}
+		else if (key.CompareNoCase("phase") == 0)
+			{
+			Emit(kPhaseCountOp, dflt ? kDefaultValue : max(0, atoi(value)));
+			}
+		else if (key.CompareNoCase("cursor") == 0)
+			{
+			Emit(kCursorOp, value.CompareNoCase("none")   == 0 ? kNoCursor     :
+							value.CompareNoCase("block")  == 0 ? kBlockCursor  :
+							value.CompareNoCase("random") == 0 ? kRandomCursor :
+							(int) kDefaultValue);
+			}
+		else if (key.CompareNoCase("reveal") == 0)
+			{
+			Emit(kRevealOp, value.CompareNoCase("type")   == 0 ? kTypeReveal   :
+							value.CompareNoCase("random") == 0 ? kRandomReveal :
+							value.CompareNoCase("center") == 0 ? kCenterReveal :
+							value.CompareNoCase("rain")   == 0 ? kRainReveal   :
+							(int) kDefaultValue);
+			}
+		}
+}
+
+/*******************************************************************************
+ Emit (private)
+
+ *******************************************************************************/
+
+void
+JMatrixScript::Emit
+	(
+	const int opcode,
+	const int value
+	)
+{
+	if (m_nLength + kInstructionSize > m_nCapacity)
+		{
+		m_nCapacity = 2 * m_nCapacity + 64 * kInstructionSize;
+
+		BYTE* code = new BYTE [ m_nCapacity ];
+		if (m_nLength > 0)
+			{
+			memcpy(code, m_pCode, m_nLength);
+			}
+
+		delete [] m_pCode;
+		m_pCode = code;
+		}
+
+	m_pCode[ m_nLength ] = (BYTE) opcode;
+	memcpy(m_pCode + m_nLength + 1, &value, sizeof(int));
+	m_nLength += kInstructionSize;
+}
@@ -0,0 +1,185 @@
+/*******************************************************************************
+ JMatrixScript.h
+
+ *******************************************************************************/
+
+#pragma once
+
+#include <afxtempl.h>
+
+class JMatrixScript
+{
+public:
+
+	enum Opcode
+	{
+		kLineOp,			// value is index of text
+		kPageBreakOp,		// value is pause in seconds
+		kDelayOp,
+		kAlignOp,
+		kColorOp,
+		kPhaseCountOp,
+		kCursorOp,
+		kRevealOp
+	};
+
+	enum Align
+	{
+		kAlignCenter,
+		kAlignLeft,
+		kAlignRight
+	};
+
+	enum Cursor
+	{
+		kNoCursor,
+		kBlockCursor,
+		kRandomCursor
+	};
+
+	enum Reveal
+	{
+		kTypeReveal,		// left to right, following the cursor
+		kRandomReveal,
+		kCenterReveal,
+		kRainReveal			// locked in by the drops that pass
+	};
+
+	enum
+	{
+		kDefaultValue = -1
+	};
+
+	struct Style
+	{
+		int			nDelay;			// milliseconds to wait before starting the line
+		int			nAlign;
+		COLORREF	color;			// kDefaultValue => Config::textColor
+		int			nPhaseCount;	// kDefaultValue => SetMaxPhaseCount()
+		int			nCursor;		// kDefaultValue => SetCursor()
+		int			nReveal;		// kDefaultValue => Config::nRevealMode
+
+		Style();
+
+		void	Apply(const int opcode, const int value);
+	};
+
+public:
+
+	JMatrixScript();
+
+	~JMatrixScript();
+
+	void	AddLine(LPCTSTR line);
+	void	RemoveAll();
+
+	int		GetLength() const;
+	BOOL	IsEmpty() const;
+	int		Read(const int offset, int* opcode, int* value) const;
+	BOOL	IsValidOffset(const int offset) const;
+	void	CopyCode(const int offset, CByteArray* code) const;
+
+	static int	ReadCode(const BYTE* code, const int offset, int* opcode, int* value);
+
+	const CString&	GetText(const int index) const;
+
+private:
+
+	BYTE*			m_pCode;		// opcode byte followed by 4 byte value
+	int				m_nLength;
+	int				m_nCapacity;
+	CStringArray	m_TextList;
+
+private:
+
+	void	Emit(const int opcode, const int value);
+	void	CompileDirective(const CString& line);
+
+	// not allowed
+
+	JMatrixScript(const JMatrixScript& source);
+	const JMatrixScript& operator=(const JMatrixScript& source);
+};
+
+
+/*******************************************************************************
+ GetLength
+
+	Returns the number of bytes of compiled code.
+
+ *******************************************************************************/
+
+inline int
+JMatrixScript::GetLength()
+	const
+{
+	return m_nLength;
+}
+
+/*******************************************************************************
+ IsEmpty
+
+ *******************************************************************************/
+
+inline BOOL
+JMatrixScript::IsEmpty()
+	const
+{
+	return (m_nLength == 0);
+}
+
+/*******************************************************************************
+ Read
+
+	Decodes the instruction at offset and returns the offset of the next
+	one.
+
+ *******************************************************************************/
+
+inline int
+JMatrixScript::Read
+	(
+	const int	offset,
+	int*		opcode,
+	int*		value
+	)
+	const
+{
+	return ReadCode(m_pCode, offset, opcode, value);
+}
+
+/*******************************************************************************
+ ReadCode (static)
+
+	Decodes an instruction in a copy made by CopyCode().
+
+ *******************************************************************************/
+
+inline int
+JMatrixScript::ReadCode
+	(
+	const BYTE*	code,
+	const int	offset,
+	int*		opcode,
+	int*		value
+	)
+{
+	*opcode = code[ offset ];
+	memcpy(value, code + offset + 1, sizeof(int));
+	return offset + 1 + sizeof(int);
+}
+
+/*******************************************************************************
+ GetText
+
+ *******************************************************************************/
+
+inline const CString&
+JMatrixScript::GetText
+	(
+	const int index
+	)
+	const
+{
+	return m_TextList.ElementAt(index);
+}
@@ -0,0 +1,1050 @@
+/*******************************************************************************
+ JMatrixSnapshot.cpp
+
+	Saves and restores the complete state of a JMatrixCtrl's animation.
+	RestoreSnapshot() decodes and checks everything before it changes
+	anything, so a snapshot that does not fit leaves the control as it
+	was.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JMatrixCtrl.h"
+
+// A snapshot is a header of kSnapshotHeaderSize DWORDs (magic, version,
+// payload length, checksum of payload) followed by the payload written by
+// WriteSnapshot().  Increment the version whenever the payload changes.
+
+const DWORD kSnapshotMagic      = 0x53584D4A;	// "JMXS"
+const DWORD kSnapshotVersion    = 2;
+const int kSnapshotHeaderSize   = 4;
+const int kMaxSnapshotRemaining = 0x7FFFFFFF;	// microseconds; longer timers are truncated
+const int kMaxSnapshotListLength = 0x10000;
+
+/*******************************************************************************
+ GetChecksum (static)
+
+	Adler-32.
+
+ *******************************************************************************/
+
+static DWORD
+GetChecksum
+	(
+	const BYTE*	data,
+	const int	length
+	)
+{
+	DWORD a = 1, b = 0;
+	for (int i=0; i<length; i++)
+		{
+		a = (a + data[i]) % 65521;
+		b = (b + a) % 65521;
+		}
+	return ((b << 16) | a);
+}
+
+/*******************************************************************************
+ IsValidAlign (static)
+
+ *******************************************************************************/
+
+static BOOL
+IsValidAlign
+	(
+	const int align
+	)
+{
+	return (align == JMatrixScript::kAlignCenter ||
+			align == JMatrixScript::kAlignLeft   ||
+			align == JMatrixScript::kAlignRight);
+}
+
+/*******************************************************************************
+ SaveSnapshot
+
+	Replaces the contents of data with the current state of the animation.
+	data is left empty if the control does not exist yet.  This can be
+	called from any thread.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::SaveSnapshot
+	(
+	CByteArray* data
+	)
+{
+	data->RemoveAll();
+
+	CSingleLock lock(&m_StateLock, TRUE);
+	if (m_nRainLayerCount == 0)
+		{
+		return;
+		}
+
+	const LONGLONG start = GetTime();
+
+	CMemFile file;
+	CArchive ar(&file, CArchive::store);
+	WriteSnapshot(ar);
+	ar.Close();
+
+	const int length = (int) file.GetLength();
+	BYTE* payload    = file.Detach();
+
+	DWORD header[ kSnapshotHeaderSize ];
+	header[0] = kSnapshotMagic;
+	header[1] = kSnapshotVersion;
+	header[2] = length;
+	header[3] = GetChecksum(payload, length);
+
+	data->SetSize(sizeof(header) + length);
+	memcpy(data->GetData(), header, sizeof(header));
+	memcpy(data->GetData() + sizeof(header), payload, length);
+	free(payload);		// CMemFile uses malloc()
+
+	m_Stats.nSnapshotTime = (int) (GetTime() - start);
+}
+
+/*******************************************************************************
+ RestoreSnapshot
+
+	Returns FALSE if data is not a consistent snapshot from this version,
+	or if it was saved from a control with a different size, fonts, or
+	rain layers.  In that case, nothing is changed.  Commands that are still
+	queued are applied first, so they do not modify the restored state.
+	This can be called from any thread.
+
+ *******************************************************************************/
+
+BOOL
+JMatrixCtrl::RestoreSnapshot
+	(
+	const BYTE*	data,
+	const int	length
+	)
+{
+	DWORD header[ kSnapshotHeaderSize ];
+	if (length < (int) sizeof(header))
+		{
+		return FALSE;
+		}
+
+	memcpy(header, data, sizeof(header));
+	const BYTE* payload = data + sizeof(header);
+	const int size      = length - sizeof(header);
+	if (header[0] != kSnapshotMagic || header[1] != kSnapshotVersion ||
+		header[2] != (DWORD) size   || header[3] != GetChecksum(payload, size))
+		{
+		return FALSE;
+		}
+
+	CSingleLock lock(&m_StateLock, TRUE);
+	if (m_nRainLayerCount == 0)
+		{
+		return FALSE;
+		}
+
+	const LONGLONG start = GetTime();
+
+	DrainCommands();
+
+	Snapshot snapshot;
+
+	CMemFile file((BYTE*) payload, size);
+	CArchive ar(&file, CArchive::load);
+	try
+		{
+		if (!ReadSnapshotGeometry(ar))
+			{
+			ar.Close();
+			return FALSE;
+			}
+		ReadSnapshot(ar, &snapshot);
+		ar.Close();
+		}
+	catch (CException* e)
+		{
+		// The checksum matched, so the snapshot is either from a different
+		// build or was built by hand.  Nothing has been changed.
+
+		e->Delete();
+		ar.Abort();
+		return FALSE;
+		}
+
+	ApplySnapshot(snapshot);
+
+	m_nLayoutSerial++;					// discard the prepared next page
+	m_LayoutEvent.SetEvent();
+	m_WakeEvent.SetEvent();				// timers changed
+
+	m_Stats.nSnapshotTime = (int) (GetTime() - start);
+	return TRUE;
+}
+
+/*******************************************************************************
+ WriteSnapshot (private)
+
+	Timers are saved relative to now, so the animation continues from the
+	same point no matter when it is restored.  Everything that is drawn
+	incrementally (the rain layers, the spinning characters, and the text
+	plane) is saved as a grid of cells and redrawn from scratch.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::WriteSnapshot
+	(
+	CArchive& ar
+	)
+{
+	const LONGLONG now = GetTime();
+
+	// geometry
+
+	ar << m_nWidth << m_nHeight << m_nRows << m_nCols << m_nRainLayerCount;
+	for (int i=0; i<m_nRainLayerCount; i++)
+		{
+		ar << m_RainLayer[i].nRows << m_RainLayer[i].nCols;
+		}
+
+	// timers
+
+	ar << m_nRandomState;
+
+	for (int id=0; id<kTimerCount; id++)
+		{
+		const Timer& t = m_Timer[id];
+		ar << t.nInterval;
+		ar << (int) max(0, min(t.due - now, (LONGLONG) kMaxSnapshotRemaining));
+		}
+
+	ar << m_nTextTimerID;
+	ar << (int) max(0, min(now - m_RainTime, (LONGLONG) kMaxSnapshotRemaining));
+
+	// rain
+
+	for (int j=0; j<m_nRainLayerCount; j++)
+		{
+		const RainLayer& layer = m_RainLayer[j];
+
+		ar << layer.nClock << layer.nActivationCredit << layer.nActiveColumns;
+		for (int k=0; k<layer.nActiveColumns; k++)		// order matters
+			{
+			const int col         = layer.pActive[k];
+			const MatrixColumn& c = layer.pColumns[col];
+			ar << col << c.nCounter << c.nCounterMax << c.prev;
+			ar << layer.pPosition[col] << layer.pTime[col] << layer.pVelocity[col];
+			}
+
+		layer.wheel.Write(ar);
+		ar.Write(layer.pCells, layer.nRows * layer.nCols * sizeof(WORD));
+		}
+
+	// spinning characters
+
+	const int cellCount = m_nRows * m_nCols;
+
+	ar << m_nSpinTick << m_nSpinCredit << m_nActiveSpins;
+	for (int cell=0; cell<cellCount; cell++)
+		{
+		if (m_pSpinEnd[cell] != 0)
+			{
+			ar << cell << m_pSpinEnd[cell];
+			}
+		}
+
+	m_SpinWheel.Write(ar);
+	ar.Write(m_pSpinChar, cellCount);
+
+	// current page
+
+	ar << m_nNextPageOffset;
+	WriteStyle(ar, m_NextPageStyle);
+
+	ar << m_pPage->nEndOffset << m_pPage->nPauseInterval;
+	WriteStyle(ar, m_pPage->endStyle);
+
+	const int lineCount = m_pPage->lines.GetSize();
+	ar << lineCount;
+	for (int l=0; l<lineCount; l++)
+		{
+		ar << m_pPage->lines[l];
+		ar << m_pPage->lineStart[l].x << m_pPage->lineStart[l].y;
+		WriteStyle(ar, m_pPage->lineStyle[l]);
+		}
+
+	// active line
+
+	ar << m_nActiveLine << m_nLineCursor << m_nLinePhaseCount << m_nLineReveal;
+	ar << m_ActiveLine;
+	WritePhaseList(ar, m_PhaseList);
+	WritePhaseList(ar, m_PhasingList);
+	WritePhaseList(ar, m_RevealOrder);
+	ar << m_nRevealCount << m_nHiddenCount << m_nRevealRow;
+	WritePhaseList(ar, m_RevealColumn);
+	WritePhaseList(ar, m_RevealNext);
+	ar << m_CursorPt.x << m_CursorPt.y << m_CursorChar << m_nTextPreset;
+
+	// ticker, newest line first
+
+	ar << m_bTicker << m_nTickerCredit << m_nTickerCount;
+	for (int t=0; t<m_nTickerCount; t++)
+		{
+		const TickerLine& line = m_pTickerLine[ (m_nTickerHead - t + m_nTickerRows) % m_nTickerRows ];
+		ar << line.nLength << line.nAlign << line.nPhaseCount << line.color;
+		ar.Write(line.pText, line.nLength);
+		ar.Write(line.pShown, line.nLength);
+		for (int c=0; c<line.nLength; c++)
+			{
+			ar << line.pPhase[c];
+			}
+		}
+}
+
+/*******************************************************************************
+ ReadSnapshotGeometry (private)
+
+	Returns FALSE if the snapshot was saved from a control with a
+	different grid.
+
+ *******************************************************************************/
+
+BOOL
+JMatrixCtrl::ReadSnapshotGeometry
+	(
+	CArchive& ar
+	)
+{
+	int width, height, rows, cols, layerCount;
+	ar >> width >> height >> rows >> cols >> layerCount;
+	if (width != m_nWidth || height != m_nHeight ||
+		rows  != m_nRows  || cols   != m_nCols   ||
+		layerCount != m_nRainLayerCount)
+		{
+		return FALSE;
+		}
+
+	for (int i=0; i<m_nRainLayerCount; i++)
+		{
+		ar >> rows >> cols;
+		if (rows != m_RainLayer[i].nRows || cols != m_RainLayer[i].nCols)
+			{
+			return FALSE;
+			}
+		}
+
+	return TRUE;
+}
+
+/*******************************************************************************
+ ReadSnapshot (private)
+
+	Decodes what WriteSnapshot() saved after the geometry and checks that
+	it is consistent, so applying it cannot break any invariant that the
+	animation relies on.  Throws CArchiveException if the data does not
+	fit.  Nothing in the control is changed.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::ReadSnapshot
+	(
+	CArchive&	ar,
+	Snapshot*	snapshot
+	)
+{
+	const LONGLONG now = GetTime();
+
+	// timers
+
+	ar >> snapshot->nRandomState;
+
+	for (int id=0; id<kTimerCount; id++)
+		{
+		Timer& t = snapshot->timer[id];
+
+		int remaining;
+		ar >> t.nInterval >> remaining;
+		if (t.nInterval < 0 || remaining < 0)
+			{
+			AfxThrowArchiveException(CArchiveException::badIndex);
+			}
+		t.due = now + remaining;
+		}
+
+	int rainLag;
+	ar >> snapshot->nTextTimerID >> rainLag;
+	if ((snapshot->nTextTimerID != -1 && snapshot->nTextTimerID != kUpdateTextID &&
+		 snapshot->nTextTimerID != kUpdateSpinID) ||
+		rainLag < 0)
+		{
+		AfxThrowArchiveException(CArchiveException::badIndex);
+		}
+	snapshot->rainTime = now - rainLag;
+
+	// rain
+
+	for (int j=0; j<m_nRainLayerCount; j++)
+		{
+		ReadSnapshotLayer(ar, m_RainLayer[j], snapshot->layer + j);
+		}
+
+	// spinning characters
+
+	const int cellCount = m_nRows * m_nCols;
+
+	int spinCount;
+	ar >> snapshot->nSpinTick >> snapshot->nSpinCredit >> spinCount;
+	if (snapshot->nSpinCredit < 0 || 10000 <= snapshot->nSpinCredit ||
+		spinCount < 0 || cellCount < spinCount)
+		{
+		AfxThrowArchiveException(CArchiveException::badIndex);
+		}
+
+	snapshot->spinCell.SetSize(spinCount);
+	snapshot->spinEnd.SetSize(spinCount);
+	for (int i=0; i<spinCount; i++)
+		{
+		int& cell = snapshot->spinCell.ElementAt(i);
+		int& end  = snapshot->spinEnd.ElementAt(i);
+		ar >> cell >> end;
+		if (cell < 0 || cellCount <= cell || end == 0 ||
+			(i > 0 && cell <= snapshot->spinCell[i-1]))		// written in order
+			{
+			AfxThrowArchiveException(CArchiveException::badIndex);
+			}
+		}
+
+	snapshot->spinWheel.SetSize(cellCount, kSpinWheelSize);
+	snapshot->spinWheel.Read(ar);
+
+	snapshot->spinChar.SetSize(cellCount);
+	if (ar.Read(snapshot->spinChar.GetData(), cellCount) != (UINT) cellCount)
+		{
+		AfxThrowArchiveException(CArchiveException::endOfFile);
+		}
+
+	// exactly the active cells are scheduled
+
+	CByteArray scheduled;
+	scheduled.SetSize(cellCount);
+	snapshot->spinWheel.GetScheduled(scheduled.GetData());
+
+	for (int cell=0, k=0; cell<cellCount; cell++)
+		{
+		const BOOL active = (k < spinCount && snapshot->spinCell[k] == cell);
+		if (active)
+			{
+			k++;
+			}
+		if (scheduled[cell] != active)
+			{
+			AfxThrowArchiveException(CArchiveException::badIndex);
+			}
+		}
+
+	ReadSnapshotText(ar, snapshot);
+
+	// the timers that drive the text need a line to work on
+
+	const int lineCount = snapshot->page.lines.GetSize();
+	if ((snapshot->timer[ kUpdateTextID ].nInterval > 0 &&
+		 !snapshot->bTicker && snapshot->nActiveLine < 0) ||
+		(snapshot->timer[ kUpdateCursorID ].nInterval > 0 && snapshot->nActiveLine < 0) ||
+		(snapshot->timer[ kNextLineID ].nInterval > 0 && snapshot->nActiveLine+1 >= lineCount))
+		{
+		AfxThrowArchiveException(CArchiveException::badIndex);
+		}
+}
+
+/*******************************************************************************
+ ReadSnapshotLayer (private)
+
+	Decodes one rain layer.  Every active column is listed once, its head
+	lies between its current row and the row where it stops, and exactly
+	the active columns are scheduled in the wheel.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::ReadSnapshotLayer
+	(
+	CArchive&			ar,
+	const RainLayer&	layer,
+	SnapshotLayer*		snapshot
+	)
+{
+	int activeCount;
+	ar >> snapshot->nClock >> snapshot->nActivationCredit >> activeCount;
+	if (snapshot->nActivationCredit < 0 || 100 <= snapshot->nActivationCredit ||
+		activeCount < 0 || layer.nCols < activeCount)
+		{
+		AfxThrowArchiveException(CArchiveException::badIndex);
+		}
+
+	CByteArray active;
+	active.SetSize(layer.nCols);
+	memset(active.GetData(), 0, layer.nCols);
+
+	snapshot->active.SetSize(activeCount);
+	snapshot->columns.SetSize(activeCount);
+	snapshot->position.SetSize(activeCount);
+	snapshot->time.SetSize(activeCount);
+	snapshot->velocity.SetSize(activeCount);
+
+	for (int k=0; k<activeCount; k++)
+		{
+		int& col        = snapshot->active.ElementAt(k);
+		MatrixColumn& c = snapshot->columns.ElementAt(k);
+		int& position   = snapshot->position.ElementAt(k);
+		int& time       = snapshot->time.ElementAt(k);
+		int& velocity   = snapshot->velocity.ElementAt(k);
+
+		ar >> col >> c.nCounter >> c.nCounterMax >> c.prev;
+		ar >> position >> time >> velocity;
+		c.bActive = TRUE;
+
+		const int age = (int) ((DWORD) snapshot->nClock - (DWORD) time);	// clock wraps
+		if (col < 0 || layer.nCols <= col || active[col] ||
+			c.nCounter < 0 || c.nCounterMax <= c.nCounter || layer.nRows < c.nCounterMax ||
+			(BYTE) c.prev < kMinBackChar ||
+			position < (c.nCounter << kRowShift) || (c.nCounterMax << kRowShift) < position ||
+			age < 0 || velocity <= 0 || kMaxDropVelocity < velocity)
+			{
+			AfxThrowArchiveException(CArchiveException::badIndex);
+			}
+
+		active[col] = TRUE;
+		}
+
+	snapshot->wheel.SetSize(layer.nCols, kRainWheelSize);
+	snapshot->wheel.Read(ar);
+
+	CByteArray scheduled;
+	scheduled.SetSize(layer.nCols);
+	snapshot->wheel.GetScheduled(scheduled.GetData());
+	if (memcmp(scheduled.GetData(), active.GetData(), layer.nCols) != 0)
+		{
+		AfxThrowArchiveException(CArchiveException::badIndex);
+		}
+
+	const int cellCount = layer.nRows * layer.nCols;
+	snapshot->cells.SetSize(cellCount);
+
+	const UINT size = cellCount * sizeof(WORD);
+	if (ar.Read(snapshot->cells.GetData(), size) != size)
+		{
+		AfxThrowArchiveException(CArchiveException::endOfFile);
+		}
+
+	for (int i=0; i<cellCount; i++)
+		{
+		const WORD cell = snapshot->cells[i];
+		if (cell != 0 && ((cell & 0xFF) < kMinBackChar || kFadeLevelCount <= (cell >> 8)))
+			{
+			AfxThrowArchiveException(CArchiveException::badIndex);
+			}
+		}
+}
+
+/*******************************************************************************
+ ReadSnapshotText (private)
+
+	Decodes the current page, the active line, and the ticker.  The
+	positions of the lines only depend on the lines and the grid, so
+	they must match the layout that this control computes.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::ReadSnapshotText
+	(
+	CArchive&	ar,
+	Snapshot*	snapshot
+	)
+{
+	// current page
+
+	ar >> snapshot->nNextPageOffset;
+	ReadStyle(ar, &snapshot->nextPageStyle);
+
+	PageLayout& page = snapshot->page;
+	ar >> page.nEndOffset >> page.nPauseInterval;
+	ReadStyle(ar, &page.endStyle);
+
+	if (!m_Script.IsValidOffset(snapshot->nNextPageOffset) ||
+		!m_Script.IsValidOffset(page.nEndOffset) || page.nPauseInterval < 0)
+		{
+		AfxThrowArchiveException(CArchiveException::badIndex);
+		}
+
+	int lineCount;
+	ar >> lineCount;
+	if (lineCount < 0 || kMaxSnapshotListLength < lineCount)
+		{
+		AfxThrowArchiveException(CArchiveException::badIndex);
+		}
+
+	CPointList lineStart;
+	lineStart.SetSize(lineCount);
+	page.lines.SetSize(lineCount);
+	page.lineStyle.SetSize(lineCount);
+	for (int l=0; l<lineCount; l++)
+		{
+		ar >> page.lines[l];
+		ar >> lineStart[l].x >> lineStart[l].y;
+		ReadStyle(ar, &page.lineStyle[l]);
+		}
+
+	AlignPageLayout(&page);
+	for (int p=0; p<lineCount; p++)
+		{
+		if (page.lineStart[p] != lineStart[p])
+			{
+			AfxThrowArchiveException(CArchiveException::badIndex);
+			}
+		}
+
+	// active line
+
+	ar >> snapshot->nActiveLine >> snapshot->nLineCursor;
+	ar >> snapshot->nLinePhaseCount >> snapshot->nLineReveal;
+	ar >> snapshot->activeLine;
+	ReadPhaseList(ar, &snapshot->phaseList);
+	ReadPhaseList(ar, &snapshot->phasingList);
+	ReadPhaseList(ar, &snapshot->revealOrder);
+	ar >> snapshot->nRevealCount >> snapshot->nHiddenCount >> snapshot->nRevealRow;
+	ReadPhaseList(ar, &snapshot->revealColumn);
+	ReadPhaseList(ar, &snapshot->revealNext);
+	ar >> snapshot->cursorPt.x >> snapshot->cursorPt.y;
+	ar >> snapshot->cursorChar >> snapshot->nTextPreset;
+
+	if (snapshot->nActiveLine < -1 || lineCount <= snapshot->nActiveLine)
+		{
+		AfxThrowArchiveException(CArchiveException::badIndex);
+		}
+
+	ValidateActiveLine(*snapshot);
+
+	// ticker, newest line first
+
+	int tickerCount;
+	ar >> snapshot->bTicker >> snapshot->nTickerCredit >> tickerCount;
+	if ((snapshot->bTicker != FALSE && snapshot->bTicker != TRUE) ||
+		snapshot->nTickerCredit < 0 || 1000 < snapshot->nTickerCredit ||
+		tickerCount < 0 || m_nTickerRows < tickerCount)
+		{
+		AfxThrowArchiveException(CArchiveException::badIndex);
+		}
+
+	const int width = m_nTickerWidth;
+	snapshot->tickerLine.SetSize(tickerCount);
+	snapshot->tickerText.SetSize(tickerCount * width);
+	snapshot->tickerShown.SetSize(tickerCount * width);
+	snapshot->tickerPhase.SetSize(tickerCount * width);
+
+	for (int t=0; t<tickerCount; t++)
+		{
+		TickerLine& line = snapshot->tickerLine.ElementAt(t);
+		ar >> line.nLength >> line.nAlign >> line.nPhaseCount >> line.color;
+		if (line.nLength < 0 || width < line.nLength ||
+			!IsValidAlign(line.nAlign) || line.nPhaseCount < 0)
+			{
+			AfxThrowArchiveException(CArchiveException::badIndex);
+			}
+
+		if (ar.Read(snapshot->tickerText.GetData()  + t * width, line.nLength) != (UINT) line.nLength ||
+			ar.Read(snapshot->tickerShown.GetData() + t * width, line.nLength) != (UINT) line.nLength)
+			{
+			AfxThrowArchiveException(CArchiveException::endOfFile);
+			}
+
+		for (int c=0; c<line.nLength; c++)
+			{
+			ar >> snapshot->tickerPhase.ElementAt(t * width + c);
+			}
+		}
+}
+
+/*******************************************************************************
+ ValidateActiveLine (private)
+
+	Throws CArchiveException unless the state of the active line is the
+	same as what the text timers would have produced:  each character is
+	either hidden or phasing in, the characters that are still changing
+	are listed once, and the reveal order is a permutation that agrees
+	with which characters have been revealed.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::ValidateActiveLine
+	(
+	const Snapshot& snapshot
+	)
+	const
+{
+	if ((snapshot.nTextPreset != kNoCursor && snapshot.nTextPreset != kBlockCursor &&
+		 snapshot.nTextPreset != kRandomCursor) ||
+		snapshot.cursorPt.x < -1 || m_nCols < snapshot.cursorPt.x ||
+		snapshot.cursorPt.y < -kMaxSnapshotListLength || kMaxSnapshotListLength < snapshot.cursorPt.y)
+		{
+		AfxThrowArchiveException(CArchiveException::badIndex);
+		}
+
+	// after the page ends, the lists describe the previous line and are
+	// not used again
+
+	if (snapshot.nActiveLine < 0)
+		{
+		if (snapshot.nRevealRow != -1)
+			{
+			AfxThrowArchiveException(CArchiveException::badIndex);
+			}
+		return;
+		}
+
+	const int length = snapshot.page.lines[ snapshot.nActiveLine ].GetLength();
+	const int shown  = snapshot.activeLine.GetLength();
+	const int reveal = snapshot.nLineReveal;
+	if (snapshot.phaseList.GetSize() != length || length < shown ||
+		snapshot.revealOrder.GetSize() != length ||
+		(reveal != JMatrixScript::kTypeReveal && reveal != JMatrixScript::kRandomReveal &&
+		 reveal != JMatrixScript::kCenterReveal && reveal != JMatrixScript::kRainReveal) ||
+		snapshot.nRevealCount < 0 || length < snapshot.nRevealCount ||
+		(reveal == JMatrixScript::kRainReveal && length > 0 &&
+		 snapshot.nRevealCount == length))		// StartRevealDrop() wraps around
+		{
+		AfxThrowArchiveException(CArchiveException::badIndex);
+		}
+
+	// revealed characters are in the text
+
+	int hidden = 0;
+	for (int i=0; i<length; i++)
+		{
+		const int phase = snapshot.phaseList[i];
+		if (phase < -1 || (phase >= 0 && shown <= i))
+			{
+			AfxThrowArchiveException(CArchiveException::badIndex);
+			}
+		else if (phase < 0)
+			{
+			hidden++;
+			}
+		}
+
+	if (hidden != snapshot.nHiddenCount)
+		{
+		AfxThrowArchiveException(CArchiveException::badIndex);
+		}
+
+	// each character that is still changing is listed once
+
+	CByteArray seen;
+	seen.SetSize(length + 1);		// never empty, so GetData() is never NULL
+	memset(seen.GetData(), 0, length);
+
+	const int phasingCount = snapshot.phasingList.GetSize();
+	for (int j=0; j<phasingCount; j++)
+		{
+		const int i = snapshot.phasingList[j];
+		if (i < 0 || length <= i || snapshot.phaseList[i] < 0 || seen[i])
+			{
+			AfxThrowArchiveException(CArchiveException::badIndex);
+			}
+		seen[i] = TRUE;
+		}
+
+	// the reveal order is a permutation, kTypeReveal goes from left to
+	// right, and except for kRainReveal, the characters before
+	// nRevealCount are exactly the ones revealed so far
+
+	memset(seen.GetData(), 0, length);
+	for (int k=0; k<length; k++)
+		{
+		const int i = snapshot.revealOrder[k];
+		if (i < 0 || length <= i || seen[i] ||
+			(reveal == JMatrixScript::kTypeReveal && i != k) ||
+			(reveal != JMatrixScript::kRainReveal &&
+			 (k < snapshot.nRevealCount) != (snapshot.phaseList[i] >= 0)))
+			{
+			AfxThrowArchiveException(CArchiveException::badIndex);
+			}
+		seen[i] = TRUE;
+		}
+
+	if (snapshot.nRevealRow == -1)
+		{
+		return;
+		}
+
+	// the drops in the front rain layer reveal the characters linked to
+	// their columns, so each chain must end
+
+	const RainLayer& layer = m_RainLayer[0];
+	if (reveal != JMatrixScript::kRainReveal ||
+		snapshot.nRevealRow < 0 || layer.nRows <= snapshot.nRevealRow ||
+		snapshot.revealColumn.GetSize() != layer.nCols ||
+		snapshot.revealNext.GetSize() != length)
+		{
+		AfxThrowArchiveException(CArchiveException::badIndex);
+		}
+
+	memset(seen.GetData(), 0, length);
+	for (int col=0; col<layer.nCols; col++)
+		{
+		for (int i=snapshot.revealColumn[col]; i>=0; i=snapshot.revealNext[i])
+			{
+			if (length <= i || seen[i])
+				{
+				AfxThrowArchiveException(CArchiveException::badIndex);
+				}
+			seen[i] = TRUE;
+			}
+		}
+}
+
+/*******************************************************************************
+ ApplySnapshot (private)
+
+	Replaces the state of the animation with what ReadSnapshot() decoded.
+	The wheels are swapped, so snapshot is left with the old ones.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::ApplySnapshot
+	(
+	Snapshot& snapshot
+	)
+{
+	// timers
+
+	m_nRandomState = snapshot.nRandomState;
+
+	for (int id=0; id<kTimerCount; id++)
+		{
+		m_Timer[id] = snapshot.timer[id];
+		}
+
+	m_nTextTimerID = snapshot.nTextTimerID;
+	m_RainTime     = snapshot.rainTime;
+
+	// rain
+
+	for (int j=0; j<m_nRainLayerCount; j++)
+		{
+		RainLayer& layer     = m_RainLayer[j];
+		SnapshotLayer& saved = snapshot.layer[j];
+
+		for (int col=0; col<layer.nCols; col++)
+			{
+			layer.pColumns[col].bActive = FALSE;
+			layer.pVelocity[col]        = 0;
+			}
+
+		layer.nClock            = saved.nClock;
+		layer.nActivationCredit = saved.nActivationCredit;
+		layer.nActiveColumns    = saved.active.GetSize();
+
+		for (int k=0; k<layer.nActiveColumns; k++)
+			{
+			const int col = saved.active[k];
+
+			layer.pColumns[col]     = saved.columns[k];
+			layer.pPosition[col]    = saved.position[k];
+			layer.pTime[col]        = saved.time[k];
+			layer.pVelocity[col]    = saved.velocity[k];
+			layer.pActive[k]        = col;
+			layer.pActiveIndex[col] = k;
+			}
+
+		layer.wheel.Swap(saved.wheel);
+		memcpy(layer.pCells, saved.cells.GetData(), layer.nRows * layer.nCols * sizeof(WORD));
+		RedrawRainLayer(layer);
+		}
+
+	// spinning characters
+
+	const int cellCount = m_nRows * m_nCols;
+	memset(m_pSpinEnd, 0, cellCount * sizeof(int));
+
+	m_nSpinTick    = snapshot.nSpinTick;
+	m_nSpinCredit  = snapshot.nSpinCredit;
+	m_nActiveSpins = snapshot.spinCell.GetSize();
+	for (int i=0; i<m_nActiveSpins; i++)
+		{
+		m_pSpinEnd[ snapshot.spinCell[i] ] = snapshot.spinEnd[i];
+		}
+
+	m_SpinWheel.Swap(snapshot.spinWheel);
+	memcpy(m_pSpinChar, snapshot.spinChar.GetData(), cellCount);
+	RedrawSpin();
+
+	// current page
+
+	m_nNextPageOffset = snapshot.nNextPageOffset;
+	m_NextPageStyle   = snapshot.nextPageStyle;
+	if (m_Script.GetLength() < m_nNextPageOffset)
+		{
+		m_nNextPageOffset = 0;		// script was cleared; start over
+		}
+
+	m_pPage->nEndOffset     = snapshot.page.nEndOffset;
+	m_pPage->endStyle       = snapshot.page.endStyle;
+	m_pPage->nPauseInterval = snapshot.page.nPauseInterval;
+	m_pPage->nSerial        = m_nLayoutSerial;
+	m_pPage->lines.Copy(snapshot.page.lines);
+	m_pPage->lineStart.Copy(snapshot.page.lineStart);
+	m_pPage->lineStyle.Copy(snapshot.page.lineStyle);
+
+	// active line
+
+	m_nActiveLine     = snapshot.nActiveLine;
+	m_nLineCursor     = snapshot.nLineCursor;
+	m_nLinePhaseCount = snapshot.nLinePhaseCount;
+	m_nLineReveal     = snapshot.nLineReveal;
+	m_ActiveLine      = snapshot.activeLine;
+	m_PhaseList.Copy(snapshot.phaseList);
+	m_PhasingList.Copy(snapshot.phasingList);
+	m_RevealOrder.Copy(snapshot.revealOrder);
+	m_nRevealCount    = snapshot.nRevealCount;
+	m_nHiddenCount    = snapshot.nHiddenCount;
+	m_nRevealRow      = snapshot.nRevealRow;
+	m_RevealColumn.Copy(snapshot.revealColumn);
+	m_RevealNext.Copy(snapshot.revealNext);
+	m_CursorPt        = snapshot.cursorPt;
+	m_CursorChar      = snapshot.cursorChar;
+	m_nTextPreset     = snapshot.nTextPreset;
+
+	// ticker
+
+	m_bTicker       = snapshot.bTicker;
+	m_nTickerCredit = snapshot.nTickerCredit;
+	m_nTickerCount  = snapshot.tickerLine.GetSize();
+	m_nTickerHead   = (m_nTickerCount > 0 ? m_nTickerCount-1 : 0);
+
+	const int width = m_nTickerWidth;
+	for (int t=0; t<m_nTickerCount; t++)
+		{
+		const TickerLine& saved = snapshot.tickerLine[t];
+		TickerLine& line        = m_pTickerLine[ m_nTickerHead - t ];
+
+		line.nLength     = saved.nLength;
+		line.nAlign      = saved.nAlign;
+		line.nCol        = GetLineColumn(line.nLength, line.nAlign);
+		line.nPhaseCount = saved.nPhaseCount;
+		line.color       = saved.color;
+		memcpy(line.pText,  snapshot.tickerText.GetData()  + t * width, line.nLength);
+		memcpy(line.pShown, snapshot.tickerShown.GetData() + t * width, line.nLength);
+		memcpy(line.pPhase, snapshot.tickerPhase.GetData() + t * width, line.nLength * sizeof(int));
+
+		line.nPhasing = 0;
+		for (int c=0; c<line.nLength; c++)
+			{
+			if (line.pShown[c] != line.pText[c])
+				{
+				line.nPhasing++;
+				}
+			}
+		line.bDirty = FALSE;
+		}
+
+	ResetTextDirty(m_PhaseList.GetSize());
+	RedrawTextPlane();
+}
+
+/*******************************************************************************
+ WriteStyle (static private)
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::WriteStyle
+	(
+	CArchive&					ar,
+	const JMatrixScript::Style&	style
+	)
+{
+	ar << style.nDelay << style.nAlign << style.color;
+	ar << style.nPhaseCount << style.nCursor << style.nReveal;
+}
+
+/*******************************************************************************
+ ReadStyle (static private)
+
+	Throws CArchiveException unless every field is a value that
+	JMatrixScript can produce.
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::ReadStyle
+	(
+	CArchive&				ar,
+	JMatrixScript::Style*	style
+	)
+{
+	ar >> style->nDelay >> style->nAlign >> style->color;
+	ar >> style->nPhaseCount >> style->nCursor >> style->nReveal;
+
+	if (style->nDelay < 0 || !IsValidAlign(style->nAlign) ||
+		style->nPhaseCount < JMatrixScript::kDefaultValue ||
+		style->nCursor < JMatrixScript::kDefaultValue ||
+		JMatrixScript::kRandomCursor < style->nCursor ||
+		style->nReveal < JMatrixScript::kDefaultValue ||
+		JMatrixScript::kRainReveal < style->nReveal)
+		{
+		AfxThrowArchiveException(CArchiveException::badIndex);
+		}
+}
+
+/*******************************************************************************
+ WritePhaseList (static private)
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::WritePhaseList
+	(
+	CArchive&			ar,
+	const CPhaseList&	list
+	)
+{
+	const int count = list.GetSize();
+	ar << count;
+	for (int i=0; i<count; i++)
+		{
+		ar << list[i];
+		}
+}
+
+/*******************************************************************************
+ ReadPhaseList (static private)
+
+ *******************************************************************************/
+
+void
+JMatrixCtrl::ReadPhaseList
+	(
+	CArchive&	ar,
+	CPhaseList*	list
+	)
+{
+	int count;
+	ar >> count;
+	if (count < 0 || kMaxSnapshotListLength < count)
+		{
+		AfxThrowArchiveException(CArchiveException::badIndex);
+		}
+
+	list->SetSize(count);
+	for (int i=0; i<count; i++)
+		{
+		ar >> list->ElementAt(i);
+		}
+}
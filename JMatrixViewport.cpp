@@ -0,0 +1,292 @@
+/*******************************************************************************
+ JMatrixViewport.cpp
+
+	Displays one slice of a JMatrixCtrl, so a single simulation can span
+	several monitors.  Create the JMatrixCtrl with the virtual size of the
+	whole wall (it does not need to be visible), and then create one
+	viewport per monitor.  The viewports only copy their slice of the
+	most recent frame, so they cost almost nothing.
+
+	Bezels are hidden by leaving a gap in the virtual grid between
+	adjacent monitors.  GetSourceRect() and GetVirtualSize() compute the
+	layout from the monitor rectangles and the bezel width in pixels.
+
+	A viewport created with CreateShared() displays the frames that a
+	JMatrixCtrl in another process publishes with ShareFrames().  It
+	polls for new frames, and it keeps waiting if the producer has not
+	started yet.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JMatrixViewport.h"
+#include "JMatrixCtrl.h"
+
+const UINT kPollShareTimerID  = 1;
+const UINT kPollShareInterval = 10;		// milliseconds
+
+/*******************************************************************************
+ Constructor
+
+ *******************************************************************************/
+
+JMatrixViewport::JMatrixViewport()
+	:
+	m_pCtrl(NULL),
+	m_Source(0, 0),
+	m_nShareSerial(0),
+	m_bPainted(FALSE)
+{
+}
+
+/*******************************************************************************
+ Destructor
+
+ *******************************************************************************/
+
+JMatrixViewport::~JMatrixViewport()
+{
+}
+
+/*******************************************************************************
+ Create
+
+	source is the top left corner of the slice in the virtual grid.  If
+	pParentWnd is NULL, dwStyle should include WS_POPUP, and rect is in
+	screen coordinates.
+
+ *******************************************************************************/
+
+BOOL
+JMatrixViewport::Create
+	(
+	JMatrixCtrl*	ctrl,
+	const CPoint&	source,
+	DWORD			dwStyle,
+	const RECT&		rect,
+	CWnd*			pParentWnd,
+	UINT			nID
+	)
+{
+	static CString className = AfxRegisterWndClass(CS_HREDRAW | CS_VREDRAW);
+
+	m_pCtrl  = ctrl;
+	m_Source = source;
+
+	const BOOL result = CreateEx(0, className, NULL, dwStyle, rect, pParentWnd, nID);
+	if (result)
+		{
+		m_pCtrl->AddViewport(this);
+		}
+
+	return result;
+}
+
+/*******************************************************************************
+ CreateShared
+
+	shareName is the name that the producer passed to
+	JMatrixCtrl::ShareFrames().  The other arguments are the same as for
+	Create().
+
+ *******************************************************************************/
+
+BOOL
+JMatrixViewport::CreateShared
+	(
+	LPCTSTR			shareName,
+	const CPoint&	source,
+	DWORD			dwStyle,
+	const RECT&		rect,
+	CWnd*			pParentWnd,
+	UINT			nID
+	)
+{
+	static CString className = AfxRegisterWndClass(CS_HREDRAW | CS_VREDRAW);
+
+	m_pCtrl     = NULL;
+	m_Source    = source;
+	m_ShareName = shareName;
+	m_Share.Open(m_ShareName);
+
+	const BOOL result = CreateEx(0, className, NULL, dwStyle, rect, pParentWnd, nID);
+	if (result)
+		{
+		SetTimer(kPollShareTimerID, kPollShareInterval, NULL);
+		}
+
+	return result;
+}
+
+/*******************************************************************************
+ GetSourceRect (static)
+
+	Returns the slice of the virtual grid that monitorList[index] displays.
+	Each monitor is shifted by bezel for every distinct monitor edge above
+	it or to its left, so columns continue seamlessly behind the bezels.
+
+ *******************************************************************************/
+
+CRect
+JMatrixViewport::GetSourceRect
+	(
+	const CRect*	monitorList,
+	const int		count,
+	const int		index,
+	const CSize&	bezel
+	)
+{
+	CPoint origin(monitorList[0].left, monitorList[0].top);
+	for (int i=1; i<count; i++)
+		{
+		origin.x = min(origin.x, monitorList[i].left);
+		origin.y = min(origin.y, monitorList[i].top);
+		}
+
+	const CRect& m = monitorList[index];
+
+	int gapX = 0, gapY = 0;
+	for (int j=0; j<count; j++)
+		{
+		BOOL newX = (monitorList[j].right  <= m.left);
+		BOOL newY = (monitorList[j].bottom <= m.top);
+		for (int k=0; k<j; k++)
+			{
+			if (monitorList[k].right == monitorList[j].right)
+				{
+				newX = FALSE;
+				}
+			if (monitorList[k].bottom == monitorList[j].bottom)
+				{
+				newY = FALSE;
+				}
+			}
+
+		gapX += (newX ? 1 : 0);
+		gapY += (newY ? 1 : 0);
+		}
+
+	CRect r = m;
+	r.OffsetRect(bezel.cx * gapX - origin.x, bezel.cy * gapY - origin.y);
+	return r;
+}
+
+/*******************************************************************************
+ GetVirtualSize (static)
+
+	Returns the size with which to create the JMatrixCtrl.
+
+ *******************************************************************************/
+
+CSize
+JMatrixViewport::GetVirtualSize
+	(
+	const CRect*	monitorList,
+	const int		count,
+	const CSize&	bezel
+	)
+{
+	CSize size(0, 0);
+	for (int i=0; i<count; i++)
+		{
+		const CRect r = GetSourceRect(monitorList, count, i, bezel);
+		size.cx       = max(size.cx, r.right);
+		size.cy       = max(size.cy, r.bottom);
+		}
+
+	return size;
+}
+
+BEGIN_MESSAGE_MAP(JMatrixViewport, CWnd)
+	//{{AFX_MSG_MAP(JMatrixViewport)
+	ON_WM_PAINT()
+	ON_WM_TIMER()
+	ON_WM_DESTROY()
+	//}}AFX_MSG_MAP
+END_MESSAGE_MAP()
+
+/*******************************************************************************
+ OnPaint
+
+ *******************************************************************************/
+
+void
+JMatrixViewport::OnPaint()
+{
+	CPaintDC dc(this);
+	m_bPainted = TRUE;
+
+	CRect r;
+	GetClientRect(r);
+	r.OffsetRect(m_Source.x, m_Source.y);
+
+	if (m_pCtrl != NULL)
+		{
+		m_pCtrl->DrawViewport(dc, r);
+		}
+	else
+		{
+		m_nShareSerial = m_Share.GetSerial();
+		m_Share.Draw(dc, r);
+		}
+}
+
+/*******************************************************************************
+ OnTimer
+
+	Only used when the frames come from another process.
+
+ *******************************************************************************/
+
+void
+JMatrixViewport::OnTimer
+	(
+	UINT nIDEvent
+	)
+{
+	if (nIDEvent != kPollShareTimerID)
+		{
+		CWnd::OnTimer(nIDEvent);
+		return;
+		}
+
+	if (!m_Share.IsOpen() && !m_Share.Open(m_ShareName))
+		{
+		return;
+		}
+	else if (!m_Share.CheckHeader())	// producer is restarting
+		{
+		return;
+		}
+
+	if (IsWindowVisible() && !IsIconic())
+		{
+		m_Share.KeepAlive();
+		}
+
+	if (m_Share.GetSerial() != m_nShareSerial)
+		{
+		Invalidate(FALSE);
+		}
+}
+
+/*******************************************************************************
+ OnDestroy
+
+ *******************************************************************************/
+
+void
+JMatrixViewport::OnDestroy()
+{
+	if (m_pCtrl != NULL)
+		{
+		m_pCtrl->RemoveViewport(this);
+		}
+	else
+		{
+		KillTimer(kPollShareTimerID);
+		m_Share.Close();
+		}
+
+	CWnd::OnDestroy();
+}
@@ -0,0 +1,85 @@
+/*******************************************************************************
+ JMatrixViewport.h
+
+ *******************************************************************************/
+
+#pragma once
+
+#include "JFrameShare.h"
+
+class JMatrixCtrl;
+
+class JMatrixViewport : public CWnd
+{
+public:
+
+	JMatrixViewport();
+
+	virtual	~JMatrixViewport();
+
+	BOOL	Create(JMatrixCtrl* ctrl, const CPoint& source,
+				   DWORD dwStyle, const RECT& rect, CWnd* pParentWnd, UINT nID=NULL);
+	BOOL	CreateShared(LPCTSTR shareName, const CPoint& source,
+						 DWORD dwStyle, const RECT& rect, CWnd* pParentWnd, UINT nID=NULL);
+
+	const CPoint&	GetSource() const;
+	BOOL			WasPainted();
+
+	static CRect	GetSourceRect(const CRect* monitorList, const int count,
+								  const int index, const CSize& bezel);
+	static CSize	GetVirtualSize(const CRect* monitorList, const int count,
+								   const CSize& bezel);
+
+protected:
+
+	//{{AFX_MSG(JMatrixViewport)
+	afx_msg void OnPaint();
+	afx_msg void OnTimer(UINT nIDEvent);
+	afx_msg void OnDestroy();
+	//}}AFX_MSG
+	DECLARE_MESSAGE_MAP()
+
+private:
+
+	JMatrixCtrl*	m_pCtrl;		// NULL => frames come from m_Share
+	CPoint			m_Source;		// top left of slice in virtual grid
+	CString			m_ShareName;
+	JFrameShare		m_Share;
+	LONG			m_nShareSerial;	// last frame that was painted
+	BOOL			m_bPainted;		// OnPaint() ran since the last WasPainted()
+
+private:
+
+	// not allowed
+
+	JMatrixViewport(const JMatrixViewport& source);
+	const JMatrixViewport& operator=(const JMatrixViewport& source);
+};
+
+
+/*******************************************************************************
+ GetSource
+
+ *******************************************************************************/
+
+inline const CPoint&
+JMatrixViewport::GetSource()
+	const
+{
+	return m_Source;
+}
+
+/*******************************************************************************
+ WasPainted
+
+	Returns TRUE if the window was painted since the last call.
+
+ *******************************************************************************/
+
+inline BOOL
+JMatrixViewport::WasPainted()
+{
+	const BOOL painted = m_bPainted;
+	m_bPainted         = FALSE;
+	return painted;
+}
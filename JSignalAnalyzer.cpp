@@ -0,0 +1,548 @@
+/*******************************************************************************
+ JSignalAnalyzer.cpp
+
+	Reduces an external signal to three levels between 0 and kMaxLevel:
+	the overall loudness, the bass, and the treble.  The signal is either
+	a PCM WAV file, which is played (silently) in a loop on a separate
+	thread, or a number that is pushed via PushMetric(), e.g., the CPU
+	load.
+
+	The thread analyzes the kWindowSize samples preceding the current
+	playback position every kAnalysisInterval milliseconds.  Loudness is
+	the RMS of the samples.  Bass and treble are the RMS of the parts of
+	the spectrum below kBassLimit and above kTrebleLimit, computed with
+	an FFT.  Each RMS is converted to decibels, and kMinDecibels..0 dB
+	maps to 0..kMaxLevel.
+
+	The three levels are packed into a single LONG, so they are handed
+	to the animation with one InterlockedExchange(), and GetLevels()
+	never waits and never sees a mixture of two analyses.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JSignalAnalyzer.h"
+#include <math.h>
+
+const int kAnalysisInterval = 20;		// milliseconds
+const int kBassLimit        = 250;		// Hz
+const int kTrebleLimit      = 2000;		// Hz
+const double kMinDecibels   = -60.0;
+const double kFullScale     = 32768.0;
+const double kPi            = 3.14159265358979323846;
+const int kMaxChannels      = 32;
+const int kMaxSampleCount   = 1 << 24;	// about 6 minutes at 44.1 kHz; the rest is ignored
+const int kReadBlockFrames  = 4096;
+
+/*******************************************************************************
+ Constructor
+
+ *******************************************************************************/
+
+JSignalAnalyzer::JSignalAnalyzer()
+	:
+	m_nFileLevels(-1),
+	m_nMetricLevels(-1),
+	m_pSamples(NULL),
+	m_nSampleCount(0),
+	m_nSampleRate(0),
+	m_StartTime(0),
+	m_pThread(NULL),
+	m_bStopThread(FALSE)
+{
+	m_pWindowSamples = new short [ kWindowSize ];
+	m_pReal          = new float [ kWindowSize ];
+	m_pImag          = new float [ kWindowSize ];
+	m_pCos           = new float [ kWindowSize/2 ];
+	m_pSin           = new float [ kWindowSize/2 ];
+	m_pWindow        = new float [ kWindowSize ];
+
+	for (int i=0; i<kWindowSize/2; i++)
+		{
+		m_pCos[i] = (float) cos(2.0 * kPi * i / kWindowSize);
+		m_pSin[i] = (float) sin(2.0 * kPi * i / kWindowSize);
+		}
+
+	for (int j=0; j<kWindowSize; j++)
+		{
+		m_pWindow[j] = (float) (0.5 - 0.5 * cos(2.0 * kPi * j / kWindowSize));
+		}
+}
+
+/*******************************************************************************
+ Destructor
+
+ *******************************************************************************/
+
+JSignalAnalyzer::~JSignalAnalyzer()
+{
+	StopThread();
+
+	delete [] m_pSamples;
+	delete [] m_pWindowSamples;
+	delete [] m_pReal;
+	delete [] m_pImag;
+	delete [] m_pCos;
+	delete [] m_pSin;
+	delete [] m_pWindow;
+}
+
+/*******************************************************************************
+ PlayFile
+
+	Loads a PCM WAV file (8 or 16 bits, any number of channels) and starts
+	analyzing it in a loop.  Returns FALSE if the file cannot be read.
+	While a file is playing, pushed metrics are ignored.
+
+ *******************************************************************************/
+
+BOOL
+JSignalAnalyzer::PlayFile
+	(
+	LPCTSTR fileName
+	)
+{
+	StopThread();
+	InterlockedExchange(&m_nFileLevels, -1);
+
+	if (!ReadWaveFile(fileName) || m_nSampleCount < kWindowSize)
+		{
+		return FALSE;
+		}
+
+	m_StartTime   = GetTickCount();
+	m_bStopThread = FALSE;
+	m_pThread     = AfxBeginThread(ThreadMain, this, THREAD_PRIORITY_BELOW_NORMAL,
+								   0, CREATE_SUSPENDED);
+	if (m_pThread == NULL)
+		{
+		return FALSE;
+		}
+
+	m_pThread->m_bAutoDelete = FALSE;
+	m_pThread->ResumeThread();
+	return TRUE;
+}
+
+/*******************************************************************************
+ PushMetric
+
+	level is between 0 and kMaxLevel.  It is used for all three levels.
+	This can be called from any thread.
+
+ *******************************************************************************/
+
+void
+JSignalAnalyzer::PushMetric
+	(
+	const int level
+	)
+{
+	const int v = max(0, min(level, (int) kMaxLevel));
+	InterlockedExchange(&m_nMetricLevels, Pack(v, v, v));
+}
+
+/*******************************************************************************
+ Stop
+
+	Stops the file and forgets the metric, so the levels return to
+	neutral.
+
+ *******************************************************************************/
+
+void
+JSignalAnalyzer::Stop()
+{
+	StopThread();
+	InterlockedExchange(&m_nFileLevels, -1);
+	InterlockedExchange(&m_nMetricLevels, -1);
+}
+
+/*******************************************************************************
+ GetLevels
+
+	Returns kNeutralLevel for everything if there is no signal.
+
+ *******************************************************************************/
+
+void
+JSignalAnalyzer::GetLevels
+	(
+	int* level,
+	int* bass,
+	int* treble
+	)
+	const
+{
+	LONG v = m_nFileLevels;
+	if (v == -1)
+		{
+		v = m_nMetricLevels;
+		}
+
+	if (v == -1)
+		{
+		*level = *bass = *treble = kNeutralLevel;
+		}
+	else
+		{
+		*level  =  v        & 0x3FF;
+		*bass   = (v >> 10) & 0x3FF;
+		*treble = (v >> 20) & 0x3FF;
+		}
+}
+
+/*******************************************************************************
+ Pack (static private)
+
+ *******************************************************************************/
+
+LONG
+JSignalAnalyzer::Pack
+	(
+	const int level,
+	const int bass,
+	const int treble
+	)
+{
+	return (level | (bass << 10) | (treble << 20));
+}
+
+/*******************************************************************************
+ ToLevel (static private)
+
+ *******************************************************************************/
+
+int
+JSignalAnalyzer::ToLevel
+	(
+	const double meanSquare
+	)
+{
+	if (meanSquare <= 0.0)
+		{
+		return 0;
+		}
+
+	const double db = 10.0 * log10(meanSquare / (kFullScale * kFullScale));
+	const int level = (int) ((db - kMinDecibels) * kMaxLevel / -kMinDecibels);
+	return max(0, min(level, (int) kMaxLevel));
+}
+
+/*******************************************************************************
+ Analyze
+
+	Computes the levels of kWindowSize samples.  This does not depend on
+	the thread, so it can be used to check the analysis against known
+	signals, but not while a file is playing.
+
+ *******************************************************************************/
+
+void
+JSignalAnalyzer::Analyze
+	(
+	const short*	samples,
+	int*			level,
+	int*			bass,
+	int*			treble
+	)
+{
+	double sum = 0.0;
+	for (int i=0; i<kWindowSize; i++)
+		{
+		const double s = samples[i];
+		sum           += s * s;
+		m_pReal[i]     = (float) (s * m_pWindow[i]);
+		m_pImag[i]     = 0.0f;
+		}
+
+	*level = ToLevel(sum / kWindowSize);
+
+	Transform();
+
+	// Parseval:  the mean square of a band is the sum of the power of its
+	// bins, counted twice for the negative frequencies, divided by N times
+	// the power of the window (3N/8 for Hann)
+
+	const int rate      = (m_nSampleRate > 0 ? m_nSampleRate : 44100);
+	const int bassEnd   = max(2, kBassLimit * kWindowSize / rate);
+	const int trebleEnd = min(kTrebleLimit * kWindowSize / rate, kWindowSize/2);
+	const double scale  = 2.0 / (kWindowSize * (0.375 * kWindowSize));
+
+	double bassSum = 0.0, trebleSum = 0.0;
+	for (int k=1; k<kWindowSize/2; k++)
+		{
+		const double p = m_pReal[k] * m_pReal[k] + m_pImag[k] * m_pImag[k];
+		if (k < bassEnd)
+			{
+			bassSum += p;
+			}
+		else if (k >= trebleEnd)
+			{
+			trebleSum += p;
+			}
+		}
+
+	*bass   = ToLevel(bassSum * scale);
+	*treble = ToLevel(trebleSum * scale);
+}
+
+/*******************************************************************************
+ Transform (private)
+
+	In-place radix-2 FFT of m_pReal and m_pImag.
+
+ *******************************************************************************/
+
+void
+JSignalAnalyzer::Transform()
+{
+	const int n = kWindowSize;
+
+	int j = 0;
+	for (int i=1; i<n; i++)
+		{
+		int bit = n >> 1;
+		for (; j & bit; bit >>= 1)
+			{
+			j ^= bit;
+			}
+		j ^= bit;
+
+		if (i < j)
+			{
+			float t    = m_pReal[i];
+			m_pReal[i] = m_pReal[j];
+			m_pReal[j] = t;
+
+			t          = m_pImag[i];
+			m_pImag[i] = m_pImag[j];
+			m_pImag[j] = t;
+			}
+		}
+
+	for (int len=2; len<=n; len<<=1)
+		{
+		const int half = len / 2;
+		const int step = n / len;
+		for (int start=0; start<n; start+=len)
+			{
+			for (int k=0; k<half; k++)
+				{
+				const float wr = m_pCos[ k * step ];
+				const float wi = -m_pSin[ k * step ];
+
+				const int a = start + k;
+				const int b = a + half;
+
+				const float xr = m_pReal[b] * wr - m_pImag[b] * wi;
+				const float xi = m_pReal[b] * wi + m_pImag[b] * wr;
+
+				m_pReal[b] = m_pReal[a] - xr;
+				m_pImag[b] = m_pImag[a] - xi;
+				m_pReal[a] += xr;
+				m_pImag[a] += xi;
+				}
+			}
+		}
+}
+
+/*******************************************************************************
+ ReadInt (static)
+
+	WAV files are always little endian.
+
+ *******************************************************************************/
+
+static inline int
+ReadInt
+	(
+	const BYTE*	p,
+	const int	byteCount
+	)
+{
+	int v = 0;
+	for (int i=byteCount-1; i>=0; i--)
+		{
+		v = (v << 8) | p[i];
+		}
+	return v;
+}
+
+/*******************************************************************************
+ ReadWaveFile (private)
+
+	Mixes the channels down to mono.  Only the chunk headers and the
+	samples are read, a block at a time, so the file can be arbitrarily
+	large, but only the first kMaxSampleCount samples are kept.
+
+ *******************************************************************************/
+
+BOOL
+JSignalAnalyzer::ReadWaveFile
+	(
+	LPCTSTR fileName
+	)
+{
+	delete [] m_pSamples;
+	m_pSamples     = NULL;
+	m_nSampleCount = 0;
+
+	CFile file;
+	if (!file.Open(fileName, CFile::modeRead | CFile::typeBinary))
+		{
+		return FALSE;
+		}
+
+	const DWORD fileLength = file.GetLength();
+
+	BYTE header[16];
+	if (file.Read(header, 12) < 12 ||
+		memcmp(header, "RIFF", 4) != 0 || memcmp(header+8, "WAVE", 4) != 0)
+		{
+		return FALSE;
+		}
+
+	int channels = 0, bits = 0, format = 0;
+	DWORD pcmOffset = 0;
+	DWORD pcmBytes  = 0;
+
+	DWORD offset = 12;
+	while (offset + 8 <= fileLength)
+		{
+		file.Seek(offset, CFile::begin);
+		if (file.Read(header, 8) < 8)
+			{
+			break;
+			}
+
+		const DWORD length = min((DWORD) ReadInt(header+4, 4), fileLength - offset - 8);
+
+		if (memcmp(header, "fmt ", 4) == 0 && length >= 16)
+			{
+			if (file.Read(header, 16) < 16)
+				{
+				break;
+				}
+
+			format        = ReadInt(header, 2);
+			channels      = ReadInt(header+2, 2);
+			m_nSampleRate = ReadInt(header+4, 4);
+			bits          = ReadInt(header+14, 2);
+			}
+		else if (memcmp(header, "data", 4) == 0)
+			{
+			pcmOffset = offset + 8;
+			pcmBytes  = length;
+			}
+
+		offset += 8 + length + (length & 1);	// chunks are padded to even length
+		}
+
+	if (!(format == 1 || format == 0xFFFE) ||		// PCM or WAVE_FORMAT_EXTENSIBLE
+		channels <= 0 || channels > kMaxChannels || m_nSampleRate <= 0 ||
+		(bits != 8 && bits != 16) || pcmOffset == 0)
+		{
+		return FALSE;
+		}
+
+	const int sampleBytes = bits / 8;
+	const int frameBytes  = sampleBytes * channels;
+
+	m_nSampleCount = min(pcmBytes / frameBytes, (DWORD) kMaxSampleCount);
+	m_pSamples     = new short [ m_nSampleCount ];
+
+	BYTE* block = new BYTE [ kReadBlockFrames * frameBytes ];
+	file.Seek(pcmOffset, CFile::begin);
+
+	int i = 0;
+	while (i < m_nSampleCount)
+		{
+		const int frameCount = min(kReadBlockFrames, m_nSampleCount - i);
+		const int readCount  = file.Read(block, frameCount * frameBytes) / frameBytes;
+		if (readCount <= 0)
+			{
+			break;
+			}
+
+		for (int j=0; j<readCount; j++, i++)
+			{
+			const BYTE* p = block + j * frameBytes;
+
+			int sum = 0;
+			for (int c=0; c<channels; c++)
+				{
+				sum += (bits == 8 ? (p[c] - 128) * 256 : (short) ReadInt(p + 2*c, 2));
+				}
+			m_pSamples[i] = (short) (sum / channels);
+			}
+		}
+
+	delete [] block;
+
+	m_nSampleCount = i;
+	return TRUE;
+}
+
+/*******************************************************************************
+ StopThread (private)
+
+ *******************************************************************************/
+
+void
+JSignalAnalyzer::StopThread()
+{
+	if (m_pThread != NULL)
+		{
+		InterlockedExchange(&m_bStopThread, TRUE);
+		m_WakeEvent.SetEvent();
+		WaitForSingleObject(m_pThread->m_hThread, INFINITE);
+
+		delete m_pThread;
+		m_pThread = NULL;
+		}
+}
+
+/*******************************************************************************
+ ThreadMain (static private)
+
+	Follows the playback position in real time.  Analyses that are missed
+	because the thread was not scheduled are simply skipped.
+
+ *******************************************************************************/
+
+UINT
+JSignalAnalyzer::ThreadMain
+	(
+	LPVOID param
+	)
+{
+	JSignalAnalyzer* self = (JSignalAnalyzer*) param;
+
+	while (!self->m_bStopThread)
+		{
+		const DWORD elapsed = GetTickCount() - self->m_StartTime;
+		const int end       = (int) ((elapsed * (LONGLONG) self->m_nSampleRate / 1000) %
+									 self->m_nSampleCount);
+
+		// copy the window, wrapping around the end of the file
+
+		int start = end - kWindowSize;
+		if (start < 0)
+			{
+			start += self->m_nSampleCount;
+			}
+		for (int i=0; i<kWindowSize; i++)
+			{
+			self->m_pWindowSamples[i] = self->m_pSamples[ (start + i) % self->m_nSampleCount ];
+			}
+
+		int level, bass, treble;
+		self->Analyze(self->m_pWindowSamples, &level, &bass, &treble);
+		InterlockedExchange(&(self->m_nFileLevels), Pack(level, bass, treble));
+
+		WaitForSingleObject(self->m_WakeEvent, kAnalysisInterval);
+		}
+
+	return 0;
+}
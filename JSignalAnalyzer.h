@@ -0,0 +1,84 @@
+/*******************************************************************************
+ JSignalAnalyzer.h
+
+ *******************************************************************************/
+
+#pragma once
+
+#include <afxmt.h>
+
+class JSignalAnalyzer
+{
+public:
+
+	enum
+	{
+		kWindowSize   = 1024,		// samples per analysis; power of 2
+		kNeutralLevel = 500,
+		kMaxLevel     = 1000
+	};
+
+public:
+
+	JSignalAnalyzer();
+
+	~JSignalAnalyzer();
+
+	BOOL	PlayFile(LPCTSTR fileName);
+	void	PushMetric(const int level);
+	void	Stop();
+
+	BOOL	IsActive() const;
+	void	GetLevels(int* level, int* bass, int* treble) const;
+
+	void	Analyze(const short* samples, int* level, int* bass, int* treble);
+
+private:
+
+	volatile LONG	m_nFileLevels;		// packed by Pack(); -1 => no file
+	volatile LONG	m_nMetricLevels;	// packed by Pack(); -1 => no metric
+
+	short*			m_pSamples;			// mono
+	int				m_nSampleCount;
+	int				m_nSampleRate;		// samples per second
+	DWORD			m_StartTime;		// GetTickCount() when playback started
+
+	short*			m_pWindowSamples;	// kWindowSize, unwrapped
+	float*			m_pReal;			// kWindowSize
+	float*			m_pImag;			// kWindowSize
+	float*			m_pCos;				// kWindowSize/2
+	float*			m_pSin;				// kWindowSize/2
+	float*			m_pWindow;			// Hann window
+
+	CWinThread*		m_pThread;
+	CEvent			m_WakeEvent;
+	volatile LONG	m_bStopThread;
+
+private:
+
+	BOOL	ReadWaveFile(LPCTSTR fileName);
+	void	Transform();
+	void	StopThread();
+
+	static UINT	ThreadMain(LPVOID param);
+	static LONG	Pack(const int level, const int bass, const int treble);
+	static int	ToLevel(const double meanSquare);
+
+	// not allowed
+
+	JSignalAnalyzer(const JSignalAnalyzer& source);
+	const JSignalAnalyzer& operator=(const JSignalAnalyzer& source);
+};
+
+
+/*******************************************************************************
+ IsActive
+
+ *******************************************************************************/
+
+inline BOOL
+JSignalAnalyzer::IsActive()
+	const
+{
+	return (m_nFileLevels != -1 || m_nMetricLevels != -1);
+}
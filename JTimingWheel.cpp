@@ -0,0 +1,394 @@
+/*******************************************************************************
+ JTimingWheel.cpp
+
+	Schedules integer items (e.g., grid cells) at integer times.  Each
+	slot holds an intrusive singly linked list stored in arrays, so
+	scheduling is O(1), never allocates, and the cost of PopDue() is
+	proportional to the number of items that are due plus the number of
+	slots that are scanned, not the number of items.
+
+	There are two levels.  Each fine slot covers one unit of time, and
+	each coarse slot covers one revolution of the fine slots.  When a
+	revolution starts, the items in its coarse slot move down to the fine
+	slots, so each item is only touched once or twice before it is due,
+	even if it is due many revolutions in the future.  Items that are due
+	more than one coarse revolution in the future simply stay in their
+	coarse slot until their time comes around.
+
+	Time may wrap around, as long as nothing is scheduled more than 2^31
+	units in the future.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JTimingWheel.h"
+
+/*******************************************************************************
+ Constructor
+
+ *******************************************************************************/
+
+JTimingWheel::JTimingWheel()
+	:
+	m_nItemCount(0),
+	m_pNext(NULL),
+	m_pDue(NULL),
+	m_nSlotMask(0),
+	m_nSlotShift(0),
+	m_pHead(NULL),
+	m_nTime(0),
+	m_nPending(-1)
+{
+}
+
+/*******************************************************************************
+ Destructor
+
+ *******************************************************************************/
+
+JTimingWheel::~JTimingWheel()
+{
+	delete [] m_pNext;
+	delete [] m_pDue;
+	delete [] m_pHead;
+}
+
+/*******************************************************************************
+ SetSize
+
+	slotCount is the number of fine slots, and it is rounded up to a power
+	of 2.  This discards everything that was scheduled.
+
+ *******************************************************************************/
+
+void
+JTimingWheel::SetSize
+	(
+	const int itemCount,
+	const int slotCount
+	)
+{
+	int count = 1, shift = 0;
+	while (count < slotCount)
+		{
+		count *= 2;
+		shift++;
+		}
+
+	delete [] m_pNext;
+	delete [] m_pDue;
+	delete [] m_pHead;
+
+	m_nItemCount = itemCount;
+	m_pNext      = new int [ itemCount ];
+	m_pDue       = new int [ itemCount ];
+	m_nSlotMask  = count - 1;
+	m_nSlotShift = shift;
+	m_pHead      = new int [ 2 * count ];
+
+	Reset(0);
+}
+
+/*******************************************************************************
+ Reset
+
+	Discards everything that was scheduled.
+
+ *******************************************************************************/
+
+void
+JTimingWheel::Reset
+	(
+	const int time
+	)
+{
+	const int count = 2 * (m_nSlotMask + 1);
+	for (int i=0; i<count; i++)
+		{
+		m_pHead[i] = -1;
+		}
+
+	m_nTime    = time;
+	m_nPending = -1;
+}
+
+/*******************************************************************************
+ PopDue
+
+	Returns the next item that is due at or before now, or -1 if there
+	are no more.  Call it repeatedly until it returns -1.  Items may be
+	scheduled again while doing so.  If now jumps ahead by more than one
+	revolution, everything is rescheduled once instead of scanning every
+	slot that was skipped.
+
+ *******************************************************************************/
+
+int
+JTimingWheel::PopDue
+	(
+	const int now
+	)
+{
+	if (Elapsed(m_nTime, now) > m_nSlotMask)
+		{
+		Rebuild(now);
+		}
+
+	while (m_nPending < 0 && Elapsed(m_nTime, now) >= 0)
+		{
+		if ((m_nTime & m_nSlotMask) == 0)
+			{
+			Cascade();
+			}
+
+		const int s = m_nTime & m_nSlotMask;
+
+		int item   = m_pHead[s];
+		m_pHead[s] = -1;
+		while (item >= 0)
+			{
+			const int next = m_pNext[item];
+			if (Elapsed(now, m_pDue[item]) <= 0)
+				{
+				m_pNext[item] = m_nPending;
+				m_nPending    = item;
+				}
+			else
+				{
+				m_pNext[item] = m_pHead[s];
+				m_pHead[s]    = item;
+				}
+			item = next;
+			}
+
+		m_nTime = (int) ((DWORD) m_nTime + 1);
+		}
+
+	const int item = m_nPending;
+	if (item >= 0)
+		{
+		m_nPending = m_pNext[item];
+		}
+	return item;
+}
+
+/*******************************************************************************
+ Cascade (private)
+
+	Called when a revolution starts.  Moves the items in the coarse slot
+	for this revolution down to the fine slots.
+
+ *******************************************************************************/
+
+void
+JTimingWheel::Cascade()
+{
+	const int s = m_nSlotMask + 1 + ((m_nTime >> m_nSlotShift) & m_nSlotMask);
+
+	int item   = m_pHead[s];
+	m_pHead[s] = -1;
+	while (item >= 0)
+		{
+		const int next = m_pNext[item];
+		Schedule(item, m_pDue[item]);		// far future stays coarse
+		item = next;
+		}
+}
+
+/*******************************************************************************
+ Rebuild (private)
+
+	Called when now jumps ahead by more than one revolution.  Everything
+	that is due becomes pending, and everything else is rescheduled
+	relative to now.
+
+ *******************************************************************************/
+
+void
+JTimingWheel::Rebuild
+	(
+	const int now
+	)
+{
+	int list        = -1;
+	const int count = 2 * (m_nSlotMask + 1);
+	for (int s=0; s<count; s++)
+		{
+		int item   = m_pHead[s];
+		m_pHead[s] = -1;
+		while (item >= 0)
+			{
+			const int next = m_pNext[item];
+			m_pNext[item]  = list;
+			list           = item;
+			item           = next;
+			}
+		}
+
+	m_nTime = now;
+	while (list >= 0)
+		{
+		const int next = m_pNext[list];
+		if (Elapsed(now, m_pDue[list]) <= 0)
+			{
+			m_pNext[list] = m_nPending;
+			m_nPending    = list;
+			}
+		else
+			{
+			Schedule(list, m_pDue[list]);
+			}
+		list = next;
+		}
+}
+
+/*******************************************************************************
+ GetScheduled
+
+	Sets flags[item] to 1 for every item that is scheduled or pending, and
+	to 0 for all the others.  flags must hold GetItemCount() bytes.
+
+ *******************************************************************************/
+
+void
+JTimingWheel::GetScheduled
+	(
+	BYTE* flags
+	)
+	const
+{
+	memset(flags, 0, m_nItemCount);
+
+	const int count = 2 * (m_nSlotMask + 1);
+	for (int s=-1; s<count; s++)		// -1 => pending
+		{
+		for (int item=(s < 0 ? m_nPending : m_pHead[s]); item>=0; item=m_pNext[item])
+			{
+			flags[item] = 1;
+			}
+		}
+}
+
+/*******************************************************************************
+ Write
+
+	Saves the schedule, including the order of the items in each slot,
+	so Read() reproduces exactly the same sequence from PopDue().
+
+ *******************************************************************************/
+
+void
+JTimingWheel::Write
+	(
+	CArchive& ar
+	)
+	const
+{
+	ar << m_nTime;
+
+	const int count = 2 * (m_nSlotMask + 1);
+	for (int s=-1; s<count; s++)		// -1 => pending
+		{
+		const int first = (s < 0 ? m_nPending : m_pHead[s]);
+
+		int n = 0;
+		for (int i=first; i>=0; i=m_pNext[i])
+			{
+			n++;
+			}
+		ar << n;
+
+		for (int item=first; item>=0; item=m_pNext[item])
+			{
+			ar << item << m_pDue[item];
+			}
+		}
+}
+
+/*******************************************************************************
+ Read
+
+	Restores what Write() saved.  The wheel must already have the same
+	size.  Throws CArchiveException if the data does not fit, e.g., if
+	an item is listed twice or in the wrong slot, and then the wheel is
+	unchanged.
+
+ *******************************************************************************/
+
+void
+JTimingWheel::Read
+	(
+	CArchive& ar
+	)
+{
+	JTimingWheel w;
+	w.SetSize(m_nItemCount, m_nSlotMask + 1);
+
+	ar >> w.m_nTime;
+
+	CByteArray seen;
+	seen.SetSize(m_nItemCount);
+	memset(seen.GetData(), 0, m_nItemCount);
+
+	const int count = 2 * (m_nSlotMask + 1);
+	for (int s=-1; s<count; s++)
+		{
+		int* link = (s < 0 ? &(w.m_nPending) : w.m_pHead + s);
+
+		int n;
+		ar >> n;
+		if (n < 0 || m_nItemCount < n)
+			{
+			AfxThrowArchiveException(CArchiveException::badIndex);
+			}
+
+		for (int i=0; i<n; i++)
+			{
+			int item, due;
+			ar >> item >> due;
+			if (item < 0 || m_nItemCount <= item || seen[item] ||
+				(0 <= s && s <= m_nSlotMask && (due & m_nSlotMask) != s) ||
+				(m_nSlotMask < s &&
+				 ((due >> m_nSlotShift) & m_nSlotMask) != s - m_nSlotMask - 1))
+				{
+				AfxThrowArchiveException(CArchiveException::badIndex);
+				}
+
+			seen[item]     = TRUE;
+			w.m_pDue[item] = due;
+			*link          = item;
+			link           = w.m_pNext + item;
+			}
+
+		*link = -1;
+		}
+
+	Swap(w);
+}
+
+/*******************************************************************************
+ Swap
+
+	Exchanges the contents of the two wheels.
+
+ *******************************************************************************/
+
+void
+JTimingWheel::Swap
+	(
+	JTimingWheel& source
+	)
+{
+	int n;
+	int* p;
+
+	n = m_nItemCount;  m_nItemCount = source.m_nItemCount;  source.m_nItemCount = n;
+	n = m_nSlotMask;   m_nSlotMask  = source.m_nSlotMask;   source.m_nSlotMask  = n;
+	n = m_nSlotShift;  m_nSlotShift = source.m_nSlotShift;  source.m_nSlotShift = n;
+	n = m_nTime;       m_nTime      = source.m_nTime;       source.m_nTime      = n;
+	n = m_nPending;    m_nPending   = source.m_nPending;    source.m_nPending   = n;
+
+	p = m_pNext;       m_pNext      = source.m_pNext;       source.m_pNext      = p;
+	p = m_pDue;        m_pDue       = source.m_pDue;        source.m_pDue       = p;
+	p = m_pHead;       m_pHead      = source.m_pHead;       source.m_pHead      = p;
+}
\ No newline at end of file
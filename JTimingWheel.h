@@ -0,0 +1,109 @@
+/*******************************************************************************
+ JTimingWheel.h
+
+ *******************************************************************************/
+
+#pragma once
+
+class JTimingWheel
+{
+public:
+
+	JTimingWheel();
+
+	~JTimingWheel();
+
+	void	SetSize(const int itemCount, const int slotCount);
+	void	Reset(const int time);
+
+	void	Schedule(const int item, const int time);
+	int		PopDue(const int now);
+
+	int		GetItemCount() const;
+	void	GetScheduled(BYTE* flags) const;
+
+	void	Write(CArchive& ar) const;
+	void	Read(CArchive& ar);
+	void	Swap(JTimingWheel& source);
+
+private:
+
+	int		m_nItemCount;
+	int*	m_pNext;		// intrusive list links, indexed by item
+	int*	m_pDue;			// time at which each item is due
+	int		m_nSlotMask;	// slot count is a power of 2
+	int		m_nSlotShift;	// log2 of slot count
+	int*	m_pHead;		// first item in each slot; fine slots, then coarse slots
+	int		m_nTime;		// next slot to scan
+	int		m_nPending;		// due items that have not yet been returned
+
+private:
+
+	void	Cascade();
+	void	Rebuild(const int now);
+
+	static int	Elapsed(const int from, const int to);
+
+	// not allowed
+
+	JTimingWheel(const JTimingWheel& source);
+	const JTimingWheel& operator=(const JTimingWheel& source);
+};
+
+
+/*******************************************************************************
+ Schedule
+
+	Each item can only be scheduled once at a time.  Times in the past
+	are treated as the next scan.  Items that are due within one
+	revolution go into the fine slots.  The rest go into the coarse slots
+	and move down when their revolution starts.
+
+ *******************************************************************************/
+
+inline void
+JTimingWheel::Schedule
+	(
+	const int item,
+	const int time
+	)
+{
+	ASSERT( 0 <= item && item < m_nItemCount );
+
+	const int t   = (Elapsed(m_nTime, time) < 0 ? m_nTime : time);
+	const int s   = (Elapsed(m_nTime, t) <= m_nSlotMask ? t & m_nSlotMask :
+					 m_nSlotMask + 1 + ((t >> m_nSlotShift) & m_nSlotMask));
+	m_pDue[item]  = t;
+	m_pNext[item] = m_pHead[s];
+	m_pHead[s]    = item;
+}
+
+/*******************************************************************************
+ Elapsed (static private)
+
+	Returns to - from.  Time wraps, so this is only meaningful if the two
+	are less than 2^31 apart.
+
+ *******************************************************************************/
+
+inline int
+JTimingWheel::Elapsed
+	(
+	const int from,
+	const int to
+	)
+{
+	return (int) ((DWORD) to - (DWORD) from);
+}
+
+/*******************************************************************************
+ GetItemCount
+
+ *******************************************************************************/
+
+inline int
+JTimingWheel::GetItemCount()
+	const
+{
+	return m_nItemCount;
+}
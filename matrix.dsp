@@ -90,10 +90,46 @@ LINK32=link.exe
 # PROP Default_Filter "cpp;c;cxx;rc;def;r;odl;idl;hpj;bat"
 # Begin Source File
 
+SOURCE=.\JCommandQueue.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\JFrameShare.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\JGlowFilter.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\JGlyphBatch.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\JMatrixCtrl.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\JMatrixScript.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\JMatrixSnapshot.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\JMatrixViewport.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\JSignalAnalyzer.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\JTimingWheel.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\matrix.cpp
 # End Source File
 # Begin Source File
@@ -115,10 +151,42 @@ SOURCE=.\StdAfx.cpp
 # PROP Default_Filter "h;hpp;hxx;hm;inl"
 # Begin Source File
 
+SOURCE=.\JCommandQueue.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\JFrameShare.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\JGlowFilter.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\JGlyphBatch.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\JMatrixCtrl.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\JMatrixScript.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\JMatrixViewport.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\JSignalAnalyzer.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\JTimingWheel.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\matrix.h
 # End Source File
 # Begin Source File
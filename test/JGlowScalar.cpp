@@ -0,0 +1,97 @@
+/*******************************************************************************
+ JGlowScalar.cpp
+
+	JGlowFilter compiled a second time, without SSE2, so the tests can
+	compare the two paths in one program.  The class is renamed, so it
+	cannot be declared in the same file as JGlowFilter, and JGlowScalar
+	forwards to it.
+
+ *******************************************************************************/
+
+#define JGlowFilter JGlowFilterScalar
+#define JGLOW_NO_SSE2
+#include "../JGlowFilter.cpp"
+#undef JGlowFilter
+
+#include "JGlowScalar.h"
+
+/*******************************************************************************
+ Constructor
+
+ *******************************************************************************/
+
+JGlowScalar::JGlowScalar()
+	:
+	m_pFilter(new JGlowFilterScalar)
+{
+}
+
+/*******************************************************************************
+ Destructor
+
+ *******************************************************************************/
+
+JGlowScalar::~JGlowScalar()
+{
+	delete m_pFilter;
+}
+
+/*******************************************************************************
+ SetSize
+
+ *******************************************************************************/
+
+void
+JGlowScalar::SetSize
+	(
+	const int width,
+	const int height
+	)
+{
+	m_pFilter->SetSize(width, height);
+}
+
+/*******************************************************************************
+ SetParameters
+
+ *******************************************************************************/
+
+void
+JGlowScalar::SetParameters
+	(
+	const int radius,
+	const int strength,
+	const int threshold
+	)
+{
+	m_pFilter->SetParameters(radius, strength, threshold);
+}
+
+/*******************************************************************************
+ AddSource
+
+ *******************************************************************************/
+
+void
+JGlowScalar::AddSource
+	(
+	const CRect& r
+	)
+{
+	m_pFilter->AddSource(r);
+}
+
+/*******************************************************************************
+ Apply
+
+ *******************************************************************************/
+
+int
+JGlowScalar::Apply
+	(
+	BYTE*		bits,
+	const int	stride
+	)
+{
+	return m_pFilter->Apply(bits, stride);
+}
@@ -0,0 +1,34 @@
+/*******************************************************************************
+ JGlowScalar.h
+
+ *******************************************************************************/
+
+#pragma once
+
+class JGlowFilterScalar;
+
+class JGlowScalar
+{
+public:
+
+	JGlowScalar();
+
+	~JGlowScalar();
+
+	void	SetSize(const int width, const int height);
+	void	SetParameters(const int radius, const int strength, const int threshold);
+
+	void	AddSource(const CRect& r);
+	int		Apply(BYTE* bits, const int stride);
+
+private:
+
+	JGlowFilterScalar*	m_pFilter;
+
+private:
+
+	// not allowed
+
+	JGlowScalar(const JGlowScalar& source);
+	const JGlowScalar& operator=(const JGlowScalar& source);
+};
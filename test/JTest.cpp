@@ -0,0 +1,349 @@
+/*******************************************************************************
+ JTest.cpp
+
+	Minimal support for the console tests and benchmarks.  JTEST() prints
+	the failed expression and keeps going, so one run reports every
+	failure.  The benchmarks print one line per measurement, and
+	JTestAtLeast() and JTestAtMost() also fail the run if the result is
+	far from what the hardware we ship on achieves.  The limits are
+	loose on purpose, so they only catch pathological slow paths.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JTest.h"
+#include "JMatrixCtrl.h"
+#include <stdio.h>
+
+static int theFailureCount = 0;
+
+/*******************************************************************************
+ JTestCheck
+
+ *******************************************************************************/
+
+BOOL
+JTestCheck
+	(
+	const BOOL	ok,
+	LPCTSTR		expr,
+	LPCTSTR		file,
+	const int	line
+	)
+{
+	if (!ok)
+		{
+		printf("%s(%d): failed: %s\n", file, line, expr);
+		fflush(stdout);
+		theFailureCount++;
+		}
+	return ok;
+}
+
+/*******************************************************************************
+ JTestGetFailureCount
+
+ *******************************************************************************/
+
+int
+JTestGetFailureCount()
+{
+	return theFailureCount;
+}
+
+/*******************************************************************************
+ JTestGetMicroseconds
+
+	The real clock, even when the control runs on a manual clock.
+
+ *******************************************************************************/
+
+LONGLONG
+JTestGetMicroseconds()
+{
+	static LONGLONG freq = 0;
+	if (freq == 0)
+		{
+		LARGE_INTEGER f;
+		QueryPerformanceFrequency(&f);
+		freq = f.QuadPart;
+		}
+
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return (t.QuadPart / freq) * 1000000 + ((t.QuadPart % freq) * 1000000) / freq;
+}
+
+/*******************************************************************************
+ JTestReport
+
+ *******************************************************************************/
+
+void
+JTestReport
+	(
+	LPCTSTR			name,
+	const double	value,
+	LPCTSTR			unit
+	)
+{
+	printf("  %-44s %12.1f %s\n", name, value, unit);
+	fflush(stdout);
+}
+
+/*******************************************************************************
+ JTestAtLeast
+
+	Reports the value and fails if it is below the limit.
+
+ *******************************************************************************/
+
+BOOL
+JTestAtLeast
+	(
+	LPCTSTR			name,
+	const double	value,
+	const double	limit,
+	LPCTSTR			unit
+	)
+{
+	JTestReport(name, value, unit);
+	if (value < limit)
+		{
+		printf("  failed: %s is below %.1f %s\n", name, limit, unit);
+		theFailureCount++;
+		return FALSE;
+		}
+	return TRUE;
+}
+
+/*******************************************************************************
+ JTestAtMost
+
+	Reports the value and fails if it is above the limit.
+
+ *******************************************************************************/
+
+BOOL
+JTestAtMost
+	(
+	LPCTSTR			name,
+	const double	value,
+	const double	limit,
+	LPCTSTR			unit
+	)
+{
+	JTestReport(name, value, unit);
+	if (value > limit)
+		{
+		printf("  failed: %s is above %.1f %s\n", name, limit, unit);
+		theFailureCount++;
+		return FALSE;
+		}
+	return TRUE;
+}
+
+/*******************************************************************************
+ JTestCreateCtrl
+
+	Creates a hidden control whose frames are exactly the given size.  It
+	runs on the manual clock, so the caller drives it with Step().  Set the
+	configuration before calling this.
+
+ *******************************************************************************/
+
+BOOL
+JTestCreateCtrl
+	(
+	JMatrixCtrl*	ctrl,
+	const CSize&	size,
+	const DWORD		seed
+	)
+{
+	JMatrixCtrl::Config config = ctrl->GetConfig();
+	config.bRenderThread       = FALSE;
+	config.bSuspendWhenHidden  = FALSE;
+	ctrl->SetConfig(config);
+
+	ctrl->UseManualClock(seed);
+
+	CRect r(CPoint(0,0), size);
+	::AdjustWindowRectEx(&r, WS_POPUP, FALSE, WS_EX_CLIENTEDGE);
+	if (!ctrl->Create(WS_POPUP, r, NULL))
+		{
+		return FALSE;
+		}
+
+	CRect client;
+	ctrl->GetClientRect(client);
+	return JTEST( client.Size() == size );
+}
+
+/*******************************************************************************
+ JTestRandom
+
+	xorshift32, so a seed reproduces the same run on every platform.
+
+ *******************************************************************************/
+
+JTestRandom::JTestRandom
+	(
+	const DWORD seed
+	)
+	:
+	m_nState(seed != 0 ? seed : 0x12345678)
+{
+}
+
+/*******************************************************************************
+ Next
+
+ *******************************************************************************/
+
+DWORD
+JTestRandom::Next()
+{
+	m_nState ^= m_nState << 13;
+	m_nState ^= m_nState >> 17;
+	m_nState ^= m_nState << 5;
+	return m_nState;
+}
+
+/*******************************************************************************
+ Range
+
+	Returns a number between first and last, inclusive.
+
+ *******************************************************************************/
+
+int
+JTestRandom::Range
+	(
+	const int first,
+	const int last
+	)
+{
+	const DWORD count = (DWORD) last - (DWORD) first + 1;
+	return (int) ((DWORD) first + (count == 0 ? Next() : Next() % count));
+}
+
+/*******************************************************************************
+ Chance
+
+ *******************************************************************************/
+
+BOOL
+JTestRandom::Chance
+	(
+	const int percent
+	)
+{
+	return ((int) (Next() % 100) < percent);
+}
+
+/*******************************************************************************
+ JTestImage
+
+	An offscreen 32 bit DIB section, so the tests can compare pixels.
+
+ *******************************************************************************/
+
+JTestImage::JTestImage
+	(
+	const int width,
+	const int height
+	)
+	:
+	m_nWidth(width),
+	m_nHeight(height),
+	m_hBitmapOld(NULL),
+	m_pBits(NULL)
+{
+	BITMAPINFO info;
+	memset(&info, 0, sizeof(info));
+	info.bmiHeader.biSize        = sizeof(BITMAPINFOHEADER);
+	info.bmiHeader.biWidth       = width;
+	info.bmiHeader.biHeight      = -height;		// top-down
+	info.bmiHeader.biPlanes      = 1;
+	info.bmiHeader.biBitCount    = 32;
+	info.bmiHeader.biCompression = BI_RGB;
+
+	m_DC.CreateCompatibleDC(NULL);
+
+	void* bits     = NULL;
+	HBITMAP bitmap = ::CreateDIBSection(m_DC.m_hDC, &info, DIB_RGB_COLORS, &bits, NULL, 0);
+	ASSERT( bitmap != NULL );
+
+	m_Bitmap.Attach(bitmap);
+	m_pBits      = (DWORD*) bits;
+	m_hBitmapOld = ::SelectObject(m_DC.m_hDC, bitmap);
+	m_DC.FillSolidRect(0, 0, width, height, RGB(0,0,0));
+}
+
+/*******************************************************************************
+ Destructor
+
+ *******************************************************************************/
+
+JTestImage::~JTestImage()
+{
+	::SelectObject(m_DC.m_hDC, m_hBitmapOld);
+}
+
+/*******************************************************************************
+ Equals
+
+ *******************************************************************************/
+
+BOOL
+JTestImage::Equals
+	(
+	const JTestImage& image
+	)
+	const
+{
+	GdiFlush();
+
+	if (m_nWidth != image.m_nWidth || m_nHeight != image.m_nHeight)
+		{
+		return FALSE;
+		}
+
+	for (int y=0; y<m_nHeight; y++)
+		{
+		for (int x=0; x<m_nWidth; x++)
+			{
+			if (GetPixel(x,y) != image.GetPixel(x,y))
+				{
+				return FALSE;
+				}
+			}
+		}
+
+	return TRUE;
+}
+
+/*******************************************************************************
+ IsBlack
+
+ *******************************************************************************/
+
+BOOL
+JTestImage::IsBlack()
+	const
+{
+	GdiFlush();
+
+	for (int y=0; y<m_nHeight; y++)
+		{
+		for (int x=0; x<m_nWidth; x++)
+			{
+			if (GetPixel(x,y) != 0)
+				{
+				return FALSE;
+				}
+			}
+		}
+
+	return TRUE;
+}
@@ -0,0 +1,136 @@
+/*******************************************************************************
+ JTest.h
+
+ *******************************************************************************/
+
+#pragma once
+
+#define JTEST(expr)	JTestCheck((expr) ? TRUE : FALSE, #expr, __FILE__, __LINE__)
+
+BOOL		JTestCheck(const BOOL ok, LPCTSTR expr, LPCTSTR file, const int line);
+int			JTestGetFailureCount();
+
+LONGLONG	JTestGetMicroseconds();
+void		JTestReport(LPCTSTR name, const double value, LPCTSTR unit);
+BOOL		JTestAtLeast(LPCTSTR name, const double value, const double limit, LPCTSTR unit);
+BOOL		JTestAtMost(LPCTSTR name, const double value, const double limit, LPCTSTR unit);
+
+class JMatrixCtrl;
+
+BOOL		JTestCreateCtrl(JMatrixCtrl* ctrl, const CSize& size, const DWORD seed);
+
+class JTestRandom
+{
+public:
+
+	JTestRandom(const DWORD seed);
+
+	DWORD	Next();
+	int		Range(const int first, const int last);
+	BOOL	Chance(const int percent);
+
+private:
+
+	DWORD	m_nState;
+};
+
+class JTestImage
+{
+public:
+
+	JTestImage(const int width, const int height);
+
+	~JTestImage();
+
+	CDC&			GetDC();
+	const DWORD*	GetRow(const int y) const;
+	DWORD			GetPixel(const int x, const int y) const;
+	BOOL			Equals(const JTestImage& image) const;
+	BOOL			IsBlack() const;
+
+	int				GetWidth() const;
+	int				GetHeight() const;
+
+private:
+
+	int			m_nWidth;
+	int			m_nHeight;
+	CDC			m_DC;
+	CBitmap		m_Bitmap;
+	HGDIOBJ		m_hBitmapOld;
+	DWORD*		m_pBits;		// top-down, 0x00RRGGBB
+
+private:
+
+	// not allowed
+
+	JTestImage(const JTestImage& source);
+	const JTestImage& operator=(const JTestImage& source);
+};
+
+
+/*******************************************************************************
+ GetDC
+
+ *******************************************************************************/
+
+inline CDC&
+JTestImage::GetDC()
+{
+	return m_DC;
+}
+
+/*******************************************************************************
+ GetRow
+
+ *******************************************************************************/
+
+inline const DWORD*
+JTestImage::GetRow
+	(
+	const int y
+	)
+	const
+{
+	return m_pBits + y * m_nWidth;
+}
+
+/*******************************************************************************
+ GetPixel
+
+ *******************************************************************************/
+
+inline DWORD
+JTestImage::GetPixel
+	(
+	const int x,
+	const int y
+	)
+	const
+{
+	return m_pBits[ y * m_nWidth + x ] & 0x00FFFFFF;
+}
+
+/*******************************************************************************
+ GetWidth
+
+ *******************************************************************************/
+
+inline int
+JTestImage::GetWidth()
+	const
+{
+	return m_nWidth;
+}
+
+/*******************************************************************************
+ GetHeight
+
+ *******************************************************************************/
+
+inline int
+JTestImage::GetHeight()
+	const
+{
+	return m_nHeight;
+}
@@ -0,0 +1,344 @@
+/*******************************************************************************
+ TestCommandQueue.cpp
+
+	Several producers push commands while one consumer drains them.  Each
+	command identifies its producer and its sequence number three times:
+	in both values and in the text, so the consumer can tell if it sees a
+	slot that has not been completely filled, or if a producer's commands
+	arrive out of order.  Some commands have text that spans several
+	slots, like long lines, and their slots must arrive together.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JTest.h"
+#include "JCommandQueue.h"
+#include "JMatrixCtrl.h"
+
+const int kProducerCount   = 4;
+const int kQueueCapacity   = 1024;		// same as JMatrixCtrl
+const int kTestCount       = 50000;		// commands per producer
+const int kBenchmarkCount  = 1000000;	// commands per producer
+const int kCtrlCount       = 20000;		// commands per producer
+
+struct ProducerInfo
+{
+	JCommandQueue*	queue;
+	JMatrixCtrl*	ctrl;
+	int				nID;
+	int				nCount;
+};
+
+/*******************************************************************************
+ GetTextLength (static)
+
+	Every 16th command needs three slots.
+
+ *******************************************************************************/
+
+static int
+GetTextLength
+	(
+	const int seq
+	)
+{
+	const int limit = JCommandQueue::kMaxTextLength;
+	return (seq % 16 == 15 ? 2 * limit + seq % limit : seq % (limit + 1));
+}
+
+/*******************************************************************************
+ GetTextChar (static)
+
+	The text of each command is a run of this character.
+
+ *******************************************************************************/
+
+static TCHAR
+GetTextChar
+	(
+	const int id,
+	const int seq
+	)
+{
+	return (TCHAR) ('A' + (id * 7 + seq) % 26);
+}
+
+/*******************************************************************************
+ ProduceCommands (static)
+
+	Fills each slot exactly the way JMatrixCtrl::PushCommand() does.
+
+ *******************************************************************************/
+
+static UINT
+ProduceCommands
+	(
+	LPVOID param
+	)
+{
+	const ProducerInfo* info = (const ProducerInfo*) param;
+	JCommandQueue* queue     = info->queue;
+
+	const int perSlot = JCommandQueue::kMaxTextLength;
+
+	for (int seq=0; seq<info->nCount; seq++)
+		{
+		const int length = GetTextLength(seq);
+		const int count  = max(1, (length + perSlot - 1) / perSlot);
+		const TCHAR c    = GetTextChar(info->nID, seq);
+		const LONG first = queue->Reserve(count);
+
+		for (int s=0; s<count; s++)
+			{
+			const LONG ticket = first + s;
+			while (!queue->IsFree(ticket))
+				{
+				Sleep(0);
+				}
+
+			JCommandQueue::Command& cmd = queue->GetSlot(ticket);
+			cmd.nType                   = 0;
+			cmd.nValue1                 = info->nID;
+			cmd.nValue2                 = seq;
+			cmd.bContinued              = (s < count-1);
+
+			const int chunk = min(length - s * perSlot, perSlot);
+			for (int i=0; i<chunk; i++)
+				{
+				cmd.text[i] = c;
+				}
+			cmd.text[ chunk ] = '\0';
+
+			queue->Publish(ticket);
+			}
+		}
+
+	return 0;
+}
+
+/*******************************************************************************
+ StartThreads (static)
+
+ *******************************************************************************/
+
+static void
+StartThreads
+	(
+	AFX_THREADPROC	proc,
+	ProducerInfo*	info,
+	CWinThread**	thread
+	)
+{
+	for (int i=0; i<kProducerCount; i++)
+		{
+		info[i].nID = i;
+		thread[i]   = AfxBeginThread(proc, info + i, THREAD_PRIORITY_NORMAL,
+									 0, CREATE_SUSPENDED);
+		thread[i]->m_bAutoDelete = FALSE;
+		}
+
+	for (int j=0; j<kProducerCount; j++)
+		{
+		thread[j]->ResumeThread();
+		}
+}
+
+/*******************************************************************************
+ WaitForThreads (static)
+
+ *******************************************************************************/
+
+static void
+WaitForThreads
+	(
+	CWinThread** thread
+	)
+{
+	for (int i=0; i<kProducerCount; i++)
+		{
+		WaitForSingleObject(thread[i]->m_hThread, INFINITE);
+		delete thread[i];
+		}
+}
+
+/*******************************************************************************
+ RunQueue (static)
+
+	Returns the number of commands per second that passed through the
+	queue.
+
+ *******************************************************************************/
+
+static double
+RunQueue
+	(
+	const int count
+	)
+{
+	JCommandQueue queue;
+	queue.SetCapacity(kQueueCapacity);
+
+	ProducerInfo info[ kProducerCount ];
+	CWinThread* thread[ kProducerCount ];
+	int nextSeq[ kProducerCount ];
+	for (int i=0; i<kProducerCount; i++)
+		{
+		info[i].queue  = &queue;
+		info[i].ctrl   = NULL;
+		info[i].nCount = count;
+		nextSeq[i]     = 0;
+		}
+
+	const LONGLONG start = JTestGetMicroseconds();
+	StartThreads(ProduceCommands, info, thread);
+
+	int received = 0, bad = 0, idle = 0;
+	int partID = -1, partLength = 0;		// command whose text continues
+	while (received < kProducerCount * count && idle < 1000000)
+		{
+		const JCommandQueue::Command* cmd = queue.GetFront();
+		if (cmd == NULL)
+			{
+			Sleep(0);
+			idle++;
+			continue;
+			}
+		idle = 0;
+
+		// a torn slot shows up as an unknown producer, a sequence number
+		// that skips, text that does not match the values, or a slot from
+		// another command between the slots of a long one
+
+		const int id = cmd->nValue1, seq = cmd->nValue2;
+		BOOL ok = (0 <= id && id < kProducerCount && seq == nextSeq[id] &&
+				   (partID < 0 || partID == id));
+		if (ok)
+			{
+			const int rest   = GetTextLength(seq) - partLength;
+			const int length = min(rest, (int) JCommandQueue::kMaxTextLength);
+			const TCHAR c    = GetTextChar(id, seq);
+			ok = (cmd->text[ length ] == '\0' && cmd->bContinued == (rest > length));
+			for (int j=0; ok && j<length; j++)
+				{
+				ok = (cmd->text[j] == c);
+				}
+			partLength += length;
+			}
+
+		if (cmd->bContinued)
+			{
+			partID = id;
+			}
+		else
+			{
+			if (ok)
+				{
+				nextSeq[id]++;
+				}
+			partID     = -1;
+			partLength = 0;
+			received++;
+			}
+
+		if (!ok)
+			{
+			bad++;
+			}
+
+		queue.PopFront();
+		}
+
+	const LONGLONG time = JTestGetMicroseconds() - start;
+	WaitForThreads(thread);
+
+	JTEST( received == kProducerCount * count );
+	JTEST( bad == 0 );
+	JTEST( queue.GetFront() == NULL );
+	for (int k=0; k<kProducerCount; k++)
+		{
+		JTEST( nextSeq[k] == count );
+		}
+
+	return received * 1e6 / max(time, (LONGLONG) 1);
+}
+
+/*******************************************************************************
+ PushToCtrl (static)
+
+ *******************************************************************************/
+
+static UINT
+PushToCtrl
+	(
+	LPVOID param
+	)
+{
+	const ProducerInfo* info = (const ProducerInfo*) param;
+	for (int i=0; i<info->nCount; i++)
+		{
+		info->ctrl->SetIntervals(info->nID, i);
+		}
+
+	return 0;
+}
+
+/*******************************************************************************
+ TestCommandQueue
+
+	Also checks that JMatrixCtrl applies every command when the queue
+	overflows while the animation runs.
+
+ *******************************************************************************/
+
+void
+TestCommandQueue()
+{
+	RunQueue(kTestCount);
+
+	JMatrixCtrl ctrl;
+	if (!JTestCreateCtrl(&ctrl, CSize(320, 200), 40))
+		{
+		return;
+		}
+	ctrl.Step(100);
+	const int before = ctrl.GetStats().nCommandCount;
+
+	ProducerInfo info[ kProducerCount ];
+	CWinThread* thread[ kProducerCount ];
+	for (int i=0; i<kProducerCount; i++)
+		{
+		info[i].queue  = NULL;
+		info[i].ctrl   = &ctrl;
+		info[i].nCount = kCtrlCount;
+		}
+
+	StartThreads(PushToCtrl, info, thread);
+
+	int steps = 0;
+	while (ctrl.GetStats().nCommandCount - before < kProducerCount * kCtrlCount &&
+		   steps < 100000)
+		{
+		ctrl.Step(1);
+		steps++;
+		}
+
+	WaitForThreads(thread);
+	ctrl.Step(1);
+
+	JTEST( ctrl.GetStats().nCommandCount - before == kProducerCount * kCtrlCount );
+	JTEST( ctrl.GetStats().nCommandStalls > 0 );
+
+	ctrl.DestroyWindow();
+}
+
+/*******************************************************************************
+ BenchmarkCommandQueue
+
+ *******************************************************************************/
+
+void
+BenchmarkCommandQueue()
+{
+	JTestAtLeast("commands from 4 producers", RunQueue(kBenchmarkCount),
+				 1000000, "commands/sec");
+}
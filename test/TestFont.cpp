@@ -0,0 +1,157 @@
+/*******************************************************************************
+ TestFont.cpp
+
+	Changing the fonts of a running control.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JTest.h"
+#include "JMatrixCtrl.h"
+
+const int kFontSwitchCount = 6;
+
+static const int kTextFontHeight[] = { 14, 20, 11 };
+static const int kRainFontHeight[] = { 14, 18 };
+
+/*******************************************************************************
+ GetFont (static)
+
+ *******************************************************************************/
+
+static LOGFONT
+GetFont
+	(
+	const int	height,
+	const BYTE	charSet
+	)
+{
+	LOGFONT font;
+	memset(&font, 0, sizeof(LOGFONT));
+	font.lfHeight         = height;
+	font.lfWeight         = FW_BOLD;
+	font.lfCharSet        = charSet;
+	font.lfPitchAndFamily = FIXED_PITCH | FF_MODERN;
+	strcpy(font.lfFaceName, "Courier New");
+	return font;
+}
+
+/*******************************************************************************
+ TestFont
+
+	The animation continues after every change, and switching back to the
+	original fonts does not leave any extra buffers behind.  Settings that
+	only take effect when the control is created are not picked up by the
+	next font change.
+
+ *******************************************************************************/
+
+void
+TestFont()
+{
+	JMatrixCtrl ctrl;
+	ctrl.SetIntervals(0, 0);
+	ctrl.AddTextLine("The quick brown fox");
+	ctrl.AddTextLine("jumps over the lazy dog");
+
+	const CSize size(480, 320);
+	if (!JTestCreateCtrl(&ctrl, size, 39))
+		{
+		return;
+		}
+
+	ctrl.SetTextFont(GetFont(14, ANSI_CHARSET));
+	ctrl.Step(2000);
+	const int bufferBytes = ctrl.GetStats().nBufferBytes;
+
+	JTestImage image(size.cx, size.cy);
+	for (int i=0; i<kFontSwitchCount; i++)
+		{
+		ctrl.SetTextFont(GetFont(kTextFontHeight[ i % 3 ], ANSI_CHARSET));
+		ctrl.Step(300);
+		ctrl.SetRainFont(GetFont(14, i % 2 ? ANSI_CHARSET : GREEK_CHARSET));
+		ctrl.Step(300);
+
+		ctrl.DrawViewport(image.GetDC(), CRect(CPoint(0,0), size));
+		JTEST( !image.IsBlack() );
+		}
+
+	const JMatrixCtrl::Config created = ctrl.GetConfig();
+
+	JMatrixCtrl::Config config         = created;
+	config.nColSpacing                 = created.nColSpacing + 3;
+	config.nRainLayerCount             = (created.nRainLayerCount == 1 ? 2 : 1);
+	config.bIndexedRain                = !created.bIndexedRain;
+	config.rainLayer[0].nFontHeight    = created.rainLayer[0].nFontHeight + 6;
+	ctrl.SetConfig(config);
+
+	config = ctrl.GetConfig();
+	JTEST( config.nColSpacing == created.nColSpacing );
+	JTEST( config.nRainLayerCount == created.nRainLayerCount );
+	JTEST( config.bIndexedRain == created.bIndexedRain );
+	JTEST( config.rainLayer[0].nFontHeight == created.rainLayer[0].nFontHeight );
+
+	ctrl.SetTextFont(GetFont(14, ANSI_CHARSET));
+	ctrl.SetRainFont(GetFont(14, GREEK_CHARSET));
+	ctrl.Step(300);
+	JTEST( ctrl.GetStats().nBufferBytes == bufferBytes );
+
+	ctrl.DestroyWindow();
+}
+
+/*******************************************************************************
+ BenchmarkFont
+
+	Switches the fonts of a running control on a 4K grid.
+
+ *******************************************************************************/
+
+void
+BenchmarkFont()
+{
+	JMatrixCtrl ctrl;
+
+	JMatrixCtrl::Config config = ctrl.GetConfig();
+	config.nRainLayerCount     = 2;
+	ctrl.SetConfig(config);
+
+	ctrl.SetIntervals(0, 0);
+	for (int i=0; i<40; i++)
+		{
+		ctrl.AddTextLine("Directed by Somebody Or Other");
+		}
+
+	if (!JTestCreateCtrl(&ctrl, CSize(3840, 2160), 39))
+		{
+		return;
+		}
+
+	ctrl.Step(1000);
+
+	LONGLONG textTotal = 0, textMax = 0, rainTotal = 0, rainMax = 0;
+	for (int j=0; j<kFontSwitchCount; j++)
+		{
+		LONGLONG start = JTestGetMicroseconds();
+		ctrl.SetTextFont(GetFont(kTextFontHeight[ j % 3 ], ANSI_CHARSET));
+		LONGLONG t = JTestGetMicroseconds() - start;
+		textTotal += t;
+		textMax    = max(textMax, t);
+
+		ctrl.Step(50);
+
+		start = JTestGetMicroseconds();
+		ctrl.SetRainFont(GetFont(kRainFontHeight[ j % 2 ], j % 2 ? ANSI_CHARSET : GREEK_CHARSET));
+		t = JTestGetMicroseconds() - start;
+		rainTotal += t;
+		rainMax    = max(rainMax, t);
+
+		ctrl.Step(50);
+		}
+
+	JTestReport("text font, average", textTotal / 1000.0 / kFontSwitchCount, "ms");
+	JTestAtMost("text font, worst", textMax / 1000.0, 1000, "ms");
+	JTestReport("rain font, average", rainTotal / 1000.0 / kFontSwitchCount, "ms");
+	JTestAtMost("rain font, worst", rainMax / 1000.0, 1000, "ms");
+
+	ctrl.DestroyWindow();
+}
@@ -0,0 +1,222 @@
+/*******************************************************************************
+ TestFrameShare.cpp
+
+	One process publishes frames through JFrameShare while a second
+	process draws them.  Every frame is a single colour that encodes its
+	serial number, so the consumer can tell if it ever shows a frame that
+	mixes two publications, or one that is older than the last one that
+	it showed.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JTest.h"
+#include "JFrameShare.h"
+#include <stdio.h>
+
+const int kFrameWidth       = 128;		// small, so the producer often laps the consumer
+const int kFrameHeight      = 64;
+const int kConsumerDraws    = 400;
+const DWORD kFirstFrameWait = 10000;	// milliseconds
+const DWORD kMaxTestTime    = 60000;	// milliseconds
+
+/*******************************************************************************
+ GetFrameColor (static)
+
+ *******************************************************************************/
+
+static COLORREF
+GetFrameColor
+	(
+	const LONG serial
+	)
+{
+	return RGB(serial & 0xFF, (serial >> 8) & 0xFF, (serial >> 16) & 0xFF);
+}
+
+/*******************************************************************************
+ GetFrameSerial (static)
+
+	Inverse of GetFrameColor() for a pixel read from a DIB.
+
+ *******************************************************************************/
+
+static LONG
+GetFrameSerial
+	(
+	const DWORD pixel
+	)
+{
+	return (GetRValue(pixel) << 16) | (GetGValue(pixel) << 8) | GetBValue(pixel);
+}
+
+/*******************************************************************************
+ IsUniform (static)
+
+ *******************************************************************************/
+
+static BOOL
+IsUniform
+	(
+	const JTestImage& image
+	)
+{
+	const DWORD pixel = image.GetPixel(0,0);
+	for (int y=0; y<image.GetHeight(); y++)
+		{
+		const DWORD* row = image.GetRow(y);
+		for (int x=0; x<image.GetWidth(); x++)
+			{
+			if ((row[x] & 0x00FFFFFF) != pixel)
+				{
+				return FALSE;
+				}
+			}
+		}
+
+	return TRUE;
+}
+
+/*******************************************************************************
+ RunFrameConsumer
+
+	Runs in the child process started by TestFrameShare().  Returns the
+	number of failures, which becomes the exit code.
+
+ *******************************************************************************/
+
+int
+RunFrameConsumer
+	(
+	LPCTSTR		name,
+	const int	count
+	)
+{
+	JFrameShare share;
+	if (!JTEST( share.Open(name) ))
+		{
+		return JTestGetFailureCount();
+		}
+	JTEST( share.GetSize() == CSize(kFrameWidth, kFrameHeight) );
+
+	JTestImage image(kFrameWidth, kFrameHeight);
+	const CRect source(0, 0, kFrameWidth, kFrameHeight);
+
+	const DWORD start = GetTickCount();
+	while (!share.Draw(image.GetDC(), source) && GetTickCount() - start < kFirstFrameWait)
+		{
+		share.KeepAlive();
+		Sleep(1);
+		}
+
+	LONG last = 0;
+	int intact = 0, changes = 0, mixed = 0, stale = 0;
+	for (int i=0; i<count; i++)
+		{
+		share.KeepAlive();
+		if (share.Draw(image.GetDC(), source))
+			{
+			intact++;
+			}
+
+		// the producer counts a frame just after publishing it
+
+		const LONG serial = GetFrameSerial(image.GetPixel(0,0));
+		if (!IsUniform(image))
+			{
+			mixed++;
+			}
+		if (serial < last || serial == 0 || serial > share.GetSerial() + 1)
+			{
+			stale++;
+			}
+		if (serial != last)
+			{
+			changes++;
+			}
+		last = serial;
+		}
+
+	JTEST( mixed == 0 );
+	JTEST( stale == 0 );
+	JTEST( intact > 0 );
+	JTEST( changes > 1 );
+
+	JTestReport("consumer: frames seen", changes, "");
+	JTestReport("consumer: torn copies retried", share.GetTornCount(), "");
+	fflush(stdout);
+
+	return JTestGetFailureCount();
+}
+
+/*******************************************************************************
+ TestFrameShare
+
+	Starts this program again as the consumer and publishes frames until
+	it exits.
+
+ *******************************************************************************/
+
+void
+TestFrameShare()
+{
+	CString name;
+	name.Format("JMatrixTestFrames%lu", GetCurrentProcessId());
+
+	JFrameShare share;
+	if (!JTEST( share.Create(name, kFrameWidth, kFrameHeight) ))
+		{
+		return;
+		}
+	JTEST( share.IsProducer() );
+	JTEST( !share.IsWatched() );
+
+	TCHAR path[ MAX_PATH ];
+	GetModuleFileName(NULL, path, MAX_PATH);
+
+	CString cmdLine;
+	cmdLine.Format("\"%s\" -consumer %s %d", path, (LPCTSTR) name, kConsumerDraws);
+
+	STARTUPINFO startup;
+	memset(&startup, 0, sizeof(startup));
+	startup.cb = sizeof(startup);
+
+	PROCESS_INFORMATION process;
+	const BOOL started = CreateProcess(NULL, cmdLine.GetBuffer(0), NULL, NULL, FALSE, 0,
+									   NULL, NULL, &startup, &process);
+	cmdLine.ReleaseBuffer();
+	if (!JTEST( started ))
+		{
+		return;
+		}
+
+	JTestImage frame(kFrameWidth, kFrameHeight);
+
+	BOOL watched = FALSE;
+	DWORD exitCode = STILL_ACTIVE;
+	const DWORD start = GetTickCount();
+	for (LONG serial=1; GetTickCount() - start < kMaxTestTime; serial++)
+		{
+		frame.GetDC().FillSolidRect(0, 0, kFrameWidth, kFrameHeight, GetFrameColor(serial));
+		share.Publish(frame.GetDC());
+		watched = watched || share.IsWatched();
+
+		GetExitCodeProcess(process.hProcess, &exitCode);
+		if (exitCode != STILL_ACTIVE)
+			{
+			break;
+			}
+		}
+
+	if (exitCode == STILL_ACTIVE)
+		{
+		TerminateProcess(process.hProcess, 1);
+		WaitForSingleObject(process.hProcess, INFINITE);
+		}
+	CloseHandle(process.hProcess);
+	CloseHandle(process.hThread);
+
+	JTEST( exitCode == 0 );
+	JTEST( watched );
+	JTEST( share.GetSerial() > 1 );
+}
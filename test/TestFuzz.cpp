@@ -0,0 +1,864 @@
+/*******************************************************************************
+ TestFuzz.cpp
+
+	Random scripts, grid sizes, and parameters.  Each round is reproduced
+	by its seed, which is printed when the round fails:
+
+		matrixtest -fuzz count seed
+
+	The configurations stay within the ranges documented in JMatrixCtrl.h,
+	because SetConfig() leaves the validation to the caller.  Everything
+	else, including the scripts and the snapshots, may be garbage.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JTest.h"
+#include "JMatrixCtrl.h"
+#include "JMatrixScript.h"
+#include "JTimingWheel.h"
+#include <stdio.h>
+
+const int kTestRoundCount   = 16;
+const int kScriptLineCount  = 300;
+const int kMaxLineLength    = 5000;
+const int kWheelRoundCount  = 3000;
+const int kMaxGridWidth     = 640;
+const int kMaxGridHeight    = 400;
+const int kMaxRunTime       = 3000;		// milliseconds
+const int kHeaderBytes      = 16;		// magic, version, length, checksum
+
+const int kBenchmarkLineCount = 100000;
+const int kBenchmarkWidth     = 640;
+const int kBenchmarkHeight    = 360;
+const int kBenchmarkTime      = 3000;	// milliseconds
+
+static const char* kKeyList[] =
+{
+	"delay", "align", "color", "phase", "cursor", "reveal", "Reveal", "speed", "", "=="
+};
+
+const int kKeyCount = sizeof(kKeyList) / sizeof(char*);
+
+static const char* kValueList[] =
+{
+	"default", "left", "right", "center", "none", "block", "random", "type",
+	"rain", "0", "-1", "2147483647", "-2147483648", "99999999999999",
+	"FFFFFFFFFF", "80ff40", "zz", "", "="
+};
+
+const int kValueCount = sizeof(kValueList) / sizeof(char*);
+
+/*******************************************************************************
+ RandomNumber (static)
+
+ *******************************************************************************/
+
+static CString
+RandomNumber
+	(
+	JTestRandom& rnd
+	)
+{
+	CString s;
+	if (rnd.Chance(50))
+		{
+		s = kValueList[ rnd.Range(9, 13) ];
+		}
+	else
+		{
+		s.Format("%d", (int) rnd.Next() >> rnd.Range(0, 31));
+		}
+	return s;
+}
+
+/*******************************************************************************
+ RandomLine (static)
+
+	Text, page breaks, and directives, most of them malformed.  The result
+	never contains '\0', since AddTextLine() takes a C string.
+
+ *******************************************************************************/
+
+static CString
+RandomLine
+	(
+	JTestRandom& rnd
+	)
+{
+	CString line;
+
+	const int kind = rnd.Range(0, 9);
+	if (kind <= 3)						// text
+		{
+		const int length = (rnd.Chance(5) ? rnd.Range(0, kMaxLineLength) : rnd.Range(0, 80));
+		for (int i=0; i<length; i++)
+			{
+			line += (char) (rnd.Chance(90) ? rnd.Range(32, 126) : rnd.Range(1, 255));
+			}
+		}
+	else if (kind <= 5)					// page break
+		{
+		line = "\x01";
+		if (rnd.Chance(70))
+			{
+			line += (rnd.Chance(80) ? " " : "");
+			line += (rnd.Chance(80) ? RandomNumber(rnd) : CString(kValueList[ rnd.Range(0, kValueCount-1) ]));
+			}
+		}
+	else if (kind <= 8)					// directive
+		{
+		line = "\x02";
+		const int count = rnd.Range(0, 6);
+		for (int i=0; i<count; i++)
+			{
+			line += (rnd.Chance(80) ? " " : "\t ");
+			line += kKeyList[ rnd.Range(0, kKeyCount-1) ];
+			if (rnd.Chance(90))
+				{
+				line += "=";
+				}
+			line += (rnd.Chance(30) ? RandomNumber(rnd) : CString(kValueList[ rnd.Range(0, kValueCount-1) ]));
+			}
+		}
+	else								// garbage
+		{
+		const int length = rnd.Range(1, 40);
+		for (int i=0; i<length; i++)
+			{
+			line += (char) rnd.Range(1, 255);
+			}
+		}
+
+	return line;
+}
+
+/*******************************************************************************
+ FuzzScript (static)
+
+	Every instruction must decode to a value that the animation can use
+	without checking it again.
+
+ *******************************************************************************/
+
+static void
+FuzzScript
+	(
+	JTestRandom& rnd
+	)
+{
+	JMatrixScript script;
+	if (rnd.Chance(30))
+		{
+		script.AddLine(RandomLine(rnd));
+		script.RemoveAll();
+		}
+
+	CStringArray textList;
+	for (int i=0; i<kScriptLineCount; i++)
+		{
+		const CString line = RandomLine(rnd);
+		script.AddLine(line);
+		if (line.IsEmpty() || (line[0] != '\x01' && line[0] != '\x02'))
+			{
+			textList.Add(line);
+			}
+		}
+
+	int offset = 0, lineIndex = 0, errorCount = 0;
+	while (offset < script.GetLength())
+		{
+		if (!script.IsValidOffset(offset))
+			{
+			errorCount++;
+			break;
+			}
+
+		int opcode, value;
+		offset = script.Read(offset, &opcode, &value);
+
+		BOOL ok = FALSE;
+		if (opcode == JMatrixScript::kLineOp)
+			{
+			ok = (value == lineIndex && value < textList.GetSize() &&
+				  script.GetText(value) == textList[value]);
+			lineIndex++;
+			}
+		else if (opcode == JMatrixScript::kPageBreakOp ||
+				 opcode == JMatrixScript::kDelayOp)
+			{
+			ok = (value >= 0);
+			}
+		else if (opcode == JMatrixScript::kAlignOp)
+			{
+			ok = (JMatrixScript::kAlignCenter <= value && value <= JMatrixScript::kAlignRight);
+			}
+		else if (opcode == JMatrixScript::kColorOp)
+			{
+			ok = (value == JMatrixScript::kDefaultValue || (value & 0xFF000000) == 0);
+			}
+		else if (opcode == JMatrixScript::kPhaseCountOp)
+			{
+			ok = (value >= JMatrixScript::kDefaultValue);
+			}
+		else if (opcode == JMatrixScript::kCursorOp)
+			{
+			ok = (JMatrixScript::kDefaultValue <= value && value <= JMatrixScript::kRandomCursor);
+			}
+		else if (opcode == JMatrixScript::kRevealOp)
+			{
+			ok = (JMatrixScript::kDefaultValue <= value && value <= JMatrixScript::kRainReveal);
+			}
+
+		if (!ok)
+			{
+			errorCount++;
+			}
+		}
+
+	JTEST( errorCount == 0 );
+	JTEST( offset == script.GetLength() );
+	JTEST( lineIndex == textList.GetSize() );
+}
+
+/*******************************************************************************
+ Elapsed (static)
+
+ *******************************************************************************/
+
+static int
+Elapsed
+	(
+	const int from,
+	const int to
+	)
+{
+	return (int) ((DWORD) to - (DWORD) from);
+}
+
+/*******************************************************************************
+ SaveWheel (static)
+
+ *******************************************************************************/
+
+static void
+SaveWheel
+	(
+	const JTimingWheel&	wheel,
+	CByteArray*			data
+	)
+{
+	CMemFile file;
+	CArchive ar(&file, CArchive::store);
+	wheel.Write(ar);
+	ar.Close();
+
+	const int length = (int) file.GetLength();
+	BYTE* bytes      = file.Detach();
+	data->SetSize(length);
+	memcpy(data->GetData(), bytes, length);
+	free(bytes);		// CMemFile uses malloc()
+}
+
+/*******************************************************************************
+ LoadWheel (static)
+
+	Returns FALSE if Read() rejected the data.
+
+ *******************************************************************************/
+
+static BOOL
+LoadWheel
+	(
+	JTimingWheel&		wheel,
+	const CByteArray&	data
+	)
+{
+	CMemFile file((BYTE*) data.GetData(), data.GetSize());
+	CArchive ar(&file, CArchive::load);
+	try
+		{
+		wheel.Read(ar);
+		ar.Close();
+		}
+	catch (CException* e)
+		{
+		e->Delete();
+		ar.Abort();
+		return FALSE;
+		}
+
+	return TRUE;
+}
+
+/*******************************************************************************
+ FuzzWheel (static)
+
+	A random size and random schedules, checked against a model that
+	remembers when each item is due.  Then damaged copies of the wheel
+	are read back:  Read() must either reject them without changing
+	anything, or produce a wheel that never returns an item that was not
+	scheduled.
+
+ *******************************************************************************/
+
+static void
+FuzzWheel
+	(
+	JTestRandom& rnd
+	)
+{
+	const int itemCount = rnd.Range(1, 300);
+	const int slotCount = 1 << rnd.Range(1, 7);
+	const int start     = (int) rnd.Next();
+
+	JTimingWheel wheel;
+	wheel.SetSize(itemCount, slotCount);
+	wheel.Reset(start);
+
+	CByteArray scheduled;
+	scheduled.SetSize(itemCount);
+	memset(scheduled.GetData(), 0, itemCount);
+
+	CArray<int, int> due;
+	due.SetSize(itemCount);
+
+	int now = start, clock = start, errorCount = 0;
+	for (int round=0; round<kWheelRoundCount; round++)
+		{
+		const int scheduleCount = rnd.Range(0, 4);
+		for (int i=0; i<scheduleCount; i++)
+			{
+			const int item = rnd.Range(0, itemCount-1);
+			if (scheduled[item])
+				{
+				continue;
+				}
+
+			const int delta =
+				(rnd.Chance(10) ? -rnd.Range(1, 1 << 20) :
+				 rnd.Chance(70) ? rnd.Range(0, slotCount * slotCount) :
+								  rnd.Range(0, 1 << 24));
+			const int time = (int) ((DWORD) now + delta);
+			wheel.Schedule(item, time);
+
+			scheduled[item] = 1;
+			due[item]       = (Elapsed(clock, time) < 0 ? clock : time);
+			}
+
+		now = (int) ((DWORD) now + (rnd.Chance(90) ? rnd.Range(0, 4) : rnd.Range(0, 1 << 16)));
+
+		int item;
+		while ((item = wheel.PopDue(now)) >= 0)
+			{
+			if (item >= itemCount || !scheduled[item] || Elapsed(due[item], now) < 0)
+				{
+				errorCount++;
+				break;
+				}
+			scheduled[item] = 0;
+			}
+
+		for (int j=0; j<itemCount; j++)
+			{
+			if (scheduled[j] && Elapsed(due[j], now) >= 0)
+				{
+				errorCount++;		// missed
+				scheduled[j] = 0;
+				}
+			}
+		clock = (int) ((DWORD) now + 1);
+		}
+
+	JTEST( errorCount == 0 );
+
+	// damaged copies
+
+	CByteArray data;
+	SaveWheel(wheel, &data);
+
+	JTimingWheel copy;
+	copy.SetSize(itemCount, slotCount);
+	JTEST( LoadWheel(copy, data) );
+
+	CByteArray before, after;
+	SaveWheel(copy, &before);
+
+	BYTE* flags = new BYTE [ itemCount ];
+
+	for (int k=0; k<20; k++)
+		{
+		CByteArray bad;
+		bad.Copy(data);
+		if (rnd.Chance(20))
+			{
+			bad.SetSize(rnd.Range(0, bad.GetSize()-1));
+			}
+		const int count = rnd.Range(1, 4);
+		for (int m=0; m<count && bad.GetSize() > 0; m++)
+			{
+			bad[ rnd.Range(0, bad.GetSize()-1) ] = (BYTE) (rnd.Chance(50) ? rnd.Next() : rnd.Range(0, itemCount));
+			}
+
+		if (!LoadWheel(copy, bad))
+			{
+			SaveWheel(copy, &after);
+			JTEST( after.GetSize() == before.GetSize() &&
+				   memcmp(after.GetData(), before.GetData(), before.GetSize()) == 0 );
+			continue;
+			}
+
+		copy.GetScheduled(flags);
+
+		int t = now, item;
+		for (int n=0; n<4 * slotCount; n++)
+			{
+			t = (int) ((DWORD) t + rnd.Range(1, 4 * slotCount));
+			while ((item = copy.PopDue(t)) >= 0)
+				{
+				if (item >= itemCount || !flags[item])
+					{
+					errorCount++;
+					break;
+					}
+				flags[item] = 0;
+				}
+			}
+
+		JTEST( errorCount == 0 );
+		JTEST( LoadWheel(copy, data) );
+		}
+
+	delete [] flags;
+}
+
+/*******************************************************************************
+ RandomConfig (static)
+
+ *******************************************************************************/
+
+static void
+RandomConfig
+	(
+	JTestRandom&			rnd,
+	JMatrixCtrl::Config*	config
+	)
+{
+	config->nColSpacing          = rnd.Range(0, 12);
+	config->nAnimateTextInterval = rnd.Range(1, 100);
+	config->nMoveCursorInterval  = rnd.Range(1, 200);
+	config->nAnimateBkgdInterval = rnd.Range(1, 300);
+	config->nAnimateRainInterval = rnd.Range(1, 100);
+	config->nMinDropSpeed        = rnd.Range(1, 200);
+	config->nMaxDropSpeed        = config->nMinDropSpeed + rnd.Range(0, 400);
+	config->fSpinCharFraction    = rnd.Range(0, 200) / 100.0f;
+	config->nMinSpinCount        = rnd.Range(0, 1000);
+	config->nMaxSpinCount        = config->nMinSpinCount + rnd.Range(0, 1000);
+	config->nSpinRate            = rnd.Range(0, 10000);
+
+	config->nRainLayerCount = rnd.Range(1, JMatrixCtrl::kMaxRainLayers);
+	for (int i=0; i<config->nRainLayerCount; i++)
+		{
+		JMatrixCtrl::RainLayerConfig& layer = config->rainLayer[i];
+		layer.nFontHeight    = rnd.Range(4, 40);
+		layer.nIntervalScale = rnd.Range(25, 400);
+		layer.nIntensity     = rnd.Range(0, 100);
+		layer.nDensity       = rnd.Range(0, 100);
+		layer.nCostShare     = rnd.Range(0, 100);
+		}
+	config->bIndexedRain = rnd.Chance(30);
+
+	config->nRevealMode    = rnd.Range(JMatrixScript::kTypeReveal, JMatrixScript::kRainReveal);
+	config->bGlow          = rnd.Chance(30);
+	config->nGlowRadius    = rnd.Range(0, 16);
+	config->nGlowStrength  = rnd.Range(0, 100);
+	config->nGlowThreshold = rnd.Range(0, 255);
+
+	config->nSignalDensity    = rnd.Range(0, 100);
+	config->nSignalActivation = rnd.Range(0, 200);
+	config->nSignalSpin       = rnd.Range(0, 200);
+
+	config->nTickerRate = (rnd.Chance(25) ? rnd.Range(1, 2000) : 0);
+}
+
+/*******************************************************************************
+ ChangeConfig (static)
+
+	Only changes what may change after the control is created.
+
+ *******************************************************************************/
+
+static void
+ChangeConfig
+	(
+	JTestRandom&			rnd,
+	JMatrixCtrl::Config*	config
+	)
+{
+	JMatrixCtrl::Config c = *config;
+	RandomConfig(rnd, &c);
+
+	config->nAnimateTextInterval = c.nAnimateTextInterval;
+	config->nAnimateBkgdInterval = c.nAnimateBkgdInterval;
+	config->nAnimateRainInterval = c.nAnimateRainInterval;
+	config->fSpinCharFraction    = c.fSpinCharFraction;
+	config->nSpinRate            = c.nSpinRate;
+	config->nRevealMode          = c.nRevealMode;
+	config->bGlow                = c.bGlow;
+	config->nGlowRadius          = c.nGlowRadius;
+	config->nTickerRate          = c.nTickerRate;
+}
+
+/*******************************************************************************
+ RandomFont (static)
+
+ *******************************************************************************/
+
+static void
+RandomFont
+	(
+	JTestRandom&	rnd,
+	LOGFONT*		font
+	)
+{
+	memset(font, 0, sizeof(LOGFONT));
+	font->lfHeight         = rnd.Range(1, 60);
+	font->lfWeight         = (rnd.Chance(50) ? FW_BOLD : FW_NORMAL);
+	font->lfPitchAndFamily = FIXED_PITCH | FF_MODERN;
+	strcpy(font->lfFaceName, "Courier New");
+}
+
+/*******************************************************************************
+ FixHeader (static)
+
+	Adler-32, as in JMatrixCtrl.cpp, so damaged snapshots get past the
+	checksum.
+
+ *******************************************************************************/
+
+static void
+FixHeader
+	(
+	CByteArray& data
+	)
+{
+	DWORD a = 1, b = 0;
+	for (int i=kHeaderBytes; i<data.GetSize(); i++)
+		{
+		a = (a + data[i]) % 65521;
+		b = (b + a) % 65521;
+		}
+
+	DWORD* header = (DWORD*) data.GetData();
+	header[2]     = data.GetSize() - kHeaderBytes;
+	header[3]     = (b << 16) | a;
+}
+
+/*******************************************************************************
+ FuzzCtrl (static)
+
+	A control with a random size, configuration, and script, driven by
+	random steps and random calls.  Returns the microseconds of CPU per
+	second of animation.
+
+ *******************************************************************************/
+
+static double
+FuzzCtrl
+	(
+	JTestRandom&	rnd,
+	const DWORD		seed
+	)
+{
+	const CSize size(rnd.Chance(20) ? rnd.Range(1, 40) : rnd.Range(1, kMaxGridWidth),
+					 rnd.Chance(20) ? rnd.Range(1, 40) : rnd.Range(1, kMaxGridHeight));
+
+	JMatrixCtrl ctrl;
+
+	JMatrixCtrl::Config config = ctrl.GetConfig();
+	RandomConfig(rnd, &config);
+	ctrl.SetConfig(config);
+
+	ctrl.SetIntervals(rnd.Range(0, 2), rnd.Range(0, 2));
+	ctrl.SetMaxPhaseCount(rnd.Chance(20) ? 0x7FFFFFFF : rnd.Range(0, 50));
+	ctrl.SetCursor(rnd.Chance(70), rnd.Chance(50));
+	ctrl.AllowEuropeanChars(rnd.Chance(50));
+	ctrl.SetFrameBudget(rnd.Chance(30) ? rnd.Range(1, 20) : 0);
+
+	const int lineCount = rnd.Range(0, 200);
+	for (int i=0; i<lineCount; i++)
+		{
+		ctrl.AddTextLine(RandomLine(rnd));
+		}
+
+	if (!JTestCreateCtrl(&ctrl, size, seed))
+		{
+		return 0;
+		}
+
+	JTestImage image(64, 48);
+
+	const int runTime    = rnd.Range(500, kMaxRunTime);
+	const LONGLONG start = JTestGetMicroseconds();
+	for (int t=0; t<runTime; )
+		{
+		const int step = (rnd.Chance(80) ? rnd.Range(1, 50) : rnd.Range(50, 500));
+		ctrl.Step(step);
+		t += step;
+
+		const int action = rnd.Range(0, 99);
+		if (action < 6)
+			{
+			ctrl.AddTextLine(RandomLine(rnd));
+			}
+		else if (action < 8)
+			{
+			ctrl.ClearText();
+			}
+		else if (action < 11)
+			{
+			ChangeConfig(rnd, &config);
+			ctrl.SetConfig(config);
+			}
+		else if (action < 13)
+			{
+			LOGFONT font;
+			RandomFont(rnd, &font);
+			if (rnd.Chance(50))
+				{
+				ctrl.SetTextFont(font);
+				}
+			else
+				{
+				ctrl.SetRainFont(font);
+				}
+			}
+		else if (action < 18)
+			{
+			CByteArray data;
+			ctrl.SaveSnapshot(&data);
+			if (rnd.Chance(50))
+				{
+				JTEST( ctrl.RestoreSnapshot(data.GetData(), data.GetSize()) );
+				}
+			else if (data.GetSize() > kHeaderBytes)
+				{
+				const int count = rnd.Range(1, 8);
+				for (int j=0; j<count; j++)
+					{
+					data[ rnd.Range(kHeaderBytes, data.GetSize()-1) ] = (BYTE) rnd.Next();
+					}
+				FixHeader(data);
+				ctrl.RestoreSnapshot(data.GetData(), data.GetSize());
+				}
+			}
+		else if (action < 21)
+			{
+			ctrl.PushMetric(rnd.Range(-100, 2000));
+			}
+		else if (action < 24)
+			{
+			ctrl.SetMaxPhaseCount(rnd.Chance(30) ? 0x7FFFFFFF : rnd.Range(0, 50));
+			ctrl.SetCursor(rnd.Chance(70), rnd.Chance(50));
+			}
+		else if (action < 28)
+			{
+			const CPoint pt(rnd.Range(-100, size.cx + 100), rnd.Range(-100, size.cy + 100));
+			ctrl.DrawViewport(image.GetDC(), CRect(pt, CSize(rnd.Range(1, 200), rnd.Range(1, 200))));
+			}
+		}
+	const LONGLONG usec = JTestGetMicroseconds() - start;
+
+	const JMatrixCtrl::Stats& stats = ctrl.GetStats();
+	JTEST( 0 <= stats.nRedrawPercent && stats.nRedrawPercent <= 100 );
+	JTEST( stats.nFrames >= 0 );
+
+	ctrl.DestroyWindow();
+	return usec * 1000.0 / runTime;
+}
+
+/*******************************************************************************
+ RunFuzz
+
+	Runs count rounds, starting with the given seed, and returns the number
+	of failures.
+
+ *******************************************************************************/
+
+int
+RunFuzz
+	(
+	const int	count,
+	const DWORD	seed
+	)
+{
+	const int startCount = JTestGetFailureCount();
+
+	double slowest = 0;
+	for (int i=0; i<count; i++)
+		{
+		const DWORD roundSeed = seed + i;
+		const int failureCount = JTestGetFailureCount();
+
+		JTestRandom rnd(roundSeed);
+		FuzzScript(rnd);
+		FuzzWheel(rnd);
+		slowest = max(slowest, FuzzCtrl(rnd, roundSeed));
+
+		if (JTestGetFailureCount() > failureCount)
+			{
+			printf("  round %d failed: matrixtest -fuzz 1 %lu\n", i, roundSeed);
+			fflush(stdout);
+			}
+		}
+
+	JTestReport("slowest control", slowest, "usec/sec");
+	return JTestGetFailureCount() - startCount;
+}
+
+/*******************************************************************************
+ TestFuzz
+
+ *******************************************************************************/
+
+void
+TestFuzz()
+{
+	RunFuzz(kTestRoundCount, 4800);
+}
+
+/*******************************************************************************
+ TimeScript (static)
+
+	Returns the microseconds of CPU per second of animation for a control
+	that runs the given script.
+
+ *******************************************************************************/
+
+static double
+TimeScript
+	(
+	const CStringArray& lineList
+	)
+{
+	JMatrixCtrl ctrl;
+	ctrl.SetIntervals(0, 0);
+	for (int i=0; i<lineList.GetSize(); i++)
+		{
+		ctrl.AddTextLine(lineList[i]);
+		}
+
+	if (!JTestCreateCtrl(&ctrl, CSize(kBenchmarkWidth, kBenchmarkHeight), 48))
+		{
+		return 0;
+		}
+	ctrl.Step(100);
+
+	const LONGLONG start = JTestGetMicroseconds();
+	ctrl.Step(kBenchmarkTime);
+	const LONGLONG usec = JTestGetMicroseconds() - start;
+
+	ctrl.DestroyWindow();
+	return usec * 1000.0 / kBenchmarkTime;
+}
+
+/*******************************************************************************
+ BenchmarkFuzz
+
+	Random scripts must compile as fast as ordinary ones, and extreme
+	scripts must not cost much more than ordinary text.
+
+ *******************************************************************************/
+
+void
+BenchmarkFuzz()
+{
+	JTestRandom rnd(480);
+
+	CStringArray lineList;
+	lineList.SetSize(kBenchmarkLineCount);
+	for (int i=0; i<kBenchmarkLineCount; i++)
+		{
+		lineList[i] = RandomLine(rnd);
+		}
+
+	JMatrixScript script;
+
+	LONGLONG start = JTestGetMicroseconds();
+	for (int j=0; j<kBenchmarkLineCount; j++)
+		{
+		script.AddLine(lineList[j]);
+		}
+	const LONGLONG compileTime = JTestGetMicroseconds() - start;
+
+	JTestAtLeast("compile random lines", kBenchmarkLineCount * 1e6 / max(compileTime, (LONGLONG) 1),
+				 100000, "lines/sec");
+
+	// timing wheel
+
+	const int itemCount = 10000;
+
+	JTimingWheel wheel;
+	wheel.SetSize(itemCount, 256);
+	wheel.Reset(0);
+
+	int opCount = 0;
+	start = JTestGetMicroseconds();
+	for (int k=0; k<itemCount; k++)
+		{
+		wheel.Schedule(k, rnd.Range(0, 100000));
+		}
+	for (int now=0; now<=100000; now+=10)
+		{
+		int item;
+		while ((item = wheel.PopDue(now)) >= 0)
+			{
+			if (now < 90000)
+				{
+				wheel.Schedule(item, now + rnd.Range(1, 10000));
+				opCount++;
+				}
+			opCount++;
+			}
+		}
+	const LONGLONG wheelTime = JTestGetMicroseconds() - start;
+
+	JTestAtLeast("timing wheel", opCount * 1e6 / max(wheelTime, (LONGLONG) 1),
+				 1000000, "operations/sec");
+
+	// extreme scripts
+
+	CStringArray plain;
+	plain.Add("Wake up, Neo...");
+	plain.Add("The Matrix has you...");
+	plain.Add("\x01 1");
+	const double plainCost = TimeScript(plain);
+	JTestReport("plain script", plainCost, "usec/sec");
+
+	CString longLine('x', kMaxLineLength);
+
+	CStringArray phases, pageBreaks, longLines, directives;
+	phases.Add("\x02 phase=2147483647 reveal=random cursor=random");
+	phases.Add(plain[0]);
+	phases.Add(plain[1]);
+	phases.Add(plain[2]);
+	for (int m=0; m<1000; m++)
+		{
+		pageBreaks.Add("\x01");
+		longLines.Add(longLine);
+		directives.Add("\x02 delay=0 align=right color=FFFFFF phase=99999999999 cursor=block reveal=center");
+		}
+	longLines.Add("\x01");
+	directives.Add("short");
+	directives.Add("\x01");
+
+	const CStringArray* kScript[] = { &phases, &pageBreaks, &longLines, &directives };
+	const char* kName[] = { "huge phase counts", "only page breaks", "5000 character lines", "1000 directives per line" };
+
+	for (int n=0; n<4; n++)
+		{
+		CString name;
+		name.Format("%s vs plain script", kName[n]);
+		JTestAtMost(name, TimeScript(*(kScript[n])) / plainCost, 2, "x");
+		}
+}
@@ -0,0 +1,266 @@
+/*******************************************************************************
+ TestGlow.cpp
+
+	JGlowFilter against the same code compiled without SSE2.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JTest.h"
+#include "JGlowFilter.h"
+#include "JGlowScalar.h"
+
+const int kTestImageCount  = 60;
+const int kMaxSourceCount  = 12;
+const int kBenchmarkWidth  = 1920;
+const int kBenchmarkHeight = 1080;
+const int kBenchmarkPasses = 20;
+
+/*******************************************************************************
+ FillImage (static)
+
+	Black, with scattered glyphs of random brightness, like the rain.
+
+ *******************************************************************************/
+
+static void
+FillImage
+	(
+	BYTE*			bits,
+	const int		width,
+	const int		height,
+	const int		stride,
+	JTestRandom&	rnd
+	)
+{
+	memset(bits, 0, height * stride);
+
+	const int glyphCount = width * height / 200;
+	for (int i=0; i<glyphCount; i++)
+		{
+		const int x = rnd.Range(0, width-1), y = rnd.Range(0, height-1);
+		const int w = rnd.Range(1, 10),      h = rnd.Range(1, 14);
+		const BYTE g = (BYTE) rnd.Range(0, 255);
+		for (int y1=y; y1<min(y+h, height); y1++)
+			{
+			BYTE* p = bits + y1 * stride + x * 4;
+			for (int x1=x; x1<min(x+w, width); x1++)
+				{
+				p[0] = (BYTE) (g / 3);
+				p[1] = g;
+				p[2] = (BYTE) (g / 2);
+				p   += 4;
+				}
+			}
+		}
+}
+
+/*******************************************************************************
+ OnlyGreenGrew (static)
+
+	Returns TRUE if the glow only raised the green channel.
+
+ *******************************************************************************/
+
+static BOOL
+OnlyGreenGrew
+	(
+	const BYTE*	before,
+	const BYTE*	after,
+	const int	width,
+	const int	height,
+	const int	stride
+	)
+{
+	for (int y=0; y<height; y++)
+		{
+		const BYTE* p = before + y * stride;
+		const BYTE* q = after  + y * stride;
+		for (int x=0; x<width*4; x+=4)
+			{
+			if (p[x] != q[x] || p[x+1] > q[x+1] || p[x+2] != q[x+2] || p[x+3] != q[x+3])
+				{
+				return FALSE;
+				}
+			}
+		}
+
+	return TRUE;
+}
+
+/*******************************************************************************
+ TestGlow
+
+	Random sizes, parameters, and sources, including sources that stick
+	out of the image, must give the same result on both paths.  If the
+	SSE2 path was not compiled, or cannot run here, both paths would be
+	the same code, so this fails instead of passing without testing
+	anything.
+
+ *******************************************************************************/
+
+void
+TestGlow()
+{
+	if (!JTEST( JGlowFilter::IsSSE2Available() ))
+		{
+		return;
+		}
+
+	JTestRandom rnd(44);
+
+	JGlowFilter glow;
+	JGlowScalar scalar;
+
+	int mismatches = 0, badChannels = 0, processed = 0;
+	for (int i=0; i<kTestImageCount; i++)
+		{
+		const int width  = rnd.Range(1, 300);
+		const int height = rnd.Range(1, 200);
+		const int stride = width * 4 + 4 * rnd.Range(0, 3);
+		const int bytes  = height * stride;
+
+		const int radius    = rnd.Range(0, JGlowFilter::kMaxRadius + 2);
+		const int strength  = rnd.Range(0, 256);
+		const int threshold = rnd.Range(0, 255);
+
+		BYTE* original = new BYTE [ bytes ];
+		BYTE* image1   = new BYTE [ bytes ];
+		BYTE* image2   = new BYTE [ bytes ];
+		FillImage(original, width, height, stride, rnd);
+		memcpy(image1, original, bytes);
+		memcpy(image2, original, bytes);
+
+		glow.SetSize(width, height);
+		glow.SetParameters(radius, strength, threshold);
+		scalar.SetSize(width, height);
+		scalar.SetParameters(radius, strength, threshold);
+
+		const int sourceCount = rnd.Range(1, kMaxSourceCount);
+		for (int j=0; j<sourceCount; j++)
+			{
+			const int x = rnd.Range(-20, width), y = rnd.Range(-20, height);
+			const CRect r(x, y, x + rnd.Range(1, 80), y + rnd.Range(1, 80));
+			glow.AddSource(r);
+			scalar.AddSource(r);
+			}
+
+		const int count = glow.Apply(image1, stride);
+		JTEST( scalar.Apply(image2, stride) == count );
+		JTEST( glow.IsEmpty() );
+
+		if (memcmp(image1, image2, bytes) != 0)
+			{
+			mismatches++;
+			}
+		if (!OnlyGreenGrew(original, image1, width, height, stride))
+			{
+			badChannels++;
+			}
+		processed += count;
+
+		delete [] original;
+		delete [] image1;
+		delete [] image2;
+		}
+
+	JTEST( mismatches == 0 );
+	JTEST( badChannels == 0 );
+	JTEST( processed > 0 );
+
+	// the whole image, so every tile of a 4K frame is compared
+
+	const int width = 3840, height = 200, stride = width * 4;
+	BYTE* image1 = new BYTE [ height * stride ];
+	BYTE* image2 = new BYTE [ height * stride ];
+	FillImage(image1, width, height, stride, rnd);
+	memcpy(image2, image1, height * stride);
+
+	glow.SetSize(width, height);
+	glow.SetParameters(JGlowFilter::kMaxRadius, 256, 0);
+	glow.AddSource(CRect(0, 0, width, height));
+	scalar.SetSize(width, height);
+	scalar.SetParameters(JGlowFilter::kMaxRadius, 256, 0);
+	scalar.AddSource(CRect(0, 0, width, height));
+
+	JTEST( glow.Apply(image1, stride) == width * height );
+	JTEST( scalar.Apply(image2, stride) == width * height );
+	JTEST( memcmp(image1, image2, height * stride) == 0 );
+
+	delete [] image1;
+	delete [] image2;
+}
+
+/*******************************************************************************
+ TimeGlow (static)
+
+	Returns the milliseconds per megapixel to glow the whole image.
+
+ *******************************************************************************/
+
+template <class T>
+static double
+TimeGlow
+	(
+	T&			filter,
+	const BYTE*	original,
+	BYTE*		image,
+	const int	radius
+	)
+{
+	const int stride = kBenchmarkWidth * 4;
+	const int bytes  = kBenchmarkHeight * stride;
+
+	filter.SetSize(kBenchmarkWidth, kBenchmarkHeight);
+	filter.SetParameters(radius, 160, 96);
+
+	LONGLONG time = 0;
+	int count     = 0;
+	for (int i=0; i<kBenchmarkPasses; i++)
+		{
+		memcpy(image, original, bytes);
+		filter.AddSource(CRect(0, 0, kBenchmarkWidth, kBenchmarkHeight));
+
+		const LONGLONG start = JTestGetMicroseconds();
+		count += filter.Apply(image, stride);
+		time  += JTestGetMicroseconds() - start;
+		}
+
+	return time / 1000.0 / (count / 1e6);
+}
+
+/*******************************************************************************
+ BenchmarkGlow
+
+	Cost per megapixel of a full frame on both paths.  Both passes use
+	running sums, so a larger radius only costs more because of the
+	wider margin around each tile.
+
+ *******************************************************************************/
+
+void
+BenchmarkGlow()
+{
+	const int bytes = kBenchmarkHeight * kBenchmarkWidth * 4;
+	BYTE* original  = new BYTE [ bytes ];
+	BYTE* image     = new BYTE [ bytes ];
+
+	JTestRandom rnd(44);
+	FillImage(original, kBenchmarkWidth, kBenchmarkHeight, kBenchmarkWidth * 4, rnd);
+
+	JGlowFilter glow;
+	JGlowScalar scalar;
+
+	const double fast = TimeGlow(glow, original, image, 4);
+	const double slow = TimeGlow(scalar, original, image, 4);
+	const double wide = TimeGlow(glow, original, image, JGlowFilter::kMaxRadius);
+
+	JTestAtMost("glow, radius 4", fast, 40, "ms/MP");
+	JTestReport("glow without SSE2, radius 4", slow, "ms/MP");
+	JTestReport("SSE2 speedup", slow / fast, "x");
+	JTEST( JGlowFilter::IsSSE2Available() );		// otherwise there is no speedup
+	JTestAtMost("glow, radius 16", wide, 2 * fast + 1, "ms/MP");
+
+	delete [] original;
+	delete [] image;
+}
@@ -0,0 +1,152 @@
+/*******************************************************************************
+ TestRain.cpp
+
+	The smooth rain draws a frame every nAnimateRainInterval, but each
+	frame only redraws the tiles that changed, so it must not cost more
+	than the original control, which copied the whole frame on every tick.
+
+	Moving the rain one row at a time also only redraws the changed
+	tiles, so it is much cheaper than the original control.  The smooth
+	rain cannot match it per second:  it redraws the tiles around each
+	head five times as often, and a head that moves a few pixels still
+	dirties whole tiles.  Instead, each frame of the smooth rain must
+	cost no more than a frame of the stepped rain.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JTest.h"
+#include "JMatrixCtrl.h"
+
+const int kGridWidth    = 1920;
+const int kGridHeight   = 1080;
+const int kWarmUpTime   = 3000;		// milliseconds, so the columns are running
+const int kMeasureTime  = 3000;		// milliseconds
+const int kStepSize     = 100;		// milliseconds
+const int kCopyCount    = 20;
+
+struct RainCost
+{
+	double	usec;					// CPU per second of animation
+	double	frames;					// frames per second
+	double	redraw;					// percent of each frame, on average
+};
+
+/*******************************************************************************
+ TimeRain (static)
+
+	The text is revealed throughout, so the text timers run as well.
+
+ *******************************************************************************/
+
+static void
+TimeRain
+	(
+	const int	rainInterval,
+	RainCost*	cost
+	)
+{
+	memset(cost, 0, sizeof(RainCost));
+
+	JMatrixCtrl ctrl;
+
+	JMatrixCtrl::Config config  = ctrl.GetConfig();
+	config.nAnimateRainInterval = rainInterval;
+	ctrl.SetConfig(config);
+
+	ctrl.SetIntervals(0, 200);
+	for (int i=0; i<40; i++)
+		{
+		ctrl.AddTextLine(i % 2 == 0 ? "Wake up, Neo..." : "The Matrix has you...");
+		if (i % 4 == 3)
+			{
+			ctrl.AddTextLine("\x01 200");
+			}
+		}
+
+	if (!JTestCreateCtrl(&ctrl, CSize(kGridWidth, kGridHeight), 31))
+		{
+		return;
+		}
+	ctrl.Step(kWarmUpTime);
+
+	int frames = ctrl.GetStats().nFrames, redraw = 0, count = 0;
+
+	const LONGLONG start = JTestGetMicroseconds();
+	for (int t=0; t<kMeasureTime; t+=kStepSize)
+		{
+		ctrl.Step(kStepSize);
+		redraw += ctrl.GetStats().nRedrawPercent;
+		count++;
+		}
+	const LONGLONG usec = JTestGetMicroseconds() - start;
+
+	const double seconds = kMeasureTime / 1000.0;
+	cost->usec   = usec / seconds;
+	cost->frames = (ctrl.GetStats().nFrames - frames) / seconds;
+	cost->redraw = redraw / (double) count;
+
+	ctrl.DestroyWindow();
+}
+
+/*******************************************************************************
+ TimeFullFrame (static)
+
+	Returns the microseconds needed to copy the whole back buffer once,
+	which is the least that each Draw() used to cost.
+
+ *******************************************************************************/
+
+static double
+TimeFullFrame()
+{
+	JTestImage back(kGridWidth, kGridHeight), frame(kGridWidth, kGridHeight);
+
+	const LONGLONG start = JTestGetMicroseconds();
+	for (int i=0; i<kCopyCount; i++)
+		{
+		frame.GetDC().BitBlt(0, 0, kGridWidth, kGridHeight, &back.GetDC(), 0, 0, SRCCOPY);
+		}
+	return (JTestGetMicroseconds() - start) / (double) kCopyCount;
+}
+
+/*******************************************************************************
+ BenchmarkRain
+
+	The original control drew the whole frame on every text tick and every
+	rain tick.  The smooth rain must cost less than that, and the text must
+	not add frames to the ones drawn for the rain.  Moving the rain once per
+	row is the reference for the cost of each frame.
+
+ *******************************************************************************/
+
+void
+BenchmarkRain()
+{
+	const JMatrixCtrl::Config defaults;
+
+	const double fullFrame = TimeFullFrame();
+	const double oldFrames = 1000.0 / defaults.nAnimateTextInterval +
+							 1000.0 / defaults.nAnimateBkgdInterval;
+
+	RainCost smooth, stepped;
+	TimeRain(defaults.nAnimateRainInterval, &smooth);
+	TimeRain(defaults.nAnimateBkgdInterval, &stepped);
+
+	JTestReport("whole frame redrawn on every tick", fullFrame * oldFrames, "usec/sec");
+	JTestReport("one row at a time: frames", stepped.frames, "frames/sec");
+	JTestReport("one row at a time: redrawn", stepped.redraw, "%");
+	JTestReport("one row at a time: cost", stepped.usec, "usec/sec");
+	JTestReport("smooth rain: redrawn", smooth.redraw, "%");
+	JTestReport("smooth rain: cost", smooth.usec, "usec/sec");
+
+	JTestAtMost("smooth rain: frames", smooth.frames,
+				1000.0 / defaults.nAnimateRainInterval + 1, "frames/sec");
+	JTestAtMost("smooth rain: redrawn", smooth.redraw, 25, "%");
+	JTestAtMost("smooth rain vs whole frame on every tick",
+				100 * smooth.usec / (fullFrame * oldFrames), 100, "%");
+
+	JTestReport("smooth rain vs one row at a time", 100 * smooth.usec / stepped.usec, "%");
+	JTestAtMost("smooth rain vs one row at a time, per frame",
+				100 * (smooth.usec / smooth.frames) / (stepped.usec / stepped.frames), 100, "%");
+}
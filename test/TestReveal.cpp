@@ -0,0 +1,126 @@
+/*******************************************************************************
+ TestReveal.cpp
+
+	Cost of revealing the text.  Each character is touched once when it is
+	revealed and once per phase, so the number of updates per character
+	must not grow with the length of the line.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JTest.h"
+#include "JMatrixCtrl.h"
+
+const int kGridWidth     = 3840;		// 4K
+const int kGridHeight    = 96;
+const int kLineCount     = 3;
+const int kShortLength   = 30;
+const int kLongLength    = 300;
+const int kPhaseCount    = 5;
+const int kCursorSpeed   = 5;		// milliseconds per character
+const int kStepSize      = 250;		// milliseconds
+const int kIdleTime      = 2000;	// milliseconds without updates => page is finished
+const int kMaxPageTime   = 60000;	// milliseconds
+
+static const char* kModeName[] =
+{
+	"type", "random", "center", "rain"
+};
+
+const int kModeCount = sizeof(kModeName) / sizeof(char*);
+
+/*******************************************************************************
+ RevealPage (static)
+
+	Runs one page and returns the number of text updates per character.
+	*usecPerSecond receives the time that the control needed for each
+	second of animation, including the rain.
+
+ *******************************************************************************/
+
+static double
+RevealPage
+	(
+	const int	mode,
+	const int	length,
+	double*		usecPerSecond
+	)
+{
+	JMatrixCtrl ctrl;
+
+	JMatrixCtrl::Config config = ctrl.GetConfig();
+	config.nRevealMode         = mode;
+	config.nMoveCursorInterval = kCursorSpeed;
+	ctrl.SetConfig(config);
+
+	ctrl.SetIntervals(0, 600);
+	ctrl.SetMaxPhaseCount(kPhaseCount);
+
+	CString line;
+	for (int i=0; i<length; i++)
+		{
+		line += (char) ('A' + i % 26);
+		}
+	for (int j=0; j<kLineCount; j++)
+		{
+		ctrl.AddTextLine(line);
+		}
+	ctrl.AddTextLine("\x01 600");
+
+	if (!JTestCreateCtrl(&ctrl, CSize(kGridWidth, kGridHeight), 38))
+		{
+		return 0;
+		}
+
+	// run until the updates stop, i.e., the page is finished
+
+	const LONGLONG start = JTestGetMicroseconds();
+
+	int updates = 0, idle = 0, t = 0;
+	while ((updates == 0 || idle < kIdleTime) && t < kMaxPageTime)
+		{
+		ctrl.Step(kStepSize);
+		t += kStepSize;
+
+		const int n = ctrl.GetStats().nTextUpdates;
+		idle        = (n == updates ? idle + kStepSize : 0);
+		updates     = n;
+		}
+
+	*usecPerSecond = (JTestGetMicroseconds() - start) * 1000.0 / t;
+
+	JTEST( t < kMaxPageTime );
+	ctrl.DestroyWindow();
+
+	return updates / (double) (kLineCount * length);
+}
+
+/*******************************************************************************
+ BenchmarkReveal
+
+ *******************************************************************************/
+
+void
+BenchmarkReveal()
+{
+	for (int mode=0; mode<kModeCount; mode++)
+		{
+		double shortTime, longTime;
+		const double shortUpdates = RevealPage(mode, kShortLength, &shortTime);
+		const double longUpdates  = RevealPage(mode, kLongLength, &longTime);
+
+		// each character phases at most kPhaseCount times, plus the
+		// reveal and the final update
+
+		CString name;
+		name.Format("%s: updates per char, %d chars", kModeName[mode], kShortLength);
+		JTestAtMost(name, shortUpdates, kPhaseCount + 2, "");
+		name.Format("%s: updates per char, %d chars", kModeName[mode], kLongLength);
+		JTestAtMost(name, longUpdates, kPhaseCount + 2, "");
+
+		name.Format("%s: cost, %d chars", kModeName[mode], kShortLength);
+		JTestReport(name, shortTime, "usec/sec");
+		name.Format("%s: cost, %d chars", kModeName[mode], kLongLength);
+		JTestReport(name, longTime, "usec/sec");
+		}
+}
@@ -0,0 +1,220 @@
+/*******************************************************************************
+ TestScript.cpp
+
+	JMatrixScript
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JTest.h"
+#include "JMatrixScript.h"
+#include <stdio.h>
+
+const int kBenchmarkLineCount = 100000;
+
+/*******************************************************************************
+ ReadNext (static)
+
+	Returns the offset of the next instruction after checking it.
+
+ *******************************************************************************/
+
+static int
+ReadNext
+	(
+	const JMatrixScript&	script,
+	const int				offset,
+	const int				opcode,
+	const int				value
+	)
+{
+	int op = -1, v = -1;
+	const int next = script.Read(offset, &op, &v);
+	JTEST( op == opcode );
+	JTEST( v == value );
+	return next;
+}
+
+/*******************************************************************************
+ TestScript
+
+ *******************************************************************************/
+
+void
+TestScript()
+{
+	JMatrixScript script;
+	JTEST( script.IsEmpty() );
+
+	script.AddLine("first line");
+	script.AddLine("\x01 5");
+	script.AddLine("\x01");
+	script.AddLine("\x01 -3");
+	script.AddLine("second line");
+
+	int offset = 0;
+	offset = ReadNext(script, offset, JMatrixScript::kLineOp, 0);
+	offset = ReadNext(script, offset, JMatrixScript::kPageBreakOp, 5);
+	offset = ReadNext(script, offset, JMatrixScript::kPageBreakOp, 0);
+	offset = ReadNext(script, offset, JMatrixScript::kPageBreakOp, 0);
+	offset = ReadNext(script, offset, JMatrixScript::kLineOp, 1);
+	JTEST( offset == script.GetLength() );
+	JTEST( script.GetText(0) == "first line" );
+	JTEST( script.GetText(1) == "second line" );
+
+	// directives apply in order
+
+	script.RemoveAll();
+	JTEST( script.IsEmpty() );
+
+	script.AddLine("\x02 delay=500 align=left color=80FF40 phase=5 cursor=block reveal=rain");
+	script.AddLine("\x02 align=RIGHT cursor=none reveal=center");
+	script.AddLine("\x02 delay=default color=default phase=default cursor=default reveal=default");
+	script.AddLine("\x02 align=default cursor=random reveal=random");
+
+	offset = 0;
+	offset = ReadNext(script, offset, JMatrixScript::kDelayOp, 500);
+	offset = ReadNext(script, offset, JMatrixScript::kAlignOp, JMatrixScript::kAlignLeft);
+	offset = ReadNext(script, offset, JMatrixScript::kColorOp, (int) RGB(0x80, 0xFF, 0x40));
+	offset = ReadNext(script, offset, JMatrixScript::kPhaseCountOp, 5);
+	offset = ReadNext(script, offset, JMatrixScript::kCursorOp, JMatrixScript::kBlockCursor);
+	offset = ReadNext(script, offset, JMatrixScript::kRevealOp, JMatrixScript::kRainReveal);
+
+	offset = ReadNext(script, offset, JMatrixScript::kAlignOp, JMatrixScript::kAlignRight);
+	offset = ReadNext(script, offset, JMatrixScript::kCursorOp, JMatrixScript::kNoCursor);
+	offset = ReadNext(script, offset, JMatrixScript::kRevealOp, JMatrixScript::kCenterReveal);
+
+	offset = ReadNext(script, offset, JMatrixScript::kDelayOp, 0);
+	offset = ReadNext(script, offset, JMatrixScript::kColorOp, JMatrixScript::kDefaultValue);
+	offset = ReadNext(script, offset, JMatrixScript::kPhaseCountOp, JMatrixScript::kDefaultValue);
+	offset = ReadNext(script, offset, JMatrixScript::kCursorOp, JMatrixScript::kDefaultValue);
+	offset = ReadNext(script, offset, JMatrixScript::kRevealOp, JMatrixScript::kDefaultValue);
+
+	offset = ReadNext(script, offset, JMatrixScript::kAlignOp, JMatrixScript::kAlignCenter);
+	offset = ReadNext(script, offset, JMatrixScript::kCursorOp, JMatrixScript::kRandomCursor);
+	offset = ReadNext(script, offset, JMatrixScript::kRevealOp, JMatrixScript::kRandomReveal);
+	JTEST( offset == script.GetLength() );
+
+	// malformed directives are ignored, and negative numbers are clamped
+
+	script.RemoveAll();
+	script.AddLine("\x02");
+	script.AddLine("\x02   \t ");
+	script.AddLine("\x02 =5 delay speed=3 delay=");
+	script.AddLine("\x02 delay=-20 phase=-1");
+	script.AddLine("");
+
+	offset = 0;
+	offset = ReadNext(script, offset, JMatrixScript::kDelayOp, 0);
+	offset = ReadNext(script, offset, JMatrixScript::kDelayOp, 0);
+	offset = ReadNext(script, offset, JMatrixScript::kPhaseCountOp, 0);
+	offset = ReadNext(script, offset, JMatrixScript::kLineOp, 0);
+	JTEST( offset == script.GetLength() );
+	JTEST( script.GetText(0).IsEmpty() );
+
+	// offsets saved in a snapshot
+
+	JTEST( script.IsValidOffset(0) );
+	JTEST( script.IsValidOffset(script.GetLength()) );
+	JTEST( script.IsValidOffset(10 * script.GetLength()) );
+	JTEST( !script.IsValidOffset(-5) );
+	JTEST( !script.IsValidOffset(3) );
+
+	// the style follows the directives
+
+	JMatrixScript::Style style;
+	JTEST( style.nDelay == 0 );
+	JTEST( style.nAlign == JMatrixScript::kAlignCenter );
+	JTEST( style.nPhaseCount == JMatrixScript::kDefaultValue );
+
+	style.Apply(JMatrixScript::kDelayOp, 250);
+	style.Apply(JMatrixScript::kAlignOp, JMatrixScript::kAlignRight);
+	style.Apply(JMatrixScript::kColorOp, (int) RGB(1,2,3));
+	style.Apply(JMatrixScript::kPhaseCountOp, 7);
+	style.Apply(JMatrixScript::kCursorOp, JMatrixScript::kNoCursor);
+	style.Apply(JMatrixScript::kRevealOp, JMatrixScript::kRainReveal);
+	style.Apply(JMatrixScript::kLineOp, 99);
+
+	JTEST( style.nDelay == 250 );
+	JTEST( style.nAlign == JMatrixScript::kAlignRight );
+	JTEST( style.color == RGB(1,2,3) );
+	JTEST( style.nPhaseCount == 7 );
+	JTEST( style.nCursor == JMatrixScript::kNoCursor );
+	JTEST( style.nReveal == JMatrixScript::kRainReveal );
+
+	// the buffer grows without losing anything
+
+	script.RemoveAll();
+	for (int i=0; i<1000; i++)
+		{
+		CString s;
+		s.Format("line %d", i);
+		script.AddLine(s);
+		}
+
+	offset = 0;
+	for (int j=0; j<1000; j++)
+		{
+		offset = ReadNext(script, offset, JMatrixScript::kLineOp, j);
+		}
+	JTEST( offset == script.GetLength() );
+	JTEST( script.GetText(999) == "line 999" );
+}
+
+/*******************************************************************************
+ BenchmarkScript
+
+	Compiles a script like the end credits of a film:  mostly text, a
+	directive every few lines, and a page break every 20 lines.
+
+ *******************************************************************************/
+
+void
+BenchmarkScript()
+{
+	CStringArray lineList;
+	lineList.SetSize(kBenchmarkLineCount);
+	for (int i=0; i<kBenchmarkLineCount; i++)
+		{
+		CString& s = lineList[i];
+		if (i % 20 == 19)
+			{
+			s = "\x01 3";
+			}
+		else if (i % 5 == 0)
+			{
+			s.Format("\x02 delay=%d align=%s color=%06X phase=%d", i % 700,
+					 (i % 3 == 0 ? "left" : i % 3 == 1 ? "center" : "right"),
+					 i * 2654435761u & 0xFFFFFF, i % 12);
+			}
+		else
+			{
+			s.Format("Line %6d ................................ Somebody Or Other", i);
+			}
+		}
+
+	JMatrixScript script;
+
+	const LONGLONG start = JTestGetMicroseconds();
+	for (int j=0; j<kBenchmarkLineCount; j++)
+		{
+		script.AddLine(lineList[j]);
+		}
+	const LONGLONG compileTime = JTestGetMicroseconds() - start;
+
+	int opcode, value, count = 0;
+	for (int offset=0; offset<script.GetLength(); offset=script.Read(offset, &opcode, &value))
+		{
+		count++;
+		}
+	const LONGLONG readTime = JTestGetMicroseconds() - start - compileTime;
+
+	JTEST( count > kBenchmarkLineCount );
+
+	JTestReport("compile 100k lines", compileTime / 1000.0, "ms");
+	JTestReport("compiled size", script.GetLength() / 1024.0, "KB");
+	JTestAtLeast("compile rate", kBenchmarkLineCount * 1e6 / max(compileTime, (LONGLONG) 1),
+				 100000, "lines/sec");
+	JTestAtLeast("read rate", count * 1e6 / max(readTime, (LONGLONG) 1),
+				 10000000, "instructions/sec");
+}
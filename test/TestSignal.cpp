@@ -0,0 +1,378 @@
+/*******************************************************************************
+ TestSignal.cpp
+
+	JSignalAnalyzer against known signals, both directly and by playing
+	WAV files written to the temporary directory.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JTest.h"
+#include "JSignalAnalyzer.h"
+#include <math.h>
+
+const double kPi           = 3.14159265358979323846;
+const double kHalfScale    = 16384.0;	// -6 dB peak, so -9 dB RMS for a sine
+const int kHalfScaleLevel  = 849;		// (60 - 9.03) / 60 * kMaxLevel
+const int kLevelTolerance  = 40;
+const int kQuietLevel      = 300;
+const DWORD kMaxLevelWait  = 2000;		// milliseconds
+
+struct WaveInfo
+{
+	int		nFormat;		// 1 => PCM, 3 => float, 0xFFFE => extensible
+	int		nChannels;
+	int		nRate;
+	int		nBits;
+	int		nFrameCount;
+	double	frequency;		// Hz; 0 => silence
+	BOOL	bOddChunk;		// odd length chunk before the data
+	int		nClaimedBytes;	// size in the data chunk header; 0 => actual size
+	int		nCutBytes;		// bytes missing from the end of the file
+};
+
+/*******************************************************************************
+ AppendInt (static)
+
+ *******************************************************************************/
+
+static void
+AppendInt
+	(
+	CByteArray&	data,
+	const int	value,
+	const int	byteCount
+	)
+{
+	for (int i=0; i<byteCount; i++)
+		{
+		data.Add((BYTE) (value >> (8*i)));
+		}
+}
+
+/*******************************************************************************
+ AppendTag (static)
+
+ *******************************************************************************/
+
+static void
+AppendTag
+	(
+	CByteArray&	data,
+	LPCSTR		tag
+	)
+{
+	for (int i=0; i<4; i++)
+		{
+		data.Add((BYTE) tag[i]);
+		}
+}
+
+/*******************************************************************************
+ WriteWaveFile (static)
+
+	Writes a sine wave with the same samples on every channel and returns
+	the full path of the file.
+
+ *******************************************************************************/
+
+static CString
+WriteWaveFile
+	(
+	LPCTSTR			name,
+	const WaveInfo&	info
+	)
+{
+	const int sampleBytes = info.nBits / 8;
+	const int dataBytes   = info.nFrameCount * info.nChannels * sampleBytes;
+
+	CByteArray data;
+	AppendTag(data, "RIFF");
+	AppendInt(data, 0, 4);			// filled in below
+	AppendTag(data, "WAVE");
+
+	AppendTag(data, "fmt ");
+	AppendInt(data, info.nFormat == 0xFFFE ? 40 : 16, 4);
+	AppendInt(data, info.nFormat, 2);
+	AppendInt(data, info.nChannels, 2);
+	AppendInt(data, info.nRate, 4);
+	AppendInt(data, info.nRate * info.nChannels * sampleBytes, 4);
+	AppendInt(data, info.nChannels * sampleBytes, 2);
+	AppendInt(data, info.nBits, 2);
+	if (info.nFormat == 0xFFFE)
+		{
+		AppendInt(data, 22, 2);
+		AppendInt(data, info.nBits, 2);
+		AppendInt(data, 0, 4);			// channel mask
+		AppendInt(data, 1, 4);			// KSDATAFORMAT_SUBTYPE_PCM
+		AppendInt(data, 0x00100000, 4);
+		AppendInt(data, 0xAA000080, 4);
+		AppendInt(data, 0x719B3800, 4);
+		}
+
+	if (info.bOddChunk)
+		{
+		AppendTag(data, "LIST");
+		AppendInt(data, 5, 4);
+		AppendTag(data, "INFO");
+		data.Add('x');
+		data.Add(0);					// padding
+		}
+
+	AppendTag(data, "data");
+	AppendInt(data, info.nClaimedBytes > 0 ? info.nClaimedBytes : dataBytes, 4);
+
+	for (int i=0; i<info.nFrameCount; i++)
+		{
+		const double v = kHalfScale * sin(2.0 * kPi * info.frequency * i / info.nRate);
+		for (int c=0; c<info.nChannels; c++)
+			{
+			if (info.nBits == 8)
+				{
+				data.Add((BYTE) (128 + (int) floor(v / 256.0 + 0.5)));
+				}
+			else
+				{
+				AppendInt(data, (int) floor(v + 0.5), sampleBytes);
+				}
+			}
+		}
+
+	const int riffBytes = data.GetSize() - 8;
+	for (int j=0; j<4; j++)
+		{
+		data[4+j] = (BYTE) (riffBytes >> (8*j));
+		}
+
+	TCHAR dir[ MAX_PATH ];
+	GetTempPath(MAX_PATH, dir);
+	const CString path = CString(dir) + name;
+
+	CFile file;
+	if (JTEST( file.Open(path, CFile::modeCreate | CFile::modeWrite | CFile::typeBinary) ))
+		{
+		file.Write(data.GetData(), data.GetSize() - info.nCutBytes);
+		file.Close();
+		}
+
+	return path;
+}
+
+/*******************************************************************************
+ WaitForLevels (static)
+
+	Returns FALSE if the thread did not analyze the file in time.
+
+ *******************************************************************************/
+
+static BOOL
+WaitForLevels
+	(
+	const JSignalAnalyzer&	analyzer,
+	int*					level,
+	int*					bass,
+	int*					treble
+	)
+{
+	const int neutral = JSignalAnalyzer::kNeutralLevel;
+
+	const DWORD start = GetTickCount();
+	do
+		{
+		analyzer.GetLevels(level, bass, treble);
+		if (*level != neutral || *bass != neutral || *treble != neutral)
+			{
+			return TRUE;
+			}
+		Sleep(10);
+		}
+		while (GetTickCount() - start < kMaxLevelWait);
+
+	return FALSE;
+}
+
+/*******************************************************************************
+ IsNear (static)
+
+ *******************************************************************************/
+
+static BOOL
+IsNear
+	(
+	const int value,
+	const int expected
+	)
+{
+	return (abs(value - expected) <= kLevelTolerance);
+}
+
+/*******************************************************************************
+ TestSignal
+
+ *******************************************************************************/
+
+void
+TestSignal()
+{
+	JSignalAnalyzer analyzer;
+	JTEST( !analyzer.IsActive() );
+
+	int level, bass, treble;
+	analyzer.GetLevels(&level, &bass, &treble);
+	JTEST( level == JSignalAnalyzer::kNeutralLevel );
+	JTEST( bass == JSignalAnalyzer::kNeutralLevel );
+	JTEST( treble == JSignalAnalyzer::kNeutralLevel );
+
+	// the analysis itself, at the default rate of 44.1 kHz
+
+	short samples[ JSignalAnalyzer::kWindowSize ];
+	for (int i=0; i<JSignalAnalyzer::kWindowSize; i++)
+		{
+		samples[i] = (short) floor(kHalfScale * sin(2.0 * kPi * 100.0 * i / 44100) + 0.5);
+		}
+	analyzer.Analyze(samples, &level, &bass, &treble);
+	JTEST( IsNear(level, kHalfScaleLevel) );
+	JTEST( IsNear(bass, kHalfScaleLevel) );
+	JTEST( treble < kQuietLevel );
+
+	for (int j=0; j<JSignalAnalyzer::kWindowSize; j++)
+		{
+		samples[j] = (short) floor(kHalfScale * sin(2.0 * kPi * 5000.0 * j / 44100) + 0.5);
+		}
+	analyzer.Analyze(samples, &level, &bass, &treble);
+	JTEST( IsNear(level, kHalfScaleLevel) );
+	JTEST( bass < kQuietLevel );
+	JTEST( IsNear(treble, kHalfScaleLevel) );
+
+	memset(samples, 0, sizeof(samples));
+	analyzer.Analyze(samples, &level, &bass, &treble);
+	JTEST( level == 0 && bass == 0 && treble == 0 );
+
+	// metrics are clamped, and Stop() returns to neutral
+
+	analyzer.PushMetric(300);
+	JTEST( analyzer.IsActive() );
+	analyzer.GetLevels(&level, &bass, &treble);
+	JTEST( level == 300 && bass == 300 && treble == 300 );
+
+	analyzer.PushMetric(5000);
+	analyzer.GetLevels(&level, &bass, &treble);
+	JTEST( level == JSignalAnalyzer::kMaxLevel && treble == JSignalAnalyzer::kMaxLevel );
+
+	analyzer.Stop();
+	JTEST( !analyzer.IsActive() );
+	analyzer.GetLevels(&level, &bass, &treble);
+	JTEST( level == JSignalAnalyzer::kNeutralLevel );
+
+	// 16 bit stereo with an odd length chunk before the data
+
+	WaveInfo info;
+	memset(&info, 0, sizeof(info));
+	info.nFormat     = 1;
+	info.nChannels   = 2;
+	info.nRate       = 44100;
+	info.nBits       = 16;
+	info.nFrameCount = 44100;
+	info.frequency   = 100;
+	info.bOddChunk   = TRUE;
+
+	CStringArray fileList;
+	fileList.Add(WriteWaveFile("jmatrix-bass.wav", info));
+	JTEST( analyzer.PlayFile(fileList[0]) );
+	JTEST( WaitForLevels(analyzer, &level, &bass, &treble) );
+	JTEST( IsNear(level, kHalfScaleLevel) );
+	JTEST( IsNear(bass, kHalfScaleLevel) );
+	JTEST( treble < kQuietLevel );
+
+	// metrics are ignored while the file plays
+
+	analyzer.PushMetric(0);
+	JTEST( WaitForLevels(analyzer, &level, &bass, &treble) );
+	JTEST( IsNear(bass, kHalfScaleLevel) );
+	analyzer.Stop();
+
+	// extensible format
+
+	info.nFormat   = 0xFFFE;
+	info.frequency = 5000;
+	info.bOddChunk = FALSE;
+	fileList.Add(WriteWaveFile("jmatrix-treble.wav", info));
+	JTEST( analyzer.PlayFile(fileList[1]) );
+	JTEST( WaitForLevels(analyzer, &level, &bass, &treble) );
+	JTEST( bass < kQuietLevel );
+	JTEST( IsNear(treble, kHalfScaleLevel) );
+
+	// 8 bit mono at 8 kHz:  1 kHz is between the bands only if the rate
+	// in the file is used
+
+	info.nFormat     = 1;
+	info.nChannels   = 1;
+	info.nRate       = 8000;
+	info.nBits       = 8;
+	info.nFrameCount = 8000;
+	info.frequency   = 1000;
+	fileList.Add(WriteWaveFile("jmatrix-8bit.wav", info));
+	JTEST( analyzer.PlayFile(fileList[2]) );
+	JTEST( WaitForLevels(analyzer, &level, &bass, &treble) );
+	JTEST( IsNear(level, kHalfScaleLevel) );
+	JTEST( bass < kQuietLevel );
+	JTEST( treble < kQuietLevel );
+
+	// silence
+
+	info.nBits       = 16;
+	info.nRate       = 44100;
+	info.nFrameCount = 4096;
+	info.frequency   = 0;
+	fileList.Add(WriteWaveFile("jmatrix-silence.wav", info));
+	JTEST( analyzer.PlayFile(fileList[3]) );
+	JTEST( WaitForLevels(analyzer, &level, &bass, &treble) );
+	JTEST( level == 0 && bass == 0 && treble == 0 );
+
+	// a data chunk that claims more than the file holds is cut short, and
+	// still plays if enough is left
+
+	info.frequency     = 100;
+	info.nFrameCount   = 2 * JSignalAnalyzer::kWindowSize;
+	info.nClaimedBytes = 1000000;
+	fileList.Add(WriteWaveFile("jmatrix-short-data.wav", info));
+	JTEST( analyzer.PlayFile(fileList[4]) );
+	JTEST( WaitForLevels(analyzer, &level, &bass, &treble) );
+	JTEST( IsNear(bass, kHalfScaleLevel) );
+
+	// rejected files leave the levels neutral
+
+	info.nFrameCount = JSignalAnalyzer::kWindowSize - 1;
+	fileList.Add(WriteWaveFile("jmatrix-too-short.wav", info));
+
+	info.nFrameCount   = 4096;
+	info.nClaimedBytes = 0;
+	info.nFormat       = 3;
+	info.nBits         = 32;
+	fileList.Add(WriteWaveFile("jmatrix-float.wav", info));
+
+	info.nFormat = 1;
+	info.nBits   = 24;
+	fileList.Add(WriteWaveFile("jmatrix-24bit.wav", info));
+
+	info.nBits     = 16;
+	info.nCutBytes = 4096 * 2 + 8 + 10;		// all samples, the data header, and part of fmt
+	fileList.Add(WriteWaveFile("jmatrix-truncated.wav", info));
+
+	for (int k=5; k<fileList.GetSize(); k++)
+		{
+		JTEST( !analyzer.PlayFile(fileList[k]) );
+		analyzer.GetLevels(&level, &bass, &treble);
+		JTEST( level == JSignalAnalyzer::kNeutralLevel );
+		}
+
+	JTEST( !analyzer.PlayFile("no such file.wav") );
+
+	analyzer.Stop();
+	JTEST( !analyzer.IsActive() );
+
+	for (int m=0; m<fileList.GetSize(); m++)
+		{
+		DeleteFile(fileList[m]);
+		}
+}
@@ -0,0 +1,441 @@
+/*******************************************************************************
+ TestSnapshot.cpp
+
+	A snapshot restored into a second control must make it draw exactly
+	the same frames as the control that saved it, and a damaged snapshot
+	must leave the control untouched.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JTest.h"
+#include "JMatrixCtrl.h"
+#include <stdio.h>
+
+const int kGridWidth       = 400;
+const int kGridHeight      = 300;
+const int kCompareCount    = 40;
+const int kCompareStep     = 50;		// milliseconds
+const int kCorruptionCount = 60;
+const int kHeaderBytes     = 16;		// magic, version, length, checksum
+
+const COLORREF kMarkerColor = RGB(0x5A, 0x3C, 0x1E);
+
+enum
+{
+	kDefaultConfig,
+	kGlowConfig,
+	kIndexedConfig,
+	kTickerConfig,
+
+	kConfigCount
+};
+
+static const char* kConfigName[] =
+{
+	"default", "glow", "indexed rain", "ticker"
+};
+
+/*******************************************************************************
+ CreateCtrl (static)
+
+	All the controls in a test must be created the same way, because the
+	snapshot does not include the configuration or the script.
+
+ *******************************************************************************/
+
+static BOOL
+CreateCtrl
+	(
+	JMatrixCtrl*	ctrl,
+	const int		configType,
+	const CSize&	size
+	)
+{
+	JMatrixCtrl::Config config = ctrl->GetConfig();
+	if (configType == kGlowConfig)
+		{
+		config.bGlow = TRUE;
+		}
+	else if (configType == kIndexedConfig)
+		{
+		config.bIndexedRain    = TRUE;
+		config.nRainLayerCount = 3;
+		}
+	else if (configType == kTickerConfig)
+		{
+		config.nTickerRate = 8;
+		}
+	ctrl->SetConfig(config);
+
+	ctrl->SetIntervals(200, 400);
+	ctrl->AddTextLine("\x02 reveal=random phase=4");
+	ctrl->AddTextLine("Wake up, Neo...");
+	ctrl->AddTextLine("The Matrix has you...");
+	ctrl->AddTextLine("\x01 300");
+	ctrl->AddTextLine("\x02 align=left reveal=rain cursor=block");
+	ctrl->AddTextLine("Follow the white rabbit.");
+	ctrl->AddTextLine("\x01");
+	ctrl->AddTextLine("\x02 reveal=center color=FFC040");
+	ctrl->AddTextLine("Knock, knock, Neo.");
+
+	return JTestCreateCtrl(ctrl, size, 46);
+}
+
+/*******************************************************************************
+ Draw (static)
+
+ *******************************************************************************/
+
+static void
+Draw
+	(
+	JMatrixCtrl&	ctrl,
+	JTestImage&		image
+	)
+{
+	ctrl.DrawViewport(image.GetDC(), CRect(0, 0, image.GetWidth(), image.GetHeight()));
+}
+
+/*******************************************************************************
+ CountDifferentFrames (static)
+
+	Steps both controls in lockstep and returns the number of frames that
+	differ.
+
+ *******************************************************************************/
+
+static int
+CountDifferentFrames
+	(
+	JMatrixCtrl&	ctrl1,
+	JMatrixCtrl&	ctrl2,
+	const int		frameCount
+	)
+{
+	JTestImage image1(kGridWidth, kGridHeight), image2(kGridWidth, kGridHeight);
+
+	int count = 0;
+	for (int i=0; i<frameCount; i++)
+		{
+		ctrl1.Step(kCompareStep);
+		ctrl2.Step(kCompareStep);
+
+		Draw(ctrl1, image1);
+		Draw(ctrl2, image2);
+		if (!image1.Equals(image2))
+			{
+			count++;
+			}
+		}
+
+	return count;
+}
+
+/*******************************************************************************
+ GetChecksum (static)
+
+	Adler-32, as in JMatrixSnapshot.cpp, so damaged snapshots can be given a
+	valid header.
+
+ *******************************************************************************/
+
+static DWORD
+GetChecksum
+	(
+	const BYTE*	data,
+	const int	length
+	)
+{
+	DWORD a = 1, b = 0;
+	for (int i=0; i<length; i++)
+		{
+		a = (a + data[i]) % 65521;
+		b = (b + a) % 65521;
+		}
+	return ((b << 16) | a);
+}
+
+/*******************************************************************************
+ FixHeader (static)
+
+ *******************************************************************************/
+
+static void
+FixHeader
+	(
+	CByteArray& data
+	)
+{
+	DWORD* header = (DWORD*) data.GetData();
+	header[2]     = data.GetSize() - kHeaderBytes;
+	header[3]     = GetChecksum(data.GetData() + kHeaderBytes, data.GetSize() - kHeaderBytes);
+}
+
+/*******************************************************************************
+ Restore (static)
+
+ *******************************************************************************/
+
+inline BOOL
+Restore
+	(
+	JMatrixCtrl&		ctrl,
+	const CByteArray&	data
+	)
+{
+	return ctrl.RestoreSnapshot(data.GetData(), data.GetSize());
+}
+
+/*******************************************************************************
+ GetInt (static)
+
+ *******************************************************************************/
+
+inline int
+GetInt
+	(
+	const CByteArray&	data,
+	const int			offset
+	)
+{
+	int value;
+	memcpy(&value, data.GetData() + offset, sizeof(int));
+	return value;
+}
+
+/*******************************************************************************
+ RestoreChanged (static)
+
+	Restores a copy of data with the int at offset replaced by value and
+	a valid header.
+
+ *******************************************************************************/
+
+static BOOL
+RestoreChanged
+	(
+	JMatrixCtrl&		ctrl,
+	const CByteArray&	data,
+	const int			offset,
+	const int			value
+	)
+{
+	CByteArray bad;
+	bad.Copy(data);
+	memcpy(bad.GetData() + offset, &value, sizeof(int));
+	FixHeader(bad);
+	return Restore(ctrl, bad);
+}
+
+/*******************************************************************************
+ TestRanges (static)
+
+	Every style and ticker line in the script has kMarkerColor, so they
+	can be found in the snapshot.  A style is delay, align, color, phase
+	count, cursor, reveal.  A ticker line is length, align, phase count,
+	color.  Each field that is out of range must be rejected.
+
+ *******************************************************************************/
+
+static void
+TestRanges
+	(
+	const BOOL ticker
+	)
+{
+	JMatrixCtrl ctrl;
+
+	JMatrixCtrl::Config config = ctrl.GetConfig();
+	config.nTickerRate         = (ticker ? 8 : 0);
+	ctrl.SetConfig(config);
+
+	ctrl.SetIntervals(0, 0);
+	ctrl.AddTextLine("\x02 align=right phase=4 color=5A3C1E");
+	ctrl.AddTextLine("Wake up, Neo...");
+	ctrl.AddTextLine("The Matrix has you...");
+
+	if (!JTestCreateCtrl(&ctrl, CSize(kGridWidth, kGridHeight), 46))
+		{
+		return;
+		}
+
+	ctrl.Step(1000);
+
+	CByteArray data;
+	ctrl.SaveSnapshot(&data);
+
+	int styleCount = 0, lineCount = 0;
+	for (int i=kHeaderBytes + 12; i + 16 <= data.GetSize(); i++)
+		{
+		if (GetInt(data, i) != (int) kMarkerColor)
+			{
+			continue;
+			}
+
+		if (GetInt(data, i-4) == 4)		// only ticker lines have the phase count there
+			{
+			lineCount++;
+			JTEST( !RestoreChanged(ctrl, data, i-8, 3) );
+			JTEST( !RestoreChanged(ctrl, data, i-4, -1) );
+			}
+		else
+			{
+			styleCount++;
+			JTEST( GetInt(data, i-4) == JMatrixScript::kAlignRight );
+			JTEST( !RestoreChanged(ctrl, data, i-8, -1) );
+			JTEST( !RestoreChanged(ctrl, data, i-4, 3) );
+			JTEST( !RestoreChanged(ctrl, data, i+4, -2) );
+			JTEST( !RestoreChanged(ctrl, data, i+8, 3) );
+			JTEST( !RestoreChanged(ctrl, data, i+12, 4) );
+			}
+		}
+
+	JTEST( styleCount > 0 );
+	JTEST( lineCount > 0 || !ticker );
+	JTEST( Restore(ctrl, data) );
+
+	ctrl.DestroyWindow();
+}
+
+/*******************************************************************************
+ TestRoundTrip (static)
+
+ *******************************************************************************/
+
+static void
+TestRoundTrip
+	(
+	const int configType
+	)
+{
+	const CSize size(kGridWidth, kGridHeight);
+
+	JMatrixCtrl source, target, twin;
+	if (!CreateCtrl(&source, configType, size) ||
+		!CreateCtrl(&target, configType, size) ||
+		!CreateCtrl(&twin, configType, size))
+		{
+		return;
+		}
+
+	source.Step(2500);
+	target.Step(700);
+
+	CByteArray data;
+	source.SaveSnapshot(&data);
+	JTEST( data.GetSize() > kHeaderBytes );
+	JTEST( Restore(target, data) );
+
+	// the restored control continues exactly like the original, from the
+	// next frame on
+
+	const int different = CountDifferentFrames(source, target, kCompareCount);
+	if (!JTEST( different == 0 ))
+		{
+		printf("  %s: %d of %d frames differ\n", kConfigName[ configType ], different, kCompareCount);
+		}
+
+	JTestImage image(kGridWidth, kGridHeight);
+	Draw(target, image);
+	JTEST( !image.IsBlack() );
+
+	// damaged snapshots are rejected without touching the control, or
+	// accepted if the damage happens to be harmless
+
+	source.SaveSnapshot(&data);
+	JTEST( Restore(target, data) );
+	JTEST( Restore(twin, data) );
+
+	JTestRandom rnd(4600 + configType);
+
+	int rejected = 0, changed = 0;
+	for (int i=0; i<kCorruptionCount; i++)
+		{
+		CByteArray bad;
+		bad.Copy(data);
+
+		const int kind = i % 4;
+		if (kind == 0)						// checksum does not match
+			{
+			bad[ rnd.Range(kHeaderBytes, bad.GetSize()-1) ] ^= 0x10;
+			}
+		else if (kind == 1)					// truncated
+			{
+			bad.SetSize(rnd.Range(kHeaderBytes, bad.GetSize()-1));
+			FixHeader(bad);
+			}
+		else								// bytes changed, valid header
+			{
+			const int count = (kind == 2 ? 1 : rnd.Range(2, 20));
+			for (int j=0; j<count; j++)
+				{
+				bad[ rnd.Range(kHeaderBytes, bad.GetSize()-1) ] = (BYTE) rnd.Next();
+				}
+			FixHeader(bad);
+			}
+
+		if (Restore(target, bad))
+			{
+			JTEST( kind >= 2 );
+			JTEST( Restore(target, data) && Restore(twin, data) );
+			}
+		else
+			{
+			rejected++;
+			if (CountDifferentFrames(target, twin, 2) > 0)
+				{
+				changed++;
+				JTEST( Restore(target, data) && Restore(twin, data) );
+				}
+			}
+		}
+
+	JTEST( rejected >= kCorruptionCount / 2 );
+	JTEST( changed == 0 );
+
+	// header and geometry
+
+	CByteArray bad;
+	bad.Copy(data);
+	bad[0] ^= 1;
+	JTEST( !Restore(target, bad) );
+
+	bad.Copy(data);
+	bad[4]++;
+	JTEST( !Restore(target, bad) );
+
+	JTEST( !target.RestoreSnapshot(data.GetData(), kHeaderBytes - 1) );
+
+	JMatrixCtrl other;
+	if (CreateCtrl(&other, configType, CSize(kGridWidth + 40, kGridHeight)))
+		{
+		JTEST( !Restore(other, data) );
+		other.SaveSnapshot(&bad);
+		JTEST( !Restore(target, bad) );
+		other.DestroyWindow();
+		}
+
+	JTEST( CountDifferentFrames(target, twin, 4) == 0 );
+
+	source.DestroyWindow();
+	target.DestroyWindow();
+	twin.DestroyWindow();
+}
+
+/*******************************************************************************
+ TestSnapshot
+
+ *******************************************************************************/
+
+void
+TestSnapshot()
+{
+	for (int i=0; i<kConfigCount; i++)
+		{
+		TestRoundTrip(i);
+		}
+
+	TestRanges(FALSE);
+	TestRanges(TRUE);
+}
@@ -0,0 +1,248 @@
+/*******************************************************************************
+ TestTicker.cpp
+
+	The ticker must read lines at exactly nTickerRate, however high,
+	without allocating memory, and its cost must not grow with the rate.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JTest.h"
+#include "JMatrixCtrl.h"
+
+const int kGridWidth       = 640;
+const int kGridHeight      = 360;
+const int kTestRate        = 40;		// lines per second
+const int kScriptLines     = 1000;
+const int kBenchmarkWidth  = 1920;
+const int kBenchmarkHeight = 1080;
+const int kBenchmarkTime   = 2000;		// milliseconds
+const int kBenchmarkRuns   = 3;			// the cheapest one counts
+const int kStepSize        = 100;		// milliseconds
+
+static const int kBenchmarkRate[] =
+{
+	100, 300, 1000
+};
+
+const int kBenchmarkRateCount = sizeof(kBenchmarkRate) / sizeof(int);
+
+/*******************************************************************************
+ CreateTicker (static)
+
+	Every line is different, and the script also contains page breaks and
+	directives, which the ticker must skip.
+
+ *******************************************************************************/
+
+static BOOL
+CreateTicker
+	(
+	JMatrixCtrl*	ctrl,
+	const int		rate,
+	const CSize&	size
+	)
+{
+	JMatrixCtrl::Config config = ctrl->GetConfig();
+	config.nTickerRate         = rate;
+	ctrl->SetConfig(config);
+
+	ctrl->SetIntervals(0, 0);
+	for (int i=0; i<kScriptLines; i++)
+		{
+		CString line;
+		line.Format("%05d  LIVE  %s", i, (i % 3 == 0 ? "follow the white rabbit" : "knock, knock"));
+		ctrl->AddTextLine(line);
+
+		if (i % 10 == 9)
+			{
+			ctrl->AddTextLine("\x01 5");
+			ctrl->AddTextLine(i % 20 == 19 ? "\x02 align=right color=FFC040" : "\x02 align=left");
+			}
+		}
+
+	return JTestCreateCtrl(ctrl, size, 47);
+}
+
+/*******************************************************************************
+ TestTicker
+
+ *******************************************************************************/
+
+void
+TestTicker()
+{
+	JMatrixCtrl ctrl;
+	if (!CreateTicker(&ctrl, kTestRate, CSize(kGridWidth, kGridHeight)))
+		{
+		return;
+		}
+
+	ctrl.Step(100);		// the first line starts after the intro
+	const int bufferBytes = ctrl.GetStats().nBufferBytes;
+	const int start       = ctrl.GetStats().nTickerLines;
+	JTEST( start > 0 );
+
+	ctrl.Step(2000);
+
+	const int count = ctrl.GetStats().nTickerLines - start;
+	JTEST( 2 * kTestRate - 1 <= count && count <= 2 * kTestRate + 1 );
+
+	JTestImage image(kGridWidth, kGridHeight);
+	ctrl.DrawViewport(image.GetDC(), CRect(0, 0, kGridWidth, kGridHeight));
+	JTEST( !image.IsBlack() );
+
+	// a new font keeps the stream going
+
+	LOGFONT font;
+	memset(&font, 0, sizeof(LOGFONT));
+	font.lfHeight         = 18;
+	font.lfWeight         = FW_BOLD;
+	font.lfPitchAndFamily = FIXED_PITCH | FF_MODERN;
+	strcpy(font.lfFaceName, "Courier New");
+	ctrl.SetTextFont(font);
+
+	const int before = ctrl.GetStats().nTickerLines;
+	ctrl.Step(1000);
+	const int after = ctrl.GetStats().nTickerLines;
+	JTEST( before >= start + count );
+	JTEST( kTestRate - 1 <= after - before && after - before <= kTestRate + 1 );
+
+	// the lines do not need any more memory
+
+	const int fontBytes = ctrl.GetStats().nBufferBytes;
+	ctrl.Step(1000);
+	JTEST( ctrl.GetStats().nBufferBytes == fontBytes );
+	JTEST( bufferBytes > 0 );
+
+	ctrl.DestroyWindow();
+
+	// a script without any lines
+
+	JMatrixCtrl empty;
+	JMatrixCtrl::Config config = empty.GetConfig();
+	config.nTickerRate         = 1000;
+	empty.SetConfig(config);
+	empty.AddTextLine("\x01");
+	empty.AddTextLine("\x02 align=left");
+	if (JTestCreateCtrl(&empty, CSize(kGridWidth, kGridHeight), 47))
+		{
+		empty.Step(500);
+		JTEST( empty.GetStats().nTickerLines == 0 );
+		empty.DestroyWindow();
+		}
+
+	// a script that is cleared while the ticker is running
+
+	JMatrixCtrl cleared;
+	if (CreateTicker(&cleared, 1000, CSize(kGridWidth, kGridHeight)))
+		{
+		cleared.Step(500);
+		cleared.ClearText();
+		cleared.Step(500);
+
+		const int lines = cleared.GetStats().nTickerLines;
+		cleared.Step(500);
+		JTEST( cleared.GetStats().nTickerLines == lines );
+		cleared.DestroyWindow();
+		}
+}
+
+/*******************************************************************************
+ TimeTicker (static)
+
+	Returns the microseconds of CPU per second of animation.  The rain is
+	turned off, so the cost is only the text and the frames.  *lines and
+	*frames receive the lines read and the frames drawn per second.
+
+ *******************************************************************************/
+
+static double
+TimeTicker
+	(
+	const int	rate,
+	double*		lines,
+	double*		frames
+	)
+{
+	*lines = *frames = 0;
+
+	JMatrixCtrl ctrl;
+
+	JMatrixCtrl::Config config = ctrl.GetConfig();
+	config.fSpinCharFraction   = 0;
+	for (int i=0; i<config.nRainLayerCount; i++)
+		{
+		config.rainLayer[i].nDensity = 0;
+		}
+	ctrl.SetConfig(config);
+
+	if (!CreateTicker(&ctrl, rate, CSize(kBenchmarkWidth, kBenchmarkHeight)))
+		{
+		return 0;
+		}
+	ctrl.Step(kStepSize);
+
+	const JMatrixCtrl::Stats start = ctrl.GetStats();
+	const LONGLONG begin           = JTestGetMicroseconds();
+	for (int t=0; t<kBenchmarkTime; t+=kStepSize)
+		{
+		ctrl.Step(kStepSize);
+		}
+	const LONGLONG usec = JTestGetMicroseconds() - begin;
+
+	const double seconds = kBenchmarkTime / 1000.0;
+	*lines  = (ctrl.GetStats().nTickerLines - start.nTickerLines) / seconds;
+	*frames = (ctrl.GetStats().nFrames - start.nFrames) / seconds;
+
+	ctrl.DestroyWindow();
+	return usec / seconds;
+}
+
+/*******************************************************************************
+ BenchmarkTicker
+
+	A full HD ticker must read every line on time at hundreds of lines per
+	second.  Scrolling changes the whole frame, so the ticker is only
+	drawn with the rain frames, and the cost must not depend on the rate.
+	The rates take turns several times, so anything else that runs on
+	the machine slows them down alike, and the cheapest run of each rate
+	counts.
+
+ *******************************************************************************/
+
+void
+BenchmarkTicker()
+{
+	const double maxFrames = 1000.0 / JMatrixCtrl::Config().nAnimateRainInterval + 1;
+
+	double lines[ kBenchmarkRateCount ], frames[ kBenchmarkRateCount ];
+	double cost[ kBenchmarkRateCount ];
+	for (int j=0; j<kBenchmarkRuns; j++)
+		{
+		for (int i=0; i<kBenchmarkRateCount; i++)
+			{
+			const double t = TimeTicker(kBenchmarkRate[i], lines + i, frames + i);
+			cost[i]        = (j == 0 ? t : min(cost[i], t));
+			}
+		}
+
+	for (int i=0; i<kBenchmarkRateCount; i++)
+		{
+		const int rate = kBenchmarkRate[i];
+
+		CString name;
+		name.Format("ticker at %d lines/sec: lines read", rate);
+		JTestAtLeast(name, lines[i], rate - 1, "lines/sec");
+		name.Format("ticker at %d lines/sec: frames", rate);
+		JTestAtMost(name, frames[i], maxFrames, "frames/sec");
+		name.Format("ticker at %d lines/sec", rate);
+		JTestReport(name, cost[i], "usec/sec");
+
+		if (i > 0)
+			{
+			name.Format("ticker at %d lines/sec vs %d", rate, kBenchmarkRate[0]);
+			JTestAtMost(name, cost[i] / cost[0], 1.5, "x");
+			}
+		}
+}
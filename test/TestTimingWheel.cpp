@@ -0,0 +1,429 @@
+/*******************************************************************************
+ TestTimingWheel.cpp
+
+	JTimingWheel against a model that simply remembers when each item is
+	due.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JTest.h"
+#include "JTimingWheel.h"
+
+const int kItemCount      = 300;
+const int kSlotCount      = 64;
+const int kRoundCount     = 20000;
+const int kSmallItemCount = 10;
+const int kSmallSlotCount = 8;
+
+struct WheelModel
+{
+	int		nClock;						// next time that PopDue() will scan
+	BYTE	scheduled[ kItemCount ];
+	int		due[ kItemCount ];
+};
+
+/*******************************************************************************
+ Elapsed (static)
+
+ *******************************************************************************/
+
+static int
+Elapsed
+	(
+	const int from,
+	const int to
+	)
+{
+	return (int) ((DWORD) to - (DWORD) from);
+}
+
+/*******************************************************************************
+ ScheduleBoth (static)
+
+	Schedules the item on both the wheel and the model.
+
+ *******************************************************************************/
+
+static void
+ScheduleBoth
+	(
+	JTimingWheel&	wheel,
+	WheelModel&		model,
+	const int		item,
+	const int		time
+	)
+{
+	wheel.Schedule(item, time);
+
+	model.scheduled[item] = 1;
+	model.due[item]       = (Elapsed(model.nClock, time) < 0 ? model.nClock : time);
+}
+
+/*******************************************************************************
+ PopAll (static)
+
+	Pops everything that is due and checks it against the model.  Some of
+	the items are scheduled again while popping, like the rain does.
+
+ *******************************************************************************/
+
+static void
+PopAll
+	(
+	JTimingWheel&	wheel,
+	WheelModel&		model,
+	const int		now,
+	JTestRandom&	rnd,
+	int*			popCount,
+	int*			errorCount
+	)
+{
+	int item;
+	while ((item = wheel.PopDue(now)) >= 0)
+		{
+		(*popCount)++;
+		if (item >= kItemCount || !model.scheduled[item] || Elapsed(model.due[item], now) < 0)
+			{
+			(*errorCount)++;
+			continue;
+			}
+
+		model.scheduled[item] = 0;
+		if (rnd.Chance(30))
+			{
+			ScheduleBoth(wheel, model, item, (int) ((DWORD) now + rnd.Range(1, 3 * kSlotCount)));
+			}
+		}
+
+	for (int i=0; i<kItemCount; i++)
+		{
+		if (model.scheduled[i] && Elapsed(model.due[i], now) >= 0)
+			{
+			(*errorCount)++;		// missed
+			model.scheduled[i] = 0;
+			}
+		}
+
+	if (Elapsed(model.nClock, now) >= 0)
+		{
+		model.nClock = (int) ((DWORD) now + 1);
+		}
+}
+
+/*******************************************************************************
+ SaveWheel (static)
+
+ *******************************************************************************/
+
+static void
+SaveWheel
+	(
+	const JTimingWheel&	wheel,
+	CByteArray*			data
+	)
+{
+	CMemFile file;
+	CArchive ar(&file, CArchive::store);
+	wheel.Write(ar);
+	ar.Close();
+
+	const int length = (int) file.GetLength();
+	BYTE* bytes      = file.Detach();
+	data->SetSize(length);
+	memcpy(data->GetData(), bytes, length);
+	free(bytes);		// CMemFile uses malloc()
+}
+
+/*******************************************************************************
+ LoadWheel (static)
+
+	Returns FALSE if Read() rejected the data.
+
+ *******************************************************************************/
+
+static BOOL
+LoadWheel
+	(
+	JTimingWheel&		wheel,
+	const CByteArray&	data
+	)
+{
+	CMemFile file((BYTE*) data.GetData(), data.GetSize());
+	CArchive ar(&file, CArchive::load);
+	try
+		{
+		wheel.Read(ar);
+		ar.Close();
+		}
+	catch (CException* e)
+		{
+		e->Delete();
+		ar.Abort();
+		return FALSE;
+		}
+
+	return TRUE;
+}
+
+/*******************************************************************************
+ BuildWheelData (static)
+
+	Writes data in the format of JTimingWheel::Write() for a wheel with
+	kSmallSlotCount slots.  Each entry is a list (-1 => pending, then the
+	fine and coarse slots), an item, and its due time.  count overrides
+	the number of items in the first list, unless it is -1.
+
+ *******************************************************************************/
+
+static void
+BuildWheelData
+	(
+	const int	time,
+	const int	entry[][3],
+	const int	entryCount,
+	const int	count,
+	CByteArray*	data
+	)
+{
+	CMemFile file;
+	CArchive ar(&file, CArchive::store);
+	ar << time;
+
+	for (int list=-1; list<2*kSmallSlotCount; list++)
+		{
+		int n = 0;
+		for (int i=0; i<entryCount; i++)
+			{
+			if (entry[i][0] == list)
+				{
+				n++;
+				}
+			}
+		ar << (list == -1 && count != -1 ? count : n);
+
+		for (int j=0; j<entryCount; j++)
+			{
+			if (entry[j][0] == list)
+				{
+				ar << entry[j][1] << entry[j][2];
+				}
+			}
+		}
+	ar.Close();
+
+	const int length = (int) file.GetLength();
+	BYTE* bytes      = file.Detach();
+	data->SetSize(length);
+	memcpy(data->GetData(), bytes, length);
+	free(bytes);
+}
+
+/*******************************************************************************
+ RunModel (static)
+
+	Random schedules, small steps, and jumps of many revolutions, starting
+	at the given time.  Returns the number of items that were popped.
+
+ *******************************************************************************/
+
+static int
+RunModel
+	(
+	const int	start,
+	const DWORD	seed
+	)
+{
+	JTestRandom rnd(seed);
+
+	JTimingWheel wheel;
+	wheel.SetSize(kItemCount, kSlotCount);
+	wheel.Reset(start);
+
+	WheelModel model;
+	model.nClock = start;
+	memset(model.scheduled, 0, sizeof(model.scheduled));
+
+	BYTE flags[ kItemCount ];
+
+	int now = start, popCount = 0, errorCount = 0, flagErrors = 0;
+	for (int round=0; round<kRoundCount; round++)
+		{
+		const int scheduleCount = rnd.Range(0, 4);
+		for (int i=0; i<scheduleCount; i++)
+			{
+			const int item = rnd.Range(0, kItemCount-1);
+			if (model.scheduled[item])
+				{
+				continue;
+				}
+
+			// past, within one revolution, within the coarse slots, or
+			// beyond them
+
+			const int delta =
+				(rnd.Chance(10) ? -rnd.Range(1, 20) :
+				 rnd.Chance(50) ? rnd.Range(0, kSlotCount) :
+				 rnd.Chance(80) ? rnd.Range(kSlotCount, kSlotCount * kSlotCount) :
+								  rnd.Range(kSlotCount * kSlotCount, 1 << 20));
+			ScheduleBoth(wheel, model, item, (int) ((DWORD) now + delta));
+			}
+
+		const int step =
+			(rnd.Chance(75) ? rnd.Range(0, 3) :
+			 rnd.Chance(80) ? rnd.Range(4, 2 * kSlotCount) :
+							  rnd.Range(2 * kSlotCount, 40 * kSlotCount));
+		now = (int) ((DWORD) now + step);
+
+		PopAll(wheel, model, now, rnd, &popCount, &errorCount);
+
+		if (round % 97 == 0)
+			{
+			wheel.GetScheduled(flags);
+			if (memcmp(flags, model.scheduled, kItemCount) != 0)
+				{
+				flagErrors++;
+				}
+			}
+		}
+
+	JTEST( errorCount == 0 );
+	JTEST( flagErrors == 0 );
+	return popCount;
+}
+
+/*******************************************************************************
+ TestTimingWheel
+
+ *******************************************************************************/
+
+void
+TestTimingWheel()
+{
+	// model, including time wrapping past 2^31 and 2^32
+
+	JTEST( RunModel(0, 461) > 1000 );
+	JTEST( RunModel(0x7FFFF000, 462) > 1000 );
+	JTEST( RunModel((int) 0xFFFFF000, 463) > 1000 );
+
+	// Read() reproduces exactly the same sequence
+
+	JTestRandom rnd(464);
+
+	JTimingWheel wheel;
+	wheel.SetSize(kItemCount, kSlotCount);
+	wheel.Reset(100);
+
+	for (int i=0; i<kItemCount; i+=2)
+		{
+		wheel.Schedule(i, 100 + rnd.Range(0, 10 * kSlotCount));
+		}
+	int n = 0;
+	while (wheel.PopDue(150) >= 0)		// leave some pending
+		{
+		if (++n == 3)
+			{
+			break;
+			}
+		}
+
+	CByteArray data;
+	SaveWheel(wheel, &data);
+
+	JTimingWheel copy;
+	copy.SetSize(kItemCount, kSlotCount);
+	JTEST( LoadWheel(copy, data) );
+
+	int mismatches = 0, popCount = 0;
+	for (int now=150; now<150 + 12 * kSlotCount; now+=rnd.Range(0, 5))
+		{
+		int item1, item2;
+		do
+			{
+			item1 = wheel.PopDue(now);
+			item2 = copy.PopDue(now);
+			if (item1 != item2)
+				{
+				mismatches++;
+				break;
+				}
+			if (item1 >= 0)
+				{
+				popCount++;
+				if (rnd.Chance(50))
+					{
+					const int t = now + rnd.Range(1, 3 * kSlotCount);
+					wheel.Schedule(item1, t);
+					copy.Schedule(item1, t);
+					}
+				}
+			}
+			while (item1 >= 0);
+		}
+
+	JTEST( mismatches == 0 );
+	JTEST( popCount > kItemCount / 2 );
+
+	// hand-built data
+
+	JTimingWheel small;
+	small.SetSize(kSmallItemCount, kSmallSlotCount);
+
+	const int valid[][3] = { { -1, 3, 0 }, { 2, 4, 2 }, { 2, 6, 2 }, { 8+1, 5, 9 } };
+	BuildWheelData(0, valid, 4, -1, &data);
+	JTEST( LoadWheel(small, data) );
+
+	BYTE flags[ kSmallItemCount ];
+	small.GetScheduled(flags);
+	JTEST( flags[3] && flags[4] && flags[5] && flags[6] );
+	JTEST( !flags[0] && !flags[7] );
+
+	JTEST( small.PopDue(0) == 3 );
+	JTEST( small.PopDue(0) == -1 );
+	JTEST( small.PopDue(2) == 6 );		// the last item in the slot comes out first
+	JTEST( small.PopDue(2) == 4 );
+	JTEST( small.PopDue(8) == -1 );
+	JTEST( small.PopDue(9) == 5 );
+
+	BuildWheelData(0, valid, 4, -1, &data);
+	JTEST( LoadWheel(small, data) );
+
+	CByteArray before;
+	SaveWheel(small, &before);
+
+	const int duplicate[][3]        = { { 2, 4, 2 }, { 3, 4, 3 } };
+	const int duplicatePending[][3] = { { -1, 3, 0 }, { -1, 3, 0 } };
+	const int wrongFine[][3]        = { { 2, 4, 3 } };
+	const int wrongCoarse[][3]      = { { 8+1, 5, 17 } };
+	const int itemTooLarge[][3]     = { { 2, kSmallItemCount, 2 } };
+	const int itemNegative[][3]     = { { 2, -1, 2 } };
+
+	CArray<CByteArray*, CByteArray*> badList;
+	for (int j=0; j<8; j++)
+		{
+		badList.Add(new CByteArray);
+		}
+
+	BuildWheelData(0, duplicate,        2, -1, badList[0]);
+	BuildWheelData(0, duplicatePending, 2, -1, badList[1]);
+	BuildWheelData(0, wrongFine,        1, -1, badList[2]);
+	BuildWheelData(0, wrongCoarse,      1, -1, badList[3]);
+	BuildWheelData(0, itemTooLarge,     1, -1, badList[4]);
+	BuildWheelData(0, itemNegative,     1, -1, badList[5]);
+	BuildWheelData(0, valid,            4, kSmallItemCount + 1, badList[6]);
+
+	BuildWheelData(0, valid, 4, -1, badList[7]);		// truncated
+	badList[7]->SetSize(badList[7]->GetSize() - 4);
+
+	for (int k=0; k<badList.GetSize(); k++)
+		{
+		JTEST( !LoadWheel(small, *(badList[k])) );
+
+		CByteArray after;
+		SaveWheel(small, &after);
+		JTEST( after.GetSize() == before.GetSize() &&
+			   memcmp(after.GetData(), before.GetData(), before.GetSize()) == 0 );
+
+		delete badList[k];
+		}
+}
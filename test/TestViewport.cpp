@@ -0,0 +1,180 @@
+/*******************************************************************************
+ TestViewport.cpp
+
+	One simulation spanning several monitors, displayed through slices of
+	the virtual grid.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JTest.h"
+#include "JMatrixCtrl.h"
+#include "JMatrixViewport.h"
+
+const int kMonitorCount = 3;
+const int kFrameCount   = 40;
+const int kFrameStep    = 25;		// milliseconds
+
+/*******************************************************************************
+ IsLit (static)
+
+	Returns TRUE if any pixel in the given columns and rows is not black.
+
+ *******************************************************************************/
+
+static BOOL
+IsLit
+	(
+	const JTestImage&	image,
+	const int			x1,
+	const int			x2,
+	const int			y1,
+	const int			y2
+	)
+{
+	for (int y=max(0, y1); y<min(y2, image.GetHeight()); y++)
+		{
+		for (int x=max(0, x1); x<min(x2, image.GetWidth()); x++)
+			{
+			if (image.GetPixel(x,y) != 0)
+				{
+				return TRUE;
+				}
+			}
+		}
+
+	return FALSE;
+}
+
+/*******************************************************************************
+ IsSlice (static)
+
+	Returns TRUE if slice shows exactly the given part of the whole grid.
+
+ *******************************************************************************/
+
+static BOOL
+IsSlice
+	(
+	const JTestImage&	slice,
+	const JTestImage&	whole,
+	const CRect&		source
+	)
+{
+	for (int y=0; y<slice.GetHeight(); y++)
+		{
+		for (int x=0; x<slice.GetWidth(); x++)
+			{
+			const int wx = source.left + x, wy = source.top + y;
+			const DWORD expected =
+				(0 <= wx && wx < whole.GetWidth() && 0 <= wy && wy < whole.GetHeight() ?
+				 whole.GetPixel(wx, wy) : 0);
+
+			if (slice.GetPixel(x,y) != expected)
+				{
+				return FALSE;
+				}
+			}
+		}
+
+	return TRUE;
+}
+
+/*******************************************************************************
+ TestViewport
+
+	Two monitors stacked vertically, plus a third to the right of the top
+	one.  Every slice must be an exact part of the single frame, and the
+	rain must run from the bottom of the top monitor, behind the bezel,
+	into the bottom monitor.
+
+ *******************************************************************************/
+
+void
+TestViewport()
+{
+	const CRect monitorList[ kMonitorCount ] =
+		{
+		CRect(0,   0,   320, 200),
+		CRect(0,   200, 320, 400),
+		CRect(320, 0,   640, 200)
+		};
+	const CSize bezel(24, 30);
+
+	// layout
+
+	const CSize size = JMatrixViewport::GetVirtualSize(monitorList, kMonitorCount, bezel);
+	JTEST( size == CSize(664, 430) );
+
+	CRect source[ kMonitorCount ];
+	for (int i=0; i<kMonitorCount; i++)
+		{
+		source[i] = JMatrixViewport::GetSourceRect(monitorList, kMonitorCount, i, bezel);
+		}
+
+	JTEST( source[0] == CRect(0,   0,   320, 200) );
+	JTEST( source[1] == CRect(0,   230, 320, 430) );
+	JTEST( source[2] == CRect(344, 0,   664, 200) );
+
+	// rendering
+
+	JMatrixCtrl ctrl;
+
+	JMatrixCtrl::Config config = ctrl.GetConfig();
+	for (int j=0; j<config.nRainLayerCount; j++)
+		{
+		config.rainLayer[j].nDensity = 100;
+		}
+	ctrl.SetConfig(config);
+
+	if (!JTestCreateCtrl(&ctrl, size, 35))
+		{
+		return;
+		}
+
+	ctrl.Step(2000);
+
+	JTestImage whole(size.cx, size.cy);
+	ctrl.DrawViewport(whole.GetDC(), CRect(CPoint(0,0), size));
+	JTEST( !whole.IsBlack() );
+
+	const int boundary = source[0].bottom;
+	const int x2       = source[0].right;
+
+	BOOL continuous = FALSE;
+	for (int k=0; k<kFrameCount; k++)
+		{
+		ctrl.Step(kFrameStep);
+		ctrl.DrawViewport(whole.GetDC(), CRect(CPoint(0,0), size));
+
+		for (int m=0; m<kMonitorCount; m++)
+			{
+			JTestImage slice(source[m].Width(), source[m].Height());
+			ctrl.DrawViewport(slice.GetDC(), source[m]);
+			JTEST( IsSlice(slice, whole, source[m]) );
+			}
+
+		// a trail lit just above the boundary, all the way behind the
+		// bezel, and just below it, so the column was not restarted
+
+		for (int x=0; x<x2 && !continuous; x+=4)
+			{
+			BOOL lit = IsLit(whole, x, x+4, boundary - 8, boundary);
+			for (int y=boundary; lit && y<boundary+bezel.cy+8; y+=8)
+				{
+				lit = IsLit(whole, x, x+4, y, y+8);
+				}
+			continuous = lit;
+			}
+		}
+
+	JTEST( continuous );
+
+	// parts of a slice outside the grid are black
+
+	JTestImage outside(200, 100);
+	ctrl.DrawViewport(outside.GetDC(), CRect(size.cx - 100, -50, size.cx + 100, 50));
+	JTEST( IsSlice(outside, whole, CRect(size.cx - 100, -50, size.cx + 100, 50)) );
+
+	ctrl.DestroyWindow();
+}
@@ -0,0 +1,148 @@
+/*******************************************************************************
+ matrixtest.cpp
+
+	Console tests and benchmarks for the parts of JMatrixCtrl that can be
+	checked without looking at the screen.
+
+		matrixtest				runs the tests
+		matrixtest -bench		also runs the benchmarks
+		matrixtest name ...		runs the tests and benchmarks whose names
+								start with one of the arguments
+
+	"-consumer name count" is used by the frame sharing test to start the
+	second process.
+
+	"-fuzz count seed" runs count rounds of the fuzz test, starting with
+	the given seed.  Failing rounds print their seed.
+
+	The exit code is the number of failures.
+
+ *******************************************************************************/
+
+#include "StdAfx.h"
+#include "JTest.h"
+#include <stdio.h>
+
+void	TestScript();
+void	BenchmarkScript();
+void	TestViewport();
+void	TestFont();
+void	TestCommandQueue();
+void	TestFrameShare();
+void	TestGlow();
+void	TestSignal();
+void	TestTimingWheel();
+void	TestSnapshot();
+void	TestTicker();
+int		RunFrameConsumer(LPCTSTR name, const int count);
+void	TestFuzz();
+int		RunFuzz(const int count, const DWORD seed);
+void	BenchmarkFont();
+void	BenchmarkCommandQueue();
+void	BenchmarkGlow();
+void	BenchmarkTicker();
+void	BenchmarkRain();
+void	BenchmarkFuzz();
+void	BenchmarkReveal();
+
+struct TestInfo
+{
+	LPCTSTR	name;
+	void	(*run)();
+	BOOL	bBenchmark;
+};
+
+static const TestInfo kTestList[] =
+{
+	{ "script",				TestScript,				FALSE },
+	{ "viewport",			TestViewport,			FALSE },
+	{ "font",				TestFont,				FALSE },
+	{ "queue",				TestCommandQueue,		FALSE },
+	{ "share",				TestFrameShare,			FALSE },
+	{ "glow",				TestGlow,				FALSE },
+	{ "signal",				TestSignal,				FALSE },
+	{ "wheel",				TestTimingWheel,		FALSE },
+	{ "snapshot",			TestSnapshot,			FALSE },
+	{ "ticker",				TestTicker,				FALSE },
+	{ "fuzz",				TestFuzz,				FALSE },
+	{ "bench-script",		BenchmarkScript,		TRUE  },
+	{ "bench-reveal",		BenchmarkReveal,		TRUE  },
+	{ "bench-font",			BenchmarkFont,			TRUE  },
+	{ "bench-queue",		BenchmarkCommandQueue,	TRUE  },
+	{ "bench-glow",			BenchmarkGlow,			TRUE  },
+	{ "bench-ticker",		BenchmarkTicker,		TRUE  },
+	{ "bench-rain",			BenchmarkRain,			TRUE  },
+	{ "bench-fuzz",			BenchmarkFuzz,			TRUE  }
+};
+
+const int kTestCount = sizeof(kTestList) / sizeof(TestInfo);
+
+/*******************************************************************************
+ main
+
+ *******************************************************************************/
+
+int
+main
+	(
+	int		argc,
+	char*	argv[]
+	)
+{
+	if (!AfxWinInit(::GetModuleHandle(NULL), NULL, ::GetCommandLine(), 0))
+		{
+		printf("unable to initialize MFC\n");
+		return 1;
+		}
+
+	if (argc == 4 && strcmp(argv[1], "-consumer") == 0)
+		{
+		return RunFrameConsumer(argv[2], atoi(argv[3]));
+		}
+
+	if (argc == 4 && strcmp(argv[1], "-fuzz") == 0)
+		{
+		const int failureCount = RunFuzz(atoi(argv[2]), strtoul(argv[3], NULL, 10));
+		printf(failureCount == 0 ? "all rounds passed\n" : "%d failures\n", failureCount);
+		return failureCount;
+		}
+
+	BOOL bench = FALSE;
+	CStringArray prefixList;
+	for (int i=1; i<argc; i++)
+		{
+		if (strcmp(argv[i], "-bench") == 0)
+			{
+			bench = TRUE;
+			}
+		else
+			{
+			prefixList.Add(argv[i]);
+			}
+		}
+
+	for (int j=0; j<kTestCount; j++)
+		{
+		const TestInfo& info = kTestList[j];
+
+		BOOL run = (prefixList.GetSize() == 0 && (bench || !info.bBenchmark));
+		for (int k=0; k<prefixList.GetSize(); k++)
+			{
+			if (strncmp(info.name, prefixList[k], prefixList[k].GetLength()) == 0)
+				{
+				run = TRUE;
+				}
+			}
+
+		if (run)
+			{
+			printf("%s\n", info.name);
+			fflush(stdout);
+			info.run();
+			}
+		}
+
+	const int failureCount = JTestGetFailureCount();
+	printf(failureCount == 0 ? "all tests passed\n" : "%d failures\n", failureCount);
+	return failureCount;
+}
@@ -0,0 +1,210 @@
+# Microsoft Developer Studio Project File - Name="matrixtest" - Package Owner=<4>
+# Microsoft Developer Studio Generated Build File, Format Version 6.00
+# ** DO NOT EDIT **
+
+# TARGTYPE "Win32 (x86) Console Application" 0x0103
+
+CFG=matrixtest - Win32 Debug
+!MESSAGE This is not a valid makefile. To build this project using NMAKE,
+!MESSAGE use the Export Makefile command and run
+!MESSAGE 
+!MESSAGE NMAKE /f "matrixtest.mak".
+!MESSAGE 
+!MESSAGE You can specify a configuration when running NMAKE
+!MESSAGE by defining the macro CFG on the command line. For example:
+!MESSAGE 
+!MESSAGE NMAKE /f "matrixtest.mak" CFG="matrixtest - Win32 Debug"
+!MESSAGE 
+!MESSAGE Possible choices for configuration are:
+!MESSAGE 
+!MESSAGE "matrixtest - Win32 Release" (based on "Win32 (x86) Console Application")
+!MESSAGE "matrixtest - Win32 Debug" (based on "Win32 (x86) Console Application")
+!MESSAGE 
+
+# Begin Project
+# PROP AllowPerConfigDependencies 0
+# PROP Scc_ProjName ""
+# PROP Scc_LocalPath ""
+CPP=cl.exe
+RSC=rc.exe
+
+!IF  "$(CFG)" == "matrixtest - Win32 Release"
+
+# PROP BASE Use_MFC 2
+# PROP BASE Use_Debug_Libraries 0
+# PROP BASE Output_Dir "Release"
+# PROP BASE Intermediate_Dir "Release"
+# PROP BASE Target_Dir ""
+# PROP Use_MFC 2
+# PROP Use_Debug_Libraries 0
+# PROP Output_Dir "Release"
+# PROP Intermediate_Dir "Release"
+# PROP Ignore_Export_Lib 0
+# PROP Target_Dir ""
+# ADD BASE CPP /nologo /MD /W3 /GX /O2 /D "WIN32" /D "NDEBUG" /D "_CONSOLE" /D "_AFXDLL" /FD /c
+# ADD CPP /nologo /MD /W3 /GX /O2 /I ".." /D "WIN32" /D "NDEBUG" /D "_CONSOLE" /D "_MBCS" /D "_AFXDLL" /FD /c
+# ADD BASE RSC /l 0x409 /d "NDEBUG" /d "_AFXDLL"
+# ADD RSC /l 0x409 /d "NDEBUG" /d "_AFXDLL"
+BSC32=bscmake.exe
+# ADD BASE BSC32 /nologo
+# ADD BSC32 /nologo
+LINK32=link.exe
+# ADD BASE LINK32 /nologo /subsystem:console /machine:I386
+# ADD LINK32 /nologo /subsystem:console /machine:I386
+
+!ELSEIF  "$(CFG)" == "matrixtest - Win32 Debug"
+
+# PROP BASE Use_MFC 2
+# PROP BASE Use_Debug_Libraries 1
+# PROP BASE Output_Dir "Debug"
+# PROP BASE Intermediate_Dir "Debug"
+# PROP BASE Target_Dir ""
+# PROP Use_MFC 2
+# PROP Use_Debug_Libraries 1
+# PROP Output_Dir "Debug"
+# PROP Intermediate_Dir "Debug"
+# PROP Ignore_Export_Lib 0
+# PROP Target_Dir ""
+# ADD BASE CPP /nologo /MDd /W3 /Gm /GX /ZI /Od /D "WIN32" /D "_DEBUG" /D "_CONSOLE" /D "_AFXDLL" /FD /GZ /c
+# ADD CPP /nologo /MDd /W3 /Gm /GX /ZI /Od /I ".." /D "WIN32" /D "_DEBUG" /D "_CONSOLE" /D "_MBCS" /D "_AFXDLL" /FD /GZ /c
+# ADD BASE RSC /l 0x409 /d "_DEBUG" /d "_AFXDLL"
+# ADD RSC /l 0x409 /d "_DEBUG" /d "_AFXDLL"
+BSC32=bscmake.exe
+# ADD BASE BSC32 /nologo
+# ADD BSC32 /nologo
+LINK32=link.exe
+# ADD BASE LINK32 /nologo /subsystem:console /debug /machine:I386 /pdbtype:sept
+# ADD LINK32 /nologo /subsystem:console /debug /machine:I386 /pdbtype:sept
+
+!ENDIF 
+
+# Begin Target
+
+# Name "matrixtest - Win32 Release"
+# Name "matrixtest - Win32 Debug"
+# Begin Group "Source Files"
+
+# PROP Default_Filter "cpp;c;cxx;rc;def;r;odl;idl;hpj;bat"
+# Begin Source File
+
+SOURCE=.\JGlowScalar.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\JTest.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\matrixtest.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\TestCommandQueue.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\TestFont.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\TestFrameShare.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\TestFuzz.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\TestGlow.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\TestRain.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\TestReveal.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\TestScript.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\TestSignal.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\TestSnapshot.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\TestTicker.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\TestTimingWheel.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\TestViewport.cpp
+# End Source File
+# End Group
+# Begin Group "JMatrixCtrl"
+
+# PROP Default_Filter ""
+# Begin Source File
+
+SOURCE=..\JCommandQueue.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\JFrameShare.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\JGlowFilter.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\JGlyphBatch.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\JMatrixCtrl.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\JMatrixScript.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\JMatrixSnapshot.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\JMatrixViewport.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\JSignalAnalyzer.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\JTimingWheel.cpp
+# End Source File
+# End Group
+# Begin Group "Header Files"
+
+# PROP Default_Filter "h;hpp;hxx;hm;inl"
+# Begin Source File
+
+SOURCE=.\JGlowScalar.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\JTest.h
+# End Source File
+# End Group
+# End Target
+# End Project